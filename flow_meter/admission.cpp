@@ -0,0 +1,360 @@
+/**
+ * \file admission.cpp
+ * \brief Admission policies deciding which new flows may evict flows from full lines of flow cache.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cstring>
+#include <iostream>
+
+#include "admission.h"
+
+using namespace std;
+
+/**
+ * \brief Compute hash of summary key (64-bit FNV-1a).
+ */
+static uint64_t summary_hash(const FlowRecord &key)
+{
+   uint64_t hash = 14695981039346656037ULL;
+   uint8_t data[2 + 16];
+   int len = 2;
+
+   data[0] = key.ipVersion;
+   data[1] = key.protocolIdentifier;
+   if (key.ipVersion == 4) {
+      memcpy(data + len, &key.destinationIPv4Address, 4);
+      len += 4;
+   } else {
+      memcpy(data + len, key.destinationIPv6Address, 16);
+      len += 16;
+   }
+   for (int i = 0; i < len; i++) {
+      hash ^= data[i];
+      hash *= 1099511628211ULL;
+   }
+   return hash;
+}
+
+/**
+ * \brief Check whether two summary keys are equal (source prefix is not part of the key).
+ */
+static bool summary_equal(const FlowRecord &a, const FlowRecord &b)
+{
+   if (a.ipVersion != b.ipVersion || a.protocolIdentifier != b.protocolIdentifier) {
+      return false;
+   }
+   if (a.ipVersion == 4) {
+      return a.destinationIPv4Address == b.destinationIPv4Address;
+   }
+   return !memcmp(a.destinationIPv6Address, b.destinationIPv6Address, 16);
+}
+
+/**
+ * \brief Create summary key: copy addressing of a flow and mask addresses to prefixes.
+ */
+static void summary_key(FlowRecord &key, uint8_t ip_version, uint8_t protocol, uint32_t src4, uint32_t dst4,
+   const char *src6, const char *dst6)
+{
+   key.ipVersion = ip_version;
+   key.protocolIdentifier = protocol;
+   key.sourceIPv4Address = 0;
+   key.destinationIPv4Address = 0;
+   memset(key.sourceIPv6Address, 0, 16);
+   memset(key.destinationIPv6Address, 0, 16);
+   if (ip_version == 4) {
+      uint32_t mask = 0xFFFFFFFF << (32 - SUMMARY_PREFIX_V4);
+      key.sourceIPv4Address = src4 & mask;
+      key.destinationIPv4Address = dst4 & mask;
+      key.flowFieldIndicator = FLW_FLOWFIELDINDICATOR | FLW_TIMESTAMPS_MASK | FLW_IPV4_MASK | FLW_IPSTAT_MASK;
+   } else {
+      memcpy(key.sourceIPv6Address, src6, SUMMARY_PREFIX_V6 / 8);
+      memcpy(key.destinationIPv6Address, dst6, SUMMARY_PREFIX_V6 / 8);
+      key.flowFieldIndicator = FLW_FLOWFIELDINDICATOR | FLW_TIMESTAMPS_MASK | FLW_IPV6_MASK | FLW_IPSTAT_MASK;
+   }
+   key.flowFieldIndicator |= FLW_PACKETTOTALCOUNT;
+}
+
+// PrefixAggregator ***********************************************************
+
+PrefixAggregator::PrefixAggregator(double inactivetimeout, double activetimeout) : aggregated(0), exported(0),
+   table(SUMMARY_TABLE_SIZE), exporter(NULL), inactive(inactivetimeout), active(activetimeout)
+{
+   for (unsigned int i = 0; i < table.size(); i++) {
+      table[i].packetTotalCount = 0;
+   }
+}
+
+PrefixAggregator::~PrefixAggregator()
+{
+}
+
+void PrefixAggregator::set_exporter(FlowExporter *exp)
+{
+   exporter = exp;
+}
+
+/**
+ * \brief Find summary record for key, the record is created (and colliding record exported) when missing.
+ * \param [in] key Summary key.
+ * \return Summary record.
+ */
+FlowRecord *PrefixAggregator::lookup(const FlowRecord &key)
+{
+   FlowRecord &rec = table[summary_hash(key) % table.size()];
+
+   if (rec.packetTotalCount != 0 && !summary_equal(rec, key)) {
+      export_summary(rec);
+   }
+   if (rec.packetTotalCount == 0) {
+      rec.flowFieldIndicator = key.flowFieldIndicator;
+      rec.flowStartTimestamp = key.flowStartTimestamp;
+      rec.flowEndTimestamp = key.flowEndTimestamp;
+      rec.ipVersion = key.ipVersion;
+      rec.protocolIdentifier = key.protocolIdentifier;
+      rec.ipClassOfService = 0;
+      rec.ipTtl = 0;
+      rec.sourceIPv4Address = key.sourceIPv4Address;
+      rec.destinationIPv4Address = key.destinationIPv4Address;
+      memcpy(rec.sourceIPv6Address, key.sourceIPv6Address, 16);
+      memcpy(rec.destinationIPv6Address, key.destinationIPv6Address, 16);
+      rec.sourceTransportPort = 0;
+      rec.destinationTransportPort = 0;
+      rec.octetTotalLength = 0;
+      rec.tcpControlBits = 0;
+      rec.linkBitField = 0;
+      rec.dirBitField = 0;
+   } else if (rec.sourceIPv4Address != key.sourceIPv4Address ||
+              memcmp(rec.sourceIPv6Address, key.sourceIPv6Address, 16)) {
+      // Traffic from more source prefixes (e.g. spoofed flood), source address is left empty.
+      rec.sourceIPv4Address = 0;
+      memset(rec.sourceIPv6Address, 0, 16);
+   }
+   return &rec;
+}
+
+/**
+ * \brief Aggregate packet which was not admitted into flow cache.
+ * \param [in] pkt Packet.
+ */
+void PrefixAggregator::add_packet(const Packet &pkt)
+{
+   FlowRecord key;
+   summary_key(key, pkt.ipVersion, pkt.protocolIdentifier, pkt.sourceIPv4Address, pkt.destinationIPv4Address,
+      pkt.sourceIPv6Address, pkt.destinationIPv6Address);
+   key.flowStartTimestamp = pkt.timestamp;
+   key.flowEndTimestamp = pkt.timestamp;
+
+   FlowRecord *rec = lookup(key);
+   rec->packetTotalCount++;
+   rec->octetTotalLength += pkt.ipLength;
+   rec->tcpControlBits |= pkt.tcpControlBits;
+   rec->linkBitField |= pkt.linkBitField;
+   rec->dirBitField |= pkt.dirBitField;
+   rec->flowEndTimestamp = pkt.timestamp;
+   aggregated++;
+}
+
+/**
+ * \brief Aggregate flow evicted from flow cache.
+ * \param [in] flow Flow record.
+ */
+void PrefixAggregator::add_flow(const FlowRecord &flow)
+{
+   FlowRecord key;
+   summary_key(key, flow.ipVersion, flow.protocolIdentifier, flow.sourceIPv4Address, flow.destinationIPv4Address,
+      flow.sourceIPv6Address, flow.destinationIPv6Address);
+   key.flowStartTimestamp = flow.flowStartTimestamp;
+   key.flowEndTimestamp = flow.flowEndTimestamp;
+
+   FlowRecord *rec = lookup(key);
+   rec->packetTotalCount += flow.packetTotalCount;
+   rec->octetTotalLength += flow.octetTotalLength;
+   rec->tcpControlBits |= flow.tcpControlBits;
+   rec->linkBitField |= flow.linkBitField;
+   rec->dirBitField |= flow.dirBitField;
+   if (flow.flowEndTimestamp > rec->flowEndTimestamp) {
+      rec->flowEndTimestamp = flow.flowEndTimestamp;
+   }
+   aggregated++;
+}
+
+/**
+ * \brief Export summary records which timed out.
+ * \param [in] now Current time.
+ * \param [in] all Export all summary records.
+ */
+void PrefixAggregator::export_expired(double now, bool all)
+{
+   for (unsigned int i = 0; i < table.size(); i++) {
+      FlowRecord &rec = table[i];
+      if (rec.packetTotalCount != 0 &&
+          (all || now - rec.flowStartTimestamp > active || now - rec.flowEndTimestamp > inactive)) {
+         export_summary(rec);
+      }
+   }
+}
+
+void PrefixAggregator::export_summary(FlowRecord &rec)
+{
+   if (exporter != NULL) {
+      exporter->export_flow(rec);
+   }
+   rec.packetTotalCount = 0;
+   exported++;
+}
+
+// ProbationPolicy ************************************************************
+
+int ProbationPolicy::insert_position(int insertpos, int linesize)
+{
+   return linesize - 1;
+}
+
+// SketchPolicy ***************************************************************
+
+SketchPolicy::SketchPolicy(double inactivetimeout, double activetimeout) : updates(0),
+   aggregator(inactivetimeout, activetimeout)
+{
+   sketch = new uint8_t[SKETCH_ROWS * SKETCH_WIDTH];
+   memset(sketch, 0, SKETCH_ROWS * SKETCH_WIDTH);
+}
+
+SketchPolicy::~SketchPolicy()
+{
+   delete [] sketch;
+}
+
+void SketchPolicy::set_exporter(FlowExporter *exp)
+{
+   aggregator.set_exporter(exp);
+}
+
+bool SketchPolicy::admit(const Packet &pkt, uint64_t hashval, const FlowRecord &victim)
+{
+   if (++updates >= SKETCH_DECAY) {
+      // Halve all counters so that random keys of a flood do not saturate the sketch.
+      for (int i = 0; i < SKETCH_ROWS * SKETCH_WIDTH; i++) {
+         sketch[i] >>= 1;
+      }
+      updates = 0;
+   }
+
+   // Rows are indexed by different 16-bit parts of remixed hash.
+   uint64_t h = hashval * 0x9E3779B97F4A7C15ULL;
+   uint8_t estimate = 0xFF;
+   for (int row = 0; row < SKETCH_ROWS; row++) {
+      uint8_t &counter = sketch[row * SKETCH_WIDTH + ((h >> (row * 16)) & (SKETCH_WIDTH - 1))];
+      if (counter < 0xFF) {
+         counter++;
+      }
+      if (counter < estimate) {
+         estimate = counter;
+      }
+   }
+
+   if (estimate >= SKETCH_THRESHOLD) {
+      return true;
+   }
+   aggregator.add_packet(pkt);
+   return false;
+}
+
+void SketchPolicy::export_expired(double now, bool all)
+{
+   aggregator.export_expired(now, all);
+}
+
+void SketchPolicy::report(ostream &out) const
+{
+   out << "Exported summary records: " << aggregator.exported << endl;
+}
+
+// AggregatePolicy ************************************************************
+
+AggregatePolicy::AggregatePolicy(double inactivetimeout, double activetimeout) : aggregator(inactivetimeout, activetimeout)
+{
+}
+
+void AggregatePolicy::set_exporter(FlowExporter *exp)
+{
+   aggregator.set_exporter(exp);
+}
+
+bool AggregatePolicy::absorb(const FlowRecord &rec)
+{
+   // Summary record is a basic flow, data of plugin extensions would be lost
+   if (rec.packetTotalCount == 1 && rec.exts == NULL) {
+      aggregator.add_flow(rec);
+      return true;
+   }
+   return false;
+}
+
+void AggregatePolicy::export_expired(double now, bool all)
+{
+   aggregator.export_expired(now, all);
+}
+
+void AggregatePolicy::report(ostream &out) const
+{
+   out << "Aggregated single-packet flows: " << aggregator.aggregated << endl;
+   out << "Exported summary records: " << aggregator.exported << endl;
+}
+
+/**
+ * \brief Create admission policy by its name.
+ * \param [in] name Name of the policy: none, probation, sketch or aggregate.
+ * \param [in] inactivetimeout Inactive timeout of summary records.
+ * \param [in] activetimeout Active timeout of summary records.
+ * \return New policy or NULL when name is unknown.
+ */
+AdmissionPolicy *create_admission_policy(const string &name, double inactivetimeout, double activetimeout)
+{
+   if (name == "none") {
+      return new AdmissionPolicy();
+   } else if (name == "probation") {
+      return new ProbationPolicy();
+   } else if (name == "sketch") {
+      return new SketchPolicy(inactivetimeout, activetimeout);
+   } else if (name == "aggregate") {
+      return new AggregatePolicy(inactivetimeout, activetimeout);
+   }
+   return NULL;
+}
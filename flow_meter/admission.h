@@ -0,0 +1,218 @@
+/**
+ * \file admission.h
+ * \brief Admission policies deciding which new flows may evict flows from full lines of flow cache.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "packet.h"
+#include "flowifc.h"
+#include "flowexporter.h"
+
+#define SKETCH_ROWS           4        /**< Number of rows of count-min sketch. */
+#define SKETCH_WIDTH          65536    /**< Number of counters in one row of count-min sketch. */
+#define SKETCH_THRESHOLD      2        /**< New flow is admitted when its packets were seen at least this many times. */
+#define SKETCH_DECAY          16384    /**< Counters are halved after this number of updates. */
+
+#define SUMMARY_TABLE_SIZE    4096     /**< Number of per-prefix summary records. */
+#define SUMMARY_PREFIX_V4     24       /**< Length of IPv4 prefix of summary records. */
+#define SUMMARY_PREFIX_V6     64       /**< Length of IPv6 prefix of summary records. */
+
+/**
+ * \brief Aggregates packets and single-packet flows into per-prefix summary records.
+ *
+ * Summary record is keyed by IP version, protocol and destination prefix. Source prefix is kept while all
+ * aggregated traffic comes from one source prefix, otherwise it is zero. Ports are zero, packet and byte
+ * counters are sums of aggregated traffic.
+ */
+class PrefixAggregator
+{
+public:
+   PrefixAggregator(double inactivetimeout, double activetimeout);
+   ~PrefixAggregator();
+
+   void set_exporter(FlowExporter *exp);
+   void add_packet(const Packet &pkt);
+   void add_flow(const FlowRecord &rec);
+   void export_expired(double now, bool all);
+
+   uint64_t aggregated; /**< Number of aggregated packets and flows. */
+   uint64_t exported; /**< Number of exported summary records. */
+
+private:
+   FlowRecord *lookup(const FlowRecord &key);
+   void export_summary(FlowRecord &rec);
+
+   std::vector<FlowRecord> table;
+   FlowExporter *exporter;
+   double inactive;
+   double active;
+};
+
+/**
+ * \brief Base class of flow cache admission policies.
+ *
+ * Default policy (this class) reproduces the original behavior: every new flow is admitted and the last flow
+ * of a full line is evicted and exported.
+ */
+class AdmissionPolicy
+{
+public:
+   virtual ~AdmissionPolicy()
+   {
+   }
+
+   /**
+    * \brief Set exporter of records created by policy.
+    * \param [in] exp Flow exporter.
+    */
+   virtual void set_exporter(FlowExporter *exp)
+   {
+   }
+
+   /**
+    * \brief Position in a line where new flows are inserted after eviction.
+    * \param [in] insertpos Position given by replacement vector.
+    * \param [in] linesize Size of the line.
+    * \return Insert position.
+    */
+   virtual int insert_position(int insertpos, int linesize)
+   {
+      return insertpos;
+   }
+
+   /**
+    * \brief Decide whether packet of a new flow may evict a flow from full line.
+    *
+    * Not called for packets which any plugin is interested in, those always create their flow.
+    * \param [in] pkt Packet of the new flow.
+    * \param [in] hashval Hash of the new flow.
+    * \param [in] victim Flow which would be evicted.
+    * \return True to evict victim and create the flow, false when the packet was accounted by the policy.
+    */
+   virtual bool admit(const Packet &pkt, uint64_t hashval, const FlowRecord &victim)
+   {
+      return true;
+   }
+
+   /**
+    * \brief Called for flow evicted from full line.
+    * \param [in] rec Evicted flow.
+    * \return True if the flow was absorbed by the policy and must not be exported.
+    */
+   virtual bool absorb(const FlowRecord &rec)
+   {
+      return false;
+   }
+
+   /**
+    * \brief Export timed out records of the policy.
+    * \param [in] now Current time.
+    * \param [in] all Export all records.
+    */
+   virtual void export_expired(double now, bool all)
+   {
+   }
+
+   /**
+    * \brief Print policy statistics.
+    */
+   virtual void report(std::ostream &out) const
+   {
+   }
+};
+
+/**
+ * \brief New flows occupy the last (probationary) position of a line until their second packet moves them up.
+ *
+ * A flood of single-packet flows evicts only the flow in the probationary position.
+ */
+class ProbationPolicy : public AdmissionPolicy
+{
+public:
+   int insert_position(int insertpos, int linesize);
+};
+
+/**
+ * \brief Count-min sketch admission: new flow may evict a flow only when its key was seen before.
+ *
+ * Packets of flows which are not admitted are aggregated into per-prefix summary records.
+ */
+class SketchPolicy : public ProbationPolicy
+{
+public:
+   SketchPolicy(double inactivetimeout, double activetimeout);
+   ~SketchPolicy();
+
+   void set_exporter(FlowExporter *exp);
+   bool admit(const Packet &pkt, uint64_t hashval, const FlowRecord &victim);
+   void export_expired(double now, bool all);
+   void report(std::ostream &out) const;
+
+private:
+   uint8_t *sketch;
+   uint32_t updates;
+   PrefixAggregator aggregator;
+};
+
+/**
+ * \brief Single-packet flows without extensions evicted from full lines are aggregated into per-prefix summary records.
+ */
+class AggregatePolicy : public ProbationPolicy
+{
+public:
+   AggregatePolicy(double inactivetimeout, double activetimeout);
+
+   void set_exporter(FlowExporter *exp);
+   bool absorb(const FlowRecord &rec);
+   void export_expired(double now, bool all);
+   void report(std::ostream &out) const;
+
+private:
+   PrefixAggregator aggregator;
+};
+
+AdmissionPolicy *create_admission_policy(const std::string &name, double inactivetimeout, double activetimeout);
+
+#endif
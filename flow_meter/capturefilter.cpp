@@ -0,0 +1,312 @@
+/**
+ * \file capturefilter.cpp
+ * \brief Capture filter selecting snap length of packets according to needs of active plugins.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "capturefilter.h"
+#include "packet.h"
+
+using namespace std;
+
+/**
+ * \brief Filter expression of packets of tunnels decapsulated by packet parser.
+ */
+#define TUNNEL_EXPRESSION "udp port 4789 or udp port 2152 or ip proto 47 or ip proto 4 or ip proto 41 or " \
+   "ip6 proto 47 or ip6 proto 4 or ip6 proto 41"
+
+/**
+ * \brief Filter expressions of MPLS packets, untagged and VLAN tagged.
+ * MPLS shifts offsets of the rest of expression and libpcap rejects VLAN match after it,
+ * so each expression is a rule of its own.
+ */
+#define MPLS_EXPRESSION "mpls"
+#define VLAN_MPLS_EXPRESSION "vlan and mpls"
+
+/**
+ * \brief Filter expression of IP packets which need only headers to be captured.
+ */
+#define HEADER_EXPRESSION "ip or ip6"
+
+/**
+ * \brief Match expression on untagged and on VLAN tagged packets.
+ * \param [in] expression Filter expression.
+ * \return Filter expression.
+ */
+static string vlan_expression(const string &expression)
+{
+   if (expression.empty()) {
+      return expression;
+   }
+   return "(" + expression + ") or (vlan and (" + expression + "))";
+}
+
+/**
+ * \brief Create filter expression of IPv4 packets with payload starting with signature.
+ * Only the first 4 bytes of signature are compared, so the expression may match more packets.
+ * Payload length is checked first: load beyond the packet would end the whole program and drop the packet.
+ * \param [in] proto Transport protocol (tcp or udp).
+ * \param [in] signature Leading payload bytes.
+ * \return Filter expression.
+ */
+static string signature_expression(const string &proto, const string &signature)
+{
+   const char *offset = (proto == "tcp" ? "((tcp[12] & 0xf0) >> 2)" : "8");
+   const char *payload_len = (proto == "tcp" ? "ip[2:2] - ((ip[0] & 0xf) << 2) - ((tcp[12] & 0xf0) >> 2)" :
+      "udp[4:2] - 8");
+   int len = signature.length() >= 4 ? 4 : (signature.length() >= 2 ? 2 : signature.length());
+   if (len == 0) {
+      return proto;
+   }
+
+   uint32_t value = 0;
+   for (int i = 0; i < len; i++) {
+      value = (value << 8) | (uint8_t) signature[i];
+   }
+
+   char buf[256];
+   snprintf(buf, sizeof(buf), "(%s >= %d and %s[%s:%d] = 0x%x)", payload_len, len, proto.c_str(), offset, len, value);
+   return buf;
+}
+
+/**
+ * \brief Create filter expression of packets which plugin wants to inspect.
+ * \param [in] interest Interest of plugin.
+ * \return Filter expression, empty when plugin wants all packets.
+ */
+static string interest_expression(const plugin_interest &interest)
+{
+   if (interest.all) {
+      return "";
+   }
+
+   string expression;
+   for (int i = 0; i < 2; i++) {
+      if (!(interest.protocols & (i == 0 ? INTEREST_TCP : INTEREST_UDP))) {
+         continue;
+      }
+      string proto = (i == 0 ? "tcp" : "udp");
+      vector<string> terms;
+
+      if (interest.ports.empty() && interest.signatures.empty()) {
+         terms.push_back(proto);
+      }
+      if (!interest.ports.empty()) {
+         string ports;
+         for (unsigned int j = 0; j < interest.ports.size(); j++) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%sport %u", (j == 0 ? "" : " or "), interest.ports[j]);
+            ports += buf;
+         }
+         terms.push_back("(" + proto + " and (" + ports + "))");
+      }
+      if (!interest.signatures.empty()) {
+         // Payload offset is known only with IPv4 headers, all IPv6 packets of the protocol are matched.
+         string signatures;
+         for (unsigned int j = 0; j < interest.signatures.size(); j++) {
+            signatures += (j == 0 ? "" : " or ") + signature_expression(proto, interest.signatures[j]);
+         }
+         terms.push_back("(ip and (" + signatures + "))");
+         terms.push_back("(ip6 and " + proto + ")");
+      }
+
+      for (unsigned int j = 0; j < terms.size(); j++) {
+         expression += (expression.empty() ? "" : " or ") + terms[j];
+      }
+   }
+   return expression;
+}
+
+/**
+ * \brief Compare rules by snap length, longer first.
+ */
+static bool longer_snaplen(const capture_rule &a, const capture_rule &b)
+{
+   return a.snaplen > b.snaplen;
+}
+
+/**
+ * \brief Create capture rules according to packets and payload depth wanted by plugins.
+ *
+ * Packets wanted by plugins which inspect payload are captured up to header length plus payload depth,
+ * other IP packets only up to header length. Tunneled packets are captured longer by headers of tunnels.
+ * Packets of other protocols are captured with the returned maximal snap length.
+ * \param [in] plugins Active plugins.
+ * \param [in] outerkey Tunnels are not decapsulated.
+ * \param [out] rules Capture rules, first matching rule applies.
+ * \return Maximal snap length of all rules.
+ */
+int capture_rules(const vector<FlowCachePlugin *> &plugins, bool outerkey, vector<capture_rule> &rules)
+{
+   vector<capture_rule> payload_rules;
+   int snaplen = CAPTURE_HEADER_SNAPLEN;
+
+   for (unsigned int i = 0; i < plugins.size(); i++) {
+      int depth = plugins[i]->get_payload_depth();
+      if (depth == PAYLOAD_NONE) {
+         continue;
+      }
+      int len = (depth == PAYLOAD_FULL || depth > MAXPCKTSIZE - CAPTURE_HEADER_SNAPLEN ?
+         MAXPCKTSIZE : CAPTURE_HEADER_SNAPLEN + depth);
+      string expression = vlan_expression(interest_expression(plugins[i]->get_interest()));
+
+      bool found = false;
+      for (unsigned int j = 0; j < payload_rules.size(); j++) {
+         if (payload_rules[j].expression == expression) {
+            payload_rules[j].snaplen = max(payload_rules[j].snaplen, len);
+            found = true;
+         }
+      }
+      if (!found) {
+         payload_rules.push_back(capture_rule(expression, len));
+      }
+      snaplen = max(snaplen, len);
+   }
+   // Packet wanted by more plugins is captured with the longest snap length.
+   stable_sort(payload_rules.begin(), payload_rules.end(), longer_snaplen);
+
+   rules.clear();
+   if (!outerkey) {
+      snaplen = min(snaplen + CAPTURE_TUNNEL_SNAPLEN, MAXPCKTSIZE);
+      rules.push_back(capture_rule(vlan_expression(TUNNEL_EXPRESSION), snaplen));
+      rules.push_back(capture_rule(MPLS_EXPRESSION, snaplen));
+      rules.push_back(capture_rule(VLAN_MPLS_EXPRESSION, snaplen));
+   }
+   rules.insert(rules.end(), payload_rules.begin(), payload_rules.end());
+   rules.push_back(capture_rule(vlan_expression(HEADER_EXPRESSION), CAPTURE_HEADER_SNAPLEN));
+
+   return snaplen;
+}
+
+/**
+ * \brief Compile filter expression and append it to program.
+ *
+ * Return instructions are patched: when snaplen is 0 (filter), matching packets continue with the
+ * next block and other packets are dropped. Otherwise (rule), matching packets are captured up to
+ * snaplen bytes and other packets continue with the next block.
+ * \param [in] handle Pcap handle.
+ * \param [in] expression Filter expression.
+ * \param [in] snaplen Snap length of matching packets or 0.
+ * \param [in,out] code Program.
+ * \param [out] errmsg Error message.
+ * \return 0 on success, non 0 on failure.
+ */
+static int append_block(pcap_t *handle, const string &expression, int snaplen, vector<struct bpf_insn> &code,
+   string &errmsg)
+{
+   struct bpf_program block;
+   if (pcap_compile(handle, &block, expression.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0) {
+      errmsg = "Unable to compile filter \"" + expression + "\": " + pcap_geterr(handle);
+      return 1;
+   }
+
+   for (unsigned int i = 0; i < block.bf_len; i++) {
+      struct bpf_insn insn = block.bf_insns[i];
+      if (BPF_CLASS(insn.code) == BPF_RET) {
+         if (BPF_RVAL(insn.code) != BPF_K) {
+            errmsg = "Unable to combine filter \"" + expression + "\": unexpected return instruction";
+            pcap_freecode(&block);
+            return 1;
+         }
+         struct bpf_insn next = BPF_STMT(BPF_JMP | BPF_JA, block.bf_len - i - 1);
+         if (snaplen == 0 && insn.k != 0) {
+            insn = next;
+         } else if (snaplen != 0) {
+            if (insn.k != 0) {
+               insn.k = snaplen;
+            } else {
+               insn = next;
+            }
+         }
+      }
+      code.push_back(insn);
+   }
+
+   pcap_freecode(&block);
+   return 0;
+}
+
+/**
+ * \brief Compile user filter and capture rules into one program.
+ *
+ * The program drops packets not matching user filter and returns snap length of the first matching
+ * rule for other packets (snaplen when no rule matches).
+ * \param [in] handle Pcap handle.
+ * \param [in] filter User filter expression, may be empty.
+ * \param [in] rules Capture rules.
+ * \param [in] snaplen Snap length of packets matching no rule.
+ * \param [out] program Compiled program, free it by pcap_freecode().
+ * \param [out] errmsg Error message.
+ * \return 0 on success, 1 when user filter is invalid, 2 when rules cannot be compiled.
+ */
+int compile_capture_filter(pcap_t *handle, const string &filter, const vector<capture_rule> &rules, int snaplen,
+   struct bpf_program &program, string &errmsg)
+{
+   vector<struct bpf_insn> code;
+
+   if (!filter.empty() && append_block(handle, filter, 0, code, errmsg) != 0) {
+      return 1;
+   }
+   for (unsigned int i = 0; i < rules.size(); i++) {
+      if (append_block(handle, rules[i].expression, rules[i].snaplen, code, errmsg) != 0) {
+         return 2;
+      }
+   }
+   struct bpf_insn ret = BPF_STMT(BPF_RET | BPF_K, (bpf_u_int32) snaplen);
+   code.push_back(ret);
+
+   if (code.size() > BPF_MAXINSNS) {
+      errmsg = "Capture filter is too long.";
+      return 2;
+   }
+
+   program.bf_len = code.size();
+   program.bf_insns = (struct bpf_insn *) malloc(code.size() * sizeof(struct bpf_insn));
+   if (program.bf_insns == NULL) {
+      errmsg = "Not enough memory.";
+      return 2;
+   }
+   memcpy(program.bf_insns, &code[0], code.size() * sizeof(struct bpf_insn));
+   return 0;
+}
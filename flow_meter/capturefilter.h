@@ -0,0 +1,70 @@
+/**
+ * \file capturefilter.h
+ * \brief Capture filter selecting snap length of packets according to needs of active plugins.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifndef CAPTUREFILTER_H
+#define CAPTUREFILTER_H
+
+#include <string>
+#include <vector>
+#include <pcap/pcap.h>
+
+#include "flowcacheplugin.h"
+
+#define CAPTURE_HEADER_SNAPLEN 128 /**< Bytes needed to parse link, network and transport headers. */
+#define CAPTURE_TUNNEL_SNAPLEN 128 /**< Bytes of headers added by tunnels (GRE, VXLAN, GTP-U, IP-in-IP). */
+
+/**
+ * \brief Packets matching filter expression are captured up to given length.
+ */
+struct capture_rule {
+   std::string expression; /**< pcap filter expression, empty expression matches all packets. */
+   int snaplen; /**< Number of captured bytes. */
+
+   capture_rule(const std::string &expression, int snaplen) : expression(expression), snaplen(snaplen)
+   {
+   }
+};
+
+int capture_rules(const std::vector<FlowCachePlugin *> &plugins, bool outerkey, std::vector<capture_rule> &rules);
+int compile_capture_filter(pcap_t *handle, const std::string &filter, const std::vector<capture_rule> &rules,
+   int snaplen, struct bpf_program &program, std::string &errmsg);
+
+#endif
@@ -0,0 +1,357 @@
+/**
+ * \file capturefilter_test.cpp
+ * \brief Check that capture rules created for plugins compile and select snap length of packets.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <pcap/pcap.h>
+
+#include "capturefilter.h"
+
+using namespace std;
+
+/**
+ * \brief Plugin with given interest and payload depth, only capture rules are created for it.
+ */
+class TestPlugin : public FlowCachePlugin
+{
+public:
+   TestPlugin(const plugin_interest &interest, int depth) : interest(interest), depth(depth)
+   {
+   }
+   plugin_interest get_interest() const
+   {
+      return interest;
+   }
+   int get_payload_depth() const
+   {
+      return depth;
+   }
+
+private:
+   plugin_interest interest;
+   int depth;
+};
+
+/**
+ * \brief Create capture rules for plugins and compile them with and without user filter.
+ * \param [in] handle Pcap handle.
+ * \param [in] name Name of plugin set.
+ * \param [in] plugins Plugins.
+ * \return Number of failures.
+ */
+static int check_rules(pcap_t *handle, const char *name, const vector<FlowCachePlugin *> &plugins)
+{
+   const char *filters[] = {"", "tcp or udp"};
+   int failures = 0;
+
+   for (int outerkey = 0; outerkey < 2; outerkey++) {
+      vector<capture_rule> rules;
+      int snaplen = capture_rules(plugins, outerkey, rules);
+
+      for (unsigned int i = 0; i < sizeof(filters) / sizeof(filters[0]); i++) {
+         struct bpf_program program;
+         string errmsg;
+
+         if (compile_capture_filter(handle, filters[i], rules, snaplen, program, errmsg) != 0) {
+            fprintf(stderr, "FAIL %s (outerkey %d, filter \"%s\"): %s\n", name, outerkey, filters[i], errmsg.c_str());
+            failures++;
+            continue;
+         }
+         pcap_freecode(&program);
+      }
+   }
+   return failures;
+}
+
+/**
+ * \brief Append big endian integer of given number of bytes to frame.
+ */
+static void put(vector<uint8_t> &frame, uint32_t value, int bytes)
+{
+   for (int i = bytes - 1; i >= 0; i--) {
+      frame.push_back((value >> (8 * i)) & 0xff);
+   }
+}
+
+/**
+ * \brief Append Ethernet header, optionally with VLAN tag.
+ */
+static void ethernet(vector<uint8_t> &frame, bool vlan, uint16_t ethertype)
+{
+   put(frame, 0x0200, 2); // Destination 02:00:00:00:00:02
+   put(frame, 0x00000002, 4);
+   put(frame, 0x0200, 2); // Source 02:00:00:00:00:01
+   put(frame, 0x00000001, 4);
+   if (vlan) {
+      put(frame, 0x8100, 2);
+      put(frame, 100, 2);
+   }
+   put(frame, ethertype, 2);
+}
+
+/**
+ * \brief Append IPv4 or IPv6 header followed by transport header and payload.
+ * \param [in,out] frame Frame.
+ * \param [in] version IP version.
+ * \param [in] proto Transport protocol.
+ * \param [in] dport Destination port (TCP and UDP).
+ * \param [in] payload Payload behind transport header.
+ */
+static void ip(vector<uint8_t> &frame, int version, uint8_t proto, uint16_t dport, const string &payload)
+{
+   int l4len = (proto == IPPROTO_TCP ? 20 : (proto == IPPROTO_UDP ? 8 : 0)) + payload.length();
+
+   if (version == 4) {
+      put(frame, 0x4500, 2);
+      put(frame, 20 + l4len, 2);
+      put(frame, 0x1234, 2);
+      put(frame, 0x4000, 2); // Don't fragment
+      put(frame, 64, 1);
+      put(frame, proto, 1);
+      put(frame, 0, 2);
+      put(frame, 0x0a000001, 4);
+      put(frame, 0x0a000002, 4);
+   } else {
+      put(frame, 0x60000000, 4);
+      put(frame, l4len, 2);
+      put(frame, proto, 1);
+      put(frame, 64, 1);
+      for (int i = 0; i < 2; i++) {
+         put(frame, 0x20010db8, 4);
+         put(frame, 0, 4);
+         put(frame, 0, 4);
+         put(frame, i + 1, 4);
+      }
+   }
+
+   if (proto == IPPROTO_TCP) {
+      put(frame, 40000, 2);
+      put(frame, dport, 2);
+      put(frame, 1, 4);
+      put(frame, 1, 4);
+      put(frame, 0x5018, 2); // Header of 20 bytes, ACK and PSH
+      put(frame, 65535, 2);
+      put(frame, 0, 4);
+   } else if (proto == IPPROTO_UDP) {
+      put(frame, 40000, 2);
+      put(frame, dport, 2);
+      put(frame, 8 + payload.length(), 2);
+      put(frame, 0, 2);
+   }
+   frame.insert(frame.end(), payload.begin(), payload.end());
+}
+
+/**
+ * \brief Crafted frame and snap length expected for it.
+ */
+struct frame_case {
+   string name;
+   vector<uint8_t> frame;
+   int snaplen;
+
+   frame_case(const string &name, int snaplen) : name(name), snaplen(snaplen)
+   {
+   }
+};
+
+/**
+ * \brief Create frame case of IP packet.
+ */
+static frame_case ip_case(const string &name, bool vlan, int version, uint8_t proto, uint16_t dport,
+   const string &payload, int snaplen)
+{
+   frame_case c(name, snaplen);
+   ethernet(c.frame, vlan, version == 4 ? 0x0800 : 0x86dd);
+   ip(c.frame, version, proto, dport, payload);
+   return c;
+}
+
+/**
+ * \brief Create frame case of MPLS packet carrying IPv4 TCP packet.
+ */
+static frame_case mpls_case(const string &name, bool vlan, int snaplen)
+{
+   frame_case c(name, snaplen);
+   ethernet(c.frame, vlan, 0x8847);
+   put(c.frame, (100 << 12) | (1 << 8) | 64, 4); // Label 100, bottom of stack
+   ip(c.frame, 4, IPPROTO_TCP, 80, "");
+   return c;
+}
+
+/**
+ * \brief Create frame case of ARP packet, no rule matches it.
+ */
+static frame_case arp_case(int snaplen)
+{
+   frame_case c("arp", snaplen);
+   ethernet(c.frame, false, 0x0806);
+   c.frame.resize(c.frame.size() + 28, 0);
+   return c;
+}
+
+/**
+ * \brief Run program created from capture rules on frames and compare returned snap lengths.
+ * \param [in] handle Pcap handle.
+ * \param [in] name Name of plugin set.
+ * \param [in] plugins Plugins.
+ * \param [in] outerkey Tunnels are not decapsulated.
+ * \param [in] filter User filter.
+ * \param [in] cases Frames with expected snap lengths.
+ * \return Number of failures.
+ */
+static int check_snaplen(pcap_t *handle, const char *name, const vector<FlowCachePlugin *> &plugins, bool outerkey,
+   const string &filter, const vector<frame_case> &cases)
+{
+   vector<capture_rule> rules;
+   int snaplen = capture_rules(plugins, outerkey, rules);
+   struct bpf_program program;
+   string errmsg;
+   int failures = 0;
+
+   if (compile_capture_filter(handle, filter, rules, snaplen, program, errmsg) != 0) {
+      fprintf(stderr, "FAIL %s: %s\n", name, errmsg.c_str());
+      return 1;
+   }
+   for (unsigned int i = 0; i < cases.size(); i++) {
+      const frame_case &c = cases[i];
+      u_int len = bpf_filter(program.bf_insns, &c.frame[0], c.frame.size(), c.frame.size());
+      if ((int) len != c.snaplen) {
+         fprintf(stderr, "FAIL %s, %s: snap length %u, expected %d\n", name, c.name.c_str(), len, c.snaplen);
+         failures++;
+      }
+   }
+   pcap_freecode(&program);
+   return failures;
+}
+
+int main()
+{
+   pcap_t *handle = pcap_open_dead(DLT_EN10MB, MAXPCKTSIZE);
+   if (handle == NULL) {
+      fprintf(stderr, "Unable to open pcap handle.\n");
+      return 1;
+   }
+
+   plugin_interest http(INTEREST_TCP);
+   http.ports.push_back(80);
+   http.ports.push_back(8080);
+   http.signatures.push_back("GET ");
+   http.signatures.push_back("HTTP");
+   plugin_interest dns(INTEREST_UDP | INTEREST_TCP);
+   dns.ports.push_back(53);
+   plugin_interest udp(INTEREST_UDP);
+
+   TestPlugin http_plugin(http, 256);
+   TestPlugin dns_plugin(dns, PAYLOAD_FULL);
+   TestPlugin udp_plugin(udp, 64);
+   TestPlugin all_plugin(plugin_interest(), 128);
+   TestPlugin header_plugin(plugin_interest(), PAYLOAD_NONE);
+
+   vector<FlowCachePlugin *> plugins;
+   int failures = check_rules(handle, "default", plugins);
+
+   // Without plugins: tunnels with room for their headers, other IP packets by headers only.
+   const int header = CAPTURE_HEADER_SNAPLEN;
+   const int tunnel = CAPTURE_HEADER_SNAPLEN + CAPTURE_TUNNEL_SNAPLEN;
+   vector<frame_case> cases;
+   cases.push_back(ip_case("ipv4 tcp", false, 4, IPPROTO_TCP, 80, "GET / HTTP/1.1\r\n", header));
+   cases.push_back(ip_case("vlan ipv6 udp", true, 6, IPPROTO_UDP, 53, "", header));
+   cases.push_back(ip_case("ipv4 icmp", false, 4, IPPROTO_ICMP, 0, string(32, 'x'), header));
+   cases.push_back(ip_case("ipv4 vxlan", false, 4, IPPROTO_UDP, 4789, string(64, 'x'), tunnel));
+   cases.push_back(ip_case("vlan ipv4 gtp-u", true, 4, IPPROTO_UDP, 2152, string(64, 'x'), tunnel));
+   cases.push_back(ip_case("ipv4 gre", false, 4, 47, 0, string(64, 'x'), tunnel));
+   cases.push_back(ip_case("ipv6 ip-in-ip", false, 6, 4, 0, string(64, 'x'), tunnel));
+   cases.push_back(mpls_case("mpls", false, tunnel));
+   cases.push_back(mpls_case("vlan mpls", true, tunnel));
+   cases.push_back(arp_case(tunnel));
+   failures += check_snaplen(handle, "default", plugins, false, "", cases);
+
+   // Tunnels are not decapsulated, everything is captured by headers only.
+   cases.clear();
+   cases.push_back(ip_case("ipv4 vxlan", false, 4, IPPROTO_UDP, 4789, string(64, 'x'), header));
+   cases.push_back(mpls_case("mpls", false, header));
+   cases.push_back(arp_case(header));
+   failures += check_snaplen(handle, "default outer", plugins, true, "", cases);
+
+   plugins.push_back(&header_plugin);
+   failures += check_rules(handle, "headers only", plugins);
+   plugins.push_back(&http_plugin);
+   plugins.push_back(&dns_plugin);
+   plugins.push_back(&udp_plugin);
+   failures += check_rules(handle, "ports and signatures", plugins);
+
+   // Packets wanted by plugins are captured with payload depth of the most demanding one.
+   const int http_len = CAPTURE_HEADER_SNAPLEN + 256;
+   const int udp_len = CAPTURE_HEADER_SNAPLEN + 64;
+   cases.clear();
+   cases.push_back(ip_case("ipv4 tcp port", false, 4, IPPROTO_TCP, 80, "", http_len));
+   cases.push_back(ip_case("vlan ipv4 tcp port", true, 4, IPPROTO_TCP, 8080, string(100, 'x'), http_len));
+   cases.push_back(ip_case("ipv4 tcp signature", false, 4, IPPROTO_TCP, 443, "GET / HTTP/1.1\r\n", http_len));
+   cases.push_back(ip_case("vlan ipv4 tcp signature", true, 4, IPPROTO_TCP, 8443, "HTTP/1.1 200 OK\r\n", http_len));
+   cases.push_back(ip_case("ipv4 tcp other payload", false, 4, IPPROTO_TCP, 443, string(100, 'x'), header));
+   cases.push_back(ip_case("ipv4 tcp short payload", false, 4, IPPROTO_TCP, 443, "GE", header));
+   cases.push_back(ip_case("ipv4 tcp no payload", false, 4, IPPROTO_TCP, 443, "", header));
+   cases.push_back(ip_case("ipv6 tcp", false, 6, IPPROTO_TCP, 443, "", http_len));
+   cases.push_back(ip_case("ipv4 udp dns", false, 4, IPPROTO_UDP, 53, string(40, 'x'), MAXPCKTSIZE));
+   cases.push_back(ip_case("vlan ipv6 tcp dns", true, 6, IPPROTO_TCP, 53, "", MAXPCKTSIZE));
+   cases.push_back(ip_case("ipv4 udp", false, 4, IPPROTO_UDP, 9999, string(40, 'x'), udp_len));
+   cases.push_back(ip_case("ipv6 udp", false, 6, IPPROTO_UDP, 9999, "", udp_len));
+   cases.push_back(ip_case("ipv4 icmp", false, 4, IPPROTO_ICMP, 0, string(32, 'x'), header));
+   cases.push_back(arp_case(MAXPCKTSIZE));
+   failures += check_snaplen(handle, "ports and signatures", plugins, true, "", cases);
+
+   // User filter drops packets before rules are applied.
+   cases.clear();
+   cases.push_back(ip_case("ipv4 tcp port", false, 4, IPPROTO_TCP, 80, "", http_len));
+   cases.push_back(ip_case("ipv4 icmp", false, 4, IPPROTO_ICMP, 0, string(32, 'x'), 0));
+   cases.push_back(arp_case(0));
+   failures += check_snaplen(handle, "user filter", plugins, true, "tcp or udp", cases);
+
+   plugins.push_back(&all_plugin);
+   failures += check_rules(handle, "all packets", plugins);
+
+   pcap_close(handle);
+   return failures == 0 ? 0 : 1;
+}
@@ -154,6 +154,21 @@ void DNSPlugin::finish()
    }
 }
 
+plugin_interest DNSPlugin::get_interest() const
+{
+   plugin_interest interest(INTEREST_TCP | INTEREST_UDP);
+   interest.ports.push_back(53);
+   return interest;
+}
+
+FlowRecordExt *DNSPlugin::create_ext(uint16_t ext_type)
+{
+   if (ext_type == dns) {
+      return new FlowRecordExtDNS();
+   }
+   return NULL;
+}
+
 std::string DNSPlugin::get_unirec_field_string()
 {
    return DNS_UNIREC_TEMPLATE;
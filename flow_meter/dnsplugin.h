@@ -255,6 +255,22 @@ struct FlowRecordExtDNS : FlowRecordExt {
          ur_set(tmplt, record, F_DNS_PSIZE, dns_psize);
          ur_set(tmplt, record, F_DNS_DO, dns_do);
    }
+
+   virtual bool checkpoint(checkpoint_buffer &buf)
+   {
+      buf.field(dns_id);
+      buf.field(dns_answers);
+      buf.field(dns_rcode);
+      buf.field(dns_qname);
+      buf.field(dns_qtype);
+      buf.field(dns_qclass);
+      buf.field(dns_rr_ttl);
+      buf.field(dns_rlength);
+      buf.field(dns_data);
+      buf.field(dns_psize);
+      buf.field(dns_do);
+      return buf.ok;
+   }
 };
 
 /**
@@ -269,6 +285,8 @@ public:
    int pre_update(FlowRecord &rec, Packet &pkt);
    void finish();
    std::string get_unirec_field_string();
+   plugin_interest get_interest() const;
+   FlowRecordExt *create_ext(uint16_t ext_type);
 
 private:
    bool parse_dns(const char *data, int payload_len, FlowRecordExtDNS *rec);
@@ -54,6 +54,7 @@
 
 #include <stdlib.h>
 #include <time.h>
+#include <signal.h>
 
 #include <libtrap/trap.h>
 
@@ -72,6 +73,9 @@
 #include "httpplugin.h"
 #include "dnsplugin.h"
 #include "sipplugin.h"
+#include "tunnelplugin.h"
+#include "tlsplugin.h"
+#include "pstatsplugin.h"
 
 using namespace std;
 
@@ -87,6 +91,23 @@ inline bool error(const string &e)
 }
 
 trap_module_info_t *module_info = NULL;
+static volatile sig_atomic_t stop = 0;
+static volatile sig_atomic_t terminated = 0; // Stopped by SIGTERM, flow cache is saved into checkpoint
+static PcapMultiReader *packet_reader = NULL;
+
+/**
+ * \brief Stop capture on SIGTERM / SIGINT.
+ */
+void signal_handler(int sig)
+{
+   if (sig == SIGTERM) {
+      terminated = 1;
+   }
+   stop = 1;
+   if (packet_reader != NULL) {
+      packet_reader->breakloop();
+   }
+}
 
 UR_FIELDS (
    ipaddr DST_IP,
@@ -111,15 +132,23 @@ UR_FIELDS (
 #define MODULE_PARAMS(PARAM) \
   PARAM('p', "plugins", "Activate specified parsing plugins. Output interface for each plugin correspond the order which you specify items in -i and -p param. "\
   "For example: \'-i u:a,u:b,u:c -p http,basic,dns\' http traffic will be send to interface u:a, basic flow to u:b etc. If you don't specify -p parameter, flow meter"\
-  "will require one output interface for basic flow by default. Format: plugin_name[,...] Supported plugins: http,dns,sip,basic", required_argument, "string")\
+  "will require one output interface for basic flow by default. Format: plugin_name[,...] Supported plugins: http,dns,sip,sipdialog,tls,tunnel,pstats,basic", required_argument, "string")\
   PARAM('c', "count", "Quit after number of packets are captured.", required_argument, "uint32")\
-  PARAM('I', "interface", "Capture from given network interface. Parameter require interface name (eth0 for example).", required_argument, "string")\
-  PARAM('r', "file", "Pcap file to read.", required_argument, "string") \
+  PARAM('I', "interface", "Capture from given network interface. Parameter require interface name (eth0 for example). "\
+  "More interfaces can be separated by comma, i-th interface sets bit i of LINK_BIT_FIELD.", required_argument, "string")\
+  PARAM('r', "file", "Pcap file to read. More files separated by comma are read at once (merged by timestamps).", required_argument, "string") \
+  PARAM('F', "filter", "BPF filter expression of captured packets.", required_argument, "string") \
+  PARAM('D', "direction", "Direction bit field of each capture source. Format: NUMBER[,...] (DEFAULT: 0)", required_argument, "string") \
   PARAM('t', "timeout", "Active and inactive timeout in seconds. Format: FLOAT:FLOAT. (DEFAULT: 300.0:30.0)", required_argument, "string") \
   PARAM('s', "cache_size", "Size of flow cache in number of flow records. Each flow record has 232 bytes. (DEFAULT: 65536)", required_argument, "uint32") \
+  PARAM('a', "admission", "Admission policy of new flows into full lines of flow cache. Format: none|probation|sketch|aggregate (DEFAULT: none)", required_argument, "string") \
+  PARAM('G', "cache_max_size", "Let flow cache double its size up to NUMBER of flow records when active flows are evicted from full lines. (DEFAULT: disabled)", required_argument, "uint32") \
   PARAM('S', "statistic", "Print statistics. NUMBER specifies interval between prints.", required_argument, "float") \
   PARAM('m', "sample", "Sampling probability. NUMBER in 100 (DEFAULT: 100)", required_argument, "int32") \
   PARAM('V', "vector", "Replacement vector. 1+32 NUMBERS.", required_argument, "string") \
+  PARAM('C', "checkpoint", "Save flow cache into given file when terminated by SIGTERM and restore it from the file at start.", required_argument, "string") \
+  PARAM('k', "tunnel_key", "Key flows of tunneled traffic (GRE, VXLAN, GTP-U, IP-in-IP) on inner or outer headers. Format: inner|outer (DEFAULT: inner)", required_argument, "string") \
+  PARAM('R', "syn_reuse", "Export finished TCP flow (FIN or RST seen) and start a new one when SYN with the same ports arrives.", no_argument, "none") \
   PARAM('v', "verbose", "Set verbose mode on.", no_argument, "none")
 
 /**
@@ -157,6 +186,26 @@ int parse_plugin_settings(const string &settings, vector<FlowCachePlugin *> &plu
          tmp.push_back(plugin_opt("sip", sip, ifc_num++));
 
          plugins.push_back(new SIPPlugin(module_options, tmp));
+      } else if (proto == "sipdialog"){
+         vector<plugin_opt> tmp;
+         tmp.push_back(plugin_opt("sip-dialog", sip_dialog, ifc_num++));
+
+         plugins.push_back(new SIPPlugin(module_options, tmp, true));
+      } else if (proto == "tunnel"){
+         vector<plugin_opt> tmp;
+         tmp.push_back(plugin_opt("tunnel", tunnel, ifc_num++));
+
+         plugins.push_back(new TunnelPlugin(module_options, tmp));
+      } else if (proto == "tls"){
+         vector<plugin_opt> tmp;
+         tmp.push_back(plugin_opt("tls", tls, ifc_num++));
+
+         plugins.push_back(new TLSPlugin(module_options, tmp));
+      } else if (proto == "pstats"){
+         vector<plugin_opt> tmp;
+         tmp.push_back(plugin_opt("pstats", pstats, ifc_num++));
+
+         plugins.push_back(new PStatsPlugin(module_options, tmp));
       } else {
          fprintf(stderr, "Unsupported plugin: \"%s\"\n", proto.c_str());
          return -1;
@@ -167,6 +216,22 @@ int parse_plugin_settings(const string &settings, vector<FlowCachePlugin *> &plu
    return ifc_num;
 }
 
+/**
+ * \brief Split comma separated list and append its items.
+ * \param [in] list List of items.
+ * \param [out] items Array for storing items.
+ */
+void parse_list(const string &list, vector<string> &items)
+{
+   size_t begin = 0, end = 0;
+
+   while (end != string::npos) {
+      end = list.find(",", begin);
+      items.push_back(list.substr(begin, (end == string::npos ? (list.length() - begin) : (end - begin))));
+      begin = end + 1;
+   }
+}
+
 /**
  * \brief Count ifc interfaces.
  * \param [in] argc Number of parameters.
@@ -200,13 +265,19 @@ int main(int argc, char *argv[])
    plugins_t plugin_wrapper;
    options_t options;
    options.flowcachesize = DEFAULT_FLOW_CACHE_SIZE;
+   options.flowcachemaxsize = 0;
+   options.statstime = 0;
    options.flowlinesize = DEFAULT_FLOW_LINE_SIZE;
    options.inactivetimeout = DEFAULT_INACTIVE_TIMEOUT;
    options.activetimeout = DEFAULT_ACTIVE_TIMEOUT;
    options.replacementstring = DEFAULT_REPLACEMENT_STRING;
+   options.admission = "none";
    options.statsout = false;
    options.verbose = false;
-   options.interface = "";
+   options.outerkey = false;
+   options.synreuse = false;
+   options.payloaddepth = PAYLOAD_NONE;
+   options.snaplen = MAXPCKTSIZE;
    options.basic_ifc_num = 0;
 
    uint32_t pkt_limit = 0;
@@ -244,7 +315,7 @@ int main(int argc, char *argv[])
          pkt_limit = strtoul(optarg, NULL, 10);
          break;
       case 'I':
-         options.interface = string(optarg);
+         parse_list(string(optarg), options.interfaces);
          break;
       case 't':
          cptr = strchr(optarg, ':');
@@ -257,11 +328,39 @@ int main(int argc, char *argv[])
          options.inactivetimeout = atof(cptr + 1);
          break;
       case 'r':
-         options.infilename = string(optarg);
+         parse_list(string(optarg), options.infilenames);
+         break;
+      case 'F':
+         options.bpffilter = string(optarg);
+         break;
+      case 'D':
+         {
+            vector<string> dirs;
+            parse_list(string(optarg), dirs);
+            for (unsigned int i = 0; i < dirs.size(); i++) {
+               char *end;
+               unsigned long dir = strtoul(dirs[i].c_str(), &end, 0);
+               if (dirs[i].empty() || *end != 0 || dir > 255) {
+                  FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+                  return error("Invalid argument for option -D: use numbers 0-255");
+               }
+               options.directions.push_back(dir);
+            }
+         }
          break;
       case 's':
          options.flowcachesize = atoi(optarg);
          break;
+      case 'a':
+         if (strcmp(optarg, "none") && strcmp(optarg, "probation") && strcmp(optarg, "sketch") && strcmp(optarg, "aggregate")) {
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+            return error("Invalid argument for option -a: use none, probation, sketch or aggregate");
+         }
+         options.admission = string(optarg);
+         break;
+      case 'G':
+         options.flowcachemaxsize = atoi(optarg);
+         break;
       case 'S':
          options.statstime = atof(optarg);
          options.statsout = true;
@@ -276,38 +375,83 @@ int main(int argc, char *argv[])
       case 'V':
          options.replacementstring = optarg;
          break;
+      case 'R':
+         options.synreuse = true;
+         break;
       case 'v':
          options.verbose = true;
          break;
+      case 'C':
+         options.checkpointfile = string(optarg);
+         break;
+      case 'k':
+         if (!strcmp(optarg, "outer")) {
+            options.outerkey = true;
+         } else if (!strcmp(optarg, "inner")) {
+            options.outerkey = false;
+         } else {
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+            return error("Invalid argument for option -k: use inner or outer");
+         }
+         break;
       default:
          FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
          return error("Invalid arguments");
       }
    }
 
-   if (options.interface != "" && options.infilename != "") {
+   if (!options.interfaces.empty() && !options.infilenames.empty()) {
       FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
       return error("Cannot capture from file and from interface at the same time.");
-   } else if (options.interface == "" && options.infilename == "") {
+   } else if (options.interfaces.empty() && options.infilenames.empty()) {
       FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
       return error("Specify capture interface (-I) or file for reading (-r). ");
    }
 
+   const vector<string> &sources = options.interfaces.empty() ? options.infilenames : options.interfaces;
+   if (sources.size() > MAX_CAPTURE_SOURCES) {
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+      return error("Too many capture sources, LINK_BIT_FIELD has 64 bits.");
+   }
+   if (options.directions.size() > sources.size()) {
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+      return error("Number of items in -D parameter exceeds number of capture sources.");
+   }
+   options.directions.resize(sources.size(), 0);
+
    if (options.flowcachesize % options.flowlinesize != 0) {
       FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
       return error("Size of flow line (32 by default) must divide size of flow cache.");
    }
 
-   PcapReader packetloader(options);
-   if (options.interface == "") {
-      if (packetloader.open_file(options.infilename) != 0) {
-         FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
-         return error("Can't open input file: " + options.infilename);
+   if (options.flowcachemaxsize != 0 && options.flowcachemaxsize < options.flowcachesize) {
+      FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+      return error("Maximal size of flow cache (-G) must not be smaller than its size (-s).");
+   }
+
+   for (unsigned int i = 0; i < plugin_wrapper.plugins.size(); i++) {
+      int depth = plugin_wrapper.plugins[i]->get_payload_depth();
+      if (depth == PAYLOAD_FULL || options.payloaddepth == PAYLOAD_FULL) {
+         options.payloaddepth = PAYLOAD_FULL;
+      } else if (depth > options.payloaddepth) {
+         options.payloaddepth = depth;
       }
-   } else {
-      if (packetloader.init_interface(options.interface) != 0) {
-         FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
-         return error("Unable to initialize libpcap: " + packetloader.errmsg);
+   }
+
+   options.snaplen = capture_rules(plugin_wrapper.plugins, options.outerkey, options.capturerules);
+
+   PcapMultiReader packetloader(options);
+   for (unsigned int i = 0; i < sources.size(); i++) {
+      if (options.interfaces.empty()) {
+         if (packetloader.open_file(sources[i], options.directions[i]) != 0) {
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+            return error("Can't open input file: " + sources[i] + " " + packetloader.errmsg);
+         }
+      } else {
+         if (packetloader.init_interface(sources[i], options.directions[i]) != 0) {
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+            return error("Unable to initialize libpcap: " + packetloader.errmsg);
+         }
       }
    }
 
@@ -331,12 +475,28 @@ int main(int argc, char *argv[])
 
    flowcache.init();
 
+   if (options.checkpointfile != "") {
+      int restored = flowcache.load_checkpoint(options.checkpointfile);
+      if (restored < 0) {
+         cerr << "flow_meter: Unable to restore flow cache from checkpoint " << options.checkpointfile << endl;
+      } else if (options.verbose) {
+         cout << "Restored flows from checkpoint: " << restored << endl;
+      }
+   }
+
+   packet_reader = &packetloader;
+   struct sigaction sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = signal_handler;
+   sigaction(SIGTERM, &sa, NULL);
+   sigaction(SIGINT, &sa, NULL);
+
    Packet packet;
-   int ret;
+   int ret = 0;
    uint32_t pkt_total = 0, pkt_parsed = 0;
    packet.packet = new char[MAXPCKTSIZE + 1];
 
-   while ((ret = packetloader.get_pkt(packet)) > 0) {
+   while (!stop && (ret = packetloader.get_pkt(packet)) > 0) {
       if (ret == 2 && (sampling == 100 || ((rand() % 99) +1) <= sampling)) {
          flowcache.put_pkt(packet);
          pkt_parsed++;
@@ -348,7 +508,7 @@ int main(int argc, char *argv[])
       }
    }
 
-   if (ret < 0) {
+   if (ret < 0 && !stop) {
       FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
       packetloader.close();
       return error("Error during reading: " + packetloader.errmsg);
@@ -359,6 +519,15 @@ int main(int argc, char *argv[])
       cout << "Packet headers parsed: "<< pkt_parsed << endl;
    }
 
+   if (terminated && options.checkpointfile != "") {
+      int saved = flowcache.save_checkpoint(options.checkpointfile);
+      if (saved < 0) {
+         cerr << "flow_meter: Unable to save flow cache into checkpoint " << options.checkpointfile << ", exporting flows" << endl;
+      } else if (options.verbose) {
+         cout << "Saved flows into checkpoint: " << saved << endl;
+      }
+   }
+
    flowcache.finish();
    flowwriter.close();
    packetloader.close();
@@ -49,6 +49,7 @@
 #include <string>
 #include <vector>
 #include <flowcacheplugin.h>
+#include "capturefilter.h"
 
 const unsigned int DEFAULT_FLOW_CACHE_SIZE = 65536;
 const unsigned int DEFAULT_FLOW_LINE_SIZE = 32;
@@ -64,15 +65,25 @@ struct options_t {
    int basic_ifc_num;
    bool statsout;
    bool verbose;
+   bool outerkey;
+   bool synreuse;
+   int payloaddepth;
+   int snaplen;
    uint32_t flowcachesize;
+   uint32_t flowcachemaxsize;
    uint32_t flowlinesize;
    double inactivetimeout;
    double activetimeout;
    double statstime;
-   std::string interface;
-   std::string infilename;
+   std::vector<std::string> interfaces;
+   std::vector<std::string> infilenames;
+   std::vector<uint8_t> directions; /**< Direction bit field of each capture source. */
+   std::vector<capture_rule> capturerules; /**< Snap lengths of packets wanted by plugins. */
+   std::string bpffilter;
    std::string outfilename;
    std::string replacementstring;
+   std::string checkpointfile;
+   std::string admission;
 };
 
 /**
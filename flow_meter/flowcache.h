@@ -52,7 +52,11 @@
 #include "flowexporter.h"
 
 #include <vector>
+#include <string>
 #include <cstring>
+#include <stdint.h>
+
+#define MAX_DISPATCH_PLUGINS 32 /**< Plugins above this count receive every packet and cannot finish inspection of a flow. */
 
 /**
  * \brief Base class for flow caches.
@@ -64,7 +68,29 @@ protected:
 private:
    std::vector<FlowCachePlugin *> plugins; /**< Array of plugins. */
 
+   /*
+    * Plugin dispatch tables. Bit i of each mask stands for plugins[i].
+    */
+   uint32_t all_mask; /**< Plugins interested in all packets. */
+   uint32_t proto_mask[2]; /**< Plugins interested in all TCP (0) or UDP (1) packets. */
+   std::vector<uint32_t> port_mask[2]; /**< Plugins interested in TCP (0) or UDP (1) port, allocated on demand. */
+   uint32_t sig_mask[2][256]; /**< Plugins with a TCP (0) or UDP (1) payload signature starting with given byte. */
+   std::vector<std::vector<std::string> > signatures; /**< Payload signatures of each plugin. */
+
 public:
+   FlowCache() : exporter(NULL), all_mask(0)
+   {
+      proto_mask[0] = proto_mask[1] = 0;
+      memset(sig_mask, 0, sizeof(sig_mask));
+   }
+
+   /**
+    * \brief Virtual destructor.
+    */
+   virtual ~FlowCache()
+   {
+   }
+
    /**
     * \brief Put packet into the cache (i.e. update corresponding flow record or create a new one)
     * \param [in] pkt Input parsed packet.
@@ -99,29 +125,112 @@ public:
    }
 
    /**
-    * \brief Add plugin to internal list of plugins.
+    * \brief Add plugin to internal list of plugins and register its interest in dispatch tables.
     * Plugins are always called in the same order, as they were added.
     */
    void add_plugin(FlowCachePlugin *plugin)
    {
+      unsigned int idx = plugins.size();
+      plugin_interest interest = plugin->get_interest();
+
       plugins.push_back(plugin);
+      signatures.push_back(interest.signatures);
+      if (idx >= MAX_DISPATCH_PLUGINS) {
+         return; // Plugin is called for every packet.
+      }
+
+      uint32_t bit = 0x1U << idx;
+      if (interest.all) {
+         all_mask |= bit;
+         return;
+      }
+      for (int proto = 0; proto < 2; proto++) {
+         if (!(interest.protocols & (proto == 0 ? INTEREST_TCP : INTEREST_UDP))) {
+            continue;
+         }
+         if (interest.ports.empty() && interest.signatures.empty()) {
+            proto_mask[proto] |= bit;
+         }
+         if (!interest.ports.empty() && port_mask[proto].empty()) {
+            port_mask[proto].assign(65536, 0);
+         }
+         for (unsigned int i = 0; i < interest.ports.size(); i++) {
+            port_mask[proto][interest.ports[i]] |= bit;
+         }
+         for (unsigned int i = 0; i < interest.signatures.size(); i++) {
+            if (!interest.signatures[i].empty()) {
+               sig_mask[proto][(uint8_t) interest.signatures[i][0]] |= bit;
+            }
+         }
+      }
    }
 
 protected:
    //Every FlowCache implementation should call these functions at appropriate places
 
+   /**
+    * \brief Find plugins interested in packet.
+    * \param [in] pkt Input parsed packet.
+    * \return Bit mask of interested plugins.
+    */
+   uint32_t plugins_mask(const Packet &pkt) const
+   {
+      uint32_t mask = all_mask;
+      int proto;
+      if ((pkt.packetFieldIndicator & PCKT_TCP_MASK) == PCKT_TCP_MASK) {
+         proto = 0;
+      } else if ((pkt.packetFieldIndicator & PCKT_UDP_MASK) == PCKT_UDP_MASK) {
+         proto = 1;
+      } else {
+         return mask;
+      }
+
+      mask |= proto_mask[proto];
+      if (!port_mask[proto].empty()) {
+         mask |= port_mask[proto][pkt.sourceTransportPort] | port_mask[proto][pkt.destinationTransportPort];
+      }
+      if (pkt.transportPayloadPacketSectionSize > 0) {
+         const char *payload = pkt.transportPayloadPacketSection;
+         uint32_t candidates = sig_mask[proto][(uint8_t) payload[0]] & ~mask;
+         while (candidates) {
+            int i = __builtin_ctz(candidates);
+            candidates &= candidates - 1;
+            const std::vector<std::string> &sigs = signatures[i];
+            for (unsigned int j = 0; j < sigs.size(); j++) {
+               if (sigs[j].size() <= pkt.transportPayloadPacketSectionSize &&
+                   !memcmp(payload, sigs[j].data(), sigs[j].size())) {
+                  mask |= 0x1U << i;
+                  break;
+               }
+            }
+         }
+      }
+      return mask;
+   }
+
+   /**
+    * \brief Check whether any plugin wants to see packet.
+    * \param [in] pkt Input parsed packet.
+    * \return True when packet must reach plugins (admission policy may not aggregate it).
+    */
+   bool plugins_interested(const Packet &pkt) const
+   {
+      return plugins.size() > MAX_DISPATCH_PLUGINS || plugins_mask(pkt) != 0;
+   }
+
    /**
     * \brief Initialize added plugins.
     */
    void plugins_init()
    {
       for (unsigned int i = 0; i < plugins.size(); i++) {
+         plugins[i]->set_exporter(exporter);
          plugins[i]->init();
       }
    }
 
    /**
-    * \brief Call post_create function for each added plugin.
+    * \brief Call post_create function for each interested plugin which has not finished inspection of the flow.
     * \param [in,out] rec Stored flow record.
     * \param [in] pkt Input parsed packet.
     * \return Options for flow cache.
@@ -129,17 +238,24 @@ protected:
    int plugins_post_create(FlowRecord &rec, const Packet &pkt)
    {
       int retval = 0;
-      for (unsigned int i = 0; i < plugins.size(); i++) {
+      uint32_t mask = plugins_mask(pkt) & ~rec.pluginsDone;
+      while (mask) {
+         int i = __builtin_ctz(mask);
+         mask &= mask - 1;
          int tmp = plugins[i]->post_create(rec, pkt);
-         if (tmp != 0) {
-            retval |= tmp;
+         if (tmp & FLOW_PLUGIN_DONE) {
+            rec.pluginsDone |= 0x1U << i;
          }
+         retval |= tmp;
+      }
+      for (unsigned int i = MAX_DISPATCH_PLUGINS; i < plugins.size(); i++) {
+         retval |= plugins[i]->post_create(rec, pkt);
       }
       return retval;
    }
 
    /**
-    * \brief Call pre_update function for each added plugin.
+    * \brief Call pre_update function for each interested plugin which has not finished inspection of the flow.
     * \param [in,out] rec Stored flow record.
     * \param [in] pkt Input parsed packet.
     * \return Options for flow cache.
@@ -147,28 +263,42 @@ protected:
    int plugins_pre_update(FlowRecord &rec, Packet &pkt)
    {
       int retval = 0;
-      for (unsigned int i = 0; i < plugins.size(); i++) {
+      uint32_t mask = plugins_mask(pkt) & ~rec.pluginsDone;
+      while (mask) {
+         int i = __builtin_ctz(mask);
+         mask &= mask - 1;
          int tmp = plugins[i]->pre_update(rec, pkt);
-         if (tmp != 0) {
-            retval |= tmp;
+         if (tmp & FLOW_PLUGIN_DONE) {
+            rec.pluginsDone |= 0x1U << i;
          }
+         retval |= tmp;
+      }
+      for (unsigned int i = MAX_DISPATCH_PLUGINS; i < plugins.size(); i++) {
+         retval |= plugins[i]->pre_update(rec, pkt);
       }
       return retval;
    }
 
    /**
-    * \brief Call post_update function for each added plugin.
+    * \brief Call post_update function for each interested plugin which has not finished inspection of the flow.
     * \param [in,out] rec Stored flow record.
     * \param [in] pkt Input parsed packet.
     */
    int plugins_post_update(FlowRecord &rec, const Packet &pkt)
    {
       int retval = 0;
-      for (unsigned int i = 0; i < plugins.size(); i++) {
+      uint32_t mask = plugins_mask(pkt) & ~rec.pluginsDone;
+      while (mask) {
+         int i = __builtin_ctz(mask);
+         mask &= mask - 1;
          int tmp = plugins[i]->post_update(rec, pkt);
-         if (tmp != 0) {
-            retval |= tmp;
+         if (tmp & FLOW_PLUGIN_DONE) {
+            rec.pluginsDone |= 0x1U << i;
          }
+         retval |= tmp;
+      }
+      for (unsigned int i = MAX_DISPATCH_PLUGINS; i < plugins.size(); i++) {
+         retval |= plugins[i]->post_update(rec, pkt);
       }
       return retval;
    }
@@ -184,6 +314,50 @@ protected:
       }
    }
 
+   /**
+    * \brief Call export_expired function for each added plugin.
+    * \param [in] now Timestamp of the last packet.
+    */
+   void plugins_export_expired(double now)
+   {
+      for (unsigned int i = 0; i < plugins.size(); i++) {
+         plugins[i]->export_expired(now);
+      }
+   }
+
+   /**
+    * \brief Create extension of given type by the plugin owning it.
+    * \param [in] ext_type Type of extension.
+    * \return New extension or NULL if no active plugin owns the type.
+    */
+   FlowRecordExt *plugins_create_ext(uint16_t ext_type)
+   {
+      for (unsigned int i = 0; i < plugins.size(); i++) {
+         FlowRecordExt *ext = plugins[i]->create_ext(ext_type);
+         if (ext != NULL) {
+            return ext;
+         }
+      }
+      return NULL;
+   }
+
+   /**
+    * \brief Get string identifying set and order of active plugins.
+    * \return Comma separated names of extensions of active plugins.
+    */
+   std::string plugins_signature()
+   {
+      std::string signature;
+      for (unsigned int i = 0; i < plugins.size(); i++) {
+         const std::vector<plugin_opt> &opts = plugins[i]->get_options();
+         for (unsigned int j = 0; j < opts.size(); j++) {
+            signature += opts[j].ext_name + ",";
+         }
+         signature += ";";
+      }
+      return signature;
+   }
+
    /**
     * \brief Call finish function for each added plugin.
     */
@@ -50,6 +50,7 @@
 
 #include "packet.h"
 #include "flowifc.h"
+#include "flowexporter.h"
 #include <vector>
 
 /**
@@ -59,8 +60,38 @@
  */
 #define FLOW_FLUSH   (0x1 << 0)
 
+/**
+ * \brief Tell FlowCache that plugin finished inspection of current flow.
+ * Plugin is not called from post_create, pre_update and post_update for further packets of the flow
+ * (until the flow record is exported). Can be returned from any of these functions.
+ */
+#define FLOW_PLUGIN_DONE (0x1 << 1)
+
+#define INTEREST_TCP (0x1 << 0) /**< Plugin wants TCP packets. */
+#define INTEREST_UDP (0x1 << 1) /**< Plugin wants UDP packets. */
+
 using namespace std;
 
+/**
+ * \brief Struct describing packets a plugin wants to receive in post_create, pre_update and post_update.
+ * Plugin with interest in all packets is called for every packet. Otherwise it is called only for packets
+ * of given transport protocols with given source or destination port or with payload starting with
+ * one of given signatures. When no ports and no signatures are given, all packets of the protocols are passed.
+ */
+struct plugin_interest {
+   bool all; /**< Plugin wants every packet. */
+   uint8_t protocols; /**< INTEREST_TCP and/or INTEREST_UDP. */
+   vector<uint16_t> ports; /**< Source or destination ports. */
+   vector<string> signatures; /**< Leading payload bytes. */
+
+   plugin_interest() : all(true), protocols(0)
+   {
+   }
+   plugin_interest(uint8_t protocols) : all(false), protocols(protocols)
+   {
+   }
+};
+
 /**
  * \brief Struct containing options for extension headers.
  */
@@ -99,6 +130,24 @@ public:
    {
    }
 
+   /**
+    * \brief Set exporter which plugin may use to export its own records (called before init).
+    * \param [in] exp Flow exporter.
+    */
+   virtual void set_exporter(FlowExporter *exp)
+   {
+   }
+
+   /**
+    * \brief Create empty extension of given type, used when flows are restored from checkpoint.
+    * \param [in] ext_type Type of extension.
+    * \return New extension or NULL if the type does not belong to plugin.
+    */
+   virtual FlowRecordExt *create_ext(uint16_t ext_type)
+   {
+      return NULL;
+   }
+
    /**
     * \brief Called before the start of processing.
     */
@@ -110,7 +159,7 @@ public:
     * \brief Called after a new flow record is created.
     * \param [in,out] rec Reference to flow record.
     * \param [in] pkt Parsed packet.
-    * \return 0 on success or FLOW_FLUSH option.
+    * \return 0 on success, FLOW_FLUSH and/or FLOW_PLUGIN_DONE option.
     */
    virtual int post_create(FlowRecord &rec, const Packet &pkt)
    {
@@ -121,7 +170,7 @@ public:
     * \brief Called before an existing record is update.
     * \param [in,out] rec Reference to flow record.
     * \param [in,out] pkt Parsed packet.
-    * \return 0 on success or FLOW_FLUSH option.
+    * \return 0 on success, FLOW_FLUSH and/or FLOW_PLUGIN_DONE option.
     */
    virtual int pre_update(FlowRecord &rec, Packet &pkt)
    {
@@ -132,7 +181,7 @@ public:
     * \brief Called after an existing record is updated.
     * \param [in,out] rec Reference to flow record.
     * \param [in,out] pkt Parsed packet.
-    * \return 0 on success or FLOW_FLUSH option.
+    * \return 0 on success, FLOW_FLUSH and/or FLOW_PLUGIN_DONE option.
     */
    virtual int post_update(FlowRecord &rec, const Packet &pkt)
    {
@@ -147,6 +196,15 @@ public:
    {
    }
 
+   /**
+    * \brief Called periodically when flow cache exports expired flows.
+    * Plugin may export its own records which timed out, even when it receives no packets.
+    * \param [in] now Timestamp of the last packet.
+    */
+   virtual void export_expired(double now)
+   {
+   }
+
    /**
     * \brief Called when everything is processed.
     */
@@ -154,6 +212,27 @@ public:
    {
    }
 
+   /**
+    * \brief Get description of packets the plugin wants to receive.
+    * Flow cache dispatches packets only to interested plugins. Default is all packets.
+    * \return Plugin interest.
+    */
+   virtual plugin_interest get_interest() const
+   {
+      return plugin_interest();
+   }
+
+   /**
+    * \brief Get number of transport payload bytes the plugin needs to inspect.
+    * Packet parser copies only as much payload as the most demanding active plugin needs
+    * and skips payload entirely when no plugin needs it.
+    * \return PAYLOAD_NONE, PAYLOAD_FULL or number of leading payload bytes.
+    */
+   virtual int get_payload_depth() const
+   {
+      return PAYLOAD_FULL;
+   }
+
    /**
     * \brief Get unirec template string from plugin.
     * \return Unirec template string.
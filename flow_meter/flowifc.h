@@ -50,6 +50,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unirec/unirec.h>
 
 // Values of field presence indicator flags (flowFieldIndicator)
@@ -123,7 +124,56 @@ enum extTypeEnum {
    http_request = 0,
    http_response,
    dns,
-   sip
+   sip,
+   tunnel,
+   tls,
+   sip_dialog,
+   pstats
+};
+
+/**
+ * \brief Buffer used to store flow records into checkpoint and to restore them back.
+ *
+ * The same code path serializes and deserializes data, direction is given by restore flag.
+ */
+struct checkpoint_buffer {
+   uint8_t *data; /**< Buffer. */
+   uint64_t size; /**< Size of the buffer. */
+   uint64_t pos; /**< Current position in the buffer. */
+   bool restore; /**< Read data from buffer instead of writing them. */
+   bool ok; /**< False when buffer overflowed. */
+
+   checkpoint_buffer(uint8_t *data, uint64_t size, bool restore) : data(data), size(size), pos(0), restore(restore), ok(true)
+   {
+   }
+
+   /**
+    * \brief Store or restore block of memory.
+    * \param [in,out] value Pointer to the memory.
+    * \param [in] len Length of the memory.
+    */
+   void bytes(void *value, uint64_t len)
+   {
+      if (!ok || len > size - pos) {
+         ok = false;
+         return;
+      }
+      if (restore) {
+         memcpy(value, data + pos, len);
+      } else {
+         memcpy(data + pos, value, len);
+      }
+      pos += len;
+   }
+
+   /**
+    * \brief Store or restore a variable (integer or fixed size array).
+    * \param [in,out] value Variable.
+    */
+   template<typename T> void field(T &value)
+   {
+      bytes(&value, sizeof(value));
+   }
 };
 
 /**
@@ -150,6 +200,16 @@ struct FlowRecordExt {
    {
    }
 
+   /**
+    * \brief Store extension data into checkpoint or restore them from it.
+    * \param [in,out] buf Checkpoint buffer.
+    * \return False if extension does not support checkpointing.
+    */
+   virtual bool checkpoint(checkpoint_buffer &buf)
+   {
+      return false;
+   }
+
    /**
     * \brief Virtual destructor.
     */
@@ -181,6 +241,9 @@ struct FlowRecord {
    uint32_t packetTotalCount;
    uint64_t octetTotalLength;
    uint8_t  tcpControlBits;
+   uint64_t linkBitField; /**< Bits of capture sources the flow was seen on. */
+   uint8_t  dirBitField; /**< Direction bits of capture sources the flow was seen on. */
+   uint32_t pluginsDone; /**< Bit i is set when i-th plugin finished inspection of the flow. */
    FlowRecordExt *exts; /**< Extension headers. */
 
    /**
@@ -219,6 +282,33 @@ struct FlowRecord {
       return NULL;
    }
 
+   /**
+    * \brief Store basic flow data into checkpoint or restore them from it (extensions are not included).
+    * \param [in,out] buf Checkpoint buffer.
+    */
+   void checkpoint(checkpoint_buffer &buf)
+   {
+      buf.field(flowFieldIndicator);
+      buf.field(flowStartTimestamp);
+      buf.field(flowEndTimestamp);
+      buf.field(ipVersion);
+      buf.field(protocolIdentifier);
+      buf.field(ipClassOfService);
+      buf.field(ipTtl);
+      buf.field(sourceIPv4Address);
+      buf.field(destinationIPv4Address);
+      buf.field(sourceIPv6Address);
+      buf.field(destinationIPv6Address);
+      buf.field(sourceTransportPort);
+      buf.field(destinationTransportPort);
+      buf.field(packetTotalCount);
+      buf.field(octetTotalLength);
+      buf.field(tcpControlBits);
+      buf.field(linkBitField);
+      buf.field(dirBitField);
+      buf.field(pluginsDone);
+   }
+
    /**
     * \brief Remove extension headers.
     */
@@ -233,7 +323,7 @@ struct FlowRecord {
    /**
     * \brief Constructor.
     */
-   FlowRecord() : exts(NULL)
+   FlowRecord() : linkBitField(0), dirBitField(0), pluginsDone(0), exts(NULL)
    {
    }
 
@@ -156,6 +156,23 @@ void HTTPPlugin::finish()
    }
 }
 
+plugin_interest HTTPPlugin::get_interest() const
+{
+   plugin_interest interest(INTEREST_TCP);
+   interest.ports.push_back(80);
+   return interest;
+}
+
+FlowRecordExt *HTTPPlugin::create_ext(uint16_t ext_type)
+{
+   if (ext_type == http_request) {
+      return new FlowRecordExtHTTPReq();
+   } else if (ext_type == http_response) {
+      return new FlowRecordExtHTTPResp();
+   }
+   return NULL;
+}
+
 std::string HTTPPlugin::get_unirec_field_string()
 {
    return HTTP_UNIREC_TEMPLATE;
@@ -387,7 +404,7 @@ bool HTTPPlugin::valid_http_method(const char *method) const
  * \param [in] data Packet payload data.
  * \param [in] payload_len Length of packet payload.
  * \param [out] rec Flow record where to store created extension header.
- * \return 0 on success.
+ * \return 0 on success or FLOW_PLUGIN_DONE when the rest of the flow is not HTTP.
  */
 int HTTPPlugin::add_ext_http_request(const char *data, int payload_len, FlowRecord &rec)
 {
@@ -396,6 +413,9 @@ int HTTPPlugin::add_ext_http_request(const char *data, int payload_len, FlowReco
       delete req;
    } else {
       rec.addExtension(req);
+      if (strcmp(req->httpReqMethod, "CONNECT") == 0) {
+         return FLOW_PLUGIN_DONE; // Rest of the flow is tunneled, not HTTP.
+      }
    }
 
    return 0;
@@ -406,7 +426,7 @@ int HTTPPlugin::add_ext_http_request(const char *data, int payload_len, FlowReco
  * \param [in] data Packet payload data.
  * \param [in] payload_len Length of packet payload.
  * \param [out] rec Flow record where to store created extension header.
- * \return 0 on success.
+ * \return 0 on success or FLOW_PLUGIN_DONE when the rest of the flow is not HTTP.
  */
 int HTTPPlugin::add_ext_http_response(const char *data, int payload_len, FlowRecord &rec)
 {
@@ -415,6 +435,9 @@ int HTTPPlugin::add_ext_http_response(const char *data, int payload_len, FlowRec
       delete resp;
    } else {
       rec.addExtension(resp);
+      if (resp->httpRespCode == 101) {
+         return FLOW_PLUGIN_DONE; // Switching protocols, rest of the flow is not HTTP.
+      }
    }
 
    return 0;
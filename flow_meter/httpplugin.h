@@ -86,6 +86,16 @@ struct FlowRecordExtHTTPReq : FlowRecordExt {
       ur_set_string(tmplt, record, F_HTTP_USER_AGENT, httpReqUserAgent);
       ur_set_string(tmplt, record, F_HTTP_REFERER, httpReqReferer);
    }
+
+   virtual bool checkpoint(checkpoint_buffer &buf)
+   {
+      buf.field(httpReqMethod);
+      buf.field(httpReqHost);
+      buf.field(httpReqUrl);
+      buf.field(httpReqUserAgent);
+      buf.field(httpReqReferer);
+      return buf.ok;
+   }
 };
 
 /**
@@ -109,6 +119,13 @@ struct FlowRecordExtHTTPResp : FlowRecordExt {
       ur_set(tmplt, record, F_HTTP_RESPONSE_CODE, httpRespCode);
       ur_set_string(tmplt, record, F_HTTP_CONTENT_TYPE, httpRespContentType);
    }
+
+   virtual bool checkpoint(checkpoint_buffer &buf)
+   {
+      buf.field(httpRespCode);
+      buf.field(httpRespContentType);
+      return buf.ok;
+   }
 };
 
 /**
@@ -123,6 +140,8 @@ public:
    int pre_update(FlowRecord &rec, Packet &pkt);
    void finish();
    std::string get_unirec_field_string();
+   plugin_interest get_interest() const;
+   FlowRecordExt *create_ext(uint16_t ext_type);
 
 private:
    bool parse_http_request(const char *data, int payload_len, FlowRecordExtHTTPReq *rec, bool create);
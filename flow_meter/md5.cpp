@@ -0,0 +1,146 @@
+/**
+ * \file md5.cpp
+ * \brief MD5 message digest (RFC 1321) used for fingerprint hashes.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <string.h>
+
+#include "md5.h"
+
+#define MD5_ROTL(x, c) (((x) << (c)) | ((x) >> (32 - (c))))
+
+/**
+ * \brief Per-round shift amounts.
+ */
+static const uint8_t md5_shift[64] = {
+   7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+   5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+   4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+   6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+/**
+ * \brief Per-round constants, floor(abs(sin(i + 1)) * 2^32).
+ */
+static const uint32_t md5_const[64] = {
+   0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+   0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+   0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+   0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+   0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+   0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+   0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+   0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+/**
+ * \brief Process one 64 byte block.
+ * \param [in,out] state Digest state.
+ * \param [in] block Input block.
+ */
+static void md5_block(uint32_t *state, const uint8_t *block)
+{
+   uint32_t w[16];
+   for (int i = 0; i < 16; i++) {
+      w[i] = block[i * 4] | (block[i * 4 + 1] << 8) | (block[i * 4 + 2] << 16) | ((uint32_t) block[i * 4 + 3] << 24);
+   }
+
+   uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+   for (int i = 0; i < 64; i++) {
+      uint32_t f;
+      int g;
+      if (i < 16) {
+         f = (b & c) | (~b & d);
+         g = i;
+      } else if (i < 32) {
+         f = (d & b) | (~d & c);
+         g = (5 * i + 1) % 16;
+      } else if (i < 48) {
+         f = b ^ c ^ d;
+         g = (3 * i + 5) % 16;
+      } else {
+         f = c ^ (b | ~d);
+         g = (7 * i) % 16;
+      }
+      uint32_t tmp = d;
+      d = c;
+      c = b;
+      b = b + MD5_ROTL(a + f + md5_const[i] + w[g], md5_shift[i]);
+      a = tmp;
+   }
+
+   state[0] += a;
+   state[1] += b;
+   state[2] += c;
+   state[3] += d;
+}
+
+void md5(const void *data, size_t len, uint8_t *digest)
+{
+   uint32_t state[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+   const uint8_t *ptr = (const uint8_t *) data;
+   size_t left = len;
+
+   for (; left >= 64; left -= 64, ptr += 64) {
+      md5_block(state, ptr);
+   }
+
+   // Padding: 0x80, zeros and message length in bits.
+   uint8_t tail[128];
+   memset(tail, 0, sizeof(tail));
+   memcpy(tail, ptr, left);
+   tail[left] = 0x80;
+   size_t tail_len = (left < 56 ? 64 : 128);
+   uint64_t bits = (uint64_t) len * 8;
+   for (int i = 0; i < 8; i++) {
+      tail[tail_len - 8 + i] = (uint8_t) (bits >> (8 * i));
+   }
+   md5_block(state, tail);
+   if (tail_len == 128) {
+      md5_block(state, tail + 64);
+   }
+
+   for (int i = 0; i < 4; i++) {
+      digest[i * 4] = (uint8_t) state[i];
+      digest[i * 4 + 1] = (uint8_t) (state[i] >> 8);
+      digest[i * 4 + 2] = (uint8_t) (state[i] >> 16);
+      digest[i * 4 + 3] = (uint8_t) (state[i] >> 24);
+   }
+}
@@ -47,8 +47,16 @@
 #include "flowcache.h"
 
 #include <cstdlib>
+#include <cstdio>
 #include <iostream>
+#include <iomanip>
 #include <locale>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
@@ -56,7 +64,8 @@ inline bool Flow::isexpired(double current_ts)
 {
    if (!isempty() &&
       (current_ts - flowrecord.flowStartTimestamp > active ||
-         current_ts - flowrecord.flowEndTimestamp > inactive)) {
+         current_ts - flowrecord.flowEndTimestamp > inactive ||
+         ((flowrecord.tcpControlBits & TCP_FIN) && current_ts - flowrecord.flowEndTimestamp > TCP_FIN_TIMEOUT))) {
       return true;
    } else {
       return false;
@@ -90,6 +99,9 @@ void Flow::create(Packet pkt, uint64_t pkt_hash, char *pkt_key, uint8_t key_len)
       flowrecord.flowFieldIndicator |= FLW_HASH;
    }
 
+   flowrecord.linkBitField = pkt.linkBitField;
+   flowrecord.dirBitField = pkt.dirBitField;
+
    if ((pkt.packetFieldIndicator & PCKT_PCAP_MASK) == PCKT_PCAP_MASK) {
       flowrecord.flowStartTimestamp = pkt.timestamp;
       flowrecord.flowEndTimestamp = pkt.timestamp;
@@ -134,6 +146,8 @@ void Flow::create(Packet pkt, uint64_t pkt_hash, char *pkt_key, uint8_t key_len)
 void Flow::update(Packet pkt)
 {
    flowrecord.packetTotalCount += 1;
+   flowrecord.linkBitField |= pkt.linkBitField;
+   flowrecord.dirBitField |= pkt.dirBitField;
    if ((pkt.packetFieldIndicator & PCKT_PCAP_MASK) == PCKT_PCAP_MASK) {
       flowrecord.flowEndTimestamp = pkt.timestamp;
    }
@@ -156,10 +170,16 @@ void NHTFlowCache::init()
    parsereplacementstring();
    insertpos = rpl[0];
    rpl.assign(rpl.begin() + 1, rpl.end());
+   insertpos = admission->insert_position(insertpos, linesize);
+   admission->set_exporter(exporter);
 }
 
 void NHTFlowCache::finish()
 {
+   rehash_finish();
+   if (!statsout) {
+      print_report(cout); // Before the cache is emptied, so that occupancy is meaningful.
+   }
    plugins_finish();
    exportexpired(true); // export whole cache
    if (!statsout) {
@@ -175,11 +195,15 @@ int NHTFlowCache::put_pkt(Packet &pkt)
       pkt.destinationTransportPort = 0;
    }
 
+   if (rehash_size != 0) {
+      rehash_step(REHASH_LINES_PER_PACKET);
+   }
+
    createhashkey(pkt); // saves key value and key length into attributes NHTFlowCache::key and NHTFlowCache::key_len
    uint64_t hashval = calculatehash(); // calculates hash value from key created before
 
 // Find place for packet
-   int lineindex = ((hashval % size) / linesize) * linesize;
+   int lineindex = line_index(hashval);
 
    bool found = false;
    int flowindex = 0;
@@ -216,11 +240,26 @@ int NHTFlowCache::put_pkt(Packet &pkt)
       if (!found) {
          flowindex = lineindex + linesize - 1;
 
+         if (!plugins_interested(pkt) && !admission->admit(pkt, hashval, flowarray[flowindex]->flowrecord)) {
+            // Packet was accounted by admission policy.
+            rejected++;
+            currtimestamp = pkt.timestamp;
+            periodic_tasks();
+            return 0;
+         }
+
          // Export flow
+         if (pkt.timestamp - flowarray[flowindex]->flowrecord.flowEndTimestamp < inactivetimeout) {
+            premature++;
+            window_premature++;
+         }
          plugins_pre_export(flowarray[flowindex]->flowrecord);
-         exporter->export_flow(flowarray[flowindex]->flowrecord);
+         if (!admission->absorb(flowarray[flowindex]->flowrecord)) {
+            exporter->export_flow(flowarray[flowindex]->flowrecord);
+         }
 
          expired++;
+         evicted++;
          int flowindexstart = lineindex + insertpos;
          Flow *ptrflow = flowarray[flowindex];
          ptrflow->erase();
@@ -237,7 +276,27 @@ int NHTFlowCache::put_pkt(Packet &pkt)
 
    int ret = 0;
    currtimestamp = pkt.timestamp;
+   if (!flowarray[flowindex]->isempty() && (pkt.packetFieldIndicator & PCKT_TCP_MASK) == PCKT_TCP_MASK) {
+      FlowRecord &rec = flowarray[flowindex]->flowrecord;
+      // Sweep of expired flows runs every 5 s, so finished flow is checked also when its key is seen again.
+      bool finished = (rec.tcpControlBits & TCP_FIN) && pkt.timestamp - rec.flowEndTimestamp > TCP_FIN_TIMEOUT;
+      // New connection reuses ports of a finished one.
+      bool reuse = synreuse && (pkt.tcpControlBits & TCP_SYN) && (rec.tcpControlBits & (TCP_FIN | TCP_RST));
+
+      if (finished || reuse) {
+         // Packet starts a new flow in the same slot.
+         plugins_pre_export(rec);
+         exporter->export_flow(rec);
+         if (reuse) {
+            reused++;
+         } else {
+            expired++;
+         }
+         flowarray[flowindex]->erase();
+      }
+   }
    if (flowarray[flowindex]->isempty()) {
+      window_created++;
       flowarray[flowindex]->create(pkt, hashval, key, key_len);
       ret = plugins_post_create(flowarray[flowindex]->flowrecord, pkt);
 
@@ -269,6 +328,27 @@ int NHTFlowCache::put_pkt(Packet &pkt)
       }
    }
 
+   if ((pkt.packetFieldIndicator & PCKT_TCP_MASK) == PCKT_TCP_MASK && (pkt.tcpControlBits & TCP_RST) &&
+       !flowarray[flowindex]->isempty()) {
+      // Connection was reset, no more packets are expected.
+      plugins_pre_export(flowarray[flowindex]->flowrecord);
+      exporter->export_flow(flowarray[flowindex]->flowrecord);
+      terminated++;
+      flowarray[flowindex]->erase();
+   }
+
+   periodic_tasks();
+
+   return 0;
+}
+
+// NHTFlowCache -- PROTECTED **************************************************
+
+/**
+ * \brief Check order of timestamps, export expired flows and print statistics.
+ */
+void NHTFlowCache::periodic_tasks()
+{
    if (currtimestamp < lasttimestamp) {
       static bool warning_printed = false;
       if (!warning_printed) {
@@ -280,13 +360,17 @@ int NHTFlowCache::put_pkt(Packet &pkt)
    if (currtimestamp - lasttimestamp > 5.0) {
       exportexpired(false); // false -- export only expired flows
       lasttimestamp = currtimestamp;
+      check_resize();
    }
 
-   return 0;
+   if (statsout && currtimestamp - lastreport >= statstime) {
+      if (lastreport != 0) {
+         print_report(cout);
+      }
+      lastreport = currtimestamp;
+   }
 }
 
-// NHTFlowCache -- PROTECTED **************************************************
-
 void NHTFlowCache::parsereplacementstring()
 {
    size_t searchpos = 0;
@@ -304,7 +388,16 @@ long NHTFlowCache::calculatehash()
 {
    locale loc;
    const collate<char> &coll = use_facet<collate<char> >(loc);
-   return coll.hash(key, key + key_len);
+   uint64_t hash = coll.hash(key, key + key_len);
+
+   // Low bits of collate hash depend mostly on the last bytes of the key (ports). Mix all bits into
+   // them, otherwise flows differing only in addresses (e.g. random-source flood) share few lines.
+   hash ^= hash >> 33;
+   hash *= 0xff51afd7ed558ccdULL;
+   hash ^= hash >> 33;
+   hash *= 0xc4ceb9fe1a85ec53ULL;
+   hash ^= hash >> 33;
+   return hash;
 }
 
 void NHTFlowCache::createhashkey(Packet pkt)
@@ -322,7 +415,6 @@ void NHTFlowCache::createhashkey(Packet pkt)
       k += sizeof(pkt.sourceTransportPort);
       *(uint16_t *) k = pkt.destinationTransportPort;
       k += sizeof(pkt.destinationTransportPort);
-      *k = '\0';
       key_len = 13;
    }
 
@@ -340,16 +432,29 @@ void NHTFlowCache::createhashkey(Packet pkt)
       k += sizeof(pkt.sourceTransportPort);
       *(uint16_t *) k = pkt.destinationTransportPort;
       k += sizeof(pkt.destinationTransportPort);
-      *k = '\0';
       key_len = 36;
    }
+
+   if (pkt.packetFieldIndicator & PCKT_TUNNEL) {
+      // Flows of different tunnels may carry overlapping inner addresses.
+      *(uint8_t *) k = pkt.tunnelType;
+      k += sizeof(pkt.tunnelType);
+      *(uint32_t *) k = pkt.tunnelId;
+      k += sizeof(pkt.tunnelId);
+      key_len += sizeof(pkt.tunnelType) + sizeof(pkt.tunnelId);
+   }
+   *k = '\0';
 }
 
 int NHTFlowCache::exportexpired(bool exportall)
 {
    int exported = 0;
    bool result = false;
-   for (int i = 0; i < size; i++) {
+   int records = (rehash_size != 0 ? rehash_size : size);
+   for (int i = 0; i < records; i++) {
+      if (flowarray[i] == NULL) {
+         continue; // Line of grown table which is not migrated yet.
+      }
       if (exportall && !flowarray[i]->isempty()) {
          result = true;
       }
@@ -366,6 +471,10 @@ int NHTFlowCache::exportexpired(bool exportall)
          result = false;
       }
    }
+   admission->export_expired(currtimestamp, exportall);
+   if (!exportall) {
+      plugins_export_expired(currtimestamp);
+   }
    return exported;
 }
 
@@ -378,6 +487,413 @@ void NHTFlowCache::endreport()
    cout << "Not empty: " << notempty << endl;
    cout << "Expired: " << expired << endl;
    cout << "Flushed: " << flushed << endl;
+   cout << "Not admitted: " << rejected << endl;
+   cout << "Terminated by RST: " << terminated << endl;
+   cout << "Flushed by SYN reuse: " << reused << endl;
    cout << "Average Lookup:  " << a << endl;
    cout << "Variance Lookup: " << float(lookups2) / hits - a * a << endl;
+   admission->report(cout);
+}
+
+/**
+ * \brief Print eviction statistics and histogram of line occupancy.
+ * \param [in] out Output stream.
+ */
+void NHTFlowCache::print_report(ostream &out) const
+{
+   vector<long> histogram(linesize + 1, 0);
+   int records = (rehash_size != 0 ? rehash_size : size);
+   for (int line = 0; line < records; line += linesize) {
+      if (flowarray[line] == NULL) {
+         continue;
+      }
+      int used = 0;
+      for (int i = line; i < line + linesize; i++) {
+         if (!flowarray[i]->isempty()) {
+            used++;
+         }
+      }
+      histogram[used]++;
+   }
+
+   // Format of timestamp is restored, the stream is shared with other reports
+   ios::fmtflags flags = out.flags();
+   streamsize precision = out.precision();
+   out << "# cache " << fixed << setprecision(3) << currtimestamp << " size " << records << " evicted " << evicted <<
+      " premature " << premature << " resizes " << resizes << " occupancy";
+   out.flags(flags);
+   out.precision(precision);
+   for (int i = 0; i <= linesize; i++) {
+      out << " " << histogram[i];
+   }
+   out << endl;
+}
+
+/**
+ * \brief Get index of the first record of the line where flow with given hash belongs.
+ * \param [in] hashval Hash of the flow.
+ * \return Index into flowarray.
+ */
+int NHTFlowCache::line_index(uint64_t hashval) const
+{
+   int lineindex = ((hashval % size) / linesize) * linesize;
+   if (rehash_size != 0 && lineindex < rehash_pos) {
+      // Line was already migrated into the grown table.
+      lineindex = ((hashval % rehash_size) / linesize) * linesize;
+   }
+   return lineindex;
+}
+
+/**
+ * \brief Start growing the cache when too many active flows were evicted from full lines since last check.
+ */
+void NHTFlowCache::check_resize()
+{
+   if (maxsize >= size * 2 && rehash_size == 0 && window_created > 0 &&
+       window_premature > window_created * GROW_PREMATURE_RATIO) {
+      rehash_start();
+   }
+   window_created = 0;
+   window_premature = 0;
+}
+
+/**
+ * \brief Double the table. Lines are migrated incrementally by rehash_step().
+ *
+ * Line L of the original table splits into lines L and L + size / linesize of the doubled table. The
+ * original lines keep their position, so records of not yet migrated lines are found at the same index.
+ */
+void NHTFlowCache::rehash_start()
+{
+   Flow **grown = new Flow*[size * 2];
+   memcpy(grown, flowarray, size * sizeof(Flow *));
+   memset(grown + size, 0, size * sizeof(Flow *));
+   delete [] flowarray;
+
+   flowarray = grown;
+   rehash_size = size * 2;
+   rehash_pos = 0;
+   resizes++;
+}
+
+/**
+ * \brief Migrate lines into the grown table.
+ * \param [in] lines Number of lines to migrate.
+ */
+void NHTFlowCache::rehash_step(int lines)
+{
+   vector<Flow *> line(linesize);
+
+   for (int n = 0; n < lines && rehash_pos < size; n++) {
+      int low = rehash_pos;
+      int high = rehash_pos + size;
+      int lowpos = low;
+      int highpos = high;
+
+      for (int i = 0; i < linesize; i++) {
+         line[i] = flowarray[low + i];
+      }
+      // Non-empty flows keep their order so that the replacement policy is preserved.
+      for (int i = 0; i < linesize; i++) {
+         if (!line[i]->isempty()) {
+            if (((line[i]->gethash() % rehash_size) / linesize) * linesize == (uint64_t) low) {
+               flowarray[lowpos++] = line[i];
+            } else {
+               flowarray[highpos++] = line[i];
+            }
+         }
+      }
+      for (int i = 0; i < linesize; i++) {
+         if (line[i]->isempty()) {
+            if (lowpos < low + linesize) {
+               flowarray[lowpos++] = line[i];
+            } else {
+               flowarray[highpos++] = line[i];
+            }
+         }
+      }
+      while (lowpos < low + linesize) {
+         flowarray[lowpos++] = new Flow(inactivetimeout, activetimeout);
+      }
+      while (highpos < high + linesize) {
+         flowarray[highpos++] = new Flow(inactivetimeout, activetimeout);
+      }
+
+      rehash_pos += linesize;
+   }
+
+   if (rehash_pos >= size) {
+      size = rehash_size;
+      rehash_size = 0;
+      rehash_pos = 0;
+   }
+}
+
+/**
+ * \brief Migrate all remaining lines into the grown table.
+ */
+void NHTFlowCache::rehash_finish()
+{
+   if (rehash_size != 0) {
+      rehash_step(size / linesize);
+   }
+}
+
+// NHTFlowCache -- CHECKPOINT *************************************************
+
+/*
+ * Checkpoint file format (host byte order):
+ *   char     magic[8]            CHECKPOINT_MAGIC
+ *   uint32   version             CHECKPOINT_VERSION
+ *   uint32   signature length
+ *   char     signature[]         Extensions of active plugins, see FlowCache::plugins_signature()
+ *   uint64   number of flows
+ *   flows:
+ *     Flow::checkpoint()         Hash, key and basic flow data
+ *     uint16   number of extensions
+ *     extensions:
+ *       uint16   extension type
+ *       uint32   length of data
+ *       data                     FlowRecordExt::checkpoint()
+ */
+
+/**
+ * \brief Save whole flow cache into file. Saved flows are removed from the cache without export.
+ * \param [in] file Path to checkpoint file.
+ * \return Number of saved flows, -1 on error (cache is left untouched).
+ */
+int NHTFlowCache::save_checkpoint(const string &file)
+{
+   rehash_finish();
+
+   string tmpfile = file + ".tmp";
+   FILE *f = fopen(tmpfile.c_str(), "wb");
+   if (f == NULL) {
+      return -1;
+   }
+
+   char *iobuffer = new char[CHECKPOINT_IO_BUFFER];
+   uint8_t *buffer = new uint8_t[CHECKPOINT_FLOW_MAX];
+   setvbuf(f, iobuffer, _IOFBF, CHECKPOINT_IO_BUFFER);
+
+   uint64_t flows = 0;
+   for (int i = 0; i < size; i++) {
+      if (!flowarray[i]->isempty()) {
+         flows++;
+      }
+   }
+
+   char magic[8] = CHECKPOINT_MAGIC;
+   uint32_t version = CHECKPOINT_VERSION;
+   string signature = plugins_signature();
+   uint32_t signature_len = signature.size();
+
+   bool ok = fwrite(magic, sizeof(magic), 1, f) == 1 &&
+      fwrite(&version, sizeof(version), 1, f) == 1 &&
+      fwrite(&signature_len, sizeof(signature_len), 1, f) == 1 &&
+      fwrite(signature.data(), 1, signature_len, f) == signature_len &&
+      fwrite(&flows, sizeof(flows), 1, f) == 1;
+
+   for (int i = 0; i < size && ok; i++) {
+      if (flowarray[i]->isempty()) {
+         continue;
+      }
+      int len = save_flow(flowarray[i], buffer);
+      ok = fwrite(buffer, 1, len, f) == (size_t) len;
+   }
+
+   ok = (fclose(f) == 0) && ok;
+   delete [] buffer;
+   delete [] iobuffer;
+
+   if (!ok || rename(tmpfile.c_str(), file.c_str()) != 0) {
+      unlink(tmpfile.c_str());
+      return -1;
+   }
+
+   for (int i = 0; i < size; i++) {
+      flowarray[i]->erase();
+   }
+   return flows;
+}
+
+/**
+ * \brief Serialize one flow with its extensions.
+ * \param [in] flow Flow to serialize.
+ * \param [out] buffer Buffer of CHECKPOINT_FLOW_MAX bytes.
+ * \return Length of serialized flow.
+ */
+int NHTFlowCache::save_flow(Flow *flow, uint8_t *buffer)
+{
+   checkpoint_buffer buf(buffer, CHECKPOINT_FLOW_MAX, false);
+   flow->checkpoint(buf);
+
+   uint16_t ext_cnt = 0;
+   uint64_t ext_cnt_pos = buf.pos;
+   buf.field(ext_cnt);
+
+   for (FlowRecordExt *ext = flow->flowrecord.exts; ext != NULL; ext = ext->next) {
+      uint64_t ext_pos = buf.pos;
+      uint16_t type = ext->extType;
+      uint32_t len = 0;
+
+      buf.field(type);
+      buf.field(len);
+      if (!ext->checkpoint(buf) || !buf.ok) {
+         // Extension does not support checkpointing or does not fit, skip it.
+         buf.pos = ext_pos;
+         buf.ok = true;
+         continue;
+      }
+      len = buf.pos - ext_pos - sizeof(type) - sizeof(len);
+      memcpy(buffer + ext_pos + sizeof(type), &len, sizeof(len));
+      ext_cnt++;
+   }
+   memcpy(buffer + ext_cnt_pos, &ext_cnt, sizeof(ext_cnt));
+
+   return buf.pos;
+}
+
+/**
+ * \brief Find free position for a flow with given hash, export a flow if the line is full.
+ * \param [in] hashval Hash of the flow.
+ * \return Index into flowarray.
+ */
+int NHTFlowCache::find_free(uint64_t hashval)
+{
+   int lineindex = line_index(hashval);
+
+   for (int flowindex = lineindex; flowindex < lineindex + linesize; flowindex++) {
+      if (flowarray[flowindex]->isempty()) {
+         return flowindex;
+      }
+   }
+
+   int flowindex = lineindex + linesize - 1;
+   plugins_pre_export(flowarray[flowindex]->flowrecord);
+   if (!admission->absorb(flowarray[flowindex]->flowrecord)) {
+      exporter->export_flow(flowarray[flowindex]->flowrecord);
+   }
+   flowarray[flowindex]->erase();
+   expired++;
+
+   return flowindex;
+}
+
+/**
+ * \brief Check that flows of checkpoint are complete, so that nothing is restored from a damaged file.
+ * \param [in] buf Checkpoint buffer positioned at the first flow (a copy is read).
+ * \param [in] flows Number of flows.
+ * \return True when all flows and their extensions are within the file and nothing follows them.
+ */
+static bool checkpoint_flows_valid(checkpoint_buffer buf, uint64_t flows)
+{
+   Flow flow(0, 0);
+
+   for (uint64_t i = 0; i < flows && buf.ok; i++) {
+      flow.checkpoint(buf);
+
+      uint16_t ext_cnt = 0;
+      buf.field(ext_cnt);
+      for (int j = 0; j < ext_cnt && buf.ok; j++) {
+         uint16_t type;
+         uint32_t len;
+         buf.field(type);
+         buf.field(len);
+         if (!buf.ok || len > buf.size - buf.pos) {
+            return false;
+         }
+         buf.pos += len;
+      }
+   }
+   return buf.ok && buf.pos == buf.size;
+}
+
+/**
+ * \brief Restore flows from checkpoint file created by save_checkpoint() and remove the file.
+ * Damaged file is left in place and nothing is restored from it.
+ * \param [in] file Path to checkpoint file.
+ * \return Number of restored flows, 0 if there is no checkpoint, -1 on error.
+ */
+int NHTFlowCache::load_checkpoint(const string &file)
+{
+   int fd = open(file.c_str(), O_RDONLY);
+   if (fd < 0) {
+      return 0;
+   }
+
+   struct stat st;
+   if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return -1;
+   }
+
+   void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (data == MAP_FAILED) {
+      return -1;
+   }
+   madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+   checkpoint_buffer buf((uint8_t *) data, st.st_size, true);
+   char magic[8];
+   uint32_t version = 0;
+   uint32_t signature_len = 0;
+   uint64_t flows = 0;
+   int restored = 0;
+
+   buf.field(magic);
+   buf.field(version);
+   buf.field(signature_len);
+   if (!buf.ok || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 || version != CHECKPOINT_VERSION ||
+       signature_len > buf.size - buf.pos) {
+      munmap(data, st.st_size);
+      return -1;
+   }
+
+   // Plugin done bits are valid only with the same set of plugins.
+   bool same_plugins = string((char *) buf.data + buf.pos, signature_len) == plugins_signature();
+   buf.pos += signature_len;
+   buf.field(flows);
+   if (!buf.ok || !checkpoint_flows_valid(buf, flows)) {
+      munmap(data, st.st_size);
+      return -1;
+   }
+
+   for (uint64_t i = 0; i < flows; i++) {
+      uint64_t hashval;
+      memcpy(&hashval, buf.data + buf.pos, sizeof(hashval));
+
+      Flow *flow = flowarray[find_free(hashval)];
+      flow->checkpoint(buf);
+      if (!same_plugins) {
+         flow->flowrecord.pluginsDone = 0;
+      }
+
+      uint16_t ext_cnt = 0;
+      buf.field(ext_cnt);
+      for (int j = 0; j < ext_cnt; j++) {
+         uint16_t type;
+         uint32_t len;
+         buf.field(type);
+         buf.field(len);
+
+         FlowRecordExt *ext = plugins_create_ext(type);
+         if (ext != NULL) {
+            checkpoint_buffer extbuf(buf.data + buf.pos, len, true);
+            if (ext->checkpoint(extbuf) && extbuf.ok) {
+               flow->flowrecord.addExtension(ext);
+            } else {
+               delete ext;
+            }
+         }
+         buf.pos += len;
+      }
+      restored++;
+   }
+
+   munmap(data, st.st_size);
+   unlink(file.c_str());
+
+   return restored;
 }
@@ -50,10 +50,21 @@
 #include "flowcache.h"
 #include "flowifc.h"
 #include "flowexporter.h"
+#include "admission.h"
 #include <string>
 
 #define MAX_KEYLENGTH 76
 
+#define TCP_FIN_TIMEOUT           5.0    /**< Inactive timeout of TCP flows which carried FIN. */
+
+#define REHASH_LINES_PER_PACKET   2      /**< Number of lines migrated into grown table per packet. */
+#define GROW_PREMATURE_RATIO      0.01   /**< Grow cache when this fraction of new flows evicts an active flow. */
+
+#define CHECKPOINT_MAGIC      "FMCACHE"   /**< Identification of flow cache checkpoint file. */
+#define CHECKPOINT_VERSION    3           /**< Version of checkpoint format, increment on every change. */
+#define CHECKPOINT_FLOW_MAX   16384       /**< Maximal size of one serialized flow including extensions. */
+#define CHECKPOINT_IO_BUFFER  (4 << 20)   /**< Size of write buffer of checkpoint file. */
+
 class Flow
 {
    uint64_t hash;
@@ -81,6 +92,7 @@ public:
       flowrecord.octetTotalLength = 0;
       flowrecord.packetTotalCount = 0;
       flowrecord.tcpControlBits = 0;
+      flowrecord.pluginsDone = 0;
       flowrecord.removeExtensions();
 
       empty_flow = true;
@@ -96,6 +108,25 @@ public:
    {
    };
 
+   /**
+    * \brief Store flow key and basic data into checkpoint or restore them from it.
+    * \param [in,out] buf Checkpoint buffer.
+    */
+   void checkpoint(checkpoint_buffer &buf)
+   {
+      buf.field(hash);
+      buf.field(key);
+      flowrecord.checkpoint(buf);
+      if (buf.restore) {
+         empty_flow = false;
+      }
+   }
+
+   uint64_t gethash() const
+   {
+      return hash;
+   }
+
    bool isempty();
    inline bool isexpired(double current_ts);
    bool belongs(uint64_t pkt_hash, char *pkt_key, uint8_t key_len);
@@ -121,10 +152,27 @@ class NHTFlowCache : public FlowCache
    long hits;
    long expired;
    long flushed;
+   long rejected;          /**< Packets of new flows not admitted into full lines. */
+   long terminated;        /**< TCP flows exported on RST. */
+   long reused;            /**< Finished TCP flows exported because of new SYN (port reuse). */
+   bool synreuse;          /**< Start a new flow when SYN arrives on a finished TCP flow. */
    long lookups;
    long lookups2;
+   long evicted;           /**< Flows evicted from full lines. */
+   long premature;         /**< Evicted flows which had a packet within inactive timeout. */
+   long window_created;    /**< Flows created since last resize check. */
+   long window_premature;  /**< Premature evictions since last resize check. */
+   long resizes;
+   int maxsize;            /**< Cache may grow up to this number of records, 0 disables growing. */
+   int rehash_size;        /**< Size of the grown table during incremental rehash, 0 otherwise. */
+   int rehash_pos;         /**< First record of the first line not yet migrated into grown table. */
+   double inactivetimeout;
+   double activetimeout;
+   double statstime;
+   double lastreport;
    double currtimestamp;
    double lasttimestamp;
+   AdmissionPolicy *admission; /**< Decides which new flows may evict flows from full lines. */
    char key[MAX_KEYLENGTH];
    std::string policy;
    replacementvector_t rpl;
@@ -140,11 +188,31 @@ public:
       this->hits = 0;
       this->expired = 0;
       this->flushed = 0;
+      this->rejected = 0;
+      this->terminated = 0;
+      this->reused = 0;
+      this->synreuse = options.synreuse;
       this->size = options.flowcachesize;
       this->lookups = 0;
       this->lookups2 = 0;
       this->policy = options.replacementstring;
       this->statsout = options.statsout;
+      this->evicted = 0;
+      this->premature = 0;
+      this->window_created = 0;
+      this->window_premature = 0;
+      this->resizes = 0;
+      this->maxsize = options.flowcachemaxsize;
+      this->rehash_size = 0;
+      this->rehash_pos = 0;
+      this->inactivetimeout = options.inactivetimeout;
+      this->activetimeout = options.activetimeout;
+      this->statstime = options.statstime;
+      this->lastreport = 0;
+      this->admission = create_admission_policy(options.admission, options.inactivetimeout, options.activetimeout);
+      if (this->admission == NULL) {
+         this->admission = new AdmissionPolicy();
+      }
 
       flowarray = new Flow*[size];
       for (int i = 0; i < size; i++) {
@@ -153,11 +221,14 @@ public:
    };
    ~NHTFlowCache()
    {
-      for (int i = 0; i < size; i++) {
+      int records = (rehash_size != 0 ? rehash_size : size);
+      for (int i = 0; i < records; i++) {
          delete flowarray[i];
       }
       delete [] flowarray;
 
+      delete admission;
+
       while (!flowexportqueue.empty()) {
          delete flowexportqueue.back();
          flowexportqueue.pop_back();
@@ -169,6 +240,9 @@ public:
    virtual void init();
    virtual void finish();
 
+   int save_checkpoint(const std::string &file);
+   int load_checkpoint(const std::string &file);
+
 protected:
    void parsereplacementstring();
    void createhashkey(Packet pkt);
@@ -176,6 +250,15 @@ protected:
    int flushflows();
    int exportexpired(bool exportall);
    void endreport();
+   int save_flow(Flow *flow, uint8_t *buffer);
+   int find_free(uint64_t hashval);
+   int line_index(uint64_t hashval) const;
+   void periodic_tasks();
+   void check_resize();
+   void rehash_start();
+   void rehash_step(int lines);
+   void rehash_finish();
+   void print_report(std::ostream &out) const;
 };
 
 #endif
@@ -51,6 +51,10 @@
 
 #define MAXPCKTSIZE 1600
 
+// Payload depth needed by plugins (other values give number of leading payload bytes)
+#define PAYLOAD_NONE 0   // Headers only, payload is not copied.
+#define PAYLOAD_FULL -1  // Whole captured payload.
+
 // Values of field presence indicator flags (packetFieldIndicator)
 // (Names of the fields are inspired by IPFIX specification)
 #define PCKT_PACKETFIELDINDICATOR               (0x1 << 0)
@@ -71,6 +75,9 @@
 #define PCKT_TCPCONTROLBITS                     (0x1 << 15)
 #define PCKT_TRANSPORTPAYLOADPACKETSECTIONSIZE  (0x1 << 16)
 #define PCKT_TRANSPORTPAYLOADPACKETSECTION      (0x1 << 17)
+#define PCKT_VLANID                             (0x1 << 18)
+#define PCKT_MPLSTOPLABEL                       (0x1 << 19)
+#define PCKT_TUNNEL                             (0x1 << 20)
 
 // Some common sets of flags
 #define PCKT_PCAP_MASK (PCKT_TIMESTAMP) // Bit 0
@@ -113,6 +120,19 @@
    PCKT_TRANSPORTPAYLOADPACKETSECTION \
 )
 
+#define PCKT_ENCAP_MASK  (\
+   PCKT_VLANID | \
+   PCKT_MPLSTOPLABEL | \
+   PCKT_TUNNEL \
+)
+
+// Tunnel types (tunnelType)
+#define TUNNEL_NONE    0
+#define TUNNEL_GRE     1
+#define TUNNEL_VXLAN   2
+#define TUNNEL_GTPU    3
+#define TUNNEL_IPIP    4
+
 // TCP flags
 #define TCP_FIN    0x01
 #define TCP_SYN    0x02
@@ -142,6 +162,14 @@ struct Packet {
    uint16_t    destinationTransportPort;
    uint8_t     tcpControlBits;
 
+   uint16_t    vlanId; /**< Outermost VLAN ID. */
+   uint32_t    mplsTopLabel; /**< Outermost MPLS label. */
+   uint8_t     tunnelType; /**< Type of outermost decapsulated tunnel. */
+   uint32_t    tunnelId; /**< GRE key, VXLAN VNI or GTP-U TEID of outermost tunnel. */
+
+   uint64_t    linkBitField; /**< Bit of the capture source the packet was received from. */
+   uint8_t     dirBitField; /**< Direction bits of the capture source. */
+
    uint16_t    packetTotalLength;
    char        *packet; /**< Array containing whole packet. */
    uint16_t    transportPayloadPacketSectionSize;
@@ -150,7 +178,7 @@ struct Packet {
    /**
     * \brief Constructor.
     */
-   Packet() : packet(NULL), transportPayloadPacketSection(NULL)
+   Packet() : linkBitField(0), dirBitField(0), packet(NULL), transportPayloadPacketSection(NULL)
    {
    }
 };
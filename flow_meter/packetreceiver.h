@@ -57,6 +57,13 @@ class PacketReceiver
 public:
    std::string errmsg; /**< String to store an error messages. */
 
+   /**
+    * \brief Destructor.
+    */
+   virtual ~PacketReceiver()
+   {
+   }
+
    /**
     * \brief Get packet from network interface or file.
     * \param [out] packet Variable for storing parsed packet.
@@ -44,9 +44,14 @@
  */
 
 #include "pcapreader.h"
+#include <cerrno>
 #include <cstdio>
 #include <cstring>
 #include <pcap/pcap.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
 
 #include <arpa/inet.h>
 #include <netinet/ether.h>
@@ -99,207 +104,642 @@ static uint32_t s_total_pkts = 0;
 bool packet_valid = false;
 
 /**
- * \brief Parsing callback function for pcap_dispatch() call. Parse packets up to tranport layer.
- * \param [in,out] arg Serves for passing pointer into callback function.
- * \param [in] h Contains timestamp and packet size.
- * \param [in] data Pointer to the captured packet data.
+ * \brief Key flows of tunneled traffic on outer headers instead of decapsulating them.
  */
-void packet_handler(u_char *arg, const struct pcap_pkthdr *h, const u_char *data)
+static bool tunnel_outer_key = false;
+
+/**
+ * \brief Number of payload bytes needed by active plugins (PAYLOAD_FULL for whole payload).
+ */
+static int payload_depth = PAYLOAD_FULL;
+
+#ifndef ETH_P_8021AD
+#define ETH_P_8021AD    0x88A8
+#endif
+#ifndef ETH_P_QINQ1
+#define ETH_P_QINQ1     0x9100
+#endif
+#ifndef ETH_P_MPLS_UC
+#define ETH_P_MPLS_UC   0x8847
+#endif
+#ifndef ETH_P_MPLS_MC
+#define ETH_P_MPLS_MC   0x8848
+#endif
+#ifndef ETH_P_TEB
+#define ETH_P_TEB       0x6558
+#endif
+
+#define VXLAN_PORT      4789
+#define GTPU_PORT       2152
+
+#define MAX_ENCAP_DEPTH 16 /**< Maximal number of stacked headers processed before the packet is dropped. */
+
+/*
+ * Layer identifiers used by the decapsulation engine. Link layer protocols are
+ * identified by ethertype, transport protocols by IP protocol number moved above
+ * the ethertype space.
+ */
+#define LAYER_ETHERTYPE(type) ((uint32_t) (type))
+#define LAYER_IPPROTO(proto)  (0x10000 | (uint32_t) (proto))
+#define LAYER_PAYLOAD         0x20000 /**< Headers are parsed, payload follows. */
+#define LAYER_INVALID         0x20001 /**< Packet cannot be parsed. */
+
+/**
+ * \brief State of packet parser shared by layer parsers.
+ */
+struct parser_state {
+   Packet *pkt;               /**< Packet being filled. */
+   const u_char *ptr;         /**< Beginning of data which are not parsed yet. */
+   const u_char *end;         /**< End of captured data. */
+   int payload_len;           /**< Length of data behind ptr according to the last IP header. */
+
+   bool saved;                /**< Outer headers of a tunnel are stored in saved_pkt. */
+   Packet saved_pkt;          /**< Packet parsed up to the outermost tunnel, used when inner headers are malformed. */
+   const u_char *saved_ptr;   /**< Beginning of the outermost tunnel header. */
+   int saved_payload_len;     /**< Payload length belonging to saved_ptr. */
+};
+
+/**
+ * \brief Layer parser. Parse header at st.ptr, move st.ptr behind it and return identifier of the next layer.
+ */
+typedef uint32_t (*layer_parser_t)(parser_state &st);
+
+/**
+ * \brief Store tunnel information and decide whether the inner headers should be parsed.
+ * \param [in,out] st Parser state.
+ * \param [in] type Tunnel type.
+ * \param [in] id Tunnel identifier.
+ * \return True if the parser should continue with inner headers.
+ */
+inline bool enter_tunnel(parser_state &st, uint8_t type, uint32_t id)
 {
-   Packet &pkt = *(Packet *)arg;
-   const u_char *data_ptr = data;
-   struct ethhdr *eth = (struct ethhdr *)data_ptr;
-   uint8_t transport_proto = 0;
-   uint16_t payload_len = 0;
+   Packet &pkt = *st.pkt;
 
-   DEBUG_MSG("---------- packet parser  #%u -------------\n", ++s_total_pkts);
-   DEBUG_MSG("Time:\t\t\t%ld.%ld\n",      h->ts.tv_sec, h->ts.tv_usec);
-   DEBUG_MSG("Packet length:\t\tcaplen=%uB len=%uB\n\n", h->caplen, h->len);
+   DEBUG_MSG("Tunnel:\n");
+   DEBUG_MSG("\tType:\t\t%u\n",        type);
+   DEBUG_MSG("\tID:\t\t%u\n",          id);
+
+   if (!(pkt.packetFieldIndicator & PCKT_TUNNEL)) {
+      pkt.tunnelType = type;
+      pkt.tunnelId = id;
+      pkt.packetFieldIndicator |= PCKT_TUNNEL;
+   }
+   if (tunnel_outer_key) {
+      return false;
+   }
+   if (!st.saved) {
+      st.saved = true;
+      st.saved_pkt = pkt;
+      st.saved_ptr = st.ptr;
+      st.saved_payload_len = st.payload_len;
+   }
+   return true;
+}
+
+/**
+ * \brief Parse ethernet header.
+ */
+uint32_t parse_eth(parser_state &st)
+{
+   if (st.ptr + sizeof(struct ethhdr) > st.end) {
+      return LAYER_INVALID;
+   }
+   struct ethhdr *eth = (struct ethhdr *)st.ptr;
 
    DEBUG_MSG("Ethernet header:\n");
    DEBUG_MSG("\tDest mac:\t%s\n",         ether_ntoa((struct ether_addr *)eth->h_dest));
    DEBUG_MSG("\tSrc mac:\t%s\n",          ether_ntoa((struct ether_addr *)eth->h_source));
+   DEBUG_MSG("\tEthertype:\t%#06x\n",     ntohs(eth->h_proto));
+
+   st.ptr += sizeof(struct ethhdr);
+   return LAYER_ETHERTYPE(ntohs(eth->h_proto));
+}
+
+/**
+ * \brief Parse 802.1Q or 802.1ad tag.
+ */
+uint32_t parse_vlan(parser_state &st)
+{
+   if (st.ptr + 4 > st.end) {
+      return LAYER_INVALID;
+   }
+   Packet &pkt = *st.pkt;
+   uint16_t vlan = ntohs(*(uint16_t *)st.ptr);
+   uint16_t ethertype = ntohs(*(uint16_t *)(st.ptr + 2));
 
-   uint16_t ethertype = ntohs(eth->h_proto);
+   DEBUG_MSG("\t802.1Q field:\n");
+   DEBUG_MSG("\t\tPriority:\t%u\n",    ((vlan & 0xE000) >> 12));
+   DEBUG_MSG("\t\tCFI:\t\t%u\n",       ((vlan & 0x1000) >> 11));
+   DEBUG_MSG("\t\tVLAN:\t\t%u\n",      (vlan & 0x0FFF));
+   DEBUG_MSG("\t\tEthertype:\t%#06x\n",ethertype);
 
-   DEBUG_MSG("\tEthertype:\t%#06x\n",     ethertype);
+   if (!(pkt.packetFieldIndicator & PCKT_VLANID)) {
+      pkt.vlanId = vlan & 0x0FFF;
+      pkt.packetFieldIndicator |= PCKT_VLANID;
+   }
 
-   if (ethertype == ETH_P_8021Q) {
-      DEBUG_CODE(uint16_t vlan = ntohs(*(unsigned uint32_t *)(data_ptr + 14)));
-      DEBUG_MSG("\t802.1Q field:\n");
-      DEBUG_MSG("\t\tPriority:\t%u\n",    ((vlan & 0xE000) >> 12));
-      DEBUG_MSG("\t\tCFI:\t\t%u\n",       ((vlan & 0x1000) >> 11));
-      DEBUG_MSG("\t\tVLAN:\t\t%u\n",      (vlan & 0x0FFF));
+   st.ptr += 4;
+   return LAYER_ETHERTYPE(ethertype);
+}
 
-      data_ptr += 18;
-      ethertype = ntohs(*(uint16_t *)&data_ptr[-2]);
-      DEBUG_MSG("\t\tEthertype:\t%#06x\n",     ethertype);
-   } else {
-      data_ptr += 14;
+/**
+ * \brief Parse MPLS label stack.
+ */
+uint32_t parse_mpls(parser_state &st)
+{
+   Packet &pkt = *st.pkt;
+   uint32_t entry;
+
+   do {
+      if (st.ptr + 4 > st.end) {
+         return LAYER_INVALID;
+      }
+      entry = ntohl(*(uint32_t *)st.ptr);
+      st.ptr += 4;
+
+      DEBUG_MSG("MPLS label:\t%u\n",      entry >> 12);
+
+      if (!(pkt.packetFieldIndicator & PCKT_MPLSTOPLABEL)) {
+         pkt.mplsTopLabel = entry >> 12;
+         pkt.packetFieldIndicator |= PCKT_MPLSTOPLABEL;
+      }
+   } while (!(entry & 0x100)); // Bottom of stack bit.
+
+   if (st.ptr >= st.end) {
+      return LAYER_INVALID;
    }
 
-   pkt.packetFieldIndicator = PCKT_TIMESTAMP;
-   pkt.timestamp = h->ts.tv_sec + h->ts.tv_usec / 1000000.0;
+   // MPLS does not carry type of the encapsulated protocol, guess it from the first nibble.
+   switch (*st.ptr >> 4) {
+   case 4:
+      return LAYER_ETHERTYPE(ETH_P_IP);
+   case 6:
+      return LAYER_ETHERTYPE(ETH_P_IPV6);
+   case 0:
+      st.ptr += 4; // Skip pseudowire control word, ethernet frame follows.
+      return LAYER_ETHERTYPE(ETH_P_TEB);
+   default:
+      return LAYER_INVALID;
+   }
+}
 
-   if (ethertype == ETH_P_IP) {
-      struct iphdr *ip = (struct iphdr *)data_ptr;
-
-      pkt.ipVersion = ip->version;
-      pkt.protocolIdentifier = ip->protocol;
-      pkt.ipClassOfService = ip->tos;
-      pkt.ipLength = ntohs(ip->tot_len);
-      pkt.ipTtl = ip->ttl;
-      pkt.sourceIPv4Address = ntohl(ip->saddr);
-      pkt.destinationIPv4Address = ntohl(ip->daddr);
-      pkt.packetFieldIndicator |= PCKT_IPV4_MASK;
-
-      transport_proto = ip->protocol;
-      payload_len = ntohs(ip->tot_len) - ip->ihl * 4;
-      data_ptr += ip->ihl * 4;
-
-      DEBUG_MSG("IPv4 header:\n");
-      DEBUG_MSG("\tHDR version:\t%u\n",   ip->version);
-      DEBUG_MSG("\tHDR length:\t%u\n",    ip->ihl);
-      DEBUG_MSG("\tTOS:\t\t%u\n",         ip->tos);
-      DEBUG_MSG("\tTotal length:\t%u\n",  ntohs(ip->tot_len));
-      DEBUG_MSG("\tID:\t\t%#x\n",         ntohs(ip->id));
-      DEBUG_MSG("\tFlags:\t\t%#x\n",      ((ntohs(ip->frag_off) & 0xE000) >> 13));
-      DEBUG_MSG("\tFrag off:\t%#x\n",     (ntohs(ip->frag_off) & 0x1FFF));
-      DEBUG_MSG("\tTTL:\t\t%u\n",         ip->ttl);
-      DEBUG_MSG("\tProtocol:\t%u\n",      ip->protocol);
-      DEBUG_MSG("\tChecksum:\t%#06x\n",   ntohs(ip->check));
-      DEBUG_MSG("\tSrc addr:\t%s\n",      inet_ntoa(*(struct in_addr *)(&ip->saddr)));
-      DEBUG_MSG("\tDest addr:\t%s\n",     inet_ntoa(*(struct in_addr *)(&ip->daddr)));
-
-   } else if (ethertype == ETH_P_IPV6) {
-      struct ip6_hdr *ip6 = (struct ip6_hdr *)data_ptr;
-
-      pkt.ipVersion = (ntohl(ip6->ip6_ctlun.ip6_un1.ip6_un1_flow) & 0xf0000000) >> 28;
-      pkt.ipClassOfService = (ntohl(ip6->ip6_ctlun.ip6_un1.ip6_un1_flow) & 0x0ff00000) >> 20;
-      pkt.protocolIdentifier = ip6->ip6_ctlun.ip6_un1.ip6_un1_nxt;
-      pkt.ipLength = ntohs(ip6->ip6_ctlun.ip6_un1.ip6_un1_plen);
-      memcpy(pkt.sourceIPv6Address, (const char *)&ip6->ip6_src, 16);
-      memcpy(pkt.destinationIPv6Address, (const char *)&ip6->ip6_dst, 16);
-      pkt.packetFieldIndicator |= PCKT_IPV6_MASK;
-
-      swapbytes128(pkt.sourceIPv6Address);
-      swapbytes128(pkt.destinationIPv6Address);
-
-      transport_proto = ip6->ip6_ctlun.ip6_un1.ip6_un1_nxt;
-      payload_len = ntohs(ip6->ip6_ctlun.ip6_un1.ip6_un1_plen);   //TODO: IPv6 Extension header
-      data_ptr += 40;
-
-      DEBUG_CODE(char buffer[INET6_ADDRSTRLEN]);
-      DEBUG_MSG("IPv6 header:\n");
-      DEBUG_MSG("\tVersion:\t%u\n",       (ntohl(ip6->ip6_ctlun.ip6_un1.ip6_un1_flow) & 0xf0000000) >> 28);
-      DEBUG_MSG("\tClass:\t\t%u\n",       (ntohl(ip6->ip6_ctlun.ip6_un1.ip6_un1_flow) & 0x0ff00000) >> 20);
-      DEBUG_MSG("\tFlow:\t\t%#x\n",       (ntohl(ip6->ip6_ctlun.ip6_un1.ip6_un1_flow) & 0x000fffff));
-      DEBUG_MSG("\tLength:\t\t%u\n",      ntohs(ip6->ip6_ctlun.ip6_un1.ip6_un1_plen));
-      DEBUG_MSG("\tProtocol:\t%u\n",      ip6->ip6_ctlun.ip6_un1.ip6_un1_nxt);
-      DEBUG_MSG("\tHop limit:\t%u\n",     ip6->ip6_ctlun.ip6_un1.ip6_un1_hlim);
-
-      DEBUG_CODE(inet_ntop(AF_INET6, (const void *)&ip6->ip6_src, buffer, INET6_ADDRSTRLEN));
-      DEBUG_MSG("\tSrc addr:\t%s\n",      buffer);
-      DEBUG_CODE(inet_ntop(AF_INET6, (const void *)&ip6->ip6_dst, buffer, INET6_ADDRSTRLEN));
-      DEBUG_MSG("\tDest addr:\t%s\n",     buffer);
+/**
+ * \brief Parse IPv4 header.
+ */
+uint32_t parse_ipv4(parser_state &st)
+{
+   if (st.ptr + sizeof(struct iphdr) > st.end) {
+      return LAYER_INVALID;
+   }
+   Packet &pkt = *st.pkt;
+   struct iphdr *ip = (struct iphdr *)st.ptr;
+
+   if (ip->ihl < 5 || st.ptr + ip->ihl * 4 > st.end) {
+      return LAYER_INVALID;
+   }
+
+   pkt.packetFieldIndicator &= ~(PCKT_IPV4_MASK | PCKT_IPV6_MASK | PCKT_TCP_MASK | PCKT_UDP_MASK);
+   pkt.sourceTransportPort = 0;
+   pkt.destinationTransportPort = 0;
+   pkt.ipVersion = ip->version;
+   pkt.protocolIdentifier = ip->protocol;
+   pkt.ipClassOfService = ip->tos;
+   pkt.ipLength = ntohs(ip->tot_len);
+   pkt.ipTtl = ip->ttl;
+   pkt.sourceIPv4Address = ntohl(ip->saddr);
+   pkt.destinationIPv4Address = ntohl(ip->daddr);
+   pkt.packetFieldIndicator |= PCKT_IPV4_MASK;
+
+   st.payload_len = ntohs(ip->tot_len) - ip->ihl * 4;
+   st.ptr += ip->ihl * 4;
+
+   DEBUG_MSG("IPv4 header:\n");
+   DEBUG_MSG("\tHDR version:\t%u\n",   ip->version);
+   DEBUG_MSG("\tHDR length:\t%u\n",    ip->ihl);
+   DEBUG_MSG("\tTOS:\t\t%u\n",         ip->tos);
+   DEBUG_MSG("\tTotal length:\t%u\n",  ntohs(ip->tot_len));
+   DEBUG_MSG("\tID:\t\t%#x\n",         ntohs(ip->id));
+   DEBUG_MSG("\tFlags:\t\t%#x\n",      ((ntohs(ip->frag_off) & 0xE000) >> 13));
+   DEBUG_MSG("\tFrag off:\t%#x\n",     (ntohs(ip->frag_off) & 0x1FFF));
+   DEBUG_MSG("\tTTL:\t\t%u\n",         ip->ttl);
+   DEBUG_MSG("\tProtocol:\t%u\n",      ip->protocol);
+   DEBUG_MSG("\tChecksum:\t%#06x\n",   ntohs(ip->check));
+   DEBUG_MSG("\tSrc addr:\t%s\n",      inet_ntoa(*(struct in_addr *)(&ip->saddr)));
+   DEBUG_MSG("\tDest addr:\t%s\n",     inet_ntoa(*(struct in_addr *)(&ip->daddr)));
+
+   return LAYER_IPPROTO(ip->protocol);
+}
+
+/**
+ * \brief Parse IPv6 header.
+ */
+uint32_t parse_ipv6(parser_state &st)
+{
+   if (st.ptr + sizeof(struct ip6_hdr) > st.end) {
+      return LAYER_INVALID;
+   }
+   Packet &pkt = *st.pkt;
+   struct ip6_hdr *ip6 = (struct ip6_hdr *)st.ptr;
+
+   pkt.packetFieldIndicator &= ~(PCKT_IPV4_MASK | PCKT_IPV6_MASK | PCKT_TCP_MASK | PCKT_UDP_MASK);
+   pkt.sourceTransportPort = 0;
+   pkt.destinationTransportPort = 0;
+   pkt.ipVersion = (ntohl(ip6->ip6_ctlun.ip6_un1.ip6_un1_flow) & 0xf0000000) >> 28;
+   pkt.ipClassOfService = (ntohl(ip6->ip6_ctlun.ip6_un1.ip6_un1_flow) & 0x0ff00000) >> 20;
+   pkt.protocolIdentifier = ip6->ip6_ctlun.ip6_un1.ip6_un1_nxt;
+   pkt.ipLength = ntohs(ip6->ip6_ctlun.ip6_un1.ip6_un1_plen);
+   memcpy(pkt.sourceIPv6Address, (const char *)&ip6->ip6_src, 16);
+   memcpy(pkt.destinationIPv6Address, (const char *)&ip6->ip6_dst, 16);
+   pkt.packetFieldIndicator |= PCKT_IPV6_MASK;
+
+   swapbytes128(pkt.sourceIPv6Address);
+   swapbytes128(pkt.destinationIPv6Address);
+
+   st.payload_len = ntohs(ip6->ip6_ctlun.ip6_un1.ip6_un1_plen);   //TODO: IPv6 Extension header
+   st.ptr += 40;
+
+   DEBUG_CODE(char buffer[INET6_ADDRSTRLEN]);
+   DEBUG_MSG("IPv6 header:\n");
+   DEBUG_MSG("\tVersion:\t%u\n",       (ntohl(ip6->ip6_ctlun.ip6_un1.ip6_un1_flow) & 0xf0000000) >> 28);
+   DEBUG_MSG("\tClass:\t\t%u\n",       (ntohl(ip6->ip6_ctlun.ip6_un1.ip6_un1_flow) & 0x0ff00000) >> 20);
+   DEBUG_MSG("\tFlow:\t\t%#x\n",       (ntohl(ip6->ip6_ctlun.ip6_un1.ip6_un1_flow) & 0x000fffff));
+   DEBUG_MSG("\tLength:\t\t%u\n",      ntohs(ip6->ip6_ctlun.ip6_un1.ip6_un1_plen));
+   DEBUG_MSG("\tProtocol:\t%u\n",      ip6->ip6_ctlun.ip6_un1.ip6_un1_nxt);
+   DEBUG_MSG("\tHop limit:\t%u\n",     ip6->ip6_ctlun.ip6_un1.ip6_un1_hlim);
+
+   DEBUG_CODE(inet_ntop(AF_INET6, (const void *)&ip6->ip6_src, buffer, INET6_ADDRSTRLEN));
+   DEBUG_MSG("\tSrc addr:\t%s\n",      buffer);
+   DEBUG_CODE(inet_ntop(AF_INET6, (const void *)&ip6->ip6_dst, buffer, INET6_ADDRSTRLEN));
+   DEBUG_MSG("\tDest addr:\t%s\n",     buffer);
+
+   return LAYER_IPPROTO(ip6->ip6_ctlun.ip6_un1.ip6_un1_nxt);
+}
+
+/**
+ * \brief Parse TCP header.
+ */
+uint32_t parse_tcp(parser_state &st)
+{
+   if (st.ptr + sizeof(struct tcphdr) > st.end) {
+      return LAYER_INVALID;
+   }
+   Packet &pkt = *st.pkt;
+   struct tcphdr *tcp = (struct tcphdr *)st.ptr;
+
+   if (tcp->doff < 5) {
+      return LAYER_INVALID;
+   }
+
+   pkt.sourceTransportPort = ntohs(tcp->source);
+   pkt.destinationTransportPort = ntohs(tcp->dest);
+   pkt.tcpControlBits = 0x0;
+   if (tcp->fin) {
+      pkt.tcpControlBits |= TCP_FIN;
+   }
+   if (tcp->syn) {
+      pkt.tcpControlBits |= TCP_SYN;
+   }
+   if (tcp->rst) {
+      pkt.tcpControlBits |= TCP_RST;
+   }
+   if (tcp->psh) {
+      pkt.tcpControlBits |= TCP_PUSH;
+   }
+   if (tcp->ack) {
+      pkt.tcpControlBits |= TCP_ACK;
+   }
+   if (tcp->urg) {
+      pkt.tcpControlBits |= TCP_URG;
+   }
+   pkt.packetFieldIndicator |= PCKT_TCP_MASK;
+
+   if (st.ptr + tcp->doff * 4 > st.end) {
+      // Options are truncated by snap length, packet has no payload to inspect.
+      st.ptr = st.end;
+      st.payload_len = 0;
    } else {
-      DEBUG_MSG("Packet parser exits: unknown ethernet type: %#06x\n", ethertype);
-      return;
+      st.ptr += tcp->doff * 4;
+      st.payload_len -= tcp->doff * 4;
    }
 
-   if (transport_proto == IPPROTO_TCP) {
-      struct tcphdr *tcp = (struct tcphdr *)data_ptr;
+   DEBUG_MSG("TCP header:\n");
+   DEBUG_MSG("\tSrc port:\t%u\n",   ntohs(tcp->source));
+   DEBUG_MSG("\tDest port:\t%u\n",  ntohs(tcp->dest));
+   DEBUG_MSG("\tSEQ:\t\t%#x\n",     ntohl(tcp->seq));
+   DEBUG_MSG("\tACK SEQ:\t%#x\n",   ntohl(tcp->ack_seq));
+   DEBUG_MSG("\tData offset:\t%u\n",tcp->doff);
+   DEBUG_MSG("\tFlags:\t\t%s%s%s%s%s%s\n", (tcp->fin ? "FIN " : ""), (tcp->syn ? "SYN " : ""), (tcp->rst ? "RST " : ""), (tcp->psh ? "PSH " : ""), (tcp->ack ? "ACK " : ""), (tcp->urg ? "URG" : ""));
+   DEBUG_MSG("\tWindow:\t\t%u\n",   ntohs(tcp->window));
+   DEBUG_MSG("\tChecksum:\t%#06x\n",ntohs(tcp->check));
+   DEBUG_MSG("\tUrg ptr:\t%#x\n",   ntohs(tcp->urg_ptr));
+   DEBUG_MSG("\tReserved1:\t%#x\n", tcp->res1);
+   DEBUG_MSG("\tReserved2:\t%#x\n", tcp->res2);
 
-      pkt.sourceTransportPort = ntohs(tcp->source);
-      pkt.destinationTransportPort = ntohs(tcp->dest);
-      pkt.tcpControlBits = 0x0;
-      if (tcp->fin) {
-         pkt.tcpControlBits |= TCP_FIN;
-      }
-      if (tcp->syn) {
-         pkt.tcpControlBits |= TCP_SYN;
+   return LAYER_PAYLOAD;
+}
+
+/**
+ * \brief Parse VXLAN header.
+ */
+uint32_t parse_vxlan(parser_state &st)
+{
+   if (st.ptr + 8 > st.end || !(st.ptr[0] & 0x08)) { // VNI flag must be set.
+      return LAYER_PAYLOAD;
+   }
+   if (!enter_tunnel(st, TUNNEL_VXLAN, ntohl(*(uint32_t *)(st.ptr + 4)) >> 8)) {
+      return LAYER_PAYLOAD;
+   }
+
+   st.ptr += 8;
+   st.payload_len -= 8;
+   return LAYER_ETHERTYPE(ETH_P_TEB);
+}
+
+/**
+ * \brief Parse GTPv1-U header.
+ */
+uint32_t parse_gtpu(parser_state &st)
+{
+   if (st.ptr + 8 > st.end) {
+      return LAYER_PAYLOAD;
+   }
+   uint8_t flags = st.ptr[0];
+   if ((flags >> 5) != 1 || !(flags & 0x10) || st.ptr[1] != 0xFF) { // Version 1, GTP (not GTP'), G-PDU message.
+      return LAYER_PAYLOAD;
+   }
+   uint32_t teid = ntohl(*(uint32_t *)(st.ptr + 4));
+   const u_char *inner = st.ptr + 8;
+
+   if (flags & 0x07) { // Sequence number, N-PDU number or extension header present.
+      if (inner + 4 > st.end) {
+         return LAYER_PAYLOAD;
       }
-      if (tcp->rst) {
-         pkt.tcpControlBits |= TCP_RST;
+      uint8_t next_ext = inner[3];
+      inner += 4;
+      while (next_ext != 0) {
+         if (inner >= st.end || inner[0] == 0 || inner + inner[0] * 4 > st.end) {
+            return LAYER_PAYLOAD;
+         }
+         next_ext = inner[inner[0] * 4 - 1];
+         inner += inner[0] * 4;
       }
-      if (tcp->psh) {
-         pkt.tcpControlBits |= TCP_PUSH;
+   }
+   if (inner >= st.end || ((*inner >> 4) != 4 && (*inner >> 4) != 6)) {
+      return LAYER_PAYLOAD;
+   }
+   if (!enter_tunnel(st, TUNNEL_GTPU, teid)) {
+      return LAYER_PAYLOAD;
+   }
+
+   st.payload_len -= inner - st.ptr;
+   st.ptr = inner;
+   return LAYER_ETHERTYPE((*inner >> 4) == 4 ? ETH_P_IP : ETH_P_IPV6);
+}
+
+/**
+ * \brief Parse UDP header.
+ */
+uint32_t parse_udp(parser_state &st)
+{
+   if (st.ptr + sizeof(struct udphdr) > st.end) {
+      return LAYER_INVALID;
+   }
+   Packet &pkt = *st.pkt;
+   struct udphdr *udp = (struct udphdr *)st.ptr;
+
+   pkt.sourceTransportPort = ntohs(udp->source);
+   pkt.destinationTransportPort = ntohs(udp->dest);
+   pkt.packetFieldIndicator |= PCKT_UDP_MASK;
+
+   st.ptr += 8;
+   st.payload_len -= 8;
+
+   DEBUG_MSG("UDP header:\n");
+   DEBUG_MSG("\tSrc port:\t%u\n",   ntohs(udp->source));
+   DEBUG_MSG("\tDest port:\t%u\n",  ntohs(udp->dest));
+   DEBUG_MSG("\tLength:\t\t%u\n",   ntohs(udp->len));
+   DEBUG_MSG("\tChecksum:\t%#06x\n",ntohs(udp->check));
+
+   if (pkt.destinationTransportPort == VXLAN_PORT) {
+      return parse_vxlan(st);
+   } else if (pkt.destinationTransportPort == GTPU_PORT || pkt.sourceTransportPort == GTPU_PORT) {
+      return parse_gtpu(st);
+   }
+   return LAYER_PAYLOAD;
+}
+
+/**
+ * \brief Parse GRE header.
+ */
+uint32_t parse_gre(parser_state &st)
+{
+   if (st.ptr + 4 > st.end) {
+      return LAYER_INVALID;
+   }
+   uint16_t flags = ntohs(*(uint16_t *)st.ptr);
+   uint16_t ethertype = ntohs(*(uint16_t *)(st.ptr + 2));
+   uint32_t key = 0;
+   int hdr_len = 4;
+
+   DEBUG_MSG("GRE header:\n");
+   DEBUG_MSG("\tFlags:\t\t%#06x\n",    flags);
+   DEBUG_MSG("\tProtocol:\t%#06x\n",   ethertype);
+
+   if ((flags & 0x0007) != 0) { // Only version 0 carries ethertype (version 1 is PPTP).
+      return LAYER_PAYLOAD;
+   }
+   if (flags & 0x8000) { // Checksum present.
+      hdr_len += 4;
+   }
+   if (flags & 0x2000) { // Key present.
+      if (st.ptr + hdr_len + 4 > st.end) {
+         return LAYER_INVALID;
       }
-      if (tcp->ack) {
-         pkt.tcpControlBits |= TCP_ACK;
+      key = ntohl(*(uint32_t *)(st.ptr + hdr_len));
+      hdr_len += 4;
+   }
+   if (flags & 0x1000) { // Sequence number present.
+      hdr_len += 4;
+   }
+   if (!enter_tunnel(st, TUNNEL_GRE, key)) {
+      return LAYER_PAYLOAD;
+   }
+
+   st.ptr += hdr_len;
+   st.payload_len -= hdr_len;
+   return LAYER_ETHERTYPE(ethertype);
+}
+
+/**
+ * \brief Continue with IP header encapsulated directly in IP.
+ */
+uint32_t parse_ipip(parser_state &st)
+{
+   uint8_t proto = st.pkt->protocolIdentifier;
+   if (!enter_tunnel(st, TUNNEL_IPIP, 0)) {
+      return LAYER_PAYLOAD;
+   }
+   return LAYER_ETHERTYPE(proto == IPPROTO_IPIP ? ETH_P_IP : ETH_P_IPV6);
+}
+
+/**
+ * \brief Parse ICMP header (debug output only).
+ */
+uint32_t parse_icmp(parser_state &st)
+{
+   DEBUG_CODE(struct icmphdr *icmp = (struct icmphdr *)st.ptr);
+   DEBUG_MSG("ICMP header:\n");
+   DEBUG_MSG("\tType:\t\t%u\n",     icmp->type);
+   DEBUG_MSG("\tCode:\t\t%u\n",     icmp->code);
+   DEBUG_MSG("\tChecksum:\t%#06x\n",ntohs(icmp->checksum));
+   DEBUG_MSG("\tRest:\t\t%#06x\n",  ntohl(*(uint32_t *)&icmp->un));
+   return LAYER_PAYLOAD;
+}
+
+/**
+ * \brief Parse ICMPv6 header (debug output only).
+ */
+uint32_t parse_icmpv6(parser_state &st)
+{
+   DEBUG_CODE(struct icmp6_hdr *icmp6 = (struct icmp6_hdr *)st.ptr);
+   DEBUG_MSG("ICMPv6 header:\n");
+   DEBUG_MSG("\tType:\t\t%u\n",     icmp6->icmp6_type);
+   DEBUG_MSG("\tCode:\t\t%u\n",     icmp6->icmp6_code);
+   DEBUG_MSG("\tChecksum:\t%#x\n",  ntohs(icmp6->icmp6_cksum));
+   DEBUG_MSG("\tBody:\t\t%#x\n",    ntohs(*(uint32_t *)&icmp6->icmp6_dataun));
+   return LAYER_PAYLOAD;
+}
+
+/**
+ * \brief Layer parsers dispatch table. Most frequent layers go first.
+ */
+static const struct {
+   uint32_t layer;
+   layer_parser_t parser;
+} layer_parsers[] = {
+   { LAYER_ETHERTYPE(ETH_P_IP),        parse_ipv4 },
+   { LAYER_IPPROTO(IPPROTO_TCP),       parse_tcp },
+   { LAYER_IPPROTO(IPPROTO_UDP),       parse_udp },
+   { LAYER_ETHERTYPE(ETH_P_IPV6),      parse_ipv6 },
+   { LAYER_ETHERTYPE(ETH_P_8021Q),     parse_vlan },
+   { LAYER_ETHERTYPE(ETH_P_8021AD),    parse_vlan },
+   { LAYER_ETHERTYPE(ETH_P_QINQ1),     parse_vlan },
+   { LAYER_ETHERTYPE(ETH_P_MPLS_UC),   parse_mpls },
+   { LAYER_ETHERTYPE(ETH_P_MPLS_MC),   parse_mpls },
+   { LAYER_ETHERTYPE(ETH_P_TEB),       parse_eth },
+   { LAYER_IPPROTO(IPPROTO_ICMP),      parse_icmp },
+   { LAYER_IPPROTO(IPPROTO_ICMPV6),    parse_icmpv6 },
+   { LAYER_IPPROTO(IPPROTO_GRE),       parse_gre },
+   { LAYER_IPPROTO(IPPROTO_IPIP),      parse_ipip },
+   { LAYER_IPPROTO(IPPROTO_IPV6),      parse_ipip }
+};
+
+/**
+ * \brief Find parser of given layer.
+ * \param [in] layer Layer identifier.
+ * \return Layer parser or NULL if layer is not supported.
+ */
+inline layer_parser_t get_layer_parser(uint32_t layer)
+{
+   for (size_t i = 0; i < sizeof(layer_parsers) / sizeof(layer_parsers[0]); i++) {
+      if (layer_parsers[i].layer == layer) {
+         return layer_parsers[i].parser;
       }
-      if (tcp->urg) {
-         pkt.tcpControlBits |= TCP_URG;
+   }
+   return NULL;
+}
+
+/**
+ * \brief Parsing callback function for pcap_dispatch() call. Parse packets up to tranport layer.
+ * Stacked VLAN tags, MPLS labels, GRE, VXLAN, GTP-U and IP-in-IP tunnels are decapsulated
+ * up to the innermost transport header unless flows are keyed on outer headers.
+ * \tparam PAYLOAD Copy transport payload into packet. When false, only headers are parsed
+ * and payload bytes are never touched.
+ * \param [in,out] arg Serves for passing pointer into callback function.
+ * \param [in] h Contains timestamp and packet size.
+ * \param [in] data Pointer to the captured packet data.
+ */
+template <bool PAYLOAD>
+void packet_handler(u_char *arg, const struct pcap_pkthdr *h, const u_char *data)
+{
+   Packet &pkt = *(Packet *)arg;
+   parser_state st;
+
+   DEBUG_MSG("---------- packet parser  #%u -------------\n", ++s_total_pkts);
+   DEBUG_MSG("Time:\t\t\t%ld.%ld\n",      h->ts.tv_sec, h->ts.tv_usec);
+   DEBUG_MSG("Packet length:\t\tcaplen=%uB len=%uB\n\n", h->caplen, h->len);
+
+   pkt.packetFieldIndicator = PCKT_TIMESTAMP;
+   pkt.timestamp = h->ts.tv_sec + h->ts.tv_usec / 1000000.0;
+
+   st.pkt = &pkt;
+   st.ptr = data;
+   st.end = data + h->caplen;
+   st.payload_len = 0;
+   st.saved = false;
+
+   uint32_t layer = parse_eth(st);
+   for (int depth = 0; layer < LAYER_PAYLOAD; depth++) {
+      layer_parser_t parser = get_layer_parser(layer);
+      if (parser == NULL || depth == MAX_ENCAP_DEPTH) {
+         DEBUG_MSG("Packet parser exits: unknown protocol: %#x\n", layer);
+         layer = LAYER_INVALID;
+         break;
       }
-      pkt.packetFieldIndicator |= PCKT_TCP_MASK;
-
-      data_ptr += tcp->doff * 4;
-      payload_len -= tcp->doff * 4;
-
-      DEBUG_MSG("TCP header:\n");
-      DEBUG_MSG("\tSrc port:\t%u\n",   ntohs(tcp->source));
-      DEBUG_MSG("\tDest port:\t%u\n",  ntohs(tcp->dest));
-      DEBUG_MSG("\tSEQ:\t\t%#x\n",     ntohl(tcp->seq));
-      DEBUG_MSG("\tACK SEQ:\t%#x\n",   ntohl(tcp->ack_seq));
-      DEBUG_MSG("\tData offset:\t%u\n",tcp->doff);
-      DEBUG_MSG("\tFlags:\t\t%s%s%s%s%s%s\n", (tcp->fin ? "FIN " : ""), (tcp->syn ? "SYN " : ""), (tcp->rst ? "RST " : ""), (tcp->psh ? "PSH " : ""), (tcp->ack ? "ACK " : ""), (tcp->urg ? "URG" : ""));
-      DEBUG_MSG("\tWindow:\t\t%u\n",   ntohs(tcp->window));
-      DEBUG_MSG("\tChecksum:\t%#06x\n",ntohs(tcp->check));
-      DEBUG_MSG("\tUrg ptr:\t%#x\n",   ntohs(tcp->urg_ptr));
-      DEBUG_MSG("\tReserved1:\t%#x\n", tcp->res1);
-      DEBUG_MSG("\tReserved2:\t%#x\n", tcp->res2);
-   } else if (transport_proto == IPPROTO_UDP) {
-      struct udphdr *udp = (struct udphdr *)data_ptr;
-
-      pkt.sourceTransportPort = ntohs(udp->source);
-      pkt.destinationTransportPort = ntohs(udp->dest);
-      pkt.packetFieldIndicator |= PCKT_UDP_MASK;
-
-      data_ptr += 8;
-      payload_len -= 8;
-
-      DEBUG_MSG("UDP header:\n");
-      DEBUG_MSG("\tSrc port:\t%u\n",   ntohs(udp->source));
-      DEBUG_MSG("\tDest port:\t%u\n",  ntohs(udp->dest));
-      DEBUG_MSG("\tLength:\t\t%u\n",   ntohs(udp->len));
-      DEBUG_MSG("\tChecksum:\t%#06x\n",ntohs(udp->check));
-   } else if (transport_proto == IPPROTO_ICMP) {
-      DEBUG_CODE(struct icmphdr *icmp = (struct icmphdr *)data_ptr);
-      DEBUG_MSG("ICMP header:\n");
-      DEBUG_MSG("\tType:\t\t%u\n",     icmp->type);
-      DEBUG_MSG("\tCode:\t\t%u\n",     icmp->code);
-      DEBUG_MSG("\tChecksum:\t%#06x\n",ntohs(icmp->checksum));
-      DEBUG_MSG("\tRest:\t\t%#06x\n",  ntohl(*(uint32_t *)&icmp->un));
-   } else if (transport_proto == IPPROTO_ICMPV6) {
-      DEBUG_CODE(struct icmp6_hdr *icmp6 = (struct icmp6_hdr *)data_ptr);
-      DEBUG_MSG("ICMPv6 header:\n");
-      DEBUG_MSG("\tType:\t\t%u\n",     icmp6->icmp6_type);
-      DEBUG_MSG("\tCode:\t\t%u\n",     icmp6->icmp6_code);
-      DEBUG_MSG("\tChecksum:\t%#x\n",  ntohs(icmp6->icmp6_cksum));
-      DEBUG_MSG("\tBody:\t\t%#x\n",    ntohs(*(uint32_t *)&icmp6->icmp6_dataun));
-   } else {
-      DEBUG_MSG("Packet parser exits: unknown transport protocol: %#06x\n", transport_proto);
+      layer = parser(st);
+   }
+
+   if (layer == LAYER_INVALID && st.saved) {
+      // Inner headers are malformed or unknown, use the outer ones.
+      DEBUG_MSG("Packet parser: using outer headers of the tunnel\n");
+      pkt = st.saved_pkt;
+      st.ptr = st.saved_ptr;
+      st.payload_len = st.saved_payload_len;
+      layer = LAYER_PAYLOAD;
+   }
+   if (layer == LAYER_INVALID || !(pkt.packetFieldIndicator & (PCKT_IPV4_MASK | PCKT_IPV6_MASK))) {
+      DEBUG_MSG("Packet parser exits: packet is not parsed\n");
       return;
    }
 
-   int len = (data_ptr - data) + payload_len;
+   int hdr_len = st.ptr - data;
+   if (!PAYLOAD) {
+      pkt.packetTotalLength = hdr_len;
+      pkt.transportPayloadPacketSectionSize = 0;
+      pkt.transportPayloadPacketSection = NULL;
+
+      DEBUG_MSG("Packet parser exits: packet parsed\n");
+      packet_valid = true;
+      return;
+   }
+
+   if (payload_depth != PAYLOAD_FULL && st.payload_len > payload_depth) {
+      st.payload_len = payload_depth;
+   }
+   int len = hdr_len + (st.payload_len > 0 ? st.payload_len : 0);
+   if (len > (int)h->caplen) {
+      len = h->caplen;
+   }
    if (len > MAXPCKTSIZE) {
       len = MAXPCKTSIZE;
       DEBUG_MSG("Packet size too long, truncating to %u\n", len);
    }
+   if (hdr_len > len) {
+      hdr_len = len;
+   }
    memcpy(pkt.packet, data, len);
    pkt.packet[len] = 0;
    pkt.packetTotalLength = len;
 
-   pkt.transportPayloadPacketSectionSize = len - (data_ptr - data);
-   pkt.transportPayloadPacketSection = pkt.packet + (data_ptr - data);
+   pkt.transportPayloadPacketSectionSize = len - hdr_len;
+   pkt.transportPayloadPacketSection = pkt.packet + hdr_len;
 
    if ((pkt.packetFieldIndicator & PCKT_TCP_MASK) == PCKT_TCP_MASK ||
        (pkt.packetFieldIndicator & PCKT_UDP_MASK) == PCKT_UDP_MASK) {
       pkt.packetFieldIndicator |= PCKT_PAYLOAD_MASK;
    }
 
-   DEBUG_MSG("Payload length:\t%u\n", payload_len);
+   DEBUG_MSG("Payload length:\t%u\n", st.payload_len);
    DEBUG_MSG("Packet parser exits: packet parsed\n");
    packet_valid = true;
 }
@@ -307,7 +747,8 @@ void packet_handler(u_char *arg, const struct pcap_pkthdr *h, const u_char *data
 /**
  * \brief Constructor.
  */
-PcapReader::PcapReader() : handle(NULL)
+PcapReader::PcapReader() : handle(NULL), live_capture(false), nonblock(false), handler(packet_handler<true>), link_bit(0),
+   dir_bit(0), snaplen(1 << 15)
 {
 }
 
@@ -315,8 +756,16 @@ PcapReader::PcapReader() : handle(NULL)
  * \brief Constructor.
  * \param [in] options Module options.
  */
-PcapReader::PcapReader(const options_t &options) : handle(NULL)
+PcapReader::PcapReader(const options_t &options) : handle(NULL), live_capture(false), nonblock(false), link_bit(0),
+   dir_bit(0), snaplen(options.snaplen), filter(options.bpffilter), rules(options.capturerules)
 {
+   tunnel_outer_key = options.outerkey;
+   payload_depth = options.payloaddepth;
+   if (payload_depth == PAYLOAD_NONE) {
+      handler = packet_handler<false>;
+   } else {
+      handler = packet_handler<true>;
+   }
 }
 
 /**
@@ -348,6 +797,10 @@ int PcapReader::open_file(const std::string &file)
 
    live_capture = false;
    errmsg = "";
+   if (set_filter() != 0) {
+      close();
+      return 3;
+   }
    return 0;
 }
 
@@ -366,7 +819,7 @@ int PcapReader::init_interface(const std::string &interface)
    char errbuf[PCAP_ERRBUF_SIZE];
    errbuf[0] = 0;
 
-   handle = pcap_open_live(interface.c_str(), 1 << 15, 1, 0, errbuf);
+   handle = pcap_open_live(interface.c_str(), snaplen, 1, 0, errbuf);
    if (handle == NULL) {
       errmsg = errbuf;
       return 2;
@@ -377,6 +830,62 @@ int PcapReader::init_interface(const std::string &interface)
 
    live_capture = true;
    errmsg = "";
+   if (set_filter() != 0) {
+      close();
+      return 3;
+   }
+   return 0;
+}
+
+/**
+ * \brief Install user filter and, when capturing from network interface, capture rules.
+ *
+ * Capture rules are attached to the socket directly: libpcap would replace snap lengths
+ * returned by the program with the maximal one. When it is not possible, only user filter
+ * is installed and all packets are captured up to the maximal snap length.
+ * \return 0 on success, non 0 on failure + errmsg is filled with error message
+ */
+int PcapReader::set_filter()
+{
+   struct bpf_program program;
+   int ret;
+
+#if defined(__linux__) && defined(SO_ATTACH_FILTER)
+   if (live_capture && !rules.empty()) {
+      ret = compile_capture_filter(handle, filter, rules, snaplen, program, errmsg);
+      if (ret == 1) {
+         return 1;
+      } else if (ret == 0) {
+         struct sock_fprog fprog;
+         fprog.len = program.bf_len;
+         fprog.filter = (struct sock_filter *) program.bf_insns;
+         ret = setsockopt(pcap_fileno(handle), SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+         if (ret != 0) {
+            errmsg = strerror(errno);
+         }
+         pcap_freecode(&program);
+         if (ret == 0) {
+            return 0;
+         }
+      }
+      fprintf(stderr, "Warning: capture rules not installed (%s), capturing %d bytes of packets.\n",
+         errmsg.c_str(), snaplen);
+      errmsg = "";
+   }
+#endif
+
+   if (filter.empty()) {
+      return 0;
+   }
+   if (compile_capture_filter(handle, filter, std::vector<capture_rule>(), snaplen, program, errmsg) != 0) {
+      return 1;
+   }
+   ret = pcap_setfilter(handle, &program);
+   pcap_freecode(&program);
+   if (ret != 0) {
+      errmsg = pcap_geterr(handle);
+      return 1;
+   }
    return 0;
 }
 
@@ -391,6 +900,16 @@ void PcapReader::close()
    }
 }
 
+/**
+ * \brief Interrupt waiting for packets, get_pkt() returns PCAP_ERROR_BREAK. Safe to call from signal handler.
+ */
+void PcapReader::breakloop()
+{
+   if (handle != NULL) {
+      pcap_breakloop(handle);
+   }
+}
+
 int PcapReader::get_pkt(Packet &packet)
 {
    if (handle == NULL) {
@@ -401,10 +920,12 @@ int PcapReader::get_pkt(Packet &packet)
    packet_valid = false;
    int ret;
 
-   while ((ret = pcap_dispatch(handle, 1, packet_handler, (u_char *)(&packet))) == 0 && live_capture) {
+   while ((ret = pcap_dispatch(handle, 1, handler, (u_char *)(&packet))) == 0 && live_capture && !nonblock) {
    } // Wait until packet is read.
 
    if (ret == 1 && packet_valid) {
+      packet.linkBitField = link_bit;
+      packet.dirBitField = dir_bit;
       return 2;
    }
    if (ret < 0) {
@@ -412,3 +933,250 @@ int PcapReader::get_pkt(Packet &packet)
    }
    return ret;
 }
+
+/**
+ * \brief Set link and direction bit fields of packets read from this source.
+ * \param [in] link Link bit field.
+ * \param [in] dir Direction bit field.
+ */
+void PcapReader::set_source(uint64_t link, uint8_t dir)
+{
+   link_bit = link;
+   dir_bit = dir;
+}
+
+/**
+ * \brief Switch network interface into non-blocking mode, get_pkt() returns 0 when no packet is available.
+ * \return 0 on success, non 0 on failure + errmsg is filled with error message
+ */
+int PcapReader::set_nonblock()
+{
+   char errbuf[PCAP_ERRBUF_SIZE];
+   if (handle == NULL || pcap_setnonblock(handle, 1, errbuf) != 0) {
+      errmsg = handle == NULL ? "No live capture opened." : errbuf;
+      return 1;
+   }
+   nonblock = true;
+   return 0;
+}
+
+/**
+ * \brief Get descriptor which can be polled for packets.
+ * \return File descriptor or -1 when not supported.
+ */
+int PcapReader::get_fd()
+{
+   return handle == NULL ? -1 : pcap_get_selectable_fd(handle);
+}
+
+/**
+ * \brief Constructor.
+ * \param [in] options Module options.
+ */
+PcapMultiReader::PcapMultiReader(const options_t &options) : options(options), next(0), interrupted(0)
+{
+}
+
+/**
+ * \brief Destructor.
+ */
+PcapMultiReader::~PcapMultiReader()
+{
+   this->close();
+}
+
+/**
+ * \brief Add opened source, assign it the next link bit.
+ * \param [in] reader Opened reader.
+ * \param [in] dir Direction bit field of the source.
+ * \return 0 on success, non 0 on failure + errmsg is filled with error message
+ */
+int PcapMultiReader::add_source(PcapReader *reader, uint8_t dir)
+{
+   if (!sources.empty() && sources[0]->is_live() != reader->is_live()) {
+      errmsg = "Cannot capture from files and network interfaces at the same time.";
+      delete reader;
+      return 1;
+   }
+
+   reader->set_source((uint64_t) 1 << sources.size(), dir);
+   sources.push_back(reader);
+
+   Packet packet;
+   packet.packet = new char[MAXPCKTSIZE + 1];
+   pending.push_back(packet);
+   state.push_back(SOURCE_EMPTY);
+   return 0;
+}
+
+/**
+ * \brief Open pcap file for reading.
+ * \param [in] file Input file name.
+ * \param [in] dir Direction bit field of packets from the file.
+ * \return 0 on success, non 0 on failure + errmsg is filled with error message
+ */
+int PcapMultiReader::open_file(const std::string &file, uint8_t dir)
+{
+   if (sources.size() == MAX_CAPTURE_SOURCES) {
+      errmsg = "Too many capture sources.";
+      return 1;
+   }
+
+   PcapReader *reader = new PcapReader(options);
+   if (reader->open_file(file) != 0) {
+      errmsg = reader->errmsg;
+      delete reader;
+      return 2;
+   }
+   return add_source(reader, dir);
+}
+
+/**
+ * \brief Initialize network interface for reading.
+ * \param [in] interface Interface name.
+ * \param [in] dir Direction bit field of packets from the interface.
+ * \return 0 on success, non 0 on failure + errmsg is filled with error message
+ */
+int PcapMultiReader::init_interface(const std::string &interface, uint8_t dir)
+{
+   if (sources.size() == MAX_CAPTURE_SOURCES) {
+      errmsg = "Too many capture sources.";
+      return 1;
+   }
+
+   PcapReader *reader = new PcapReader(options);
+   if (reader->init_interface(interface) != 0) {
+      errmsg = reader->errmsg;
+      delete reader;
+      return 2;
+   }
+   if (!sources.empty()) {
+      // More interfaces are polled, switch the first one too.
+      if ((fds.empty() && sources[0]->set_nonblock() != 0) || reader->set_nonblock() != 0) {
+         errmsg = fds.empty() ? sources[0]->errmsg : reader->errmsg;
+         delete reader;
+         return 3;
+      }
+      if (fds.empty()) {
+         struct pollfd pfd = {sources[0]->get_fd(), POLLIN, 0};
+         fds.push_back(pfd);
+      }
+      struct pollfd pfd = {reader->get_fd(), POLLIN, 0};
+      fds.push_back(pfd);
+   }
+   return add_source(reader, dir);
+}
+
+/**
+ * \brief Close all opened files and interfaces.
+ */
+void PcapMultiReader::close()
+{
+   for (unsigned int i = 0; i < sources.size(); i++) {
+      delete sources[i];
+      delete [] pending[i].packet;
+   }
+   sources.clear();
+   pending.clear();
+   state.clear();
+   fds.clear();
+}
+
+/**
+ * \brief Interrupt waiting for packets, get_pkt() returns PCAP_ERROR_BREAK. Safe to call from signal handler.
+ */
+void PcapMultiReader::breakloop()
+{
+   interrupted = 1;
+   for (unsigned int i = 0; i < sources.size(); i++) {
+      sources[i]->breakloop();
+   }
+}
+
+int PcapMultiReader::get_pkt(Packet &packet)
+{
+   if (sources.size() == 1) {
+      return sources[0]->get_pkt(packet);
+   } else if (sources.empty()) {
+      errmsg = "No live capture or file opened.";
+      return -3;
+   }
+
+   if (sources[0]->is_live()) {
+      return get_pkt_live(packet);
+   }
+   return get_pkt_file(packet);
+}
+
+/**
+ * \brief Get the oldest packet of all files, so that flow cache sees packets in timestamp order.
+ * \param [out] packet Variable for storing parsed packet.
+ * \return Same as get_pkt().
+ */
+int PcapMultiReader::get_pkt_file(Packet &packet)
+{
+   for (unsigned int i = 0; i < sources.size(); i++) {
+      if (state[i] != SOURCE_EMPTY) {
+         continue;
+      }
+
+      int ret = sources[i]->get_pkt(pending[i]);
+      if (ret == 2) {
+         state[i] = SOURCE_READY;
+      } else if (ret == 0) {
+         state[i] = SOURCE_EOF;
+      } else if (ret == 1) {
+         return 1; // Packet was read but not parsed, source stays empty.
+      } else {
+         errmsg = sources[i]->errmsg;
+         return ret;
+      }
+   }
+
+   int oldest = -1;
+   for (unsigned int i = 0; i < sources.size(); i++) {
+      if (state[i] == SOURCE_READY && (oldest < 0 || pending[i].timestamp < pending[oldest].timestamp)) {
+         oldest = i;
+      }
+   }
+   if (oldest < 0) {
+      return 0;
+   }
+
+   // Swap packet buffers instead of copying packet data.
+   char *buffer = packet.packet;
+   packet = pending[oldest];
+   pending[oldest].packet = buffer;
+   state[oldest] = SOURCE_EMPTY;
+   return 2;
+}
+
+/**
+ * \brief Get packet from any network interface, wait in poll() when there is none.
+ * \param [out] packet Variable for storing parsed packet.
+ * \return Same as get_pkt().
+ */
+int PcapMultiReader::get_pkt_live(Packet &packet)
+{
+   while (!interrupted) {
+      for (unsigned int i = 0; i < sources.size(); i++) {
+         unsigned int src = (next + i) % sources.size();
+         int ret = sources[src]->get_pkt(packet);
+         if (ret != 0) {
+            next = src + 1; // Take turns, so that busy interface does not starve the others.
+            if (ret < 0) {
+               errmsg = sources[src]->errmsg;
+            }
+            return ret;
+         }
+      }
+
+      if (poll(&fds[0], fds.size(), SOURCE_POLL_TIMEOUT) < 0 && errno != EINTR) {
+         errmsg = strerror(errno);
+         return -1;
+      }
+   }
+
+   interrupted = 0;
+   return PCAP_ERROR_BREAK;
+}
@@ -47,8 +47,12 @@
 #define PCAPREADER_H
 
 #include <pcap/pcap.h>
+#include <poll.h>
+#include <signal.h>
+#include <vector>
 
 #include "flow_meter.h"
+#include "capturefilter.h"
 #include "packet.h"
 #include "packetreceiver.h"
 
@@ -66,11 +70,70 @@ public:
    int init_interface(const std::string &interface);
    void close();
    int get_pkt(Packet &packet);
+   void breakloop();
+   void set_source(uint64_t link, uint8_t dir);
+   int set_nonblock();
+   int get_fd();
+   bool is_live() const { return live_capture; }
 private:
+   int set_filter();
+
    pcap_t *handle; /**< libpcap file handler. */
    bool live_capture; /**< PcapReader is capturing from network interface. */
+   bool nonblock; /**< get_pkt() returns 0 instead of waiting when no packet is available. */
+   pcap_handler handler; /**< Packet parser variant matching payload needs of active plugins. */
+   uint64_t link_bit; /**< Link bit field of packets from this source. */
+   uint8_t dir_bit; /**< Direction bit field of packets from this source. */
+   int snaplen; /**< Maximal number of captured bytes of packet. */
+   std::string filter; /**< User filter expression. */
+   std::vector<capture_rule> rules; /**< Snap lengths of packets wanted by plugins. */
+};
+
+#define MAX_CAPTURE_SOURCES 64 /**< Number of bits of LINK_BIT_FIELD. */
+#define SOURCE_POLL_TIMEOUT 100 /**< Timeout of waiting for packets from network interfaces in milliseconds. */
+
+/**
+ * \brief Class for reading packets from more files or network interfaces at once.
+ *
+ * Each source tags its packets with its own link bit (and direction bits), so flows
+ * of all sources share one flow cache. Packets of files are merged in timestamp
+ * order, network interfaces are polled and read in round robin.
+ */
+class PcapMultiReader : public PacketReceiver
+{
+public:
+   PcapMultiReader(const options_t &options);
+   ~PcapMultiReader();
+
+   int open_file(const std::string &file, uint8_t dir);
+   int init_interface(const std::string &interface, uint8_t dir);
+   void close();
+   int get_pkt(Packet &packet);
+   void breakloop();
+private:
+   /**
+    * \brief State of a file source.
+    */
+   enum source_state {
+      SOURCE_EMPTY, /**< Next packet has to be read. */
+      SOURCE_READY, /**< Packet is waiting in pending buffer. */
+      SOURCE_EOF /**< All packets were read. */
+   };
+
+   const options_t &options; /**< Module options passed to readers. */
+   std::vector<PcapReader *> sources; /**< Capture sources, i-th source has link bit i. */
+   std::vector<Packet> pending; /**< Next packet of each file source. */
+   std::vector<source_state> state; /**< State of each file source. */
+   std::vector<struct pollfd> fds; /**< Selectable descriptors of network interfaces. */
+   size_t next; /**< Network interface to be read first by the next get_pkt(). */
+   volatile sig_atomic_t interrupted; /**< breakloop() was called. */
+
+   int add_source(PcapReader *reader, uint8_t dir);
+   int get_pkt_file(Packet &packet);
+   int get_pkt_live(Packet &packet);
 };
 
+template <bool PAYLOAD>
 void packet_handler(u_char *arg, const struct pcap_pkthdr *h, const u_char *data);
 
 #endif
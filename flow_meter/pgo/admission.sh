@@ -0,0 +1,47 @@
+#!/bin/sh
+#
+# Compares admission policies of flow_meter on traffic with random-source
+# flood. For each policy, hit rate of flow cache, number of premature
+# exports (active flows evicted from full lines before inactive timeout),
+# number of evictions and number of packets not admitted are reported.
+#
+# Flood of the generated traffic is SYN to port 80, so the http plugin
+# would be interested in it and no packet of the flood could be rejected;
+# PLUGINS must not contain it for the comparison to make sense.
+#
+# Usage: admission.sh PCAP FLOW_METER [CACHE_SIZE]
+#
+
+PCAP="$1"
+FLOW_METER="$2"
+CACHE_SIZE="${3:-4096}"
+POLICIES="${POLICIES:-none probation sketch aggregate}"
+PLUGINS="${PLUGINS:-dns,sip,tls,basic}"
+
+if [ ! -r "$PCAP" ] || [ ! -x "$FLOW_METER" ]; then
+   echo "Usage: $0 PCAP FLOW_METER [CACHE_SIZE]" >&2
+   exit 1
+fi
+
+OUT=`mktemp -d ${TMPDIR:-/tmp}/flow_meter-admission.XXXXXX` || exit 1
+trap 'rm -rf "$OUT"' EXIT
+
+IFC=""
+for p in `echo "$PLUGINS" | tr ',' ' '`; do
+   IFC="${IFC:+$IFC,}f:$OUT/$p"
+done
+
+printf "%-10s %8s %10s %10s %12s\n" policy hit-rate premature evicted not-admitted
+for policy in $POLICIES; do
+   "$FLOW_METER" -i "$IFC" -p "$PLUGINS" -s "$CACHE_SIZE" -a "$policy" -r "$PCAP" >"$OUT/report" || exit 1
+   awk -v policy="$policy" '
+      /^# cache / { for (i = 3; i < NF; i++) { if ($i == "premature") premature = $(i + 1); if ($i == "evicted") evicted = $(i + 1) } }
+      /^Hits: / { hits = $2 }
+      /^Empty: / { empty = $2 }
+      /^Not empty: / { notempty = $3 }
+      /^Not admitted: / { rejected = $3 }
+      END {
+         packets = hits + empty + notempty + rejected
+         printf "%-10s %7.2f%% %10d %10d %12d\n", policy, packets ? 100.0 * hits / packets : 0, premature, evicted, rejected
+      }' "$OUT/report"
+done
@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+# Measures throughput of flow_meter on synthetic traffic. When reference
+# binary is given, speedup of FLOW_METER over REFERENCE is reported.
+# Best time of RUNS (default 5) runs of each binary is taken.
+#
+# Usage: benchmark.sh PCAP PACKETS FLOW_METER [REFERENCE]
+#
+
+PCAP="$1"
+PACKETS="$2"
+FLOW_METER="$3"
+REFERENCE="$4"
+RUNS="${RUNS:-5}"
+PLUGINS="http,dns,sip,tls,tunnel,pstats,basic"
+
+if [ ! -r "$PCAP" ] || [ -z "$PACKETS" ] || [ ! -x "$FLOW_METER" ]; then
+   echo "Usage: $0 PCAP PACKETS FLOW_METER [REFERENCE]" >&2
+   exit 1
+fi
+
+OUT=`mktemp -d ${TMPDIR:-/tmp}/flow_meter-bench.XXXXXX` || exit 1
+trap 'rm -rf "$OUT"' EXIT
+
+IFC=""
+for p in `echo "$PLUGINS" | tr ',' ' '`; do
+   IFC="${IFC:+$IFC,}f:$OUT/$p"
+done
+
+# Prints best wall clock time of RUNS runs in seconds.
+measure()
+{
+   best=""
+   i=0
+   while [ $i -lt "$RUNS" ]; do
+      start=`date +%s.%N`
+      "$1" -i "$IFC" -p "$PLUGINS" -r "$PCAP" >/dev/null || return 1
+      end=`date +%s.%N`
+      best=`echo "$start $end $best" | awk '{ t = $2 - $1; if ($3 != "" && $3 < t) t = $3; printf "%.4f", t }'`
+      i=`expr $i + 1`
+   done
+   echo "$best"
+}
+
+report()
+{
+   echo "$1 $2 $PACKETS" | awk '{ printf "%-24s %8.3f s %12.0f packets/s\n", $1, $2, $3 / $2 }'
+}
+
+time=`measure "$FLOW_METER"` || exit 1
+report "`basename $FLOW_METER`" "$time"
+
+if [ -n "$REFERENCE" ]; then
+   ref=`measure "$REFERENCE"` || exit 1
+   report "`basename $REFERENCE`" "$ref"
+   echo "$ref $time" | awk '{ printf "speedup                  %8.3f x\n", $1 / $2 }'
+fi
@@ -0,0 +1,304 @@
+#!/usr/bin/env python
+#
+# Generator of synthetic traffic for flow_meter profile-guided optimization
+# training and benchmark.
+#
+# Copyright (C) 2026 CESNET
+#
+# LICENSE TERMS
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in
+#    the documentation and/or other materials provided with the
+#    distribution.
+# 3. Neither the name of the Company nor the names of its contributors
+#    may be used to endorse or promote products derived from this
+#    software without specific prior written permission.
+#
+# ALTERNATIVELY, provided that this notice is retained in full, this
+# product may be distributed under the terms of the GNU General Public
+# License (GPL) version 2 or later, in which case the provisions
+# of the GPL apply INSTEAD OF those given above.
+#
+# This software is provided ``as is'', and any express or implied
+# warranties, including, but not limited to, the implied warranties of
+# merchantability and fitness for a particular purpose are disclaimed.
+# In no event shall the company or contributors be liable for any
+# direct, indirect, incidental, special, exemplary, or consequential
+# damages (including, but not limited to, procurement of substitute
+# goods or services; loss of use, data, or profits; or business
+# interruption) however caused and on any theory of liability, whether
+# in contract, strict liability, or otherwise) arising in any way out of
+# the use of this software, even if advised of the possibility of such
+# damage.
+#
+"""
+Writes pcap file with mix of traffic parsed by flow_meter plugins: HTTP and
+TLS sessions, DNS queries, SIP calls, VLAN / VXLAN / GRE encapsulated flows,
+IPv6 flows and random-source SYN flood. Output depends only on the seed.
+
+Usage: gen_traffic.py [-s SEED] [-f WEIGHT] PACKETS OUTPUT
+"""
+
+import random
+import struct
+import sys
+from optparse import OptionParser
+
+ETH_IP4 = 0x0800
+ETH_IP6 = 0x86dd
+ETH_VLAN = 0x8100
+
+TCP_FIN = 0x01
+TCP_SYN = 0x02
+TCP_RST = 0x04
+TCP_PSH = 0x08
+TCP_ACK = 0x10
+
+
+def checksum(data):
+   if len(data) % 2:
+      data += b'\0'
+   s = sum(struct.unpack('!%dH' % (len(data) // 2), data))
+   s = (s >> 16) + (s & 0xffff)
+   s += s >> 16
+   return (~s) & 0xffff
+
+
+def ether(ethertype, payload, vlan=None):
+   hdr = b'\x00\x11\x22\x33\x44\x55\x00\x66\x77\x88\x99\xaa'
+   if vlan is not None:
+      hdr += struct.pack('!HH', ETH_VLAN, vlan)
+   return hdr + struct.pack('!H', ethertype) + payload
+
+
+def ipv4(src, dst, proto, payload, ttl=64):
+   hdr = struct.pack('!BBHHHBBH4s4s', 0x45, 0, 20 + len(payload), 0, 0x4000,
+                     ttl, proto, 0, src, dst)
+   hdr = hdr[:10] + struct.pack('!H', checksum(hdr)) + hdr[12:]
+   return hdr + payload
+
+
+def ipv6(src, dst, proto, payload):
+   return struct.pack('!IHBB16s16s', 0x60000000, len(payload), proto, 64,
+                      src, dst) + payload
+
+
+def tcp(sport, dport, seq, ack, flags, payload=b''):
+   return struct.pack('!HHIIBBHHH', sport, dport, seq, ack, 0x50, flags,
+                      65535, 0, 0) + payload
+
+
+def udp(sport, dport, payload):
+   return struct.pack('!HHHH', sport, dport, 8 + len(payload), 0) + payload
+
+
+class Generator(object):
+   """Produces packets of synthetic sessions one after another."""
+
+   def __init__(self, seed, flood=10):
+      self.rnd = random.Random(seed)
+      self.flood_weight = flood
+      self.time = 1500000000.0
+      self.packets = []
+
+   def addr4(self, net):
+      return struct.pack('!BBBB', 10, net, self.rnd.randint(0, 255),
+                         self.rnd.randint(1, 254))
+
+   def addr6(self):
+      return b'\x20\x01\x0d\xb8' + bytes(bytearray(
+         self.rnd.randint(0, 255) for _ in range(12)))
+
+   def port(self):
+      return self.rnd.randint(1024, 65535)
+
+   def emit(self, frame, gap=0.0005):
+      self.time += self.rnd.expovariate(1.0 / gap)
+      self.packets.append((self.time, frame))
+
+   def tcp_session(self, dport, client_data, server_data, ip6=False,
+                   wrap=None, vlan=None):
+      if ip6:
+         cli, srv, net, proto = self.addr6(), self.addr6(), ipv6, ETH_IP6
+      else:
+         cli, srv, net, proto = self.addr4(1), self.addr4(2), ipv4, ETH_IP4
+      sport = self.port()
+      cseq, sseq = self.rnd.getrandbits(32), self.rnd.getrandbits(32)
+
+      def send(a, b, sp, dp, seq, ack, flags, data=b''):
+         pkt = net(a, b, 6, tcp(sp, dp, seq & 0xffffffff, ack & 0xffffffff,
+                                flags, data))
+         if wrap is not None:
+            pkt, proto_out = wrap(pkt, proto)
+         else:
+            proto_out = proto
+         self.emit(ether(proto_out, pkt, vlan))
+
+      send(cli, srv, sport, dport, cseq, 0, TCP_SYN)
+      send(srv, cli, dport, sport, sseq, cseq + 1, TCP_SYN | TCP_ACK)
+      send(cli, srv, sport, dport, cseq + 1, sseq + 1, TCP_ACK)
+      cseq += 1
+      sseq += 1
+      for data in client_data:
+         send(cli, srv, sport, dport, cseq, sseq, TCP_PSH | TCP_ACK, data)
+         cseq += len(data)
+      for data in server_data:
+         send(srv, cli, dport, sport, sseq, cseq, TCP_PSH | TCP_ACK, data)
+         sseq += len(data)
+         send(cli, srv, sport, dport, cseq, sseq, TCP_ACK)
+      if self.rnd.random() < 0.1:
+         send(cli, srv, sport, dport, cseq, sseq, TCP_RST)
+      else:
+         send(cli, srv, sport, dport, cseq, sseq, TCP_FIN | TCP_ACK)
+         send(srv, cli, dport, sport, sseq, cseq + 1, TCP_FIN | TCP_ACK)
+         send(cli, srv, sport, dport, cseq + 1, sseq + 1, TCP_ACK)
+
+   def http(self, **kw):
+      host = 'host%d.example.com' % self.rnd.randint(0, 999)
+      uri = '/%x/index.html?q=%d' % (self.rnd.getrandbits(32),
+                                     self.rnd.randint(0, 99999))
+      req = ('GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: Mozilla/5.0\r\n'
+             'Referer: http://%s/\r\nAccept: */*\r\n\r\n' % (uri, host, host))
+      body = b'x' * self.rnd.choice([0, 100, 1000, 1400])
+      resp = ('HTTP/1.1 %d OK\r\nContent-Type: text/html\r\n'
+              'Content-Length: %d\r\n\r\n' % (self.rnd.choice([200, 200, 404]),
+                                              len(body)))
+      self.tcp_session(80, [req.encode('ascii')],
+                       [resp.encode('ascii') + body], **kw)
+
+   def tls(self, **kw):
+      sni = ('www%d.example.org' % self.rnd.randint(0, 999)).encode('ascii')
+      ext_sni = struct.pack('!HHHBH', 0, len(sni) + 5, len(sni) + 3, 0,
+                            len(sni)) + sni
+      alpn = b'\x02h2\x08http/1.1'
+      ext_alpn = struct.pack('!HHH', 16, len(alpn) + 2, len(alpn)) + alpn
+      ext_groups = struct.pack('!HHHHHH', 10, 6, 4, 29, 23, 24)
+      exts = ext_sni + ext_groups + ext_alpn
+      ciphers = struct.pack('!HHHH', 0x1301, 0x1302, 0xc02b, 0xc02f)
+      body = (struct.pack('!H', 0x0303) + b'\x11' * 32 + b'\x00' +
+              struct.pack('!H', len(ciphers)) + ciphers + b'\x01\x00' +
+              struct.pack('!H', len(exts)) + exts)
+      hello = b'\x01' + struct.pack('!I', len(body))[1:] + body
+      client = struct.pack('!BHH', 22, 0x0301, len(hello)) + hello
+      sbody = (struct.pack('!H', 0x0303) + b'\x22' * 32 + b'\x00' +
+               struct.pack('!HB', 0x1301, 0) + struct.pack('!H', 0))
+      shello = b'\x02' + struct.pack('!I', len(sbody))[1:] + sbody
+      server = struct.pack('!BHH', 22, 0x0303, len(shello)) + shello
+      data = b'\x17\x03\x03\x04\x00' + b'\x55' * 1024
+      self.tcp_session(443, [client, data], [server, data, data], **kw)
+
+   def dns(self):
+      cli, srv = self.addr4(1), self.addr4(3)
+      sport = self.port()
+      ident = self.rnd.randint(0, 65535)
+      labels = ['a%d' % self.rnd.randint(0, 9999), 'example', 'net']
+      qname = b''.join(struct.pack('!B', len(l)) + l.encode('ascii')
+                       for l in labels) + b'\0'
+      qtype = self.rnd.choice([1, 28, 15, 16])
+      query = struct.pack('!HHHHHH', ident, 0x0100, 1, 0, 0, 0) + qname + \
+         struct.pack('!HH', qtype, 1)
+      self.emit(ether(ETH_IP4, ipv4(cli, srv, 17, udp(sport, 53, query))))
+      answer = struct.pack('!HHHIH', 0xc00c, 1, 1, 300, 4) + self.addr4(9)
+      resp = struct.pack('!HHHHHH', ident, 0x8180, 1, 1, 0, 0) + qname + \
+         struct.pack('!HH', qtype, 1) + answer
+      self.emit(ether(ETH_IP4, ipv4(srv, cli, 17, udp(53, sport, resp))))
+
+   def sip(self):
+      cli, srv = self.addr4(4), self.addr4(5)
+      callid = '%x@pbx.example.com' % self.rnd.getrandbits(48)
+      src = 'sip:%d@example.com' % self.rnd.randint(100, 999)
+      dst = 'sip:%d@example.com' % self.rnd.randint(100, 999)
+
+      def msg(first, method):
+         return ('%s\r\nVia: SIP/2.0/UDP pbx.example.com;branch=z9hG4bK%x\r\n'
+                 'From: <%s>;tag=1\r\nTo: <%s>\r\nCall-ID: %s\r\n'
+                 'CSeq: 1 %s\r\nUser-Agent: Softphone 1.0\r\n'
+                 'Content-Length: 0\r\n\r\n' %
+                 (first, self.rnd.getrandbits(32), src, dst, callid,
+                  method)).encode('ascii')
+
+      def send(a, b, data):
+         self.emit(ether(ETH_IP4, ipv4(a, b, 17, udp(5060, 5060, data))))
+
+      send(cli, srv, msg('INVITE %s SIP/2.0' % dst, 'INVITE'))
+      send(srv, cli, msg('SIP/2.0 100 Trying', 'INVITE'))
+      if self.rnd.random() < 0.3:
+         send(srv, cli, msg('SIP/2.0 486 Busy Here', 'INVITE'))
+         return
+      send(srv, cli, msg('SIP/2.0 180 Ringing', 'INVITE'))
+      send(srv, cli, msg('SIP/2.0 200 OK', 'INVITE'))
+      send(cli, srv, msg('ACK %s SIP/2.0' % dst, 'ACK'))
+      send(cli, srv, msg('BYE %s SIP/2.0' % dst, 'BYE'))
+      send(srv, cli, msg('SIP/2.0 200 OK', 'BYE'))
+
+   def vxlan(self, pkt, proto):
+      inner = ether(proto, pkt)
+      hdr = struct.pack('!II', 0x08000000, self.rnd.randint(1, 16) << 8)
+      outer = ipv4(b'\xc0\xa8\x00\x01', b'\xc0\xa8\x00\x02', 17,
+                   udp(self.port(), 4789, hdr + inner))
+      return outer, ETH_IP4
+
+   def gre(self, pkt, proto):
+      hdr = struct.pack('!HHI', 0x2000, proto, 42)
+      outer = ipv4(b'\xc0\xa8\x01\x01', b'\xc0\xa8\x01\x02', 47, hdr + pkt)
+      return outer, ETH_IP4
+
+   def flood(self):
+      src = bytes(bytearray(self.rnd.randint(1, 254) for _ in range(4)))
+      pkt = ipv4(src, b'\x0a\x02\x00\x50', 6,
+                 tcp(self.port(), 80, self.rnd.getrandbits(32), 0, TCP_SYN))
+      self.emit(ether(ETH_IP4, pkt), gap=0.00005)
+
+   def generate(self, count):
+      kinds = [
+         (30, lambda: self.http()),
+         (5, lambda: self.http(ip6=True)),
+         (5, lambda: self.http(vlan=self.rnd.randint(1, 4094))),
+         (15, lambda: self.tls()),
+         (3, lambda: self.tls(wrap=self.vxlan)),
+         (2, lambda: self.http(wrap=self.gre)),
+         (25, lambda: self.dns()),
+         (5, lambda: self.sip()),
+         (self.flood_weight, lambda: [self.flood() for _ in range(20)]),
+      ]
+      total = sum(w for w, _ in kinds)
+      while len(self.packets) < count:
+         r = self.rnd.uniform(0, total)
+         for weight, kind in kinds:
+            r -= weight
+            if r <= 0:
+               kind()
+               break
+      return self.packets[:count]
+
+
+def main():
+   parser = OptionParser(usage='%prog [-s SEED] [-f WEIGHT] PACKETS OUTPUT')
+   parser.add_option('-s', '--seed', type='int', default=1,
+                     help='seed of random generator (default: 1)')
+   parser.add_option('-f', '--flood', type='int', default=10,
+                     help='weight of SYN flood bursts in the mix, other '
+                          'sessions weigh 90 together (default: 10)')
+   opts, args = parser.parse_args()
+   if len(args) != 2:
+      parser.error('PACKETS and OUTPUT are required')
+
+   packets = Generator(opts.seed, opts.flood).generate(int(args[0]))
+   with open(args[1], 'wb') as out:
+      out.write(struct.pack('<IHHiIII', 0xa1b2c3d4, 2, 4, 0, 0, 65535, 1))
+      for ts, frame in packets:
+         sec = int(ts)
+         out.write(struct.pack('<IIII', sec, int((ts - sec) * 1000000),
+                               len(frame), len(frame)))
+         out.write(frame)
+   return 0
+
+
+if __name__ == '__main__':
+   sys.exit(main())
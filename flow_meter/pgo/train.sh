@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# Runs instrumented flow_meter on training traffic to collect profile for
+# profile-guided optimization. All plugins, admission policies and cache
+# growth are exercised.
+#
+# Usage: train.sh FLOW_METER PCAP
+#
+
+FLOW_METER="$1"
+PCAP="$2"
+PLUGINS="http,dns,sip,sipdialog,tls,tunnel,pstats,basic"
+
+if [ ! -x "$FLOW_METER" ] || [ ! -r "$PCAP" ]; then
+   echo "Usage: $0 FLOW_METER PCAP" >&2
+   exit 1
+fi
+
+OUT=`mktemp -d ${TMPDIR:-/tmp}/flow_meter-pgo.XXXXXX` || exit 1
+trap 'rm -rf "$OUT"' EXIT
+
+IFC=""
+for p in `echo "$PLUGINS" | tr ',' ' '`; do
+   IFC="${IFC:+$IFC,}f:$OUT/$p"
+done
+
+run()
+{
+   "$FLOW_METER" -i "$IFC" -p "$PLUGINS" -r "$PCAP" "$@" >/dev/null || exit 1
+}
+
+run
+run -S 1 -R -a sketch -s 4096 -G 65536
+run -a probation -s 4096 -k outer
+run -a aggregate -s 4096 -t 10:1
@@ -0,0 +1,194 @@
+/**
+ * \file pstatsplugin.cpp
+ * \brief Plugin for exporting packet length and inter-arrival time histograms of flows.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <iostream>
+#include <unirec/unirec.h>
+
+#include "pstatsplugin.h"
+#include "flowifc.h"
+#include "flowcacheplugin.h"
+#include "packet.h"
+#include "flow_meter.h"
+
+using namespace std;
+
+#define PSTATS_UNIREC_TEMPLATE "PSTATS_LEN_HIST,PSTATS_IAT_HIST,PSTATS_SIZES"
+
+UR_FIELDS (
+   bytes PSTATS_LEN_HIST,
+   bytes PSTATS_IAT_HIST,
+   bytes PSTATS_SIZES
+)
+
+/**
+ * \brief Free extensions, chained through their first bytes.
+ *
+ * Extensions are created and destroyed for every flow. They are taken from blocks which are never returned
+ * to the system, so in steady state no memory is allocated.
+ */
+static void *pstats_free = NULL;
+
+void *FlowRecordExtPStats::operator new(size_t size)
+{
+   if (pstats_free == NULL) {
+      char *block = (char *) ::operator new(size * PSTATS_POOL_BLOCK);
+      for (int i = 0; i < PSTATS_POOL_BLOCK; i++) {
+         *(void **) (block + i * size) = pstats_free;
+         pstats_free = block + i * size;
+      }
+   }
+
+   void *ptr = pstats_free;
+   pstats_free = *(void **) ptr;
+   return ptr;
+}
+
+void FlowRecordExtPStats::operator delete(void *ptr)
+{
+   if (ptr != NULL) {
+      *(void **) ptr = pstats_free;
+      pstats_free = ptr;
+   }
+}
+
+/**
+ * \brief Get bin of packet length histogram: floor(log2(length)), capped to the last bin.
+ */
+static inline int pstats_len_bin(uint32_t length)
+{
+   int bin = 31 - __builtin_clz(length | 1);
+   return bin < PSTATS_BINS ? bin : PSTATS_BINS - 1;
+}
+
+/**
+ * \brief Get bin of inter-arrival time histogram: 0 for gaps below 1 ms, floor(log2(ms)) + 1 otherwise,
+ * capped to the last bin.
+ */
+static inline int pstats_iat_bin(double iat)
+{
+   if (iat < 0.001) {
+      return 0;
+   }
+   if (iat >= (1 << (PSTATS_BINS - 2)) / 1000.0) {
+      return PSTATS_BINS - 1;
+   }
+   int bin = 32 - __builtin_clz((uint32_t) (iat * 1000));
+   return bin < PSTATS_BINS ? bin : PSTATS_BINS - 1;
+}
+
+/**
+ * \brief Add packet into statistics.
+ */
+static inline void pstats_update(FlowRecordExtPStats *ext, const Packet &pkt)
+{
+   uint32_t &len = ext->len_hist[pstats_len_bin(pkt.ipLength)];
+   len += (len != 0xFFFFFFFF);
+
+   if (ext->sizes_cnt < PSTATS_SEQ_LEN) {
+      ext->sizes[ext->sizes_cnt++] = pkt.ipLength;
+   }
+}
+
+/**
+ * \brief Constructor.
+ * \param [in] options Module options.
+ */
+PStatsPlugin::PStatsPlugin(const options_t &module_options) : statsout(module_options.statsout), flows(0)
+{
+}
+
+PStatsPlugin::PStatsPlugin(const options_t &module_options, vector<plugin_opt> plugin_options) : FlowCachePlugin(plugin_options), statsout(module_options.statsout), flows(0)
+{
+}
+
+int PStatsPlugin::post_create(FlowRecord &rec, const Packet &pkt)
+{
+   FlowRecordExtPStats *ext = new FlowRecordExtPStats();
+   pstats_update(ext, pkt);
+   ext->last_ts = pkt.timestamp;
+   rec.addExtension(ext);
+   flows++;
+
+   return 0;
+}
+
+int PStatsPlugin::post_update(FlowRecord &rec, const Packet &pkt)
+{
+   FlowRecordExtPStats *ext = (FlowRecordExtPStats *) rec.getExtension(pstats);
+   if (ext == NULL) {
+      return 0;
+   }
+
+   pstats_update(ext, pkt);
+
+   uint32_t &iat = ext->iat_hist[pstats_iat_bin(pkt.timestamp - ext->last_ts)];
+   iat += (iat != 0xFFFFFFFF);
+   ext->last_ts = pkt.timestamp;
+
+   return 0;
+}
+
+void PStatsPlugin::finish()
+{
+   if (!statsout) {
+      cout << "PStats plugin stats:" << endl;
+      cout << "Flows with packet statistics: " << flows << endl;
+   }
+}
+
+int PStatsPlugin::get_payload_depth() const
+{
+   return PAYLOAD_NONE;
+}
+
+FlowRecordExt *PStatsPlugin::create_ext(uint16_t ext_type)
+{
+   if (ext_type == pstats) {
+      return new FlowRecordExtPStats();
+   }
+   return NULL;
+}
+
+std::string PStatsPlugin::get_unirec_field_string()
+{
+   return PSTATS_UNIREC_TEMPLATE;
+}
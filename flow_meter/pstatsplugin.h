@@ -0,0 +1,138 @@
+/**
+ * \file pstatsplugin.h
+ * \brief Plugin for exporting packet length and inter-arrival time histograms of flows.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifndef PSTATSPLUGIN_H
+#define PSTATSPLUGIN_H
+
+#include <string>
+#include <arpa/inet.h>
+
+#include "fields.h"
+#include "flowifc.h"
+#include "flowcacheplugin.h"
+#include "packet.h"
+#include "flow_meter.h"
+
+using namespace std;
+
+#define PSTATS_BINS        16    /**< Number of bins of histograms. */
+#define PSTATS_SEQ_LEN     16    /**< Number of packet lengths stored from the start of flow. */
+#define PSTATS_POOL_BLOCK  4096  /**< Number of extensions allocated at once when pool is empty. */
+
+/**
+ * \brief Flow record extension header for storing packet statistics.
+ *
+ * Bin i of length histogram counts packets with IP length in [2^i, 2^(i+1)), bin 15 counts longer packets.
+ * Bin 0 of inter-arrival time histogram counts gaps below 1 ms, bin i gaps in [2^(i-1), 2^i) ms, bin 15
+ * longer gaps. Counters are not wrapped, they saturate.
+ */
+struct FlowRecordExtPStats : FlowRecordExt {
+   uint32_t len_hist[PSTATS_BINS];
+   uint32_t iat_hist[PSTATS_BINS];
+   uint16_t sizes[PSTATS_SEQ_LEN];
+   uint8_t sizes_cnt;
+   double last_ts;
+
+   /**
+    * \brief Constructor.
+    */
+   FlowRecordExtPStats() : FlowRecordExt(pstats)
+   {
+      memset(len_hist, 0, sizeof(len_hist));
+      memset(iat_hist, 0, sizeof(iat_hist));
+      sizes_cnt = 0;
+      last_ts = 0;
+   }
+
+   virtual void fillUnirec(ur_template_t *tmplt, void *record)
+   {
+      uint32_t len[PSTATS_BINS];
+      uint32_t iat[PSTATS_BINS];
+      uint16_t seq[PSTATS_SEQ_LEN];
+
+      for (int i = 0; i < PSTATS_BINS; i++) {
+         len[i] = htonl(len_hist[i]);
+         iat[i] = htonl(iat_hist[i]);
+      }
+      for (int i = 0; i < sizes_cnt; i++) {
+         seq[i] = htons(sizes[i]);
+      }
+      ur_set_var(tmplt, record, F_PSTATS_LEN_HIST, len, sizeof(len));
+      ur_set_var(tmplt, record, F_PSTATS_IAT_HIST, iat, sizeof(iat));
+      ur_set_var(tmplt, record, F_PSTATS_SIZES, seq, sizes_cnt * sizeof(seq[0]));
+   }
+
+   virtual bool checkpoint(checkpoint_buffer &buf)
+   {
+      buf.field(len_hist);
+      buf.field(iat_hist);
+      buf.field(sizes);
+      buf.field(sizes_cnt);
+      buf.field(last_ts);
+      // Corrupted checkpoint must not overflow sizes in fillUnirec
+      return buf.ok && sizes_cnt <= PSTATS_SEQ_LEN;
+   }
+
+   static void *operator new(size_t size);
+   static void operator delete(void *ptr);
+};
+
+/**
+ * \brief Flow cache plugin for exporting packet statistics.
+ */
+class PStatsPlugin : public FlowCachePlugin
+{
+public:
+   PStatsPlugin(const options_t &module_options);
+   PStatsPlugin(const options_t &module_options, vector<plugin_opt> plugin_options);
+   int post_create(FlowRecord &rec, const Packet &pkt);
+   int post_update(FlowRecord &rec, const Packet &pkt);
+   void finish();
+   std::string get_unirec_field_string();
+   int get_payload_depth() const;
+   FlowRecordExt *create_ext(uint16_t ext_type);
+
+private:
+   bool statsout;       /**< Indicator whether to print stats when flow cache is finishing or not. */
+   uint64_t flows;      /**< Total number of flows with packet statistics. */
+};
+
+#endif
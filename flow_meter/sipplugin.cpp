@@ -43,6 +43,11 @@
 #include <iostream>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <unirec/unirec.h>
 
 #include "packet.h"
@@ -52,6 +57,7 @@
 using namespace std;
 
 #define SIP_UNIREC_TEMPLATE  "SIP_MSG_TYPE,SIP_STATUS_CODE,SIP_CSEQ,SIP_CALLING_PARTY,SIP_CALLED_PARTY,SIP_CALL_ID,SIP_USER_AGENT,SIP_REQUEST_URI,SIP_VIA"
+#define SIP_DIALOG_UNIREC_TEMPLATE  "SIP_MSG_TYPE,SIP_CALLING_PARTY,SIP_CALLED_PARTY,SIP_CALL_ID,SIP_USER_AGENT,SIP_FINAL_STATUS,SIP_SETUP_DELAY,SIP_DURATION,SIP_MSG_COUNT"
 
 UR_FIELDS (
    uint16 SIP_MSG_TYPE,
@@ -62,17 +68,51 @@ UR_FIELDS (
    string SIP_CALL_ID,
    string SIP_USER_AGENT,
    string SIP_REQUEST_URI,
-   string SIP_VIA
+   string SIP_VIA,
+   uint16 SIP_FINAL_STATUS,
+   uint32 SIP_SETUP_DELAY,
+   uint32 SIP_DURATION,
+   uint32 SIP_MSG_COUNT
 )
 
-SIPPlugin::SIPPlugin(const options_t &module_options) : statsout(module_options.statsout), requests(0), responses(0), total(0)
+SIPPlugin::SIPPlugin(const options_t &module_options) : statsout(module_options.statsout), requests(0), responses(0), total(0),
+   dialog_mode(false), dialogs(NULL), exporter(NULL), last_sweep(0), dialogs_exported(0), dialogs_evicted(0)
 {
    flush_flow = true;
 }
 
-SIPPlugin::SIPPlugin(const options_t &module_options, vector<plugin_opt> plugin_options) : FlowCachePlugin(plugin_options), statsout(module_options.statsout), requests(0), responses(0), total(0)
+SIPPlugin::SIPPlugin(const options_t &module_options, vector<plugin_opt> plugin_options, bool dialog_mode) : FlowCachePlugin(plugin_options),
+   statsout(module_options.statsout), requests(0), responses(0), total(0),
+   dialog_mode(dialog_mode), dialogs(NULL), exporter(NULL), last_sweep(0), dialogs_exported(0), dialogs_evicted(0)
 {
    flush_flow = true;
+   if (dialog_mode) {
+      dialogs = new sip_dialog_t[SIP_DIALOG_TABLE_SIZE];
+      memset(dialogs, 0, SIP_DIALOG_TABLE_SIZE * sizeof(sip_dialog_t));
+   }
+}
+
+SIPPlugin::~SIPPlugin()
+{
+   if (dialogs != NULL) {
+      for (int i = 0; i < SIP_DIALOG_TABLE_SIZE; i++) {
+         delete dialogs[i].rec;
+      }
+      delete [] dialogs;
+   }
+}
+
+void SIPPlugin::set_exporter(FlowExporter *exp)
+{
+   exporter = exp;
+}
+
+void SIPPlugin::export_expired(double now)
+{
+   if (dialog_mode && now - last_sweep >= SIP_DIALOG_SWEEP) {
+      dialog_expire(now, false);
+      last_sweep = now;
+   }
 }
 
 int SIPPlugin::post_create(FlowRecord &rec, const Packet &pkt)
@@ -84,6 +124,10 @@ int SIPPlugin::post_create(FlowRecord &rec, const Packet &pkt)
       return 0;
    }
 
+   if (dialog_mode) {
+      return process_msg(rec, pkt, msg_type);
+   }
+
    FlowRecordExtSIP *sip_data = new FlowRecordExtSIP();
    sip_data->msg_type = msg_type;
    rec.addExtension(sip_data);
@@ -97,6 +141,10 @@ int SIPPlugin::pre_update(FlowRecord &rec, Packet &pkt)
 
    msg_type = parse_msg_type(pkt);
    if (msg_type != SIP_MSG_TYPE_INVALID) {
+      if (dialog_mode) {
+         /* Messages are aggregated to dialogs, the transport flow is kept in the cache. */
+         return process_msg(rec, pkt, msg_type);
+      }
       return FLOW_FLUSH;
    }
 
@@ -104,15 +152,234 @@ int SIPPlugin::pre_update(FlowRecord &rec, Packet &pkt)
 }
 void SIPPlugin::finish()
 {
+   if (dialog_mode) {
+      dialog_expire(0, true);
+   }
+
    if (!statsout) {
       cout << "SIP plugin stats:" << endl;
       cout << "Parsed sip requests: " << requests << endl;
       cout << "Parsed sip responses: " << responses << endl;
       cout << "Total sip packets processed: " << total << endl;
+      if (dialog_mode) {
+         cout << "Exported sip dialogs: " << dialogs_exported << endl;
+         cout << "Dialogs evicted from full table: " << dialogs_evicted << endl;
+      }
+   }
+}
+
+/**
+ * \brief Parse SIP message and add it to its dialog.
+ * \param [in] rec Flow record of the transport flow.
+ * \param [in] pkt Packet carrying the message.
+ * \param [in] msg_type Type of the message.
+ * \return 0, transport flow is never flushed in dialog mode.
+ */
+int SIPPlugin::process_msg(const FlowRecord &rec, const Packet &pkt, uint16_t msg_type)
+{
+   FlowRecordExtSIP msg;
+
+   msg.msg_type = msg_type;
+   parser_process_sip(pkt, &msg);
+   dialog_update(rec, pkt, msg);
+   /* Flow cache sweeps dialogs also when no SIP message arrives. */
+   export_expired(pkt.timestamp);
+
+   return 0;
+}
+
+/**
+ * \brief Compute hash of a Call-ID (64-bit FNV-1a).
+ */
+static inline uint64_t sip_call_id_hash(const char *call_id)
+{
+   uint64_t hash = 14695981039346656037ULL;
+   while (*call_id) {
+      hash ^= (uint8_t) *call_id++;
+      hash *= 1099511628211ULL;
+   }
+   return hash;
+}
+
+/**
+ * \brief Get method name from CSeq header value ("<number> <method>").
+ */
+static inline const char *sip_cseq_method(const char *cseq)
+{
+   const char *method = strchr(cseq, ' ');
+   if (method == NULL) {
+      return "";
+   }
+   while (*method == ' ') {
+      method++;
+   }
+   return method;
+}
+
+/**
+ * \brief Find (or create) dialog of the message and update it.
+ * \param [in] rec Flow record of the transport flow.
+ * \param [in] pkt Packet carrying the message.
+ * \param [in] msg Parsed message.
+ */
+void SIPPlugin::dialog_update(const FlowRecord &rec, const Packet &pkt, const FlowRecordExtSIP &msg)
+{
+   if (msg.call_id[0] == 0) {
+      return;
+   }
+
+   uint64_t hash = sip_call_id_hash(msg.call_id);
+   unsigned int line = (hash % (SIP_DIALOG_TABLE_SIZE / SIP_DIALOG_LINE_SIZE)) * SIP_DIALOG_LINE_SIZE;
+   sip_dialog_t *dialog = NULL;
+   sip_dialog_t *empty = NULL;
+   sip_dialog_t *oldest = NULL;
+
+   for (unsigned int i = line; i < line + SIP_DIALOG_LINE_SIZE; i++) {
+      sip_dialog_t &d = dialogs[i];
+      if (d.rec == NULL) {
+         if (empty == NULL) {
+            empty = &d;
+         }
+      } else if (d.hash == hash && !strcmp(d.ext->call_id, msg.call_id)) {
+         dialog = &d;
+         break;
+      } else if (oldest == NULL || d.rec->flowEndTimestamp < oldest->rec->flowEndTimestamp) {
+         oldest = &d;
+      }
+   }
+
+   if (dialog == NULL) {
+      if (empty == NULL) {
+         /* Line is full, make space by exporting the least recently updated dialog. */
+         dialogs_evicted++;
+         dialog_export(*oldest);
+         empty = oldest;
+      }
+      dialog = empty;
+      dialog->hash = hash;
+      dialog->rec = new FlowRecord();
+      *dialog->rec = rec;
+      dialog->rec->exts = NULL;
+      dialog->rec->flowStartTimestamp = pkt.timestamp;
+      dialog->rec->packetTotalCount = 0;
+      dialog->rec->octetTotalLength = 0;
+      dialog->ext = new FlowRecordExtSIPDialog();
+      dialog->rec->addExtension(dialog->ext);
+      strcpy(dialog->ext->call_id, msg.call_id);
+   }
+
+   FlowRecord *drec = dialog->rec;
+   FlowRecordExtSIPDialog *ext = dialog->ext;
+
+   drec->flowEndTimestamp = pkt.timestamp;
+   drec->packetTotalCount++;
+   drec->octetTotalLength += pkt.ipLength;
+   ext->msg_count++;
+
+   if (msg.msg_type <= 10) {
+      if (ext->msg_type == 0 && msg.msg_type != SIP_MSG_TYPE_ACK && msg.msg_type != SIP_MSG_TYPE_CANCEL &&
+          msg.msg_type != SIP_MSG_TYPE_BYE) {
+         /* Initial request of the dialog. */
+         ext->msg_type = msg.msg_type;
+         ext->request_time = pkt.timestamp;
+         strncpy(ext->method, sip_cseq_method(msg.cseq), sizeof(ext->method) - 1);
+         ext->method[sizeof(ext->method) - 1] = 0;
+         strcpy(ext->calling_party, msg.calling_party);
+         strcpy(ext->called_party, msg.called_party);
+         strcpy(ext->user_agent, msg.user_agent);
+      } else if (ext->calling_party[0] == 0) {
+         /* Dialog was seen in the middle, take the parties from any request. */
+         strcpy(ext->calling_party, msg.calling_party);
+         strcpy(ext->called_party, msg.called_party);
+         strcpy(ext->user_agent, msg.user_agent);
+      }
+      return;
+   }
+
+   /* Response: */
+   const char *method = sip_cseq_method(msg.cseq);
+   /* Status of a response without valid status line is 0. */
+   uint16_t status = (msg.status_code >= 100 && msg.status_code < 700 ? msg.status_code : 0);
+
+   if (ext->msg_type != 0 && ext->final_status == 0 && status >= 200 &&
+       !strcmp(method, ext->method)) {
+      ext->final_status = status;
+      ext->setup_delay = (uint32_t) ((pkt.timestamp - ext->request_time) * 1000);
+      if (ext->msg_type == SIP_MSG_TYPE_INVITE) {
+         if (status < 300) {
+            ext->answer_time = pkt.timestamp;
+         } else {
+            dialog_export(*dialog); /* Call was not established. */
+         }
+      } else {
+         dialog_export(*dialog); /* Transaction outside of INVITE dialog is finished. */
+      }
+      return;
+   }
+
+   if (status >= 200 && !strcmp(method, "BYE")) {
+      dialog_export(*dialog); /* Call was terminated. */
+   }
+}
+
+/**
+ * \brief Export dialog and free its slot.
+ * \param [in,out] dialog Dialog to export.
+ */
+void SIPPlugin::dialog_export(sip_dialog_t &dialog)
+{
+   FlowRecordExtSIPDialog *ext = dialog.ext;
+
+   if (ext->answer_time > 0) {
+      ext->duration = (uint32_t) ((dialog.rec->flowEndTimestamp - ext->answer_time) * 1000);
+   }
+   if (exporter != NULL) {
+      exporter->export_flow(*dialog.rec);
+   }
+   dialogs_exported++;
+
+   delete dialog.rec;
+   dialog.rec = NULL;
+   dialog.ext = NULL;
+}
+
+/**
+ * \brief Export dialogs without a message for SIP_DIALOG_TIMEOUT seconds.
+ * \param [in] now Current time.
+ * \param [in] all Export all dialogs regardless of time.
+ */
+void SIPPlugin::dialog_expire(double now, bool all)
+{
+   for (int i = 0; i < SIP_DIALOG_TABLE_SIZE; i++) {
+      if (dialogs[i].rec != NULL && (all || now - dialogs[i].rec->flowEndTimestamp >= SIP_DIALOG_TIMEOUT)) {
+         dialog_export(dialogs[i]);
+      }
+   }
+}
+plugin_interest SIPPlugin::get_interest() const
+{
+   // First four bytes of messages recognized by parse_msg_type.
+   static const char *signatures[] = {
+      "INVI", "REGI", "NOTI", "OPTI", "CANC", "INFO", "ACK ", "BYE ", "PUBL", "SUBS", "SIP/"
+   };
+   plugin_interest interest(INTEREST_TCP | INTEREST_UDP);
+   for (unsigned int i = 0; i < sizeof(signatures) / sizeof(signatures[0]); i++) {
+      interest.signatures.push_back(signatures[i]);
+   }
+   return interest;
+}
+FlowRecordExt *SIPPlugin::create_ext(uint16_t ext_type)
+{
+   if (ext_type == sip && !dialog_mode) {
+      return new FlowRecordExtSIP();
    }
+   return NULL;
 }
 string SIPPlugin::get_unirec_field_string()
 {
+   if (dialog_mode) {
+      return SIP_DIALOG_UNIREC_TEMPLATE;
+   }
    return SIP_UNIREC_TEMPLATE;
 }
 
@@ -122,291 +389,196 @@ uint16_t SIPPlugin::parse_msg_type(const Packet &pkt)
       return SIP_MSG_TYPE_INVALID;
    }
 
-   uint32_t *first_bytes;
-   uint32_t check;
+   const char *payload = pkt.transportPayloadPacketSection;
 
    /* Is there any payload to process? */
    if (pkt.transportPayloadPacketSectionSize < SIP_MIN_MSG_LEN) {
       return SIP_MSG_TYPE_INVALID;
    }
 
-   /* Get first four bytes of the packet and compare them against the patterns: */
-   first_bytes = (uint32_t *) pkt.transportPayloadPacketSection;
-
-   /* Apply the pattern on the packet: */
-   check = *first_bytes ^ SIP_TEST_1;
-
-   /*
-    * Here we will check if at least one of bytes in the SIP pattern is present in the packet.
-    * Add magic_bits to longword
-    *                |      Set those bits which were unchanged by the addition
-    *                |             |        Look at the hole bits. If some of them is unchanged,
-    *                |             |            |    most likely there is zero byte, ie. our separator.
-    *                v             v            v                                                       */
-   if ((((check + MAGIC_BITS) ^ ~check) & MAGIC_BITS_NEG) != 0) {
-      /* At least one byte of the test pattern was found -> the packet *may* contain one of the searched SIP messages: */
-      switch (*first_bytes) {
-      case SIP_REGISTER:
-         return SIP_MSG_TYPE_REGISTER;
-      case SIP_INVITE:
+   /* Compare the first four bytes of the packet against the request methods and the status line: */
+   switch (payload[0]) {
+   case 'I':
+      if (!memcmp(payload, "INVI", 4)) {
          return SIP_MSG_TYPE_INVITE;
-      case SIP_OPTIONS:
-                /* OPTIONS message is also a request in HTTP - we must identify false positives here: */
-         if (first_bytes[1] == SIP_NOT_OPTIONS1 && first_bytes[2] == SIP_NOT_OPTIONS2) {
-            return SIP_MSG_TYPE_OPTIONS;
-         }
-
-         return SIP_MSG_TYPE_INVALID;
-      case SIP_NOTIFY:	/* Notify message is a bit tricky because also Microsoft's SSDP protocol uses HTTP-like structure
-                * and NOTIFY message - we must identify false positives here: */
-         if (first_bytes[1] == SIP_NOT_NOTIFY1 && first_bytes[2] == SIP_NOT_NOTIFY2) {
-            return SIP_MSG_TYPE_INVALID;
-         }
-
-         return SIP_MSG_TYPE_NOTIFY;
-      case SIP_CANCEL:
-         return SIP_MSG_TYPE_CANCEL;
-      case SIP_INFO:
+      } else if (!memcmp(payload, "INFO", 4)) {
          return SIP_MSG_TYPE_INFO;
-      default:
-         break;
       }
-   }
-
-   /* Do the same thing for the second pattern: */
-   check = *first_bytes ^ SIP_TEST_2;
-   if ((((check + MAGIC_BITS) ^ ~check) & MAGIC_BITS_NEG) != 0) {
-      switch (*first_bytes) {
-      case SIP_REPLY:
+      break;
+   case 'R':
+      if (!memcmp(payload, "REGI", 4)) {
+         return SIP_MSG_TYPE_REGISTER;
+      }
+      break;
+   case 'O':
+      /* OPTIONS message is also a request in HTTP - we must identify false positives here: */
+      if (!memcmp(payload, "OPTIONS sip:", 12)) {
+         return SIP_MSG_TYPE_OPTIONS;
+      }
+      break;
+   case 'N':
+      /* Notify message is a bit tricky because also Microsoft's SSDP protocol uses HTTP-like structure
+       * and NOTIFY message - we must identify false positives here: */
+      if (!memcmp(payload, "NOTI", 4)) {
+         return memcmp(payload + 4, "FY * HTT", 8) ? SIP_MSG_TYPE_NOTIFY : SIP_MSG_TYPE_INVALID;
+      }
+      break;
+   case 'C':
+      if (!memcmp(payload, "CANC", 4)) {
+         return SIP_MSG_TYPE_CANCEL;
+      }
+      break;
+   case 'S':
+      if (!memcmp(payload, "SIP/", 4)) {
          return SIP_MSG_TYPE_STATUS;
-      case SIP_ACK:
+      } else if (!memcmp(payload, "SUBS", 4)) {
+         return SIP_MSG_TYPE_SUBSCRIBE;
+      }
+      break;
+   case 'A':
+      if (!memcmp(payload, "ACK ", 4)) {
          return SIP_MSG_TYPE_ACK;
-      case SIP_BYE:
+      }
+      break;
+   case 'B':
+      if (!memcmp(payload, "BYE ", 4)) {
          return SIP_MSG_TYPE_BYE;
-      case SIP_SUBSCRIBE:
-         return SIP_MSG_TYPE_SUBSCRIBE;
-      case SIP_PUBLISH:
+      }
+      break;
+   case 'P':
+      if (!memcmp(payload, "PUBL", 4)) {
          return SIP_MSG_TYPE_PUBLISH;
-      default:
-         break;
       }
+      break;
+   default:
+      break;
    }
 
    /* No pattern found, this is probably not SIP packet: */
    return SIP_MSG_TYPE_INVALID;
 }
 
-const unsigned char * SIPPlugin::parser_strtok(const unsigned char *str, unsigned int instrlen, char separator, unsigned int *strlen, parser_strtok_t * nst)
+/**
+ * \brief Find first occurrence of character in buffer.
+ * Compares 16 bytes at once using SSE2 when available (baseline on x86-64), falls back to memchr.
+ * \param [in] ptr Beginning of buffer.
+ * \param [in] end End of buffer.
+ * \param [in] c Character to find.
+ * \return Pointer to the character or NULL if not found.
+ */
+static inline const unsigned char *sip_find(const unsigned char *ptr, const unsigned char *end, unsigned char c)
 {
-   const unsigned char *char_ptr;	/* Currently processed characters */
-   const unsigned char *beginning;	/* Beginning of the original string */
-   MAGIC_INT *longword_ptr;	/* Currently processed word */
-   MAGIC_INT longword;	/* Dereferenced longword_ptr useful for the next work */
-   MAGIC_INT longword_mask;	/* Dereferenced longword_ptr with applied separator mask */
-   const unsigned char *cp;	/* A byte which is supposed to be the next separator */
-   int len;		/* Length of the string */
-   MAGIC_INT i;
-
-   /*
-    * The idea of the algorithm comes from the implementation of stdlib function strlen().
-    * See http://www.stdlib.net/~colmmacc/strlen.c.html for further details.
-    */
-
-   /* First or next run? */
-   if (str != NULL) {
-
-      char_ptr = str;
-      nst->saveptr = NULL;
-      nst->separator = separator;
-      nst->instrlen = instrlen;
-
-      /* Create a separator mask - put the separator to each byte of the integer: */
-      nst->separator_mask = 0;
-      for (i = 0; i < sizeof(longword) * 8; i += 8) {
-         nst->separator_mask |= (((MAGIC_INT) separator) << i);
+#ifdef __SSE2__
+   const __m128i needle = _mm_set1_epi8(c);
+   for (; ptr + 16 <= end; ptr += 16) {
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) ptr), needle));
+      if (mask != 0) {
+         return ptr + __builtin_ctz(mask);
       }
-
-   } else if (nst->saveptr != NULL && nst->instrlen > 0) {
-      /* Next run: */
-      char_ptr = nst->saveptr;
-   } else {
-      /* Last run: */
+   }
+#endif
+   if (ptr >= end) {
       return NULL;
    }
+   return (const unsigned char *) memchr(ptr, c, end - ptr);
+}
 
-   /*
-    * Handle the first few characters by reading one character at a time.
-    * Do this until CHAR_PTR is aligned on a longword boundary:
-    */
-   len = 0;
-   beginning = char_ptr;
-   for (; ((unsigned long int)char_ptr & (sizeof(longword) - 1)) != 0; ++char_ptr) {
-
-      /* We found the separator - return the string immediately: */
-      if (*char_ptr == nst->separator) {
-         *strlen = len;
-         nst->saveptr = char_ptr + 1;
-         if (nst->instrlen > 0) {
-            nst->instrlen--;
-         }
-         return beginning;
-      }
-      len++;
-
-      /* This is end of string - return the string as it is: */
-      nst->instrlen--;
-      if (nst->instrlen == 0) {
-         *strlen = len;
-         nst->saveptr = NULL;
-         return beginning;
-      }
+/**
+ * \brief Look up SIP header name.
+ * Names of interesting headers (including compact forms) are distinct in length and first character,
+ * which serve as a perfect hash; the name is then verified case-insensitively.
+ * \param [in] name Header name.
+ * \param [in] len Length of header name.
+ * \return SIP_HDR_* identifier.
+ */
+static inline int sip_header_id(const unsigned char *name, unsigned int len)
+{
+   static const struct {
+      const char *name;
+      int id;
+   } headers[] = {
+      { "f", SIP_HDR_FROM }, { "t", SIP_HDR_TO }, { "v", SIP_HDR_VIA }, { "i", SIP_HDR_CALL_ID },
+      { "to", SIP_HDR_TO }, { "via", SIP_HDR_VIA }, { "from", SIP_HDR_FROM }, { "cseq", SIP_HDR_CSEQ },
+      { "call-id", SIP_HDR_CALL_ID }, { "user-agent", SIP_HDR_USER_AGENT }
+   };
+   int idx;
+
+   switch ((len << 8) | (name[0] | 0x20)) {
+   case (1 << 8) | 'f': idx = 0; break;
+   case (1 << 8) | 't': idx = 1; break;
+   case (1 << 8) | 'v': idx = 2; break;
+   case (1 << 8) | 'i': idx = 3; break;
+   case (2 << 8) | 't': idx = 4; break;
+   case (3 << 8) | 'v': idx = 5; break;
+   case (4 << 8) | 'f': idx = 6; break;
+   case (4 << 8) | 'c': idx = 7; break;
+   case (7 << 8) | 'c': idx = 8; break;
+   case (10 << 8) | 'u': idx = 9; break;
+   default:
+      return SIP_HDR_UNKNOWN;
    }
 
-#define FOUND(A)        { nst->saveptr = cp + (A) + 1; *strlen = len + A; nst->instrlen -= A + 1; return beginning; }
-
-   /* Go across the string word by word: */
-   longword_ptr = (unsigned long int *)char_ptr;
-   for (;;) {
-      /*
-       * Get the current item and move to the next one. The XOR operator does the following thing:
-       * If the byte is separator, sets it to zero. Otherwise it is nonzero.
-       */
-      longword = *longword_ptr++;
-      longword_mask = longword ^ nst->separator_mask;
-
-      /* Check the end of string. If we don't have enough bytes for the next longword, return what we have: */
-      if (nst->instrlen < sizeof(longword)) {
-
-         /* The separator could be just before the end of the buffer: */
-         cp = (const unsigned char *)(longword_ptr - 1);
-         for (i = 0; i < nst->instrlen; i++) {
-
-            if (cp[i] == nst->separator) {
-               /* Correct string length: */
-               *strlen = len + i;
-
-               /* If the separator is the last character in the buffer: */
-               if (nst->instrlen == i + 1) {
-                  nst->saveptr = NULL;
-               } else {
-                  nst->saveptr = cp + i + 1;
-                  nst->instrlen -= i + 1;
-               }
-               return beginning;
-            }
-         }
-         /* Separator not found, so return the rest of buffer: */
-         *strlen = len + nst->instrlen;
-         nst->saveptr = NULL;
-         return beginning;
-      }
-
-      /*
-       * Here we will try to find the separator:
-       * Add magic_bits to longword
-       *             |      Set those bits which were unchanged by the addition
-       *             |             |        Look at the hole bits. If some of them is unchanged,
-       *             |             |            |    most likely there is zero byte, ie. our separator.
-       *             v             v            v                                                       */
-      if ((((longword_mask + MAGIC_BITS) ^ ~longword_mask) & MAGIC_BITS_NEG) != 0) {
-
-         /* Convert the integer back to the string: */
-         cp = (const unsigned char *)(longword_ptr - 1);
-
-         /* Find out which byte is the separator: */
-         if (cp[0] == nst->separator)
-            FOUND(0);
-         if (cp[1] == nst->separator)
-            FOUND(1);
-         if (cp[2] == nst->separator)
-            FOUND(2);
-         if (cp[3] == nst->separator)
-            FOUND(3);
-         if (sizeof(longword) > 4) {
-            if (cp[4] == nst->separator)
-               FOUND(4);
-            if (cp[5] == nst->separator)
-               FOUND(5);
-            if (cp[6] == nst->separator)
-               FOUND(6);
-            if (cp[7] == nst->separator)
-               FOUND(7);
-         }
-      }
-
-      /* Add the length: */
-      len += sizeof(longword);
-      nst->instrlen -= sizeof(longword);
+   if (strncasecmp((const char *) name, headers[idx].name, len) != 0) {
+      return SIP_HDR_UNKNOWN;
    }
+   return headers[idx].id;
 }
 
-void SIPPlugin::parser_field_value(const unsigned char *line, int linelen, int skip, char *dst, unsigned int dstlen)
+void SIPPlugin::parser_field_value(const unsigned char *line, int linelen, char *dst, unsigned int dstlen)
 {
-   parser_strtok_t pst;
-   unsigned int newlen;
-
-   /* Skip the leading characters: */
-   line += skip;
-   linelen -= skip;
+   const unsigned char *sep;
 
    /* Skip whitespaces: */
-   while (isalnum(*line) == 0 && linelen > 0) {
+   while (linelen > 0 && isalnum(*line) == 0) {
       line++;
       linelen--;
    }
 
    /* Trim trailing whitespaces: */
-   while (isalnum(line[linelen - 1]) == 0 && linelen > 0) {
+   while (linelen > 0 && isalnum(line[linelen - 1]) == 0) {
       linelen--;
    }
 
    /* Find the first field value: */
-   line = parser_strtok(line, linelen, ';', &newlen, &pst);
+   sep = sip_find(line, line + linelen, ';');
+   if (sep != NULL) {
+      linelen = sep - line;
+   }
 
    /* Trim to the length of the destination buffer: */
-   if (newlen > dstlen - 1) {
-      newlen = dstlen - 1;
+   if (linelen > (int) dstlen - 1) {
+      linelen = dstlen - 1;
    }
 
    /* Copy the buffer: */
-   memcpy(dst, line, newlen);
-   dst[newlen] = 0;
+   memcpy(dst, line, linelen);
+   dst[linelen] = 0;
 }
 
-void SIPPlugin::parser_field_uri(const unsigned char *line, int linelen, int skip, char *dst, unsigned int dstlen)
+void SIPPlugin::parser_field_uri(const unsigned char *line, int linelen, char *dst, unsigned int dstlen)
 {
-   parser_strtok_t pst;
-   unsigned int newlen;
-   unsigned int final_len;
+   const unsigned char *end = line + linelen;
+   const unsigned char *start = NULL;
+   const unsigned char *colon = line;
+   const unsigned char *sep;
    uint32_t uri;
-   const unsigned char *start;
-
-   /* Skip leading characters: */
-   line += skip;
-   linelen -= skip;
-
-   /* Find the first colon, this could be probably a part of the SIP uri: */
-   start = NULL;
-   final_len = 0;
-   line = parser_strtok(line, linelen, ':', &newlen, &pst);
-   while (line != NULL && newlen > 0) {
-      /* Add the linelen to get the position of the first colon: */
-      line += newlen;
-      newlen = linelen - newlen;
-      /* The characters before colon must be sip or sips: */
-      uri = SIP_UCFOUR(*((uint32_t *) (line - SIP_URI_LEN)));
-      if (uri == SIP_URI) {
-         start = line - SIP_URI_LEN;
-         final_len = newlen + SIP_URI_LEN;
-         break;
-      } else if (uri == SIP_URIS) {
-         start = line - SIP_URIS_LEN;
-         final_len = newlen + SIP_URIS_LEN;
+
+   /* Find colon which is a part of the SIP uri, the characters before colon must be sip or sips: */
+   while ((colon = sip_find(colon, end, ':')) != NULL) {
+      if (colon - line >= SIP_URIS_LEN) {
+         uri = SIP_UCFOUR(*((uint32_t *) (colon - SIP_URI_LEN)));
+         if (uri == SIP_URI) {
+            start = colon - SIP_URI_LEN;
+            break;
+         } else if (uri == SIP_URIS) {
+            start = colon - SIP_URIS_LEN;
+            break;
+         }
+      } else if (colon - line >= SIP_URI_LEN && SIP_UCFOUR(*((uint32_t *) (colon - SIP_URI_LEN))) == SIP_URI) {
+         start = colon - SIP_URI_LEN;
          break;
       }
-
-      /* Not a sip uri - find the next colon: */
-      line = parser_strtok(NULL, 0, ' ', &newlen, &pst);
+      colon++;
    }
 
    /* No URI found? Exit: */
@@ -415,23 +587,19 @@ void SIPPlugin::parser_field_uri(const unsigned char *line, int linelen, int ski
    }
 
    /* Now we have the beginning of the SIP uri. Find the end - >, ; or EOL: */
-   line = parser_strtok(start, final_len, '>', &newlen, &pst);
-   if (newlen < final_len) {
-      final_len = newlen;
+   if ((sep = sip_find(start, end, '>')) != NULL) {
+      end = sep;
+   } else if ((sep = sip_find(start, end, ';')) != NULL) {
+      end = sep;
    } else {
-      /* No bracket found, try to find at least a semicolon: */
-      line = parser_strtok(start, final_len, ';', &newlen, &pst);
-      if (newlen < final_len) {
-         final_len = newlen;
-      } else {
-         /* Nor semicolon found. Strip the whitespaces from the end of line and use the whole line: */
-         while (isalpha(start[final_len - 1]) == 0 && final_len > 0) {
-            final_len--;
-         }
+      /* Nor semicolon found. Strip the whitespaces from the end of line and use the whole line: */
+      while (end > start && isalpha(end[-1]) == 0) {
+         end--;
       }
    }
 
    /* Trim to the length of the destination buffer: */
+   unsigned int final_len = end - start;
    if (final_len > dstlen - 1) {
       final_len = dstlen - 1;
    }
@@ -444,39 +612,37 @@ void SIPPlugin::parser_field_uri(const unsigned char *line, int linelen, int ski
 int SIPPlugin::parser_process_sip(const Packet &pkt, FlowRecordExtSIP *sip_data)
 {
    const unsigned char *payload;
+   const unsigned char *end;
    const unsigned char *line;
-   int caplen;
-   unsigned int line_len = 0;
+   const unsigned char *eol;
+   unsigned int line_len;
    int field_len;
-   parser_strtok_t line_parser;
-   uint32_t first_bytes4;
-   uint32_t first_bytes3;
-   uint32_t first_bytes2;
 
    /* Skip the packet headers: */
    payload = (unsigned char *)pkt.transportPayloadPacketSection;
-   caplen = pkt.transportPayloadPacketSectionSize;
+   end = payload + pkt.transportPayloadPacketSectionSize;
 
    /* Grab the first line of the payload: */
-   line = parser_strtok(payload, caplen, '\n', &line_len, &line_parser);
-
+   line = payload;
+   eol = sip_find(line, end, '\n');
+   line_len = (eol != NULL ? eol : end) - line;
+
+   /* Note: First SIP request line has syntax: "Method SP Request-URI SP SIP-Version CRLF" (SP=single space) */
+   const unsigned char *token = sip_find(line, line + line_len, ' ');
+   const unsigned char *token_end = NULL;
+   if (token != NULL) {
+      token++;
+      token_end = sip_find(token, line + line_len, ' ');
+      if (token_end == NULL) {
+         token_end = line + line_len;
+      }
+   }
 
-   /* Get Request-URI for SIP requests from first line of the payload: */
    if (sip_data->msg_type <= 10) {
+      /* Get Request-URI for SIP requests from first line of the payload: */
       requests++;
-      /* Note: First SIP request line has syntax: "Method SP Request-URI SP SIP-Version CRLF" (SP=single space) */
-      parser_strtok_t first_line_parser;
-      const unsigned char *line_token;
-      unsigned int line_token_len;
-
-      /* Get Method part of request: */
-      line_token = parser_strtok(line, line_len, ' ', &line_token_len, &first_line_parser);
-      /* Get Request-URI part of request: */
-      line_token = parser_strtok(NULL, 0, ' ', &line_token_len, &first_line_parser);
-
-      if (line_token != NULL) {
-         /* Request-URI: */
-         parser_field_value(line_token, line_token_len, 0, sip_data->request_uri, sizeof(sip_data->request_uri));
+      if (token != NULL) {
+         parser_field_value(token, token_end - token, sip_data->request_uri, sizeof(sip_data->request_uri));
       } else {
          /* Not found */
          sip_data->request_uri[0] = 0;
@@ -484,86 +650,72 @@ int SIPPlugin::parser_process_sip(const Packet &pkt, FlowRecordExtSIP *sip_data)
    } else {
       responses++;
       if (sip_data->msg_type == 99) {
-         parser_strtok_t first_line_parser;
-         const unsigned char *line_token;
-         unsigned int line_token_len;
-         line_token = parser_strtok(line, line_len, ' ', &line_token_len, &first_line_parser);
-         line_token = parser_strtok(NULL, 0, ' ', &line_token_len, &first_line_parser);
          sip_data->status_code = SIP_MSG_TYPE_UNDEFINED;
-         if (line_token) {
-            sip_data->status_code = atoi((const char *)line_token);
+         if (token != NULL) {
+            sip_data->status_code = atoi((const char *)token);
          }
       }
    }
 
    total++;
-   /* Go to the next line. Divide the packet payload by line breaks and process them one by one: */
-   line = parser_strtok(NULL, 0, ' ', &line_len, &line_parser);
 
    /*
-    * Process all the remaining attributes:
+    * Process all the remaining header lines in one pass, empty line ends the header:
     */
-   while (line != NULL && line_len > 1) {
-      /* Get first 4, 3 and 2 bytes and compare them with searched SIP fields: */
-      first_bytes4 = SIP_UCFOUR(*((uint32_t *) line));
-      first_bytes3 = SIP_UCTHREE(*((uint32_t *) line));
-      first_bytes2 = SIP_UCTWO(*((uint32_t *) line));
-
-      /* From: */
-      if (first_bytes4 == SIP_FROM4) {
-         parser_field_uri(line, line_len, 5, sip_data->calling_party, sizeof(sip_data->calling_party));
-      } else if (first_bytes2 == SIP_FROM2) {
-         parser_field_uri(line, line_len, 2, sip_data->calling_party, sizeof(sip_data->calling_party));
+   while (eol != NULL) {
+      line = eol + 1;
+      eol = sip_find(line, end, '\n');
+      line_len = (eol != NULL ? eol : end) - line;
+      if (line_len <= 1) {
+         break;
       }
 
-      /* To: */
-      else if (first_bytes3 == SIP_TO3) {
-         parser_field_uri(line, line_len, 3, sip_data->called_party, sizeof(sip_data->called_party));
-      } else if (first_bytes2 == SIP_TO2) {
-         parser_field_uri(line, line_len, 2, sip_data->called_party, sizeof(sip_data->called_party));
+      /* Split the line to header name and value: */
+      const unsigned char *colon = sip_find(line, line + line_len, ':');
+      if (colon == NULL) {
+         continue;
+      }
+      const unsigned char *name_end = colon;
+      while (name_end > line && (name_end[-1] == ' ' || name_end[-1] == '\t')) {
+         name_end--;
       }
+      if (name_end == line) {
+         continue;
+      }
+      const unsigned char *value = colon + 1;
+      int value_len = line + line_len - value;
 
-      /* Via: */
-      else if (first_bytes4 == SIP_VIA4) {
+      switch (sip_header_id(line, name_end - line)) {
+      case SIP_HDR_FROM:
+         parser_field_uri(value, value_len, sip_data->calling_party, sizeof(sip_data->calling_party));
+         break;
+      case SIP_HDR_TO:
+         parser_field_uri(value, value_len, sip_data->called_party, sizeof(sip_data->called_party));
+         break;
+      case SIP_HDR_VIA:
          /* Via fields can be present more times. Include all and separate them by semicolons: */
          if (sip_data->via[0] == 0) {
-            parser_field_value(line, line_len, 4, sip_data->via, sizeof(sip_data->via));
+            parser_field_value(value, value_len, sip_data->via, sizeof(sip_data->via));
          } else {
             field_len = strlen(sip_data->via);
-            sip_data->via[field_len++] = ';';
-            parser_field_value(line, line_len, 4, sip_data->via + field_len, sizeof(sip_data->via) - field_len);
-         }
-      } else if (first_bytes2 == SIP_VIA2) {
-         if (sip_data->via[0] == 0) {
-            parser_field_value(line, line_len, 2, sip_data->via, sizeof(sip_data->via));
-         } else {
-            field_len = strlen(sip_data->via);
-            sip_data->via[field_len++] = ';';
-            parser_field_value(line, line_len, 2, sip_data->via + field_len, sizeof(sip_data->via) - field_len);
+            if (field_len + 2 < (int) sizeof(sip_data->via)) {
+               sip_data->via[field_len++] = ';';
+               parser_field_value(value, value_len, sip_data->via + field_len, sizeof(sip_data->via) - field_len);
+            }
          }
+         break;
+      case SIP_HDR_CALL_ID:
+         parser_field_value(value, value_len, sip_data->call_id, sizeof(sip_data->call_id));
+         break;
+      case SIP_HDR_USER_AGENT:
+         parser_field_value(value, value_len, sip_data->user_agent, sizeof(sip_data->user_agent));
+         break;
+      case SIP_HDR_CSEQ:
+         parser_field_value(value, value_len, sip_data->cseq, sizeof(sip_data->cseq));
+         break;
+      default:
+         break;
       }
-
-      /* Call-ID: */
-      else if (first_bytes4 == SIP_CALLID4) {
-         parser_field_value(line, line_len, 8, sip_data->call_id, sizeof(sip_data->call_id));
-      } else if (first_bytes2 == SIP_CALLID2) {
-         parser_field_value(line, line_len, 2, sip_data->call_id, sizeof(sip_data->call_id));
-      }
-
-      /* User-Agent: */
-      else if (first_bytes4 == SIP_USERAGENT4) {
-         parser_field_value(line, line_len, 11, sip_data->user_agent, sizeof(sip_data->user_agent));
-      }
-
-      /* CSeq: */
-      else if (first_bytes4 == SIP_CSEQ4) {
-
-         /* Save CSeq: */
-         parser_field_value(line, line_len, 5, sip_data->cseq, sizeof(sip_data->cseq));
-      }
-
-      /* Go to the next line: */
-      line = parser_strtok(NULL, 0, ' ', &line_len, &line_parser);
    }
 
    return 0;
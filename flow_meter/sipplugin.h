@@ -55,6 +55,12 @@
 
 #define SIP_FIELD_LEN				256
 
+/* Dialog correlation table: */
+#define SIP_DIALOG_TABLE_SIZE    8192     /* Maximal number of dialogs kept in the table */
+#define SIP_DIALOG_LINE_SIZE     8        /* Number of dialogs in one line of the table */
+#define SIP_DIALOG_TIMEOUT       300.0    /* Dialog is exported after this number of seconds without a message */
+#define SIP_DIALOG_SWEEP         5.0      /* Interval between searches for timed out dialogs */
+
 #define SIP_MSG_TYPE_INVALID     0
 #define SIP_MSG_TYPE_INVITE      1
 #define SIP_MSG_TYPE_ACK         2
@@ -87,73 +93,17 @@
 /* Mininum length of SIP message: */
 #define SIP_MIN_MSG_LEN     64
 
-/*
- * SIP identification table - these are all patterns that must be contained
- * at the beginning of the SIP packet. They are folded in the same group if
- * they have same the letter on the same position.
- */
-/* ** The first pattern test group: ** */
-/*                                     v    */
-#define SIP_INVITE		0x49564e49	/* IVNI */
-#define SIP_REGISTER	0x49474552	/* IGER */
-/*                                     vv   */
-#define SIP_NOTIFY		0x49544f4e	/* ITON */
-#define SIP_OPTIONS		0x4954504f	/* ITPO */
-/*                                       v  */
-#define SIP_CANCEL		0x434e4143	/* CNAC */
-/*                                        v */
-#define SIP_INFO		0x4f464e49	/* OFNI */
-
-/* ** Test second pattern test group: ** */
-/*                                     v    */
-#define SIP_ACK			0x204b4341	/*  KCA */
-#define SIP_BYE			0x20455942	/*  EYB */
-
-/*                                      v   */
-#define SIP_PUBLISH		0x4c425550	/* LBUP */
-#define SIP_SUBSCRIBE	0x53425553	/* SBUS */
-/*                                       vv */
-#define SIP_REPLY	    0x2f504953	/* /PIS */
-
-/* If one of the bytes in the tested packet equals to byte in the
- * test pattern, the packet *could* begin with the strings which
- * where used to make the test pattern.
- */
-#define SIP_TEST_1      0x49544149	/* ITAI */
-#define SIP_TEST_2      0x20424953	/*  BIS */
-
-/* MS SSDP notify header for detecting false SIP packets: */
-#define SIP_NOT_NOTIFY1 0x2a205946	/* * YF */
-#define SIP_NOT_NOTIFY2 0x54544820	/* TTH  */
-
-#define SIP_NOT_OPTIONS1 0x20534e4f	/*  SNO */
-#define SIP_NOT_OPTIONS2 0x3a706973	/* :sip */
-/*
- * SIP fields table - these patterns are used to quickly
- * detect necessary SIP fields.
- */
 /* This macro converts low ASCII characters to upper case. Colon changes to 0x1a character: */
 #define SIP_UCFOUR(A)   ((A) & 0xdfdfdfdf)
-#define SIP_UCTWO(A)    ((A) & 0x0000dfdf)
-#define SIP_UCTHREE(A)  ((A) & 0x00dfdfdf)
-/* Encoded SIP field names - long and short alternatives. The trailing number means the number of bytes to compare: */
-#define SIP_VIA4        0x1a414956	/* :AIV */
-#define SIP_VIA2        0x00001a56	/*   :V */
-#define SIP_FROM4       0x4d4f5246	/* MORF */
-#define SIP_FROM2       0x00001a46	/*   :F */
-#define SIP_TO3         0x001a4f54	/*  :OT */
-#define SIP_TO2         0x00001a54	/*   :T */
-#define SIP_CALLID4     0x4c4c4143	/* LLAC */
-#define SIP_CALLID2     0x00001a49	/*   :I */
-#define SIP_CSEQ4       0x51455343	/* QESC */
-#define SIP_CONT4       0x544e4f43	/* TNOC */
-#define SIP_CONT2       0x00001a43	/*   :C */
-#define SIP_USERAGENT4  0x52455355	/* RESU */
-#define SIP_CONT_SDP3   0x00504453	/*  PDS */
-/* Encoded SDP field names: */
-#define SDP_MAUDIO      0x55411d4d	/* UA=M */
-#define SDP_MVIDEO      0x49561d4d	/* IV=M */
-#define SDP_CONNECT     0x4e491d43	/* NI=C */
+
+/* SIP header fields processed by the parser (long and compact forms map to the same identifier): */
+#define SIP_HDR_UNKNOWN     0
+#define SIP_HDR_FROM        1
+#define SIP_HDR_TO          2
+#define SIP_HDR_VIA         3
+#define SIP_HDR_CALL_ID     4
+#define SIP_HDR_CSEQ        5
+#define SIP_HDR_USER_AGENT  6
 
 /* Encoded SIP URI start: */
 #define SIP_URI         0x1a504953	/* :PIS */
@@ -161,53 +111,6 @@
 #define SIP_URIS        0x1a535049	/* :SPI */
 #define SIP_URIS_LEN    4
 
-/* Length of initial characters to skip in some of SIP or SDP fields: */
-#define SIP_STATUS_PAD  8	/* Skip SIP/2.0 */
-#define SDP_AUDIO_PAD   8	/* Skip m=audio */
-#define SDP_VIDEO_PAD   8	/* Skip m=video */
-#define SDP_CONN_PAD    7	/* Skip c=IN IP */
-#define SDP_CONN_IP_PAD 9	/* Skip c=IN IP4 */
-
-/*
- * Bits 31, 24, 16, and 8 of this number are zero.  Call these bits
- * the "holes."  Note that there is a hole just to the left of
- * each byte, with an extra at the end:
- *
- * bits:  01111110 11111110 11111110 11111111
- * bytes: AAAAAAAA BBBBBBBB CCCCCCCC DDDDDDDD
- *
- * The 1-bits make sure that carries propagate to the next 0-bit.
- * The 0-bits provide holes for carries to fall into.
- * The magic bits are added to the inspected part of string.
- * If the string contains zero byte, the corresponding hole
- * remains empty. Otherwise it is set to zero due of overflow.
- */
-
-#ifdef __amd64__
-#define MAGIC_INT       uint64_t
-#define MAGIC_BITS      0x7efefefe7efefeffL
-#define MAGIC_BITS_NEG  0x8101010181010100L
-#else
-#define MAGIC_INT       uint32_t
-#define MAGIC_BITS      0x7efefeffL
-#define MAGIC_BITS_NEG  0x81010100L
-#endif
-
-struct parser_strtok_t {
-   parser_strtok_t()
-   {
-      separator_mask = 0;
-      saveptr = NULL;
-      separator = 0;
-      instrlen = 0;
-   }
-
-   MAGIC_INT separator_mask;
-   const unsigned char *saveptr;
-   char separator;
-   unsigned int instrlen;
-};
-
 struct FlowRecordExtSIP : FlowRecordExt {
    uint16_t msg_type;                  /* SIP message code (register, invite) < 100 or SIP response status > 100 */
    uint16_t status_code;
@@ -244,29 +147,114 @@ struct FlowRecordExtSIP : FlowRecordExt {
       ur_set_string(tmplt, record, F_SIP_REQUEST_URI, request_uri);
       ur_set_string(tmplt, record, F_SIP_VIA, via);
    }
+
+   virtual bool checkpoint(checkpoint_buffer &buf)
+   {
+      buf.field(msg_type);
+      buf.field(status_code);
+      buf.field(call_id);
+      buf.field(calling_party);
+      buf.field(called_party);
+      buf.field(via);
+      buf.field(user_agent);
+      buf.field(cseq);
+      buf.field(request_uri);
+      return buf.ok;
+   }
+};
+
+/**
+ * \brief Flow record extension header for storing aggregated SIP dialog.
+ */
+struct FlowRecordExtSIPDialog : FlowRecordExt {
+   uint16_t msg_type;                  /* Type of request which started the dialog, 0 if not seen */
+   uint16_t final_status;              /* Final response status to the initial request */
+   uint32_t setup_delay;               /* Milliseconds between initial request and its final response */
+   uint32_t duration;                  /* Milliseconds between answer and end of the dialog */
+   uint32_t msg_count;                 /* Number of SIP messages of the dialog */
+   char call_id[SIP_FIELD_LEN];
+   char calling_party[SIP_FIELD_LEN];
+   char called_party[SIP_FIELD_LEN];
+   char user_agent[SIP_FIELD_LEN];
+   char method[16];                    /* CSeq method of the initial request */
+   double request_time;                /* Timestamp of the initial request */
+   double answer_time;                 /* Timestamp of 2xx response to INVITE */
+
+   FlowRecordExtSIPDialog() : FlowRecordExt(sip_dialog)
+   {
+      msg_type = 0;
+      final_status = 0;
+      setup_delay = 0;
+      duration = 0;
+      msg_count = 0;
+      call_id[0] = 0;
+      calling_party[0] = 0;
+      called_party[0] = 0;
+      user_agent[0] = 0;
+      method[0] = 0;
+      request_time = 0;
+      answer_time = 0;
+   }
+
+   virtual void fillUnirec(ur_template_t *tmplt, void *record)
+   {
+      ur_set(tmplt, record, F_SIP_MSG_TYPE, msg_type);
+      ur_set_string(tmplt, record, F_SIP_CALL_ID, call_id);
+      ur_set_string(tmplt, record, F_SIP_CALLING_PARTY, calling_party);
+      ur_set_string(tmplt, record, F_SIP_CALLED_PARTY, called_party);
+      ur_set_string(tmplt, record, F_SIP_USER_AGENT, user_agent);
+      ur_set(tmplt, record, F_SIP_FINAL_STATUS, final_status);
+      ur_set(tmplt, record, F_SIP_SETUP_DELAY, setup_delay);
+      ur_set(tmplt, record, F_SIP_DURATION, duration);
+      ur_set(tmplt, record, F_SIP_MSG_COUNT, msg_count);
+   }
+};
+
+/**
+ * \brief Slot of SIP dialog table.
+ */
+struct sip_dialog_t {
+   uint64_t hash;                      /* Hash of Call-ID */
+   FlowRecord *rec;                    /* Aggregated dialog, NULL if slot is empty */
+   FlowRecordExtSIPDialog *ext;        /* Dialog extension of rec */
 };
 
 class SIPPlugin : public FlowCachePlugin {
 public:
    SIPPlugin(const options_t &module_options);
-   SIPPlugin(const options_t &module_options, vector<plugin_opt> plugin_options);
+   SIPPlugin(const options_t &module_options, vector<plugin_opt> plugin_options, bool dialog_mode = false);
+   ~SIPPlugin();
    int post_create(FlowRecord &rec, const Packet &pkt);
    int pre_update(FlowRecord &rec, Packet &pkt);
    void finish();
    std::string get_unirec_field_string();
+   plugin_interest get_interest() const;
+   FlowRecordExt *create_ext(uint16_t ext_type);
+   void set_exporter(FlowExporter *exp);
+   void export_expired(double now);
 
 private:
    uint16_t parse_msg_type(const Packet &pkt);
-   const unsigned char *parser_strtok(const unsigned char *str, unsigned int instrlen, char separator, unsigned int *strlen, parser_strtok_t *nst);
    int parser_process_sip(const Packet &pkt, FlowRecordExtSIP *sip_data);
-   void parser_field_uri(const unsigned char *line, int linelen, int skip, char *dst, unsigned int dstlen);
-   void parser_field_value(const unsigned char *line, int linelen, int skip, char *dst, unsigned int dstlen);
+   void parser_field_uri(const unsigned char *line, int linelen, char *dst, unsigned int dstlen);
+   void parser_field_value(const unsigned char *line, int linelen, char *dst, unsigned int dstlen);
+   int process_msg(const FlowRecord &rec, const Packet &pkt, uint16_t msg_type);
+   void dialog_update(const FlowRecord &rec, const Packet &pkt, const FlowRecordExtSIP &msg);
+   void dialog_export(sip_dialog_t &dialog);
+   void dialog_expire(double now, bool all);
 
    bool statsout;
    bool flush_flow;
    uint32_t requests;
    uint32_t responses;
    uint32_t total;
+
+   bool dialog_mode;                   /* Aggregate messages to dialogs instead of exporting each message */
+   sip_dialog_t *dialogs;              /* Dialog table, SIP_DIALOG_TABLE_SIZE slots */
+   FlowExporter *exporter;             /* Exporter of finished dialogs */
+   double last_sweep;                  /* Timestamp of the last search for timed out dialogs */
+   uint32_t dialogs_exported;
+   uint32_t dialogs_evicted;
 };
 
 #endif
@@ -0,0 +1,412 @@
+/**
+ * \file tlsplugin.cpp
+ * \brief Plugin for parsing TLS ClientHello and ServerHello messages.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <unirec/unirec.h>
+
+#include "tlsplugin.h"
+#include "flowifc.h"
+#include "flowcacheplugin.h"
+#include "packet.h"
+#include "flow_meter.h"
+#include "md5.h"
+
+using namespace std;
+
+//#define DEBUG_TLS
+
+// Print debug message if debugging is allowed.
+#ifdef DEBUG_TLS
+#define DEBUG_MSG(format, ...) fprintf(stderr, format, ##__VA_ARGS__)
+#else
+#define DEBUG_MSG(format, ...)
+#endif
+
+// Process code if debugging is allowed.
+#ifdef DEBUG_TLS
+#define DEBUG_CODE(code) code
+#else
+#define DEBUG_CODE(code)
+#endif
+
+#define TLS_UNIREC_TEMPLATE "TLS_VERSION,TLS_CIPHER,TLS_SNI,TLS_ALPN,TLS_JA3"
+
+#define TLS_JA3_MAXLEN 1024 /**< Maximal length of JA3 string, longer strings are not hashed. */
+
+#define GET_U16(ptr) ((uint16_t) (((ptr)[0] << 8) | (ptr)[1]))
+#define GET_U24(ptr) ((uint32_t) (((ptr)[0] << 16) | ((ptr)[1] << 8) | (ptr)[2]))
+
+UR_FIELDS (
+   uint16 TLS_VERSION,
+   uint16 TLS_CIPHER,
+   string TLS_SNI,
+   string TLS_ALPN,
+   bytes TLS_JA3
+)
+
+/**
+ * \brief Append number to JA3 list.
+ * \param [in,out] ja3 JA3 string buffer of TLS_JA3_MAXLEN bytes.
+ * \param [in,out] len Length of JA3 string, set to TLS_JA3_MAXLEN on overflow.
+ * \param [in] val Value to append.
+ * \param [in] first Value is the first item of list.
+ */
+static void ja3_append(char *ja3, int &len, unsigned int val, bool first)
+{
+   if (len >= TLS_JA3_MAXLEN) {
+      return;
+   }
+   int ret = snprintf(ja3 + len, TLS_JA3_MAXLEN - len, (first ? "%u" : "-%u"), val);
+   len = (ret < 0 || len + ret >= TLS_JA3_MAXLEN ? TLS_JA3_MAXLEN : len + ret);
+}
+
+/**
+ * \brief Append separator to JA3 string.
+ */
+static void ja3_separator(char *ja3, int &len)
+{
+   if (len < TLS_JA3_MAXLEN - 1) {
+      ja3[len++] = ',';
+      ja3[len] = 0;
+   } else {
+      len = TLS_JA3_MAXLEN;
+   }
+}
+
+/**
+ * \brief Copy string of given length into fixed size buffer.
+ */
+static void copy_field(char *dst, size_t dst_size, const uint8_t *src, size_t len)
+{
+   if (len >= dst_size) {
+      len = dst_size - 1;
+   }
+   memcpy(dst, src, len);
+   dst[len] = 0;
+}
+
+/**
+ * \brief Constructor.
+ * \param [in] options Module options.
+ */
+TLSPlugin::TLSPlugin(const options_t &module_options) : statsout(module_options.statsout), client_hellos(0), server_hellos(0), total(0)
+{
+}
+
+TLSPlugin::TLSPlugin(const options_t &module_options, vector<plugin_opt> plugin_options) : FlowCachePlugin(plugin_options), statsout(module_options.statsout), client_hellos(0), server_hellos(0), total(0)
+{
+}
+
+int TLSPlugin::post_create(FlowRecord &rec, const Packet &pkt)
+{
+   if ((pkt.packetFieldIndicator & PCKT_PAYLOAD_MASK) != PCKT_PAYLOAD_MASK) { // If payload is not present, return.
+      return 0;
+   }
+
+   return add_ext_tls((const uint8_t *) pkt.transportPayloadPacketSection, pkt.transportPayloadPacketSectionSize, rec);
+}
+
+int TLSPlugin::pre_update(FlowRecord &rec, Packet &pkt)
+{
+   if ((pkt.packetFieldIndicator & PCKT_PAYLOAD_MASK) != PCKT_PAYLOAD_MASK) { // If payload is not present, return.
+      return 0;
+   }
+   if (rec.getExtension(tls) != NULL) { // Hello message of this flow is already parsed.
+      return 0;
+   }
+
+   return add_ext_tls((const uint8_t *) pkt.transportPayloadPacketSection, pkt.transportPayloadPacketSectionSize, rec);
+}
+
+void TLSPlugin::finish()
+{
+   if (!statsout) {
+      cout << "TLS plugin stats:" << endl;
+      cout << "Parsed ClientHello messages: " << client_hellos << endl;
+      cout << "Parsed ServerHello messages: " << server_hellos << endl;
+      cout << "Total tls packets processed: " << total << endl;
+   }
+}
+
+std::string TLSPlugin::get_unirec_field_string()
+{
+   return TLS_UNIREC_TEMPLATE;
+}
+
+plugin_interest TLSPlugin::get_interest() const
+{
+   // Handshake record of TLS 1.x (SSL 3.0 record version is 0x0300 too).
+   plugin_interest interest(INTEREST_TCP);
+   interest.signatures.push_back(string("\x16\x03", 2));
+   return interest;
+}
+
+FlowRecordExt *TLSPlugin::create_ext(uint16_t ext_type)
+{
+   if (ext_type == tls) {
+      return new FlowRecordExtTLS();
+   }
+   return NULL;
+}
+
+/**
+ * \brief Parse TLS hello message and add extension to flow record on success.
+ * \param [in] data Pointer to packet payload section.
+ * \param [in] payload_len Payload length.
+ * \param [out] rec Destination flow record.
+ * \return FLOW_PLUGIN_DONE when hello message was parsed, 0 otherwise.
+ */
+int TLSPlugin::add_ext_tls(const uint8_t *data, int payload_len, FlowRecord &rec)
+{
+   FlowRecordExtTLS *ext = new FlowRecordExtTLS();
+   if (parse_hello(data, payload_len, ext)) {
+      rec.addExtension(ext);
+      return FLOW_PLUGIN_DONE; // Nothing more to inspect in this flow.
+   }
+
+   delete ext;
+   return 0;
+}
+
+/**
+ * \brief Parse ClientHello or ServerHello message. Payload is read in place, only exported strings are copied.
+ * \param [in] data Pointer to packet payload section.
+ * \param [in] payload_len Payload length.
+ * \param [out] ext Extension to fill.
+ * \return True if hello message was parsed.
+ */
+bool TLSPlugin::parse_hello(const uint8_t *data, int payload_len, FlowRecordExtTLS *ext)
+{
+   const uint8_t *end = data + payload_len;
+   const uint8_t *p = data;
+
+   total++;
+
+   // Record header.
+   if (payload_len < 5 || p[0] != TLS_CONTENT_HANDSHAKE) {
+      return false;
+   }
+   if (p + 5 + GET_U16(p + 3) < end) {
+      end = p + 5 + GET_U16(p + 3);
+   }
+   p += 5;
+
+   // Handshake header.
+   if (p + 4 > end) {
+      return false;
+   }
+   uint8_t hs_type = p[0];
+   bool complete = (p + 4 + GET_U24(p + 1) <= end);
+   if (complete) {
+      end = p + 4 + GET_U24(p + 1);
+   }
+   p += 4;
+   if (hs_type != TLS_HANDSHAKE_CLIENT_HELLO && hs_type != TLS_HANDSHAKE_SERVER_HELLO) {
+      return false;
+   }
+   bool client = (hs_type == TLS_HANDSHAKE_CLIENT_HELLO);
+
+   // Version, random and session ID.
+   if (p + 2 + 32 + 1 > end) {
+      return false;
+   }
+   ext->tls_version = GET_U16(p);
+   p += 2 + 32;
+   p += 1 + p[0];
+
+   char ja3[TLS_JA3_MAXLEN];
+   int ja3_len = 0;
+   ja3[0] = 0;
+   ja3_append(ja3, ja3_len, ext->tls_version, true);
+   ja3_separator(ja3, ja3_len);
+
+   if (client) {
+      if (p + 2 > end) {
+         return false;
+      }
+      uint16_t cs_len = GET_U16(p);
+      p += 2;
+      if (p + cs_len > end) {
+         return false;
+      }
+      bool first = true;
+      for (const uint8_t *cs = p; cs + 2 <= p + cs_len; cs += 2) {
+         uint16_t cipher = GET_U16(cs);
+         if (!TLS_IS_GREASE(cipher)) {
+            ja3_append(ja3, ja3_len, cipher, first);
+            first = false;
+         }
+      }
+      p += cs_len;
+      ja3_separator(ja3, ja3_len);
+
+      // Compression methods.
+      if (p + 1 > end) {
+         return false;
+      }
+      p += 1 + p[0];
+      client_hellos++;
+   } else {
+      if (p + 3 > end) {
+         return false;
+      }
+      ext->tls_cipher = GET_U16(p);
+      p += 3; // Cipher suite and compression method.
+      server_hellos++;
+   }
+
+   DEBUG_MSG("TLS %s hello: version %#06x, cipher %#06x\n", (client ? "client" : "server"), ext->tls_version, ext->tls_cipher);
+
+   if (p + 2 <= end) {
+      const uint8_t *ext_end = p + 2 + GET_U16(p);
+      if (ext_end > end) {
+         ext_end = end;
+         complete = false;
+      }
+      if (!parse_extensions(p + 2, ext_end, ext, client, ja3, ja3_len)) {
+         complete = false; // JA3 of malformed extensions would not identify the client.
+      }
+   } else if (client) {
+      ja3_separator(ja3, ja3_len); // No extensions, curves and point formats.
+      ja3_separator(ja3, ja3_len);
+   }
+
+   if (client && complete && ja3_len < TLS_JA3_MAXLEN) {
+      DEBUG_MSG("\tJA3: %s\n", ja3);
+      md5(ja3, ja3_len, ext->tls_ja3);
+      ext->tls_ja3_set = true;
+   }
+
+   return true;
+}
+
+/**
+ * \brief Parse hello extensions.
+ * \param [in] data Pointer to the first extension.
+ * \param [in] end End of extensions.
+ * \param [out] ext Extension to fill.
+ * \param [in] client Extensions belong to ClientHello.
+ * \param [in,out] ja3 JA3 string, extension types, curves and point formats are appended.
+ * \param [in,out] ja3_len Length of JA3 string.
+ * \return True if all extensions were parsed.
+ */
+bool TLSPlugin::parse_extensions(const uint8_t *data, const uint8_t *end, FlowRecordExtTLS *ext, bool client, char *ja3, int &ja3_len)
+{
+   const uint8_t *curves = NULL, *curves_end = NULL;
+   const uint8_t *points = NULL, *points_end = NULL;
+   bool first = true;
+
+   while (data + 4 <= end) {
+      uint16_t type = GET_U16(data);
+      uint16_t len = GET_U16(data + 2);
+      const uint8_t *body = data + 4;
+      data = body + len;
+      if (data > end) {
+         return false;
+      }
+
+      if (client && !TLS_IS_GREASE(type)) {
+         ja3_append(ja3, ja3_len, type, first);
+         first = false;
+      }
+
+      if (type == TLS_EXT_SERVER_NAME && client && len >= 5) {
+         // Server name list: list length, name type, name length, name.
+         uint16_t name_len = GET_U16(body + 3);
+         if (body[2] == 0 && body + 5 + name_len <= data) {
+            copy_field(ext->tls_sni, sizeof(ext->tls_sni), body + 5, name_len);
+         }
+      } else if (type == TLS_EXT_ALPN && len >= 2) {
+         // Protocol name list, offered protocols are exported separated by comma.
+         const uint8_t *proto = body + 2;
+         size_t pos = 0;
+         while (proto < data && proto + 1 + proto[0] <= data && pos + proto[0] + 2 <= sizeof(ext->tls_alpn)) {
+            if (pos != 0) {
+               ext->tls_alpn[pos++] = ',';
+            }
+            memcpy(ext->tls_alpn + pos, proto + 1, proto[0]);
+            pos += proto[0];
+            proto += 1 + proto[0];
+         }
+         ext->tls_alpn[pos] = 0;
+      } else if (type == TLS_EXT_SUPPORTED_VERSIONS) {
+         if (!client && len == 2) {
+            ext->tls_version = GET_U16(body);
+         } else if (client && len >= 1) {
+            for (const uint8_t *ver = body + 1; ver + 2 <= data && ver + 2 <= body + 1 + body[0]; ver += 2) {
+               uint16_t version = GET_U16(ver);
+               if (!TLS_IS_GREASE(version) && version > ext->tls_version) {
+                  ext->tls_version = version;
+               }
+            }
+         }
+      } else if (type == TLS_EXT_SUPPORTED_GROUPS && len >= 2) {
+         curves = body + 2;
+         curves_end = (curves + GET_U16(body) <= data ? curves + GET_U16(body) : data);
+      } else if (type == TLS_EXT_EC_POINT_FORMATS && len >= 1) {
+         points = body + 1;
+         points_end = (points + body[0] <= data ? points + body[0] : data);
+      }
+   }
+
+   if (client) {
+      ja3_separator(ja3, ja3_len);
+      first = true;
+      for (; curves != NULL && curves + 2 <= curves_end; curves += 2) {
+         uint16_t curve = GET_U16(curves);
+         if (!TLS_IS_GREASE(curve)) {
+            ja3_append(ja3, ja3_len, curve, first);
+            first = false;
+         }
+      }
+      ja3_separator(ja3, ja3_len);
+      first = true;
+      for (; points != NULL && points < points_end; points++) {
+         ja3_append(ja3, ja3_len, *points, first);
+         first = false;
+      }
+   }
+
+   return data == end;
+}
@@ -0,0 +1,141 @@
+/**
+ * \file tlsplugin.h
+ * \brief Plugin for parsing TLS ClientHello and ServerHello messages.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef TLSPLUGIN_H
+#define TLSPLUGIN_H
+
+#include <string>
+#include <string.h>
+
+#include "fields.h"
+#include "flowifc.h"
+#include "flowcacheplugin.h"
+#include "packet.h"
+#include "flow_meter.h"
+#include "md5.h"
+
+using namespace std;
+
+#define TLS_CONTENT_HANDSHAKE    22
+#define TLS_HANDSHAKE_CLIENT_HELLO 1
+#define TLS_HANDSHAKE_SERVER_HELLO 2
+
+#define TLS_EXT_SERVER_NAME         0
+#define TLS_EXT_SUPPORTED_GROUPS    10
+#define TLS_EXT_EC_POINT_FORMATS    11
+#define TLS_EXT_ALPN                16
+#define TLS_EXT_SUPPORTED_VERSIONS  43
+
+#define TLS_IS_GREASE(val) (((val) & 0x0F0F) == 0x0A0A && ((val) >> 8) == ((val) & 0xFF)) // RFC 8701 reserved values.
+
+/**
+ * \brief Flow record extension header for storing parsed TLS hello messages.
+ */
+struct FlowRecordExtTLS : FlowRecordExt {
+   uint16_t tls_version;
+   uint16_t tls_cipher;
+   char tls_sni[255];
+   char tls_alpn[64];
+   uint8_t tls_ja3[MD5_DIGEST_LENGTH];
+   bool tls_ja3_set;
+
+   /**
+    * \brief Constructor.
+    */
+   FlowRecordExtTLS() : FlowRecordExt(tls)
+   {
+      tls_version = 0;
+      tls_cipher = 0;
+      tls_sni[0] = 0;
+      tls_alpn[0] = 0;
+      memset(tls_ja3, 0, sizeof(tls_ja3));
+      tls_ja3_set = false;
+   }
+
+   virtual void fillUnirec(ur_template_t *tmplt, void *record)
+   {
+      ur_set(tmplt, record, F_TLS_VERSION, tls_version);
+      ur_set(tmplt, record, F_TLS_CIPHER, tls_cipher);
+      ur_set_string(tmplt, record, F_TLS_SNI, tls_sni);
+      ur_set_string(tmplt, record, F_TLS_ALPN, tls_alpn);
+      ur_set_var(tmplt, record, F_TLS_JA3, tls_ja3, (tls_ja3_set ? MD5_DIGEST_LENGTH : 0));
+   }
+
+   virtual bool checkpoint(checkpoint_buffer &buf)
+   {
+      buf.field(tls_version);
+      buf.field(tls_cipher);
+      buf.field(tls_sni);
+      buf.field(tls_alpn);
+      buf.field(tls_ja3);
+      buf.field(tls_ja3_set);
+      return buf.ok;
+   }
+};
+
+/**
+ * \brief Flow cache plugin for parsing TLS hello messages.
+ */
+class TLSPlugin : public FlowCachePlugin
+{
+public:
+   TLSPlugin(const options_t &module_options);
+   TLSPlugin(const options_t &module_options, vector<plugin_opt> plugin_options);
+   int post_create(FlowRecord &rec, const Packet &pkt);
+   int pre_update(FlowRecord &rec, Packet &pkt);
+   void finish();
+   std::string get_unirec_field_string();
+   plugin_interest get_interest() const;
+   FlowRecordExt *create_ext(uint16_t ext_type);
+
+private:
+   int add_ext_tls(const uint8_t *data, int payload_len, FlowRecord &rec);
+   bool parse_hello(const uint8_t *data, int payload_len, FlowRecordExtTLS *ext);
+   bool parse_extensions(const uint8_t *data, const uint8_t *end, FlowRecordExtTLS *ext, bool client, char *ja3, int &ja3_len);
+
+   bool statsout;          /**< Indicator whether to print stats when flow cache is finishing or not. */
+   uint32_t client_hellos; /**< Total number of parsed ClientHello messages. */
+   uint32_t server_hellos; /**< Total number of parsed ServerHello messages. */
+   uint32_t total;         /**< Total number of processed TLS handshake packets. */
+};
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * \file tunnelplugin.cpp
+ * \brief Plugin for exporting encapsulation information (VLAN, MPLS, tunnels).
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <iostream>
+#include <unirec/unirec.h>
+
+#include "tunnelplugin.h"
+#include "flowifc.h"
+#include "flowcacheplugin.h"
+#include "packet.h"
+#include "flow_meter.h"
+
+using namespace std;
+
+#define TUNNEL_UNIREC_TEMPLATE "VLAN_ID,MPLS_LABEL,TUNNEL_TYPE,TUNNEL_ID"
+
+UR_FIELDS (
+   uint16 VLAN_ID,
+   uint32 MPLS_LABEL,
+   uint8  TUNNEL_TYPE,
+   uint32 TUNNEL_ID
+)
+
+/**
+ * \brief Constructor.
+ * \param [in] options Module options.
+ */
+TunnelPlugin::TunnelPlugin(const options_t &module_options) : statsout(module_options.statsout), vlan(0), mpls(0), tunneled(0)
+{
+}
+
+TunnelPlugin::TunnelPlugin(const options_t &module_options, vector<plugin_opt> plugin_options) : FlowCachePlugin(plugin_options), statsout(module_options.statsout), vlan(0), mpls(0), tunneled(0)
+{
+}
+
+int TunnelPlugin::post_create(FlowRecord &rec, const Packet &pkt)
+{
+   if (!(pkt.packetFieldIndicator & PCKT_ENCAP_MASK)) {
+      return 0;
+   }
+
+   FlowRecordExtTunnel *ext = new FlowRecordExtTunnel();
+   if (pkt.packetFieldIndicator & PCKT_VLANID) {
+      ext->vlan_id = pkt.vlanId;
+      vlan++;
+   }
+   if (pkt.packetFieldIndicator & PCKT_MPLSTOPLABEL) {
+      ext->mpls_label = pkt.mplsTopLabel;
+      mpls++;
+   }
+   if (pkt.packetFieldIndicator & PCKT_TUNNEL) {
+      ext->tunnel_type = pkt.tunnelType;
+      ext->tunnel_id = pkt.tunnelId;
+      tunneled++;
+   }
+   rec.addExtension(ext);
+
+   return 0;
+}
+
+void TunnelPlugin::finish()
+{
+   if (!statsout) {
+      cout << "Tunnel plugin stats:" << endl;
+      cout << "Flows with VLAN tag: " << vlan << endl;
+      cout << "Flows with MPLS label: " << mpls << endl;
+      cout << "Tunneled flows: " << tunneled << endl;
+   }
+}
+
+int TunnelPlugin::get_payload_depth() const
+{
+   return PAYLOAD_NONE;
+}
+
+FlowRecordExt *TunnelPlugin::create_ext(uint16_t ext_type)
+{
+   if (ext_type == tunnel) {
+      return new FlowRecordExtTunnel();
+   }
+   return NULL;
+}
+
+std::string TunnelPlugin::get_unirec_field_string()
+{
+   return TUNNEL_UNIREC_TEMPLATE;
+}
@@ -0,0 +1,115 @@
+/**
+ * \file tunnelplugin.h
+ * \brief Plugin for exporting encapsulation information (VLAN, MPLS, tunnels).
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef TUNNELPLUGIN_H
+#define TUNNELPLUGIN_H
+
+#include <string>
+
+#include "fields.h"
+#include "flowifc.h"
+#include "flowcacheplugin.h"
+#include "packet.h"
+#include "flow_meter.h"
+
+using namespace std;
+
+/**
+ * \brief Flow record extension header for storing encapsulation information.
+ */
+struct FlowRecordExtTunnel : FlowRecordExt {
+   uint16_t vlan_id;
+   uint32_t mpls_label;
+   uint8_t tunnel_type;
+   uint32_t tunnel_id;
+
+   /**
+    * \brief Constructor.
+    */
+   FlowRecordExtTunnel() : FlowRecordExt(tunnel)
+   {
+      vlan_id = 0;
+      mpls_label = 0;
+      tunnel_type = TUNNEL_NONE;
+      tunnel_id = 0;
+   }
+
+   virtual void fillUnirec(ur_template_t *tmplt, void *record)
+   {
+      ur_set(tmplt, record, F_VLAN_ID, vlan_id);
+      ur_set(tmplt, record, F_MPLS_LABEL, mpls_label);
+      ur_set(tmplt, record, F_TUNNEL_TYPE, tunnel_type);
+      ur_set(tmplt, record, F_TUNNEL_ID, tunnel_id);
+   }
+
+   virtual bool checkpoint(checkpoint_buffer &buf)
+   {
+      buf.field(vlan_id);
+      buf.field(mpls_label);
+      buf.field(tunnel_type);
+      buf.field(tunnel_id);
+      return buf.ok;
+   }
+};
+
+/**
+ * \brief Flow cache plugin for exporting encapsulation information.
+ */
+class TunnelPlugin : public FlowCachePlugin
+{
+public:
+   TunnelPlugin(const options_t &module_options);
+   TunnelPlugin(const options_t &module_options, vector<plugin_opt> plugin_options);
+   int post_create(FlowRecord &rec, const Packet &pkt);
+   void finish();
+   std::string get_unirec_field_string();
+   int get_payload_depth() const;
+   FlowRecordExt *create_ext(uint16_t ext_type);
+
+private:
+   bool statsout;       /**< Indicator whether to print stats when flow cache is finishing or not. */
+   uint32_t vlan;       /**< Total number of flows with VLAN tag. */
+   uint32_t mpls;       /**< Total number of flows with MPLS label. */
+   uint32_t tunneled;   /**< Total number of tunneled flows. */
+};
+
+#endif
@@ -0,0 +1,205 @@
+/**
+ * \file benchmark.c
+ * \brief Throughput of filter evaluated from syntax tree, program, filter set and native code.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unirec/unirec.h>
+
+#include "unirecfilter.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "fields.h"
+
+#define BENCH_RECORDS 65536
+#define BENCH_ROUNDS 100
+#define BENCH_TEMPLATE "ipaddr SRC_IP,ipaddr DST_IP,uint16 SRC_PORT,uint16 DST_PORT,uint8 PROTOCOL,uint32 PACKETS,uint64 BYTES,string HTTP_HOST"
+#define BENCH_FILTER "PROTOCOL == 6 && DST_PORT == 443 && BYTES > 1000"
+
+UR_FIELDS()
+
+__thread char *str_buffer = NULL;
+
+static double now()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *strings[] = { "", "example.com", "www.example.com", "cesnet.cz" };
+
+// Get size of dynamic part of records, so records are packed as received ones and not one per page
+static unsigned int dynamic_size(ur_template_t *tmplt)
+{
+   ur_field_id_t id = UR_ITER_BEGIN;
+   unsigned int longest = 0, size = 0;
+   int i;
+
+   for (i = 0; i < (int) (sizeof(strings) / sizeof(strings[0])); i++) {
+      if (strlen(strings[i]) > longest) {
+         longest = strlen(strings[i]);
+      }
+   }
+   while ((id = ur_iter_fields(tmplt, id)) != UR_ITER_END) {
+      if (ur_is_dynamic(id)) {
+         size += longest;
+      }
+   }
+   return size;
+}
+
+// Fill record with values common in flow data, so terms of filter are not always false
+static void fill_record(ur_template_t *tmplt, void *rec)
+{
+   static const uint64_t numbers[] = { 1, 6, 17, 53, 80, 443 };
+   ur_field_id_t id = UR_ITER_BEGIN;
+   char ip[16];
+
+   while ((id = ur_iter_fields(tmplt, id)) != UR_ITER_END) {
+      void *ptr = ur_get_ptr_by_id(tmplt, rec, id);
+      uint64_t number = rand() % 8 < 6 ? numbers[rand() % 6] : (uint64_t) (rand() % 2048);
+
+      switch (ur_get_type(id)) {
+      case UR_TYPE_STRING:
+      case UR_TYPE_BYTES:
+         ur_set_string(tmplt, rec, id, strings[rand() % 4]);
+         break;
+      case UR_TYPE_IP:
+         snprintf(ip, sizeof(ip), "10.0.0.%d", rand() % 4);
+         ip_from_str(ip, (ip_addr_t *) ptr);
+         break;
+      case UR_TYPE_FLOAT:
+         *(float *) ptr = number / 2.0;
+         break;
+      case UR_TYPE_DOUBLE:
+         *(double *) ptr = number / 2.0;
+         break;
+      default:
+         // Integers (little endian), char
+         memcpy(ptr, &number, ur_get_size(id));
+         break;
+      }
+   }
+}
+
+// Evaluate filter on all records in rounds, print records per second and matches per round
+#define BENCH_RUN(NAME, EVAL) do { \
+   double start = now(); \
+   matches = 0; \
+   for (round = 0; round < rounds; round++) { \
+      for (i = 0; i < n; i++) { \
+         matches += (EVAL); \
+      } \
+   } \
+   printf("%-9s %12.0f records/s, %lu matches\n", NAME, (double) n * rounds / (now() - start), matches / rounds); \
+} while (0)
+
+int main(int argc, char **argv)
+{
+   const char *spec = argc > 1 ? argv[1] : BENCH_TEMPLATE;
+   const char *filter = argc > 2 ? argv[2] : BENCH_FILTER;
+   int n = BENCH_RECORDS;
+   int rounds = argc > 3 ? atoi(argv[3]) : BENCH_ROUNDS;
+   ur_template_t *tmplt;
+   struct ast *tree;
+   struct filter_set *set;
+   void **recs;
+   unsigned int var_size;
+   unsigned long matches;
+   int round, i;
+
+   if (argc > 4 || rounds <= 0) {
+      fprintf(stderr, "Usage: %s [TEMPLATE [FILTER [ROUNDS]]]\n", argv[0]);
+      return 1;
+   }
+   if ((tmplt = ur_define_fields_and_update_template(spec, NULL)) == NULL) {
+      fprintf(stderr, "Error: Template could not be created.\n");
+      return 1;
+   }
+   if ((tree = getTree(filter, "benchmark")) == NULL) {
+      ur_free_template(tmplt);
+      return 1;
+   }
+   str_buffer = (char *) malloc(65536);
+   recs = (void **) calloc(n, sizeof(void *));
+   if (str_buffer == NULL || recs == NULL) {
+      fprintf(stderr, "Error: Not enough memory for records.\n");
+      return 1;
+   }
+   var_size = dynamic_size(tmplt);
+   srand(1);
+   for (i = 0; i < n; i++) {
+      if ((recs[i] = ur_create_record(tmplt, var_size)) == NULL) {
+         fprintf(stderr, "Error: Not enough memory for records.\n");
+         return 1;
+      }
+      fill_record(tmplt, recs[i]);
+   }
+
+   BENCH_RUN("ast", evalAST(tree, tmplt, recs[i]));
+   set = compileFilterSet(&tree, 1, tmplt);
+   if (set != NULL && set->programs[0] != NULL) {
+      BENCH_RUN("bytecode", evalProgram(set->programs[0], recs[i]));
+      BENCH_RUN("set", evalFilterSet(set, recs[i], set->memo));
+      if (jitFilterSet(set) == 0) {
+         BENCH_RUN("jit", set->native(recs[i], set->consts, str_buffer));
+      }
+   }
+
+   freeFilterSet(set);
+   freeAST(tree);
+   for (i = 0; i < n; i++) {
+      ur_free_record(recs[i]);
+   }
+   free(recs);
+   free(str_buffer);
+   ur_free_template(tmplt);
+   ur_finalize();
+   return 0;
+}
@@ -48,7 +48,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include "../unirecfilter.h"
+#include "../iptrie.h"
+#include "../valueset.h"
 
 // get numbers of protocols and services
 #include <netdb.h>
@@ -61,6 +64,7 @@
 #include "fields.h"
 
 struct ast *main_tree = NULL;
+int parse_errors = 0;   // Number of errors in filter parsed by the last getTree()
 
 // prevent warnings
 extern struct yy_buffer_state * get_buf();
@@ -186,6 +190,208 @@ struct ast *newIP(char *column, char *cmp, char *ipAddr)
    return (struct ast *) newast;
 }
 
+struct ast *newIPSet(char *column, char *source, int is_file, struct set_item *items)
+{
+   struct ipset *newast = (struct ipset *) malloc(sizeof(struct ipset));
+   newast->type = NODE_T_IPSET;
+   newast->column = column;
+   newast->source = source;
+   newast->is_file = is_file;
+
+   // Prefixes are read again whenever the filter is parsed, e.g. on SIGUSR1
+   newast->trie = createIPTrie();
+   if (newast->trie == NULL) {
+      fprintf(stderr, "Error: Memory allocation error.\n");
+   } else {
+      if (is_file) {
+         if (loadIPPrefixes(newast->trie, source) < 0) {
+            parse_errors++;
+         }
+      } else if (items == NULL) {
+         if (addIPPrefix(newast->trie, source) != 0) {
+            printf("Warning: %s is not a valid IP prefix.\n", source);
+         }
+      }
+      for (; items != NULL; items = items->next) {
+         if (items->s == NULL || addIPPrefix(newast->trie, items->s) != 0) {
+            printf("Warning: Item of set is not a valid IP prefix.\n");
+         }
+      }
+      if (buildIPTrie(newast->trie) != 0) {
+         fprintf(stderr, "Error: Memory allocation error.\n");
+         parse_errors++;
+      }
+   }
+
+   int id = ur_get_id_by_name(column);
+   if (id == UR_E_INVALID_NAME) {
+      printf("Warning: %s is not present in input format.\n", column);
+      newast->id = UR_INVALID_FIELD;
+   } else {
+      newast->id = id;
+   }
+   if (id == UR_E_INVALID_NAME) {
+      // Never matches
+      freeIPTrie(newast->trie);
+      newast->trie = NULL;
+   } else if (ur_get_type(newast->id) != UR_TYPE_IP) {
+      printf("Warning: Type of %s is not IP address.\n", column);
+   }
+   return (struct ast *) newast;
+}
+
+struct set_item *newSetItem(char *s, int64_t number, int is_ip)
+{
+   struct set_item *item = (struct set_item *) malloc(sizeof(struct set_item));
+   item->number = number;
+   item->s = s;
+   item->is_ip = is_ip;
+   item->next = NULL;
+   return item;
+}
+
+// Write items of set as in filter, e.g. {1, 2, "a"}
+static char *setItemsToStr(const struct set_item *items)
+{
+   size_t size = 3;
+   const struct set_item *item;
+   char *str, *p;
+
+   for (item = items; item != NULL; item = item->next) {
+      size += (item->s != NULL ? strlen(item->s) : 21) + 4;
+   }
+   p = str = (char *) malloc(size);
+   if (str == NULL) {
+      return NULL;
+   }
+   p += sprintf(p, "{");
+   for (item = items; item != NULL; item = item->next) {
+      if (item->s == NULL) {
+         p += sprintf(p, "%" PRId64, item->number);
+      } else if (item->is_ip) {
+         p += sprintf(p, "%s", item->s);
+      } else {
+         p += sprintf(p, "\"%s\"", item->s);
+      }
+      if (item->next != NULL) {
+         p += sprintf(p, ", ");
+      }
+   }
+   sprintf(p, "}");
+   return str;
+}
+
+/**
+ * \brief Create node testing membership of field in set.
+ * Type of set is given by type of field: IP prefixes for IP addresses,
+ * integers for integer fields and strings otherwise.
+ * \param[in] column Name of field.
+ * \param[in] items Items of set in reverse order, NULL when they are read from file.
+ * \param[in] filename File with one item per line, NULL for items.
+ */
+struct ast *newSet(char *column, struct set_item *items, char *filename)
+{
+   struct valueset *newast;
+   struct set_item *item, *next, *list = NULL;
+   char *source;
+   int type = -1;
+   int id = ur_get_id_by_name(column);
+
+   // Items are collected by the parser from the last one
+   for (item = items; item != NULL; item = next) {
+      next = item->next;
+      item->next = list;
+      list = item;
+   }
+   source = filename != NULL ? filename : setItemsToStr(list);
+   if (id != UR_E_INVALID_NAME) {
+      type = ur_get_type(id);
+   }
+
+   if (type == UR_TYPE_IP) {
+      struct ast *ipset = newIPSet(column, source, filename != NULL, list);
+      for (item = list; item != NULL; item = next) {
+         next = item->next;
+         free(item->s);
+         free(item);
+      }
+      return ipset;
+   }
+
+   newast = (struct valueset *) calloc(1, sizeof(struct valueset));
+   newast->type = NODE_T_SET;
+   newast->column = column;
+   newast->source = source;
+   newast->is_file = filename != NULL;
+   if (id == UR_E_INVALID_NAME) {
+      printf("Warning: %s is not present in input format.\n", column);
+      newast->id = UR_INVALID_FIELD;
+   } else {
+      newast->id = id;
+   }
+
+   switch (type) {
+   case UR_TYPE_UINT8:
+   case UR_TYPE_INT8:
+   case UR_TYPE_UINT16:
+   case UR_TYPE_INT16:
+   case UR_TYPE_UINT32:
+   case UR_TYPE_INT32:
+   case UR_TYPE_UINT64:
+   case UR_TYPE_INT64:
+      newast->ints = createIntSet();
+      break;
+   case UR_TYPE_STRING:
+   case UR_TYPE_BYTES:
+      newast->strs = createStrSet();
+      break;
+   default:
+      // Sets of fields missing in input format are not created, so they never match
+      if (id != UR_E_INVALID_NAME) {
+         printf("Warning: Type of %s cannot be compared with a set.\n", column);
+      }
+      break;
+   }
+
+   // Values are read again whenever the filter is parsed, e.g. on SIGUSR1
+   if (newast->ints != NULL) {
+      if (filename != NULL && loadIntSet(newast->ints, filename) < 0) {
+         parse_errors++;
+      }
+      for (item = list; item != NULL; item = item->next) {
+         if (item->s != NULL) {
+            printf("Warning: Set of %s contains item which is not a number.\n", column);
+         } else if (addToIntSet(newast->ints, (uint64_t) item->number) != 0) {
+            fprintf(stderr, "Error: Memory allocation error.\n");
+            parse_errors++;
+         }
+      }
+      if (buildIntSet(newast->ints) != 0) {
+         fprintf(stderr, "Error: Memory allocation error.\n");
+         parse_errors++;
+      }
+   } else if (newast->strs != NULL) {
+      if (filename != NULL && loadStrSet(newast->strs, filename) < 0) {
+         parse_errors++;
+      }
+      for (item = list; item != NULL; item = item->next) {
+         if (item->s == NULL || item->is_ip) {
+            printf("Warning: Set of %s contains item which is not a string.\n", column);
+         } else if (addToStrSet(newast->strs, item->s, strlen(item->s)) != 0) {
+            fprintf(stderr, "Error: Memory allocation error.\n");
+            parse_errors++;
+         }
+      }
+   }
+
+   for (item = list; item != NULL; item = next) {
+      next = item->next;
+      free(item->s);
+      free(item);
+   }
+   return (struct ast *) newast;
+}
+
 struct ast *newString(char *column, char *cmp, char *s)
 {
    int retval;
@@ -204,6 +410,7 @@ struct ast *newString(char *column, char *cmp, char *s)
          regerror(retval, &newast->re, errb, 1023);
          printf("Regexp error: %s\n", errb);
          regfree(&newast->re);
+         parse_errors++;
       }
       free(s);
    } else {
@@ -356,6 +563,16 @@ void printAST(struct ast *ast)
 
       break;
       }
+   case NODE_T_IPSET:
+      printf("%s in %s%s", ((struct ipset*) ast)->column,
+            ((struct ipset*) ast)->is_file ? "@file:" : "",
+            ((struct ipset*) ast)->source);
+      break;
+   case NODE_T_SET:
+      printf("%s in %s%s", ((struct valueset*) ast)->column,
+            ((struct valueset*) ast)->is_file ? "@file:" : "",
+            ((struct valueset*) ast)->source);
+      break;
    case NODE_T_STRING:
       printf("%s", ((struct str*) ast)->column);
       switch (((struct ip*) ast)->cmp) {
@@ -413,6 +630,17 @@ void freeAST(struct ast *ast)
       free(((struct ip*) ast)->column);
       // free(&(((struct ip*) ast)->ipAddr));
       break;
+   case NODE_T_IPSET:
+      free(((struct ipset*) ast)->column);
+      free(((struct ipset*) ast)->source);
+      freeIPTrie(((struct ipset*) ast)->trie);
+      break;
+   case NODE_T_SET:
+      free(((struct valueset*) ast)->column);
+      free(((struct valueset*) ast)->source);
+      freeIntSet(((struct valueset*) ast)->ints);
+      freeStrSet(((struct valueset*) ast)->strs);
+      break;
    case NODE_T_STRING:
       free(((struct str*) ast)->column);
       free(((struct str*) ast)->s);
@@ -486,7 +714,7 @@ int compareFloating(double a, double b, cmp_op op) {
       case OP_GT:
          return a > b;
       case OP_EQ:
-         return abs(a - b) < EPS;
+         return fabs(a - b) < EPS;
       default:
          fprintf(stderr, "Warning: Invalid comparisson operator.\n");
          return 0;
@@ -519,9 +747,9 @@ int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec)
       int type = ur_get_type(((struct expression*) ast)->id);
       switch (type) {
       case UR_TYPE_UINT8:
-         return compareSigned(*(uint8_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
+         return compareUnsigned(*(uint8_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
       case UR_TYPE_INT8:
-         return compareUnsigned(*(int8_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
+         return compareSigned(*(int8_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
       case UR_TYPE_INT16:
          return compareSigned(*(int16_t *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression*) ast)->id)), ((struct expression*) ast)->number, ((struct expression*) ast)->cmp);
       case UR_TYPE_UINT16:
@@ -540,7 +768,11 @@ int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec)
       if (((struct expression*) ast)->id == UR_INVALID_FIELD) {
          return 0;
       }
-      return compareFloating(*(double *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression_fp*) ast)->id)), ((struct expression_fp*) ast)->number, ((struct expression_fp*) ast)->cmp);
+      expr = (char *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct expression_fp*) ast)->id));
+      if (ur_get_type(((struct expression_fp*) ast)->id) == UR_TYPE_FLOAT) {
+         return compareFloating(*(float *) expr, ((struct expression_fp*) ast)->number, ((struct expression_fp*) ast)->cmp);
+      }
+      return compareFloating(*(double *) expr, ((struct expression_fp*) ast)->number, ((struct expression_fp*) ast)->cmp);
    case NODE_T_IP:
       if (((struct ip*) ast)->id == UR_INVALID_FIELD) {
          return 0;
@@ -558,6 +790,40 @@ int evalAST(struct ast *ast, const ur_template_t *in_tmplt, const void *in_rec)
       // Address in record is higher than the given one
          return cmp == OP_NE || cmp == OP_GT || cmp == OP_GE;
       }
+   case NODE_T_IPSET:
+      if (((struct ipset*) ast)->trie == NULL) {
+         return 0;
+      }
+      return lookupIPTrie(((struct ipset*) ast)->trie, (ip_addr_t *) (ur_get_ptr_by_id(in_tmplt, in_rec, ((struct ipset*) ast)->id)));
+   case NODE_T_SET:
+      if (((struct valueset*) ast)->ints == NULL && ((struct valueset*) ast)->strs == NULL) {
+         return 0;
+      }
+      expr = (char *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct valueset*) ast)->id));
+      if (((struct valueset*) ast)->strs != NULL) {
+         size = ur_get_var_len(in_tmplt, in_rec, ((struct valueset*) ast)->id);
+         return lookupStrSet(((struct valueset*) ast)->strs, expr, size);
+      }
+      // Signed values are sign extended as when compared with ==
+      switch (ur_get_type(((struct valueset*) ast)->id)) {
+      case UR_TYPE_UINT8:
+         return lookupIntSet(((struct valueset*) ast)->ints, *(uint8_t *) expr);
+      case UR_TYPE_INT8:
+         return lookupIntSet(((struct valueset*) ast)->ints, (int64_t) *(int8_t *) expr);
+      case UR_TYPE_UINT16:
+         return lookupIntSet(((struct valueset*) ast)->ints, *(uint16_t *) expr);
+      case UR_TYPE_INT16:
+         return lookupIntSet(((struct valueset*) ast)->ints, (int64_t) *(int16_t *) expr);
+      case UR_TYPE_UINT32:
+         return lookupIntSet(((struct valueset*) ast)->ints, *(uint32_t *) expr);
+      case UR_TYPE_INT32:
+         return lookupIntSet(((struct valueset*) ast)->ints, (int64_t) *(int32_t *) expr);
+      case UR_TYPE_UINT64:
+         return lookupIntSet(((struct valueset*) ast)->ints, *(uint64_t *) expr);
+      case UR_TYPE_INT64:
+         return lookupIntSet(((struct valueset*) ast)->ints, (int64_t) *(int64_t *) expr);
+      }
+      return 0;
    case NODE_T_STRING:
       size = ur_get_var_len(in_tmplt, in_rec, ((struct str*) ast)->id); // only relevant for strings
       expr = (char *)(ur_get_ptr_by_id(in_tmplt, in_rec, ((struct str*) ast)->id));
@@ -635,6 +901,8 @@ void changeProtocol(struct ast **ast)
       *ast = newExpression(retezec, cmp, protocol, 0);
       return;
    case NODE_T_IP:
+   case NODE_T_IPSET:
+   case NODE_T_SET:
    case NODE_T_STRING:
    case NODE_T_NEGATION:
       return;
@@ -653,6 +921,7 @@ void changeProtocol(struct ast **ast)
 struct ast *getTree(const char *str, const char *port_number)
 {
    struct ast *result;
+   parse_errors = 0;
    if (str == NULL || str[0] == '\0') {
       printf("[%s] No Filter.\n", port_number);
       return NULL;
@@ -661,6 +930,7 @@ struct ast *getTree(const char *str, const char *port_number)
 
    if (yyparse()) {        // failure
       result = NULL;
+      parse_errors++;
    } else {
       result = main_tree;  // success
    }
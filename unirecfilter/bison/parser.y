@@ -10,6 +10,9 @@
     struct ast *newExpression(char *column, char *cmp, int64_t number, int is_signed);
     struct ast *newExpressionFP(char *column, char *cmp, double number);
     struct ast *newIP(char *column, char *cmp, char *ip);
+    struct ast *newIPSet(char *column, char *source, int is_file, struct set_item *items);
+    struct set_item *newSetItem(char *s, int64_t number, int is_ip);
+    struct ast *newSet(char *column, struct set_item *items, char *filename);
     struct ast *newString(char *column, char *cmp, char *s);
     struct ast *newProtocol(char *cmp, char *data);
     struct ast *newBrack(struct ast *b);
@@ -25,6 +28,7 @@
     int64_t number;
     double floating;
     struct ast* ast;
+    struct set_item *item;
 }
 
 %token <number> SIGNED
@@ -36,8 +40,11 @@
 %token <string> VAL
 %token <string> IP
 %token <string> STRING
+%token <string> PREFIX
+%token <string> FILEREF
 %token AND OR
-%token LEFT RIGHT PROTOCOL
+%token LEFT RIGHT PROTOCOL IN
+%token LBRACE RBRACE COMMA
 %token END
 
 %right OR
@@ -45,6 +52,7 @@
 %right NOT
 
 %type <ast> exp explist
+%type <item> item items
 %start body
 %%
 
@@ -66,6 +74,10 @@ exp:
     | PROTOCOL EQ STRING { $$ = (struct ast *) newProtocol($2, $3); }
     | COLUMN EQ IP { $$ = (struct ast *) newIP($1, $2, $3); }
     | COLUMN CMP IP { $$ = (struct ast *) newIP($1, $2, $3); }
+    | COLUMN IN IP { $$ = (struct ast *) newIPSet($1, $3, 0, NULL); }
+    | COLUMN IN PREFIX { $$ = (struct ast *) newIPSet($1, $3, 0, NULL); }
+    | COLUMN IN FILEREF { $$ = (struct ast *) newSet($1, NULL, $3); }
+    | COLUMN IN LBRACE items RBRACE { $$ = (struct ast *) newSet($1, $4, NULL); }
     | COLUMN EQ STRING { $$ = (struct ast *) newString($1, $2, $3); }
     | COLUMN EQ SIGNED { $$ = newExpression($1, $2, $3, 1); }
     | COLUMN EQ UNSIGNED { $$ = newExpression($1, $2, $3, 0); }
@@ -74,6 +86,19 @@ exp:
     | LEFT explist RIGHT { $$ = (struct ast *) newBrack($2); }
     ;
 
+items:
+    item { $$ = $1; }
+    | items COMMA item { $3->next = $1; $$ = $3; }
+    ;
+
+item:
+    UNSIGNED { $$ = newSetItem(NULL, $1, 0); }
+    | SIGNED { $$ = newSetItem(NULL, $1, 0); }
+    | STRING { $$ = newSetItem($1, 0, 0); }
+    | IP { $$ = newSetItem($1, 0, 1); }
+    | PREFIX { $$ = newSetItem($1, 0, 1); }
+    ;
+
 %%
 
 
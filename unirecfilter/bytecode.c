@@ -0,0 +1,836 @@
+/**
+ * \file bytecode.c
+ * \brief Compilation of filter syntax trees to flat programs.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <regex.h>
+#include <dlfcn.h>
+
+#include "bytecode.h"
+#include "iptrie.h"
+#include "valueset.h"
+#include "multimatch.h"
+
+#define BC_LABEL_ACCEPT 0
+#define BC_LABEL_REJECT 1
+#define BC_MAX_INSNS 65535   // Jump targets are 16 bit
+
+#define BC_NAME(NAME, TYPE, MEMBER, OP) #NAME,
+
+static const char *bc_names[] = {
+   BC_NUMERIC_OPS(BC_NAME)
+   "FLT_EQ", "FLT_NE", "FLT_LT", "FLT_LE", "FLT_GT", "FLT_GE",
+   "DBL_EQ", "DBL_NE", "DBL_LT", "DBL_LE", "DBL_GT", "DBL_GE",
+   "IP_EQ", "IP_NE", "IP_LT", "IP_LE", "IP_GT", "IP_GE",
+   "IP_IN", "INT_IN",
+   "CHAR_EQ", "CHAR_NE",
+   "STR_EQ", "STR_NE", "STR_RE", "STR_IN",
+   "TRUE", "FALSE",
+   "ACCEPT", "REJECT"
+};
+
+// State of compilation, jump targets of instructions are labels until the end
+struct compiler {
+   const ur_template_t *tmplt;
+   struct bc_insn *insns;
+   int count;
+   int size;
+   int *labels;               // Index of instruction for each label
+   int n_labels;
+   int labels_size;
+   int error;
+};
+
+static int new_label(struct compiler *c)
+{
+   if (c->n_labels == c->labels_size) {
+      int *labels = (int *) realloc(c->labels, 2 * c->labels_size * sizeof(int));
+      if (labels == NULL) {
+         c->error = 1;
+         return BC_LABEL_REJECT;
+      }
+      c->labels = labels;
+      c->labels_size *= 2;
+   }
+   c->labels[c->n_labels] = -1;
+   return c->n_labels++;
+}
+
+static void place_label(struct compiler *c, int label)
+{
+   c->labels[label] = c->count;
+}
+
+// Append instruction jumping to label t or f
+static struct bc_insn *emit(struct compiler *c, bc_opcode op, int t, int f)
+{
+   static struct bc_insn dummy;
+   struct bc_insn *insn;
+
+   if (c->count == c->size) {
+      if (c->size >= BC_MAX_INSNS) {
+         c->error = 1;
+         return &dummy;
+      }
+      insn = (struct bc_insn *) realloc(c->insns, 2 * c->size * sizeof(struct bc_insn));
+      if (insn == NULL) {
+         c->error = 1;
+         return &dummy;
+      }
+      c->insns = insn;
+      c->size *= 2;
+   }
+   insn = &c->insns[c->count++];
+   memset(insn, 0, sizeof(*insn));
+   insn->op = op;
+   insn->jt = t;
+   insn->jf = f;
+   return insn;
+}
+
+// Get ID of field present in input template, -1 otherwise
+static int resolve_field(struct compiler *c, const char *column)
+{
+   int id = ur_get_id_by_name(column);
+
+   if (id < 0 || !ur_is_present(c->tmplt, id)) {
+      return -1;
+   }
+   return id;
+}
+
+/*
+ * Append comparison given by first instruction of its type and operator.
+ * Integer and IP comparisons are written only with ==, < and <= and
+ * swapped jumps, so that X != 1 and X == 1 are one comparison in filter set.
+ */
+static struct bc_insn *emit_cmp(struct compiler *c, int base, cmp_op cmp, int t, int f)
+{
+   if (base != BC_FLT_EQ && base != BC_DBL_EQ) {
+      switch (cmp) {
+      case OP_NE:
+         return emit(c, base + OP_EQ, f, t);
+      case OP_GT:
+         return emit(c, base + OP_LE, f, t);
+      case OP_GE:
+         return emit(c, base + OP_LT, f, t);
+      default:
+         break;
+      }
+   }
+   return emit(c, base + cmp, t, f);
+}
+
+// Get first instruction of comparisons of numeric field type, -1 for other types
+static int numeric_base(int type)
+{
+   switch (type) {
+   case UR_TYPE_UINT8:
+      return BC_U8_EQ;
+   case UR_TYPE_INT8:
+      return BC_I8_EQ;
+   case UR_TYPE_UINT16:
+      return BC_U16_EQ;
+   case UR_TYPE_INT16:
+      return BC_I16_EQ;
+   case UR_TYPE_UINT32:
+      return BC_U32_EQ;
+   case UR_TYPE_INT32:
+      return BC_I32_EQ;
+   case UR_TYPE_UINT64:
+      return BC_U64_EQ;
+   case UR_TYPE_INT64:
+      return BC_I64_EQ;
+   case UR_TYPE_FLOAT:
+      return BC_FLT_EQ;
+   case UR_TYPE_DOUBLE:
+      return BC_DBL_EQ;
+   }
+   return -1;
+}
+
+// Emit comparison of numeric field with constant
+static void compile_number(struct compiler *c, const char *column, cmp_op cmp, int64_t number, double fp, int is_fp, int t, int f)
+{
+   int id = resolve_field(c, column);
+   struct bc_insn *insn;
+   int base;
+
+   if (id < 0 || cmp > OP_GE) {
+      emit(c, BC_FALSE, t, f);
+      return;
+   }
+   base = numeric_base(ur_get_type(id));
+   if (base == BC_FLT_EQ || base == BC_DBL_EQ) {
+      insn = emit_cmp(c, base, cmp, t, f);
+      insn->val.d = fp;
+   } else if (base >= 0 && !is_fp) {
+      insn = emit_cmp(c, base, cmp, t, f);
+      insn->val.i = number;
+   } else {
+      printf("Warning: Type of %s does not match the compared value.\n", column);
+      emit(c, BC_FALSE, t, f);
+      return;
+   }
+   insn->offset = c->tmplt->offset[id];
+}
+
+static void compile_ip(struct compiler *c, struct ip *node, int t, int f)
+{
+   int id = resolve_field(c, node->column);
+   struct bc_insn *insn;
+
+   if (id < 0 || ur_get_type(id) != UR_TYPE_IP || node->cmp > OP_GE) {
+      emit(c, BC_FALSE, t, f);
+      return;
+   }
+   insn = emit_cmp(c, BC_IP_EQ, node->cmp, t, f);
+   insn->offset = c->tmplt->offset[id];
+   insn->val.ptr = &node->ipAddr;
+}
+
+static void compile_ipset(struct compiler *c, struct ipset *node, int t, int f)
+{
+   int id = resolve_field(c, node->column);
+   struct bc_insn *insn;
+
+   if (id < 0 || ur_get_type(id) != UR_TYPE_IP || node->trie == NULL) {
+      emit(c, BC_FALSE, t, f);
+      return;
+   }
+   insn = emit(c, BC_IP_IN, t, f);
+   insn->offset = c->tmplt->offset[id];
+   insn->val.ptr = node->trie;
+}
+
+static void compile_set(struct compiler *c, struct valueset *node, int t, int f)
+{
+   int id = resolve_field(c, node->column);
+   struct bc_insn *insn;
+   int base = id >= 0 ? numeric_base(ur_get_type(id)) : -1;
+
+   if (node->ints != NULL && base >= 0 && base < BC_FLT_EQ) {
+      insn = emit(c, BC_INT_IN, t, f);
+      insn->len = base;
+      insn->val.ptr = node->ints;
+   } else if (node->strs != NULL && id >= 0 && ur_is_dynamic(id)) {
+      insn = emit(c, BC_STR_IN, t, f);
+      insn->val.ptr = node->strs;
+   } else {
+      emit(c, BC_FALSE, t, f);
+      return;
+   }
+   insn->offset = c->tmplt->offset[id];
+}
+
+static void compile_string(struct compiler *c, struct str *node, int t, int f)
+{
+   int id = resolve_field(c, node->column);
+   struct bc_insn *insn;
+
+   if (id < 0) {
+      emit(c, BC_FALSE, t, f);
+   } else if (ur_get_type(id) == UR_TYPE_CHAR) {
+      // Only == matches a char, other operators are negation of ==
+      if (strlen(node->s) != 1) {
+         emit(c, node->cmp == OP_EQ ? BC_FALSE : BC_TRUE, t, f);
+         return;
+      }
+      insn = node->cmp == OP_EQ ? emit(c, BC_CHAR_EQ, t, f) : emit(c, BC_CHAR_EQ, f, t);
+      insn->offset = c->tmplt->offset[id];
+      insn->val.i = node->s[0];
+   } else if (ur_is_dynamic(id)) {
+      if (node->cmp == OP_RE) {
+         insn = emit(c, BC_STR_RE, t, f);
+         insn->val.ptr = &node->re;
+      } else if (strlen(node->s) > UR_MAX_SIZE) {
+         // Longer than any field
+         emit(c, node->cmp == OP_EQ ? BC_FALSE : BC_TRUE, t, f);
+         return;
+      } else {
+         insn = node->cmp == OP_EQ ? emit(c, BC_STR_EQ, t, f) : emit(c, BC_STR_EQ, f, t);
+         insn->val.ptr = node->s;
+         insn->len = strlen(node->s);
+      }
+      insn->offset = c->tmplt->offset[id];
+   } else {
+      emit(c, BC_FALSE, t, f);
+   }
+}
+
+// Emit instructions of subtree, jump to label t when it holds, to f otherwise
+static void compile_node(struct compiler *c, struct ast *ast, int t, int f)
+{
+   int label;
+
+   if (ast == NULL) {
+      emit(c, BC_FALSE, t, f);
+      return;
+   }
+   switch (ast->type) {
+   case NODE_T_AST:
+      if (ast->operator == OP_NOP) {
+         compile_node(c, ast->l, t, f);
+      } else if (ast->operator == OP_AND) {
+         label = new_label(c);
+         compile_node(c, ast->l, label, f);
+         place_label(c, label);
+         compile_node(c, ast->r, t, f);
+      } else if (ast->operator == OP_OR) {
+         label = new_label(c);
+         compile_node(c, ast->l, t, label);
+         place_label(c, label);
+         compile_node(c, ast->r, t, f);
+      } else {
+         emit(c, BC_FALSE, t, f);
+      }
+      break;
+   case NODE_T_EXPRESSION: {
+      struct expression *node = (struct expression *) ast;
+      compile_number(c, node->column, node->cmp, node->number,
+                     node->is_signed ? (double) node->number : (double) (uint64_t) node->number, 0, t, f);
+      break;
+      }
+   case NODE_T_EXPRESSION_FP: {
+      struct expression_fp *node = (struct expression_fp *) ast;
+      compile_number(c, node->column, node->cmp, 0, node->number, 1, t, f);
+      break;
+      }
+   case NODE_T_IP:
+      compile_ip(c, (struct ip *) ast, t, f);
+      break;
+   case NODE_T_IPSET:
+      compile_ipset(c, (struct ipset *) ast, t, f);
+      break;
+   case NODE_T_SET:
+      compile_set(c, (struct valueset *) ast, t, f);
+      break;
+   case NODE_T_STRING:
+      compile_string(c, (struct str *) ast, t, f);
+      break;
+   case NODE_T_BRACKET:
+      compile_node(c, ((struct brack *) ast)->b, t, f);
+      break;
+   case NODE_T_NEGATION:
+      compile_node(c, ((struct brack *) ast)->b, f, t);
+      break;
+   default:
+      // Protocol names are replaced by changeProtocol()
+      emit(c, BC_FALSE, t, f);
+      break;
+   }
+}
+
+/**
+ * \brief Compile syntax tree of filter for records of given template.
+ * Fields are looked up by name, so the program is valid only for the template
+ * and has to be compiled again when the template changes. Comparisons with
+ * fields missing in the template never hold.
+ * \param[in] ast Syntax tree, it must not be freed before the program.
+ * \param[in] in_tmplt Template of input records.
+ * \return Program or NULL when filter is empty or memory allocation fails.
+ */
+struct filter_program *compileAST(struct ast *ast, const ur_template_t *in_tmplt)
+{
+   struct compiler c;
+   struct filter_program *prog;
+   int i;
+
+   if (ast == NULL) {
+      return NULL;
+   }
+   memset(&c, 0, sizeof(c));
+   c.tmplt = in_tmplt;
+   c.size = 16;
+   c.labels_size = 16;
+   c.insns = (struct bc_insn *) malloc(c.size * sizeof(struct bc_insn));
+   c.labels = (int *) malloc(c.labels_size * sizeof(int));
+   prog = (struct filter_program *) malloc(sizeof(struct filter_program));
+   if (c.insns == NULL || c.labels == NULL || prog == NULL) {
+      c.error = 1;
+   } else {
+      new_label(&c);
+      new_label(&c);
+      compile_node(&c, ast, BC_LABEL_ACCEPT, BC_LABEL_REJECT);
+      place_label(&c, BC_LABEL_ACCEPT);
+      emit(&c, BC_ACCEPT, 0, 0);
+      place_label(&c, BC_LABEL_REJECT);
+      emit(&c, BC_REJECT, 0, 0);
+   }
+   if (c.error) {
+      fprintf(stderr, "Error: Filter could not be compiled.\n");
+      free(c.insns);
+      free(c.labels);
+      free(prog);
+      return NULL;
+   }
+   // Replace labels by indexes of instructions
+   for (i = 0; i < c.count; i++) {
+      c.insns[i].jt = c.labels[c.insns[i].jt];
+      c.insns[i].jf = c.labels[c.insns[i].jf];
+   }
+   free(c.labels);
+
+   prog->insns = c.insns;
+   prog->count = c.count;
+   prog->static_size = in_tmplt->static_size;
+   return prog;
+}
+
+// Read integer field as 64 bits, signed types are sign extended
+static inline uint64_t load_int(const char *data, int base)
+{
+   switch (base) {
+   case BC_U8_EQ:
+      return *(const uint8_t *) data;
+   case BC_I8_EQ:
+      return (int64_t) *(const int8_t *) data;
+   case BC_U16_EQ:
+      return *(const uint16_t *) data;
+   case BC_I16_EQ:
+      return (int64_t) *(const int16_t *) data;
+   case BC_U32_EQ:
+      return *(const uint32_t *) data;
+   case BC_I32_EQ:
+      return (int64_t) *(const int32_t *) data;
+   case BC_I64_EQ:
+      return (int64_t) *(const int64_t *) data;
+   default:
+      return *(const uint64_t *) data;
+   }
+}
+
+// Evaluate comparison of instruction on record, static_size is size of static part of record
+static inline int eval_insn(const struct bc_insn *insn, const char *rec, uint16_t static_size)
+{
+   const char *data;
+   uint16_t len;
+   int res;
+
+   switch (insn->op) {
+#define BC_CASE(NAME, TYPE, MEMBER, OP) \
+   case BC_##NAME: \
+      res = *(const TYPE *) (rec + insn->offset) OP insn->val.MEMBER; \
+      break;
+   BC_NUMERIC_OPS(BC_CASE)
+#undef BC_CASE
+   case BC_FLT_EQ:
+      res = fabs(*(const float *) (rec + insn->offset) - insn->val.d) < BC_EPS;
+      break;
+   case BC_FLT_NE:
+      res = *(const float *) (rec + insn->offset) != insn->val.d;
+      break;
+   case BC_FLT_LT:
+      res = *(const float *) (rec + insn->offset) < insn->val.d;
+      break;
+   case BC_FLT_LE:
+      res = *(const float *) (rec + insn->offset) <= insn->val.d;
+      break;
+   case BC_FLT_GT:
+      res = *(const float *) (rec + insn->offset) > insn->val.d;
+      break;
+   case BC_FLT_GE:
+      res = *(const float *) (rec + insn->offset) >= insn->val.d;
+      break;
+   case BC_DBL_EQ:
+      res = fabs(*(const double *) (rec + insn->offset) - insn->val.d) < BC_EPS;
+      break;
+   case BC_DBL_NE:
+      res = *(const double *) (rec + insn->offset) != insn->val.d;
+      break;
+   case BC_DBL_LT:
+      res = *(const double *) (rec + insn->offset) < insn->val.d;
+      break;
+   case BC_DBL_LE:
+      res = *(const double *) (rec + insn->offset) <= insn->val.d;
+      break;
+   case BC_DBL_GT:
+      res = *(const double *) (rec + insn->offset) > insn->val.d;
+      break;
+   case BC_DBL_GE:
+      res = *(const double *) (rec + insn->offset) >= insn->val.d;
+      break;
+   case BC_IP_EQ:
+      res = ip_cmp((const ip_addr_t *) (rec + insn->offset), insn->val.ptr) == 0;
+      break;
+   case BC_IP_NE:
+      res = ip_cmp((const ip_addr_t *) (rec + insn->offset), insn->val.ptr) != 0;
+      break;
+   case BC_IP_LT:
+      res = ip_cmp((const ip_addr_t *) (rec + insn->offset), insn->val.ptr) < 0;
+      break;
+   case BC_IP_LE:
+      res = ip_cmp((const ip_addr_t *) (rec + insn->offset), insn->val.ptr) <= 0;
+      break;
+   case BC_IP_GT:
+      res = ip_cmp((const ip_addr_t *) (rec + insn->offset), insn->val.ptr) > 0;
+      break;
+   case BC_IP_GE:
+      res = ip_cmp((const ip_addr_t *) (rec + insn->offset), insn->val.ptr) >= 0;
+      break;
+   case BC_IP_IN:
+      res = lookupIPTrie((const struct ip_trie *) insn->val.ptr, (const ip_addr_t *) (rec + insn->offset));
+      break;
+   case BC_INT_IN:
+      res = lookupIntSet((const struct int_set *) insn->val.ptr, load_int(rec + insn->offset, insn->len));
+      break;
+   case BC_CHAR_EQ:
+      res = rec[insn->offset] == (char) insn->val.i;
+      break;
+   case BC_CHAR_NE:
+      res = rec[insn->offset] != (char) insn->val.i;
+      break;
+   case BC_STR_EQ:
+   case BC_STR_NE:
+      len = *(const uint16_t *) (rec + insn->offset + 2);
+      data = rec + static_size + *(const uint16_t *) (rec + insn->offset);
+      res = (len == insn->len && memcmp(data, insn->val.ptr, len) == 0) == (insn->op == BC_STR_EQ);
+      break;
+   case BC_STR_RE:
+      len = *(const uint16_t *) (rec + insn->offset + 2);
+      data = rec + static_size + *(const uint16_t *) (rec + insn->offset);
+      memcpy(str_buffer, data, len);
+      str_buffer[len] = '\0';
+      res = regexec((const regex_t *) insn->val.ptr, str_buffer, 0, NULL, 0) != REG_NOMATCH;
+      break;
+   case BC_STR_IN:
+      len = *(const uint16_t *) (rec + insn->offset + 2);
+      data = rec + static_size + *(const uint16_t *) (rec + insn->offset);
+      res = lookupStrSet((const struct str_set *) insn->val.ptr, data, len);
+      break;
+   case BC_TRUE:
+      res = 1;
+      break;
+   case BC_FALSE:
+   default:
+      res = 0;
+      break;
+   }
+   return res;
+}
+
+/**
+ * \brief Evaluate compiled filter on a record.
+ * \param[in] prog Program compiled for template of the record.
+ * \param[in] in_rec Record.
+ * \return 1 when record matches filter, 0 otherwise.
+ */
+int evalProgram(const struct filter_program *prog, const void *in_rec)
+{
+   const struct bc_insn *insn = prog->insns;
+
+   for (;;) {
+      if (insn->op == BC_ACCEPT) {
+         return 1;
+      } else if (insn->op == BC_REJECT) {
+         return 0;
+      }
+      insn = prog->insns + (eval_insn(insn, (const char *) in_rec, prog->static_size) ? insn->jt : insn->jf);
+   }
+}
+
+void printProgram(const struct filter_program *prog)
+{
+   int i;
+
+   if (prog == NULL) {
+      puts("No program for printing");
+      return;
+   }
+   for (i = 0; i < prog->count; i++) {
+      const struct bc_insn *insn = &prog->insns[i];
+
+      printf("%4d: %-8s", i, bc_names[insn->op]);
+      if (insn->op < BC_TRUE) {
+         printf(" p%u", insn->pred);
+      }
+      if (insn->op < BC_FLT_EQ) {
+         printf(" [%u] %" PRId64, insn->offset, insn->val.i);
+      } else if (insn->op < BC_IP_EQ) {
+         printf(" [%u] %lf", insn->offset, insn->val.d);
+      } else if (insn->op < BC_TRUE) {
+         printf(" [%u]", insn->offset);
+      }
+      if (insn->op < BC_ACCEPT) {
+         printf(" jt %u jf %u", insn->jt, insn->jf);
+      }
+      printf("\n");
+   }
+}
+
+void freeProgram(struct filter_program *prog)
+{
+   if (prog == NULL) {
+      return;
+   }
+   free(prog->insns);
+   free(prog);
+}
+
+// Source of regular expression of BC_STR_RE instruction
+static const char *regex_source(const struct bc_insn *insn)
+{
+   return ((const struct str *) ((const char *) insn->val.ptr - offsetof(struct str, re)))->s;
+}
+
+// Check if two instructions compare the same field with the same constant
+static int same_pred(const struct bc_insn *a, const struct bc_insn *b)
+{
+   if (a->op != b->op || a->offset != b->offset) {
+      return 0;
+   }
+   if (a->op >= BC_IP_EQ && a->op <= BC_IP_GE) {
+      return memcmp(a->val.ptr, b->val.ptr, sizeof(ip_addr_t)) == 0;
+   } else if (a->op == BC_IP_IN) {
+      return a->val.ptr == b->val.ptr || equalIPTries(a->val.ptr, b->val.ptr);
+   } else if (a->op == BC_INT_IN) {
+      return a->len == b->len && (a->val.ptr == b->val.ptr || equalIntSets(a->val.ptr, b->val.ptr));
+   } else if (a->op == BC_STR_IN) {
+      return a->val.ptr == b->val.ptr || equalStrSets(a->val.ptr, b->val.ptr);
+   } else if (a->op == BC_STR_EQ || a->op == BC_STR_NE) {
+      return a->len == b->len && memcmp(a->val.ptr, b->val.ptr, a->len) == 0;
+   } else if (a->op == BC_STR_RE) {
+      return strcmp(regex_source(a), regex_source(b)) == 0;
+   }
+   // Numbers and chars, doubles are compared bitwise
+   return memcmp(&a->val, &b->val, sizeof(a->val)) == 0;
+}
+
+// Compile expressions into one automaton, halves of the group are tried
+// when it is too large, expression which fails alone is left to regexec()
+static void add_automata(struct filter_set *set, const int *preds, int n)
+{
+   const char *patterns[n];
+   struct re_automaton *a;
+   int i;
+
+   for (i = 0; i < n; i++) {
+      patterns[i] = regex_source(&set->preds[preds[i]]);
+   }
+   a = compileAutomaton(patterns, preds, n, set->preds[preds[0]].offset, set->static_size);
+   if (a == NULL) {
+      if (n > 1) {
+         add_automata(set, preds, n / 2);
+         add_automata(set, preds + n / 2, n - n / 2);
+      }
+      return;
+   }
+   for (i = 0; i < n; i++) {
+      set->pred_automaton[preds[i]] = set->n_automata;
+   }
+   set->automata[set->n_automata++] = a;
+}
+
+// Group regular expressions of filter set by field and build their automata
+static int build_automata(struct filter_set *set)
+{
+   int *group = (int *) malloc((set->n_preds + 1) * sizeof(int));
+   int i, j, n;
+
+   set->pred_automaton = (int *) malloc((set->n_preds + 1) * sizeof(int));
+   set->automata = (struct re_automaton **) malloc((set->n_preds + 1) * sizeof(struct re_automaton *));
+   if (group == NULL || set->pred_automaton == NULL || set->automata == NULL) {
+      free(group);
+      return 1;
+   }
+   for (i = 0; i < set->n_preds; i++) {
+      const struct bc_insn *insn = &set->preds[i];
+
+      set->pred_automaton[i] = insn->op == BC_STR_RE && isAutomatonRegex(regex_source(insn)) ? -2 : -1;
+   }
+   for (i = 0; i < set->n_preds; i++) {
+      if (set->pred_automaton[i] != -2) {
+         continue;
+      }
+      n = 0;
+      for (j = i; j < set->n_preds; j++) {
+         if (set->pred_automaton[j] == -2 && set->preds[j].offset == set->preds[i].offset) {
+            set->pred_automaton[j] = -1;
+            group[n++] = j;
+         }
+      }
+      add_automata(set, group, n);
+   }
+   free(group);
+   return 0;
+}
+
+/**
+ * \brief Compile filters of all output interfaces for given template.
+ * \param[in] trees Syntax tree of each output, NULL for outputs without filter.
+ * \param[in] n_trees Number of outputs, at most 32.
+ * \param[in] in_tmplt Template of input records.
+ * \return Filter set or NULL when memory allocation fails.
+ */
+struct filter_set *compileFilterSet(struct ast **trees, int n_trees, const ur_template_t *in_tmplt)
+{
+   struct filter_set *set = (struct filter_set *) calloc(1, sizeof(struct filter_set));
+   int n_insns = 0;
+   int i, j, k;
+
+   if (set == NULL) {
+      return NULL;
+   }
+   set->programs = (struct filter_program **) calloc(n_trees, sizeof(struct filter_program *));
+   if (set->programs == NULL) {
+      free(set);
+      return NULL;
+   }
+   set->n_programs = n_trees;
+   set->static_size = in_tmplt->static_size;
+
+   for (i = 0; i < n_trees; i++) {
+      if (trees[i] == NULL) {
+         set->always |= (uint32_t) 1 << i;
+      } else if ((set->programs[i] = compileAST(trees[i], in_tmplt)) == NULL) {
+         set->fallback |= (uint32_t) 1 << i;
+      } else {
+         n_insns += set->programs[i]->count;
+      }
+   }
+
+   // Assign comparisons of all programs to distinct ones
+   set->preds = (struct bc_insn *) malloc((n_insns + 1) * sizeof(struct bc_insn));
+   set->memo = (uint8_t *) malloc(n_insns + 1);
+   if (set->preds == NULL || set->memo == NULL) {
+      freeFilterSet(set);
+      return NULL;
+   }
+   for (i = 0; i < n_trees; i++) {
+      struct filter_program *prog = set->programs[i];
+
+      for (j = 0; prog != NULL && j < prog->count; j++) {
+         struct bc_insn *insn = &prog->insns[j];
+
+         if (insn->op >= BC_TRUE) {
+            continue;
+         }
+         for (k = 0; k < set->n_preds && !same_pred(&set->preds[k], insn); k++) {
+         }
+         if (k == set->n_preds) {
+            set->preds[set->n_preds++] = *insn;
+         }
+         insn->pred = k;
+      }
+   }
+   if (build_automata(set) != 0) {
+      freeFilterSet(set);
+      return NULL;
+   }
+   return set;
+}
+
+/**
+ * \brief Evaluate filters of all output interfaces on a record.
+ * Comparisons are evaluated when a program needs them for the first time.
+ * \param[in] set Filter set compiled for template of the record.
+ * \param[in] in_rec Record.
+ * \param[out] memo Buffer of n_preds bytes for results of comparisons.
+ * \return Bit mask of outputs whose filter matches (including outputs
+ *         without filter), bits of fallback outputs are not set.
+ */
+uint32_t evalFilterSet(const struct filter_set *set, const void *in_rec, uint8_t *memo)
+{
+   const char *rec = (const char *) in_rec;
+   uint32_t mask = set->always;
+   int i;
+
+   memset(memo, 0, set->n_preds);
+   for (i = 0; i < set->n_programs; i++) {
+      const struct filter_program *prog = set->programs[i];
+      const struct bc_insn *insn;
+      int res;
+
+      if (prog == NULL) {
+         continue;
+      }
+      for (insn = prog->insns; insn->op < BC_ACCEPT; insn = prog->insns + (res ? insn->jt : insn->jf)) {
+         if (insn->op >= BC_TRUE) {
+            res = insn->op == BC_TRUE;
+         } else {
+            uint8_t *m = &memo[insn->pred];
+            if (*m == 0) {
+               if (set->pred_automaton[insn->pred] >= 0) {
+                  // Results of all expressions of the field at once
+                  scanAutomaton(set->automata[set->pred_automaton[insn->pred]], rec, memo);
+               } else {
+                  *m = eval_insn(insn, rec, set->static_size) + 1;
+               }
+            }
+            res = *m - 1;
+         }
+      }
+      if (insn->op == BC_ACCEPT) {
+         mask |= (uint32_t) 1 << i;
+      }
+   }
+   return mask;
+}
+
+void freeFilterSet(struct filter_set *set)
+{
+   int i;
+
+   if (set == NULL) {
+      return;
+   }
+   if (set->handle != NULL) {
+      dlclose(set->handle);
+   }
+   for (i = 0; i < set->n_programs; i++) {
+      freeProgram(set->programs[i]);
+   }
+   for (i = 0; i < set->n_automata; i++) {
+      freeAutomaton(set->automata[i]);
+   }
+   free(set->automata);
+   free(set->pred_automaton);
+   free(set->programs);
+   free(set->preds);
+   free(set->memo);
+   free(set->consts);
+   free(set);
+}
@@ -0,0 +1,149 @@
+/**
+ * \file bytecode.h
+ * \brief Compilation of filter syntax trees to flat programs.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+#include <unirec/unirec.h>
+
+#include "unirecfilter.h"
+
+struct re_automaton;
+
+#define BC_EPS 1e-8 // Tolerance of equality of floating point numbers
+
+/* Comparisons of numeric fields, NAME(type of field, member of constant, operator) */
+#define BC_NUMERIC_OPS(X) \
+   BC_CMP_OPS(X, U8,  uint8_t,  u) \
+   BC_CMP_OPS(X, I8,  int8_t,   i) \
+   BC_CMP_OPS(X, U16, uint16_t, u) \
+   BC_CMP_OPS(X, I16, int16_t,  i) \
+   BC_CMP_OPS(X, U32, uint32_t, u) \
+   BC_CMP_OPS(X, I32, int32_t,  i) \
+   BC_CMP_OPS(X, U64, uint64_t, u) \
+   BC_CMP_OPS(X, I64, int64_t,  i)
+
+#define BC_CMP_OPS(X, NAME, TYPE, MEMBER) \
+   X(NAME##_EQ, TYPE, MEMBER, ==) \
+   X(NAME##_NE, TYPE, MEMBER, !=) \
+   X(NAME##_LT, TYPE, MEMBER, <) \
+   X(NAME##_LE, TYPE, MEMBER, <=) \
+   X(NAME##_GT, TYPE, MEMBER, >) \
+   X(NAME##_GE, TYPE, MEMBER, >=)
+
+#define BC_ENUM(NAME, TYPE, MEMBER, OP) BC_##NAME,
+
+/* Instructions of filter program */
+typedef enum {
+   BC_NUMERIC_OPS(BC_ENUM)
+   BC_FLT_EQ, BC_FLT_NE, BC_FLT_LT, BC_FLT_LE, BC_FLT_GT, BC_FLT_GE,
+   BC_DBL_EQ, BC_DBL_NE, BC_DBL_LT, BC_DBL_LE, BC_DBL_GT, BC_DBL_GE,
+   BC_IP_EQ, BC_IP_NE, BC_IP_LT, BC_IP_LE, BC_IP_GT, BC_IP_GE,
+   BC_IP_IN, BC_INT_IN,
+   BC_CHAR_EQ, BC_CHAR_NE,
+   BC_STR_EQ, BC_STR_NE, BC_STR_RE, BC_STR_IN,
+   BC_TRUE, BC_FALSE,
+   BC_ACCEPT, BC_REJECT
+} bc_opcode;
+
+/*
+ * One comparison of field of record with constant. Program continues with
+ * instruction jt when the comparison holds, with jf otherwise. Jumps lead
+ * only forward, program ends with BC_ACCEPT or BC_REJECT.
+ */
+struct bc_insn {
+   uint16_t op;
+   uint16_t offset;     // Offset of field in record (of its offset and length for dynamic fields)
+   uint16_t jt;
+   uint16_t jf;
+   uint16_t len;        // Length of string constant, BC_INT_IN has first comparison of field type here
+   uint16_t pred;       // Index of comparison in filter set
+   union {
+      int64_t i;
+      uint64_t u;
+      double d;
+      const void *ptr;  // ip_addr_t, string, regex_t or set in syntax tree
+   } val;
+};
+
+/* Filter compiled for one input template */
+struct filter_program {
+   struct bc_insn *insns;
+   int count;
+   uint16_t static_size; // Size of static part of records
+};
+
+/* Filters compiled to native code, consts are pointer constants of comparisons */
+typedef uint32_t (*native_filters)(const void *in_rec, const void *const *consts, char *buf);
+
+/*
+ * Filters of all output interfaces compiled together. Equal comparisons of
+ * programs share one entry of preds, so each of them is evaluated at most
+ * once per record and its result is kept in memo.
+ */
+struct filter_set {
+   struct filter_program **programs; // Program of each output, NULL when it has none
+   int n_programs;
+   struct bc_insn *preds;  // Distinct comparisons
+   int n_preds;
+   uint32_t always;        // Outputs without filter
+   uint32_t fallback;      // Outputs with filter which could not be compiled
+   uint16_t static_size;
+   uint8_t *memo;          // Results of comparisons, 0 unknown, 1 false, 2 true
+   struct re_automaton **automata; // Regular expressions matched together, see multimatch.h
+   int n_automata;
+   int *pred_automaton;    // Automaton of each comparison, -1 for none
+   native_filters native;  // NULL when filters are not compiled to native code
+   const void **consts;
+   void *handle;           // Shared object with native code
+};
+
+struct filter_program *compileAST(struct ast *ast, const ur_template_t *in_tmplt);
+int evalProgram(const struct filter_program *prog, const void *in_rec);
+void printProgram(const struct filter_program *prog);
+void freeProgram(struct filter_program *prog);
+
+struct filter_set *compileFilterSet(struct ast **trees, int n_trees, const ur_template_t *in_tmplt);
+uint32_t evalFilterSet(const struct filter_set *set, const void *in_rec, uint8_t *memo);
+void freeFilterSet(struct filter_set *set);
+
+#endif
@@ -0,0 +1,178 @@
+/**
+ * \file copyplan.c
+ * \brief Copying of fields of input records to output records.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unirecfilter.h"
+#include "copyplan.h"
+
+/**
+ * \brief Create plan of copying fields present in input template to output record.
+ * Static fields lying next to each other in both records are merged into one
+ * block. Dynamic fields of output missing in input keep their current value
+ * in output record (default value).
+ * \param[in] in_tmplt Template of input records.
+ * \param[in] out_tmplt Template of output records.
+ * \param[in] out_rec Output record with default values.
+ * \return Plan or NULL when memory allocation fails.
+ */
+struct copy_plan *createCopyPlan(const ur_template_t *in_tmplt, const ur_template_t *out_tmplt, const void *out_rec)
+{
+   struct copy_plan *plan;
+   ur_field_id_t id;
+   int rec_ind = 0;
+
+   if (in_tmplt == NULL || out_tmplt == NULL) {
+      return NULL;
+   }
+   plan = (struct copy_plan *) calloc(1, sizeof(struct copy_plan));
+   if (plan == NULL) {
+      return NULL;
+   }
+   plan->in_static_size = in_tmplt->static_size;
+   plan->out_static_size = out_tmplt->static_size;
+   plan->runs = (struct copy_run *) malloc(out_tmplt->count * sizeof(struct copy_run));
+   plan->vars = (struct copy_var *) calloc(out_tmplt->count, sizeof(struct copy_var));
+   if (plan->runs == NULL || plan->vars == NULL) {
+      freeCopyPlan(plan);
+      return NULL;
+   }
+
+   while ((id = ur_iter_fields_record_order(out_tmplt, rec_ind++)) != UR_ITER_END) {
+      int present = ur_is_present(in_tmplt, id);
+
+      if (!ur_is_dynamic(id)) {
+         uint16_t src, dst, len;
+         struct copy_run *last;
+
+         if (!present) {
+            continue;
+         }
+         src = in_tmplt->offset[id];
+         dst = out_tmplt->offset[id];
+         len = ur_get_size(id);
+         last = &plan->runs[plan->n_runs > 0 ? plan->n_runs - 1 : 0];
+         if (plan->n_runs > 0 && last->src + last->len == src && last->dst + last->len == dst) {
+            last->len += len;
+         } else {
+            plan->runs[plan->n_runs].src = src;
+            plan->runs[plan->n_runs].dst = dst;
+            plan->runs[plan->n_runs].len = len;
+            plan->n_runs++;
+         }
+      } else {
+         struct copy_var *var = &plan->vars[plan->n_vars++];
+
+         var->dst = out_tmplt->offset[id];
+         if (present) {
+            var->src = in_tmplt->offset[id];
+         } else {
+            var->src = UR_INVALID_OFFSET;
+            var->len = ur_get_var_len(out_tmplt, out_rec, id);
+            if (var->len > DYN_FIELD_MAX_SIZE) {
+               var->len = DYN_FIELD_MAX_SIZE;
+            }
+            if ((var->data = (char *) malloc(var->len + 1)) == NULL) {
+               freeCopyPlan(plan);
+               return NULL;
+            }
+            memcpy(var->data, ur_get_ptr_by_id(out_tmplt, out_rec, id), var->len);
+         }
+      }
+   }
+   return plan;
+}
+
+/**
+ * \brief Copy fields of input record to output record.
+ * Dynamic fields are written one after another from the beginning of variable
+ * part of output record, each is cut to DYN_FIELD_MAX_SIZE bytes.
+ * \param[in] plan Plan for templates of both records.
+ * \param[in] in_rec Input record.
+ * \param[in,out] out_rec Output record.
+ * \return Size of output record.
+ */
+uint16_t applyCopyPlan(const struct copy_plan *plan, const void *in_rec, void *out_rec)
+{
+   const char *in = (const char *) in_rec;
+   char *out = (char *) out_rec;
+   const struct copy_run *run;
+   const struct copy_var *var;
+   uint16_t pos = 0;
+
+   for (run = plan->runs; run < plan->runs + plan->n_runs; run++) {
+      memcpy(out + run->dst, in + run->src, run->len);
+   }
+   for (var = plan->vars; var < plan->vars + plan->n_vars; var++) {
+      const char *data = var->data;
+      uint16_t len = var->len;
+
+      if (var->src != UR_INVALID_OFFSET) {
+         data = in + plan->in_static_size + *(const uint16_t *) (in + var->src);
+         len = *(const uint16_t *) (in + var->src + 2);
+         if (len > DYN_FIELD_MAX_SIZE) {
+            len = DYN_FIELD_MAX_SIZE;
+         }
+      }
+      memcpy(out + plan->out_static_size + pos, data, len);
+      *(uint16_t *) (out + var->dst) = pos;
+      *(uint16_t *) (out + var->dst + 2) = len;
+      pos += len;
+   }
+   return plan->out_static_size + pos;
+}
+
+void freeCopyPlan(struct copy_plan *plan)
+{
+   int i;
+
+   if (plan == NULL) {
+      return;
+   }
+   for (i = 0; i < plan->n_vars; i++) {
+      free(plan->vars[i].data);
+   }
+   free(plan->vars);
+   free(plan->runs);
+   free(plan);
+}
@@ -0,0 +1,77 @@
+/**
+ * \file copyplan.h
+ * \brief Copying of fields of input records to output records.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifndef COPYPLAN_H
+#define COPYPLAN_H
+
+#include <stdint.h>
+#include <unirec/unirec.h>
+
+/* Block of adjacent static fields at the same order in input and output record */
+struct copy_run {
+   uint16_t src;
+   uint16_t dst;
+   uint16_t len;
+};
+
+/* Dynamic field of output record, taken from input record or default value */
+struct copy_var {
+   uint16_t src;        // Offset of offset and length of field in input record, UR_INVALID_OFFSET for default
+   uint16_t dst;        // Offset of offset and length of field in output record
+   uint16_t len;        // Length of default value
+   char *data;          // Default value
+};
+
+/* Copying of fields for one pair of input and output template */
+struct copy_plan {
+   struct copy_run *runs;
+   int n_runs;
+   struct copy_var *vars;
+   int n_vars;
+   uint16_t in_static_size;
+   uint16_t out_static_size;
+};
+
+struct copy_plan *createCopyPlan(const ur_template_t *in_tmplt, const ur_template_t *out_tmplt, const void *out_rec);
+uint16_t applyCopyPlan(const struct copy_plan *plan, const void *in_rec, void *out_rec);
+void freeCopyPlan(struct copy_plan *plan);
+
+#endif
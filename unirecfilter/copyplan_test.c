@@ -0,0 +1,242 @@
+/**
+ * \file copyplan_test.c
+ * \brief Output records written by copy plan must have the same fields as the ones written field by field.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unirec/unirec.h>
+
+#include "unirecfilter.h"
+#include "copyplan.h"
+#include "fields.h"
+
+#define TEST_ROUNDS 500       // Pairs of input and output templates
+#define TEST_RECORDS 50       // Records copied for each pair
+#define TEST_LONG_LEN 1500    // Length of dynamic fields cut to DYN_FIELD_MAX_SIZE
+
+#define COUNT(array) ((int) (sizeof(array) / sizeof(array[0])))
+
+UR_FIELDS()
+
+/* Field of templates with its default value */
+struct test_field {
+   const char *spec;
+   const char *name;
+   const char *value;
+};
+
+static const struct test_field fields[] = {
+   { "uint64 T_U64", "T_U64", "42" },
+   { "uint32 T_U32A", "T_U32A", "7" },
+   { "uint32 T_U32B", "T_U32B", "123456" },
+   { "uint16 T_U16A", "T_U16A", "80" },
+   { "uint16 T_U16B", "T_U16B", "443" },
+   { "uint8 T_U8", "T_U8", "6" },
+   { "ipaddr T_IP", "T_IP", "10.0.0.1" },
+   { "double T_DBL", "T_DBL", "1.5" },
+   { "char T_CH", "T_CH", "x" },
+   { "string T_STR1", "T_STR1", "default" },
+   { "string T_STR2", "T_STR2", "" },
+   { "bytes T_BYTES", "T_BYTES", "dflt" },
+   { "string T_STR3", "T_STR3", "third" },
+};
+
+// Template of random nonempty subset of fields, included has bit of each field
+static ur_template_t *random_template(uint32_t *included)
+{
+   char spec[512] = "";
+   int i;
+
+   do {
+      *included = rand() & ((1U << COUNT(fields)) - 1);
+   } while (*included == 0);
+   for (i = 0; i < COUNT(fields); i++) {
+      if (*included & (1U << i)) {
+         strcat(spec, spec[0] != '\0' ? "," : "");
+         strcat(spec, fields[i].spec);
+      }
+   }
+   return ur_define_fields_and_update_template(spec, NULL);
+}
+
+// Set default values of fields missing in input as unirecfilter does, half of them have none
+static void set_defaults(const ur_template_t *out_tmplt, void *out_rec, uint32_t in_fields, uint32_t out_fields)
+{
+   int i;
+
+   for (i = 0; i < COUNT(fields); i++) {
+      ur_field_id_t id = ur_get_id_by_name(fields[i].name);
+
+      if (!(out_fields & (1U << i)) || (in_fields & (1U << i))) {
+         continue;
+      }
+      if (rand() % 2) {
+         ur_set_from_string(out_tmplt, out_rec, id, fields[i].value);
+      } else if (ur_is_dynamic(id)) {
+         ur_set_var(out_tmplt, out_rec, id, NULL, 0);
+      } else {
+         SET_NULL(id, out_tmplt, out_rec);
+      }
+   }
+}
+
+static void fill_record(const ur_template_t *tmplt, void *rec)
+{
+   static char data[TEST_LONG_LEN];
+   ur_field_id_t id = UR_ITER_BEGIN;
+   int i;
+
+   while ((id = ur_iter_fields(tmplt, id)) != UR_ITER_END) {
+      if (ur_is_dynamic(id)) {
+         int len = rand() % 8 == 0 ? TEST_LONG_LEN : rand() % 20;
+         for (i = 0; i < len; i++) {
+            data[i] = rand();
+         }
+         ur_set_var(tmplt, rec, id, data, len);
+      } else {
+         char *ptr = (char *) ur_get_ptr_by_id(tmplt, rec, id);
+         for (i = 0; i < ur_get_size(id); i++) {
+            ptr[i] = rand();
+         }
+      }
+   }
+}
+
+// Copy fields one by one, as unirecfilter does when plan cannot be created
+static void copy_fields(const ur_template_t *in_tmplt, const void *in_rec, const ur_template_t *out_tmplt, void *out_rec)
+{
+   ur_field_id_t id;
+   int rec_ind = 0;
+
+   while ((id = ur_iter_fields_record_order(out_tmplt, rec_ind++)) != UR_ITER_END) {
+      if (!ur_is_present(in_tmplt, id)) {
+         continue;
+      }
+      if (!ur_is_dynamic(id)) {
+         memcpy(ur_get_ptr_by_id(out_tmplt, out_rec, id), ur_get_ptr_by_id(in_tmplt, in_rec, id), ur_get_size(id));
+      } else {
+         int size = ur_get_var_len(in_tmplt, in_rec, id);
+         if (size > DYN_FIELD_MAX_SIZE) {
+            size = DYN_FIELD_MAX_SIZE;
+         }
+         ur_set_var(out_tmplt, out_rec, id, ur_get_ptr_by_id(in_tmplt, in_rec, id), size);
+      }
+   }
+}
+
+// Compare all fields of output records, return name of the first different one or NULL
+static const char *compare_records(const ur_template_t *tmplt, const void *a, const void *b)
+{
+   ur_field_id_t id = UR_ITER_BEGIN;
+
+   while ((id = ur_iter_fields(tmplt, id)) != UR_ITER_END) {
+      int len = ur_is_dynamic(id) ? ur_get_var_len(tmplt, a, id) : ur_get_size(id);
+
+      if ((ur_is_dynamic(id) && len != ur_get_var_len(tmplt, b, id)) ||
+          memcmp(ur_get_ptr_by_id(tmplt, a, id), ur_get_ptr_by_id(tmplt, b, id), len) != 0) {
+         return ur_get_name(id);
+      }
+   }
+   return NULL;
+}
+
+int main(int argc, char **argv)
+{
+   unsigned long copied = 0;
+   int round, r;
+
+   srand(argc > 1 ? atoi(argv[1]) : 1);
+   for (round = 0; round < TEST_ROUNDS; round++) {
+      uint32_t in_fields, out_fields;
+      ur_template_t *in_tmplt = random_template(&in_fields);
+      ur_template_t *out_tmplt = random_template(&out_fields);
+      void *in_rec = ur_create_record(in_tmplt, UR_MAX_SIZE);
+      void *plan_rec = ur_create_record(out_tmplt, UR_MAX_SIZE);
+      void *loop_rec = ur_create_record(out_tmplt, UR_MAX_SIZE);
+      struct copy_plan *plan;
+
+      if (in_tmplt == NULL || out_tmplt == NULL || in_rec == NULL || plan_rec == NULL || loop_rec == NULL) {
+         fprintf(stderr, "Error: Templates or records could not be created.\n");
+         return 1;
+      }
+      set_defaults(out_tmplt, plan_rec, in_fields, out_fields);
+      memcpy(loop_rec, plan_rec, ur_rec_size(out_tmplt, plan_rec));
+      if ((plan = createCopyPlan(in_tmplt, out_tmplt, plan_rec)) == NULL) {
+         fprintf(stderr, "Error: Copy plan could not be created.\n");
+         return 1;
+      }
+
+      // Output records are reused, so values of previous record must not remain in them
+      for (r = 0; r < TEST_RECORDS; r++) {
+         uint16_t size;
+         const char *field;
+
+         fill_record(in_tmplt, in_rec);
+         size = applyCopyPlan(plan, in_rec, plan_rec);
+         copy_fields(in_tmplt, in_rec, out_tmplt, loop_rec);
+         if (size != ur_rec_size(out_tmplt, plan_rec) || size != ur_rec_size(out_tmplt, loop_rec)) {
+            fprintf(stderr, "Error: Size of record %d of templates %d written by plan is %u, expected %u\n",
+                    r, round, size, ur_rec_size(out_tmplt, loop_rec));
+            return 1;
+         }
+         if ((field = compare_records(out_tmplt, plan_rec, loop_rec)) != NULL) {
+            fprintf(stderr, "Error: Field %s of record %d of templates %d differs.\n", field, r, round);
+            return 1;
+         }
+         copied++;
+      }
+      freeCopyPlan(plan);
+      ur_free_record(in_rec);
+      ur_free_record(plan_rec);
+      ur_free_record(loop_rec);
+      ur_free_template(in_tmplt);
+      ur_free_template(out_tmplt);
+   }
+   printf("%lu records copied\n", copied);
+   ur_finalize();
+   return 0;
+}
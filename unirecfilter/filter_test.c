@@ -0,0 +1,299 @@
+/**
+ * \file filter_test.c
+ * \brief Filters compiled to programs, filter sets and native code must give the same results as syntax tree.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unirec/unirec.h>
+
+#include "unirecfilter.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "fields.h"
+
+#define TEST_TEMPLATE "ipaddr SRC_IP,ipaddr DST_IP,uint64 BYTES,int64 I64,uint32 PACKETS,int32 I32,uint16 SRC_PORT," \
+                      "uint16 DST_PORT,int16 I16,uint8 PROTOCOL,int8 TOS,char CH,double DUR,float FL,string HOST"
+#define TEST_SETS 400     // Filter sets evaluated by programs and filter set
+#define TEST_JIT_SETS 20  // Filter sets compiled to native code
+#define TEST_RECORDS 300  // Records evaluated by each filter set
+#define TEST_OUTPUTS 12   // Maximal number of filters in set
+
+UR_FIELDS()
+
+__thread char *str_buffer = NULL;
+
+// Constructors of syntax tree nodes used by parser
+struct ast *newAST(struct ast *l, struct ast *r, log_op operator);
+struct ast *newExpression(char *column, char *cmp, int64_t number, int is_signed);
+struct ast *newExpressionFP(char *column, char *cmp, double number);
+struct ast *newIP(char *column, char *cmp, char *ip);
+struct ast *newIPSet(char *column, char *source, int is_file, struct set_item *items);
+struct set_item *newSetItem(char *s, int64_t number, int is_ip);
+struct ast *newSet(char *column, struct set_item *items, char *filename);
+struct ast *newString(char *column, char *cmp, char *s);
+struct ast *newBrack(struct ast *b);
+struct ast *newNegation(struct ast *b);
+
+static const char *ops[] = { "==", "!=", "<", "<=", ">", ">=" };
+static const char *int_fields[] = { "BYTES", "I64", "PACKETS", "I32", "DST_PORT", "I16", "PROTOCOL", "TOS", "NOSUCH" };
+static const char *ip_fields[] = { "SRC_IP", "DST_IP" };
+// Strings of records, with high bytes and NUL inside
+static const char *strings[] = { "", "a", "ab", "abc", "b", "\xe9", "a\xe9" "b", "a\0b", "\xff\xff" };
+static const int string_lens[] = { 0, 1, 2, 3, 1, 1, 3, 3, 2 };
+static const char *regexes[] = { "^a+b?$", "a", "b|^c", "ab$", "(a|b)*c", "x{2,}", "a[.]", "[[:alpha:]]b", "(^a)",
+                                 "\xe9", "^[^a]$", "a.b", "[\x80-\xff]+$" };
+
+#define COUNT(array) ((int) (sizeof(array) / sizeof(array[0])))
+
+// Address 10.0.0.N or 2001:db8::N of records and filters
+static void test_ip(char *buf, size_t size, int n)
+{
+   snprintf(buf, size, n < 4 ? "10.0.0.%d" : "2001:db8::%d", n % 4);
+}
+
+// Prefix covering one to four of addresses of records
+static void random_prefix(char *buf, size_t size)
+{
+   int n = rand() % 8;
+   char ip[64];
+
+   test_ip(ip, sizeof(ip), n);
+   snprintf(buf, size, "%s/%d", ip, (n < 4 ? 30 : 126) + rand() % 3);
+}
+
+// Random set of strings, IP prefixes or integers, small integers are kept in bitmap and large ones in hash table
+static struct ast *random_set(void)
+{
+   struct set_item *items = NULL, *item;
+   int n = 1 + rand() % 5, kind = rand() % 6, big = rand() % 3 == 0;
+   const char *column;
+   char ip[64];
+   int i;
+
+   for (i = 0; i < n; i++) {
+      if (kind == 0) {
+         item = newSetItem(strdup(strings[rand() % (COUNT(strings) - 2)]), 0, 0);
+      } else if (kind == 1) {
+         random_prefix(ip, sizeof(ip));
+         item = newSetItem(strdup(ip), 0, 1);
+      } else {
+         int64_t number = rand() % 8 - (rand() % 4 == 0 ? 4 : 0);
+         item = newSetItem(NULL, big ? number * ((int64_t) 1 << (rand() % 2 * 40)) : number, 0);
+      }
+      item->next = items;
+      items = item;
+   }
+   column = kind == 0 ? "HOST" : kind == 1 ? ip_fields[rand() % 2] : int_fields[rand() % COUNT(int_fields)];
+   return newSet(strdup(column), items, NULL);
+}
+
+// Random comparison of field with constant
+static struct ast *random_leaf(void)
+{
+   char ip[64];
+
+   switch (rand() % 7) {
+   case 0:
+      return random_set();
+   case 1:
+   case 2: {
+      int64_t number = rand() % 8 - (rand() % 4 == 0 ? 4 : 0);
+      return newExpression(strdup(int_fields[rand() % COUNT(int_fields)]), strdup(ops[rand() % 6]), number, number < 0 || rand() % 2);
+   }
+   case 3:
+      return newExpressionFP(strdup(rand() % 2 ? "DUR" : "FL"), strdup(ops[rand() % 6]), (rand() % 8) / 2.0);
+   case 4:
+      if (rand() % 2) {
+         random_prefix(ip, sizeof(ip));
+         return newIPSet(strdup(ip_fields[rand() % 2]), strdup(ip), 0, NULL);
+      }
+      test_ip(ip, sizeof(ip), rand() % 8);
+      return newIP(strdup(ip_fields[rand() % 2]), strdup(ops[rand() % 6]), strdup(ip));
+   case 5:
+      if (rand() % 3 == 0) {
+         return newString(strdup("CH"), strdup(rand() % 2 ? "==" : "!="), strdup(rand() % 2 ? "a" : "b"));
+      }
+      if (rand() % 2) {
+         return newString(strdup("HOST"), strdup("=~"), strdup(regexes[rand() % COUNT(regexes)]));
+      }
+      return newString(strdup("HOST"), strdup(rand() % 2 ? "==" : "!="), strdup(strings[rand() % (COUNT(strings) - 2)]));
+   default:
+      return newString(strdup("HOST"), strdup("=~"), strdup(regexes[rand() % COUNT(regexes)]));
+   }
+}
+
+static struct ast *random_tree(int depth)
+{
+   if (depth == 0 || rand() % 3 == 0) {
+      return newAST(random_leaf(), NULL, OP_NOP);
+   }
+   switch (rand() % 4) {
+   case 0:
+      return newAST(random_tree(depth - 1), random_leaf(), OP_AND);
+   case 1:
+      return newAST(random_tree(depth - 1), random_leaf(), OP_OR);
+   case 2:
+      return newAST(newNegation(random_tree(depth - 1)), NULL, OP_NOP);
+   default:
+      return newAST(newBrack(random_tree(depth - 1)), NULL, OP_NOP);
+   }
+}
+
+// Fill record with small values, so comparisons with constants of filters are often true
+static void fill_record(ur_template_t *tmplt, void *rec)
+{
+   ur_field_id_t id = UR_ITER_BEGIN;
+   char ip[64];
+   int i;
+
+   while ((id = ur_iter_fields(tmplt, id)) != UR_ITER_END) {
+      void *ptr = ur_get_ptr_by_id(tmplt, rec, id);
+      int64_t number = rand() % 8 - (rand() % 4 == 0 ? 4 : 0);
+
+      switch (ur_get_type(id)) {
+      case UR_TYPE_STRING:
+         i = rand() % COUNT(strings);
+         ur_set_var(tmplt, rec, id, strings[i], string_lens[i]);
+         break;
+      case UR_TYPE_IP:
+         test_ip(ip, sizeof(ip), rand() % 8);
+         ip_from_str(ip, (ip_addr_t *) ptr);
+         break;
+      case UR_TYPE_CHAR:
+         *(char *) ptr = "abx"[rand() % 3];
+         break;
+      case UR_TYPE_FLOAT:
+         *(float *) ptr = (rand() % 8) / 2.0;
+         break;
+      case UR_TYPE_DOUBLE:
+         *(double *) ptr = (rand() % 8) / 2.0;
+         break;
+      default:
+         // Integers (little endian), large values hit hash tables of sets
+         if (ur_get_size(id) == 8 && rand() % 4 == 0) {
+            number *= (int64_t) 1 << 40;
+         }
+         memcpy(ptr, &number, ur_get_size(id));
+         break;
+      }
+   }
+}
+
+int main(int argc, char **argv)
+{
+   ur_template_t *tmplt;
+   void *rec;
+   unsigned long checks = 0, matches = 0;
+   int t, r, o;
+
+   if ((tmplt = ur_define_fields_and_update_template(TEST_TEMPLATE, NULL)) == NULL) {
+      fprintf(stderr, "Error: Template could not be created.\n");
+      return 1;
+   }
+   str_buffer = (char *) malloc(65536);
+   rec = ur_create_record(tmplt, 64);
+   if (str_buffer == NULL || rec == NULL) {
+      fprintf(stderr, "Error: Not enough memory.\n");
+      return 1;
+   }
+   srand(argc > 1 ? atoi(argv[1]) : 1);
+
+   for (t = 0; t < TEST_SETS + TEST_JIT_SETS; t++) {
+      int jit = t >= TEST_SETS;
+      struct ast *trees[TEST_OUTPUTS];
+      struct filter_set *set;
+      int n = 1 + rand() % TEST_OUTPUTS;
+
+      // Outputs without filter receive all records
+      for (o = 0; o < n; o++) {
+         trees[o] = rand() % 6 ? random_tree(3) : NULL;
+      }
+      if ((set = compileFilterSet(trees, n, tmplt)) == NULL) {
+         fprintf(stderr, "Error: Filter set could not be compiled.\n");
+         return 1;
+      }
+      if (jit && jitFilterSet(set) != 0) {
+         fprintf(stderr, "Error: Filter set could not be compiled to native code.\n");
+         return 1;
+      }
+      for (r = 0; r < TEST_RECORDS; r++) {
+         uint32_t expected = 0, got;
+
+         fill_record(tmplt, rec);
+         for (o = 0; o < n; o++) {
+            if (trees[o] == NULL || evalAST(trees[o], tmplt, rec)) {
+               expected |= 1U << o;
+            }
+            if (set->programs[o] != NULL && evalProgram(set->programs[o], rec) != (int) ((expected >> o) & 1)) {
+               fprintf(stderr, "Error: Program of filter %d of set %d differs from syntax tree on record %d:\n", o, t, r);
+               printAST(trees[o]);
+               fprintf(stderr, "\n");
+               return 1;
+            }
+         }
+         got = jit ? set->native(rec, set->consts, str_buffer) : evalFilterSet(set, rec, set->memo);
+         if (got != expected) {
+            fprintf(stderr, "Error: %s of set %d differs from syntax tree on record %d: %x, expected %x\n",
+                    jit ? "Native code" : "Filter set", t, r, got, expected);
+            return 1;
+         }
+         checks++;
+         matches += __builtin_popcount(got);
+      }
+      freeFilterSet(set);
+      for (o = 0; o < n; o++) {
+         freeAST(trees[o]);
+      }
+   }
+   printf("%lu records checked, %lu matches\n", checks, matches);
+
+   ur_free_record(rec);
+   free(str_buffer);
+   ur_free_template(tmplt);
+   ur_finalize();
+   return 0;
+}
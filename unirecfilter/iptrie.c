@@ -0,0 +1,368 @@
+/**
+ * \file iptrie.c
+ * \brief Sets of IPv4 and IPv6 prefixes with lookup in compressed trie.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <endian.h>
+#include <arpa/inet.h>
+
+#include "iptrie.h"
+
+#define IP_TRIE_CHILDREN (1 << IP_TRIE_STRIDE)
+#define IP_TRIE_MASK (IP_TRIE_CHILDREN - 1)
+#define IP_TRIE_SHIFT (64 - IP_TRIE_STRIDE)
+
+// Index of address family in arrays of trie
+#define FAMILY_V4 0
+#define FAMILY_V6 1
+
+// Bits of address as two 64 bit words, IPv4 address is in upper half of the first one
+static void ip_key(const ip_addr_t *ip, int family, uint64_t *hi, uint64_t *lo)
+{
+   if (family == FAMILY_V4) {
+      *hi = (uint64_t) ntohl(ip->ui32[2]) << 32;
+      *lo = 0;
+   } else {
+      *hi = be64toh(ip->ui64[0]);
+      *lo = be64toh(ip->ui64[1]);
+   }
+}
+
+// Get IP_TRIE_STRIDE bits of address starting at bit depth, bits after the end are zero
+static inline unsigned chunk(uint64_t hi, uint64_t lo, int depth)
+{
+   if (depth <= IP_TRIE_SHIFT) {
+      return (hi >> (IP_TRIE_SHIFT - depth)) & IP_TRIE_MASK;
+   } else if (depth < 64) {
+      return ((hi << (depth - IP_TRIE_SHIFT)) | (lo >> (64 + IP_TRIE_SHIFT - depth))) & IP_TRIE_MASK;
+   } else if (depth <= 64 + IP_TRIE_SHIFT) {
+      return (lo >> (64 + IP_TRIE_SHIFT - depth)) & IP_TRIE_MASK;
+   }
+   return (lo << (depth - 64 - IP_TRIE_SHIFT)) & IP_TRIE_MASK;
+}
+
+// Append node to binary trie, return its index or -1 when memory allocation fails
+static int new_prefix_node(struct ip_trie *trie, int family)
+{
+   struct ip_prefix_node *node;
+
+   if (trie->n_prefixes[family] == trie->size_prefixes[family]) {
+      int size = trie->size_prefixes[family] ? 2 * trie->size_prefixes[family] : 64;
+      node = (struct ip_prefix_node *) realloc(trie->prefixes[family], size * sizeof(struct ip_prefix_node));
+      if (node == NULL) {
+         return -1;
+      }
+      trie->prefixes[family] = node;
+      trie->size_prefixes[family] = size;
+   }
+   node = &trie->prefixes[family][trie->n_prefixes[family]];
+   node->child[0] = -1;
+   node->child[1] = -1;
+   node->full = 0;
+   return trie->n_prefixes[family]++;
+}
+
+/**
+ * \brief Create empty set of prefixes.
+ * \return Set or NULL when memory allocation fails.
+ */
+struct ip_trie *createIPTrie(void)
+{
+   struct ip_trie *trie = (struct ip_trie *) calloc(1, sizeof(struct ip_trie));
+
+   if (trie == NULL) {
+      return NULL;
+   }
+   trie->lookup = lookupIPTrie;
+   if (new_prefix_node(trie, FAMILY_V4) < 0 || new_prefix_node(trie, FAMILY_V6) < 0) {
+      freeIPTrie(trie);
+      return NULL;
+   }
+   return trie;
+}
+
+/**
+ * \brief Add prefix to set, it has to be called before buildIPTrie().
+ * \param[in,out] trie Set of prefixes.
+ * \param[in] prefix IPv4 or IPv6 address with optional length of prefix, e.g. 10.0.0.0/8.
+ *            Address without length is a prefix of full length.
+ * \return 0 on success, 1 when prefix is not valid or memory allocation fails.
+ */
+int addIPPrefix(struct ip_trie *trie, const char *prefix)
+{
+   char addr[INET6_ADDRSTRLEN + 1];
+   const char *slash = strchr(prefix, '/');
+   size_t addr_len = slash != NULL ? (size_t) (slash - prefix) : strlen(prefix);
+   ip_addr_t ip;
+   uint64_t hi, lo;
+   int family, len, depth, node, child;
+   char *end;
+
+   if (trie->prefixes[FAMILY_V4] == NULL || addr_len >= sizeof(addr)) {
+      return 1;
+   }
+   memcpy(addr, prefix, addr_len);
+   addr[addr_len] = '\0';
+   if (!ip_from_str(addr, &ip)) {
+      return 1;
+   }
+   family = ip_is4(&ip) ? FAMILY_V4 : FAMILY_V6;
+   len = family == FAMILY_V4 ? 32 : 128;
+   if (slash != NULL) {
+      long prefix_len = isdigit((unsigned char) slash[1]) ? strtol(slash + 1, &end, 10) : -1;
+
+      if (prefix_len < 0 || prefix_len > len || *end != '\0') {
+         return 1;
+      }
+      len = prefix_len;
+   }
+   ip_key(&ip, family, &hi, &lo);
+
+   node = 0;
+   for (depth = 0; depth < len; depth++) {
+      int bit = depth < 64 ? (hi >> (63 - depth)) & 1 : (lo >> (127 - depth)) & 1;
+
+      if (trie->prefixes[family][node].full) {
+         // Covered by shorter prefix
+         return 0;
+      }
+      if ((child = trie->prefixes[family][node].child[bit]) < 0) {
+         if ((child = new_prefix_node(trie, family)) < 0) {
+            return 1;
+         }
+         trie->prefixes[family][node].child[bit] = child;
+      }
+      node = child;
+   }
+   // Longer prefixes are covered by this one
+   trie->prefixes[family][node].full = 1;
+   trie->prefixes[family][node].child[0] = -1;
+   trie->prefixes[family][node].child[1] = -1;
+   return 0;
+}
+
+/**
+ * \brief Add prefixes listed in file to set, it has to be called before buildIPTrie().
+ * File contains one prefix per line, empty lines and comments starting
+ * with # are skipped. Invalid prefixes are reported and skipped.
+ * \param[in,out] trie Set of prefixes.
+ * \param[in] filename Path to file.
+ * \return Number of added prefixes, -1 when file cannot be read.
+ */
+int loadIPPrefixes(struct ip_trie *trie, const char *filename)
+{
+   FILE *f = fopen(filename, "r");
+   char line[1024];
+   int line_num = 0;
+   int count = 0;
+
+   if (f == NULL) {
+      fprintf(stderr, "Error: File %s with prefixes could not be opened.\n", filename);
+      return -1;
+   }
+   while (fgets(line, sizeof(line), f) != NULL) {
+      char *start = line;
+      char *end = strchr(line, '#');
+
+      line_num++;
+      if (end == NULL) {
+         end = line + strlen(line);
+      }
+      while (start < end && isspace((unsigned char) *start)) {
+         start++;
+      }
+      while (end > start && isspace((unsigned char) end[-1])) {
+         end--;
+      }
+      if (start == end) {
+         continue;
+      }
+      *end = '\0';
+      if (addIPPrefix(trie, start) != 0) {
+         fprintf(stderr, "Warning: %s on line %d of %s is not a valid prefix.\n", start, line_num, filename);
+      } else {
+         count++;
+      }
+   }
+   fclose(f);
+   return count;
+}
+
+// Fill compressed node at index by next IP_TRIE_STRIDE levels of binary trie below node
+static int compress_node(struct ip_trie *trie, int family, int node, uint32_t index)
+{
+   const struct ip_prefix_node *prefixes = trie->prefixes[family];
+   struct ip_trie_node *nodes;
+   int inner[IP_TRIE_CHILDREN];
+   int n_inner = 0;
+   uint64_t vector = 0, leafvec = 0;
+   uint32_t base;
+   int i, k;
+
+   for (i = 0; i < IP_TRIE_CHILDREN; i++) {
+      int x = node;
+
+      for (k = 0; k < IP_TRIE_STRIDE && x >= 0 && !prefixes[x].full; k++) {
+         x = prefixes[x].child[(i >> (IP_TRIE_STRIDE - 1 - k)) & 1];
+      }
+      if (x < 0) {
+         continue;
+      } else if (prefixes[x].full) {
+         leafvec |= UINT64_C(1) << i;
+      } else {
+         vector |= UINT64_C(1) << i;
+         inner[n_inner++] = x;
+      }
+   }
+
+   // Inner children are stored one after another
+   base = trie->n_nodes[family];
+   if (n_inner > 0) {
+      nodes = (struct ip_trie_node *) realloc(trie->nodes[family], (base + n_inner) * sizeof(struct ip_trie_node));
+      if (nodes == NULL) {
+         return 1;
+      }
+      trie->nodes[family] = nodes;
+      trie->n_nodes[family] += n_inner;
+   }
+   trie->nodes[family][index].vector = vector;
+   trie->nodes[family][index].leafvec = leafvec;
+   trie->nodes[family][index].base = base;
+   for (i = 0; i < n_inner; i++) {
+      if (compress_node(trie, family, inner[i], base + i) != 0) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/**
+ * \brief Build compressed trie of set for lookups, no prefixes can be added after it.
+ * \param[in,out] trie Set of prefixes.
+ * \return 0 on success, 1 when memory allocation fails.
+ */
+int buildIPTrie(struct ip_trie *trie)
+{
+   int family;
+   int ret = 0;
+
+   for (family = FAMILY_V4; family <= FAMILY_V6; family++) {
+      if (trie->prefixes[family] == NULL) {
+         continue;
+      }
+      free(trie->nodes[family]);
+      trie->nodes[family] = (struct ip_trie_node *) malloc(sizeof(struct ip_trie_node));
+      trie->n_nodes[family] = 1;
+      if (trie->nodes[family] == NULL || compress_node(trie, family, 0, 0) != 0) {
+         ret = 1;
+      }
+      free(trie->prefixes[family]);
+      trie->prefixes[family] = NULL;
+   }
+   return ret;
+}
+
+/**
+ * \brief Check whether address is in set.
+ * \param[in] trie Set built by buildIPTrie().
+ * \param[in] ip Address.
+ * \return 1 when address is covered by a prefix of set, 0 otherwise.
+ */
+int lookupIPTrie(const struct ip_trie *trie, const ip_addr_t *ip)
+{
+   int family = ip_is4(ip) ? FAMILY_V4 : FAMILY_V6;
+   const struct ip_trie_node *nodes = trie->nodes[family];
+   const struct ip_trie_node *node = nodes;
+   uint64_t hi, lo;
+   int depth;
+
+   if (nodes == NULL) {
+      return 0;
+   }
+   ip_key(ip, family, &hi, &lo);
+   for (depth = 0; ; depth += IP_TRIE_STRIDE) {
+      uint64_t bit = UINT64_C(1) << chunk(hi, lo, depth);
+
+      if (!(node->vector & bit)) {
+         return (node->leafvec & bit) != 0;
+      }
+      node = nodes + node->base + __builtin_popcountll(node->vector & (bit - 1));
+   }
+}
+
+/**
+ * \brief Check whether two built sets have the same tries, so they contain the same addresses.
+ */
+int equalIPTries(const struct ip_trie *a, const struct ip_trie *b)
+{
+   int family, i;
+
+   for (family = FAMILY_V4; family <= FAMILY_V6; family++) {
+      if (a->n_nodes[family] != b->n_nodes[family]) {
+         return 0;
+      }
+      for (i = 0; i < a->n_nodes[family]; i++) {
+         const struct ip_trie_node *x = &a->nodes[family][i];
+         const struct ip_trie_node *y = &b->nodes[family][i];
+
+         if (x->vector != y->vector || x->leafvec != y->leafvec || x->base != y->base) {
+            return 0;
+         }
+      }
+   }
+   return 1;
+}
+
+void freeIPTrie(struct ip_trie *trie)
+{
+   int family;
+
+   if (trie == NULL) {
+      return;
+   }
+   for (family = FAMILY_V4; family <= FAMILY_V6; family++) {
+      free(trie->nodes[family]);
+      free(trie->prefixes[family]);
+   }
+   free(trie);
+}
@@ -0,0 +1,86 @@
+/**
+ * \file iptrie.h
+ * \brief Sets of IPv4 and IPv6 prefixes with lookup in compressed trie.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifndef IPTRIE_H
+#define IPTRIE_H
+
+#include <stdint.h>
+#include <unirec/unirec.h>
+
+#define IP_TRIE_STRIDE 6 // Bits of address consumed by one node
+
+/*
+ * Node of compressed trie. Each of 64 children is either a leaf, whose bit
+ * in leafvec tells whether its addresses are in the set, or an inner node.
+ * Inner children of a node are stored one after another from index base,
+ * i-th child is found by counting set bits of vector below bit i.
+ */
+struct ip_trie_node {
+   uint64_t vector;     // Children which are inner nodes
+   uint64_t leafvec;    // Leaves whose addresses are in the set
+   uint32_t base;       // Index of first inner child
+};
+
+/* Node of binary trie the set is built in */
+struct ip_prefix_node {
+   int child[2];
+   int full;            // Whole subtree is in the set
+};
+
+/* Set of IPv4 and IPv6 prefixes */
+struct ip_trie {
+   int (*lookup)(const struct ip_trie *trie, const ip_addr_t *ip); // First member, called by native code
+   struct ip_trie_node *nodes[2];      // Compressed tries of IPv4 and IPv6 addresses
+   int n_nodes[2];
+   struct ip_prefix_node *prefixes[2]; // Binary tries, freed by buildIPTrie()
+   int n_prefixes[2];
+   int size_prefixes[2];
+};
+
+struct ip_trie *createIPTrie(void);
+int addIPPrefix(struct ip_trie *trie, const char *prefix);
+int loadIPPrefixes(struct ip_trie *trie, const char *filename);
+int buildIPTrie(struct ip_trie *trie);
+int lookupIPTrie(const struct ip_trie *trie, const ip_addr_t *ip);
+int equalIPTries(const struct ip_trie *a, const struct ip_trie *b);
+void freeIPTrie(struct ip_trie *trie);
+
+#endif
@@ -0,0 +1,241 @@
+/**
+ * \file iptrie_test.c
+ * \brief Lookup of IPv4 and IPv6 addresses in trie must give the same results as linear search of prefixes.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <unirec/unirec.h>
+
+#include "iptrie.h"
+
+#define TEST_ROUNDS 200       // Sets of prefixes
+#define TEST_PREFIXES 60      // Maximal number of prefixes in set
+#define TEST_LOOKUPS 20000    // Addresses looked up in each set
+
+/* Prefix of set with its address in unirec format */
+struct test_prefix {
+   ip_addr_t ip;
+   int len;
+   int is4;
+};
+
+// Check whether address is covered by prefix, bit by bit
+static int covers(const struct test_prefix *prefix, const ip_addr_t *ip)
+{
+   const uint8_t *a, *b;
+   int i;
+
+   if (ip_is4(ip) != prefix->is4) {
+      return 0;
+   }
+   // IPv4 address is in third 32-bit word
+   a = prefix->ip.bytes + (prefix->is4 ? 8 : 0);
+   b = ip->bytes + (prefix->is4 ? 8 : 0);
+   for (i = 0; i < prefix->len; i++) {
+      uint8_t bit = 0x80 >> (i % 8);
+      if ((a[i / 8] & bit) != (b[i / 8] & bit)) {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+// Random prefix, addresses of IPv4 prefixes often share bytes so that prefixes are nested
+static void random_prefix(struct test_prefix *prefix, char *str, size_t size)
+{
+   char addr[INET6_ADDRSTRLEN];
+   int i;
+
+   prefix->is4 = rand() % 2;
+   if (prefix->is4) {
+      uint32_t a = rand() & (rand() % 2 ? 0xff0f00ff : 0xffffffff);
+      ip_from_str("0.0.0.0", &prefix->ip);
+      memcpy(&prefix->ip.ui32[2], &a, 4);
+      prefix->len = rand() % 33;
+      inet_ntop(AF_INET, &prefix->ip.ui32[2], addr, sizeof(addr));
+   } else {
+      for (i = 0; i < 16; i++) {
+         prefix->ip.bytes[i] = rand() % 4 ? rand() : 0;
+      }
+      prefix->ip.bytes[0] |= 0x20; // Not IPv4 address in unirec format
+      prefix->len = rand() % 129;
+      inet_ntop(AF_INET6, prefix->ip.bytes, addr, sizeof(addr));
+   }
+   snprintf(str, size, "%s/%d", addr, prefix->len);
+}
+
+// Address near one of prefixes (one bit flipped) or random one
+static void random_address(const struct test_prefix *prefixes, int n, ip_addr_t *ip)
+{
+   int i;
+
+   if (n > 0 && rand() % 2) {
+      const struct test_prefix *prefix = &prefixes[rand() % n];
+      *ip = prefix->ip;
+      if (prefix->is4) {
+         ip->bytes[8 + rand() % 4] ^= 1 << (rand() % 8);
+      } else {
+         ip->bytes[rand() % 16] ^= 1 << (rand() % 8);
+      }
+      return;
+   }
+   for (i = 0; i < 16; i++) {
+      ip->bytes[i] = rand();
+   }
+   if (rand() % 2) {
+      uint32_t a = ip->ui32[2];
+      ip_from_str("0.0.0.0", ip);
+      ip->ui32[2] = a;
+   }
+}
+
+static int check_address(struct ip_trie *trie, const char *addr, int expected)
+{
+   ip_addr_t ip;
+
+   ip_from_str(addr, &ip);
+   if (lookupIPTrie(trie, &ip) != expected) {
+      fprintf(stderr, "Error: Lookup of %s in loaded prefixes: %d, expected %d\n", addr, !expected, expected);
+      return 1;
+   }
+   return 0;
+}
+
+// Prefixes loaded from file with comments and invalid lines
+static int check_file(void)
+{
+   static const char *lines = "# list\n10.0.0.0/8\n  192.168.1.1 # host\n\nbogus\n2001:db8::/32\n10.0.0.0/33\n";
+   char filename[] = "/tmp/iptrie_test.XXXXXX";
+   struct ip_trie *trie;
+   int fd, loaded, errors = 0;
+
+   if ((fd = mkstemp(filename)) < 0 || write(fd, lines, strlen(lines)) != (ssize_t) strlen(lines)) {
+      fprintf(stderr, "Error: Temporary file could not be written.\n");
+      return 1;
+   }
+   close(fd);
+   trie = createIPTrie();
+   loaded = loadIPPrefixes(trie, filename);
+   unlink(filename);
+   if (loaded != 3 || buildIPTrie(trie) != 0) {
+      fprintf(stderr, "Error: %d prefixes loaded from file, expected 3\n", loaded);
+      freeIPTrie(trie);
+      return 1;
+   }
+   errors += check_address(trie, "10.2.3.4", 1);
+   errors += check_address(trie, "11.0.0.0", 0);
+   errors += check_address(trie, "192.168.1.1", 1);
+   errors += check_address(trie, "192.168.1.2", 0);
+   errors += check_address(trie, "2001:db8:1::1", 1);
+   errors += check_address(trie, "2001:db9::1", 0);
+   // IPv4 prefix does not cover IPv6 address with the same bits at position of IPv4 address
+   errors += check_address(trie, "::a02:304:0:0", 0);
+   freeIPTrie(trie);
+   return errors;
+}
+
+int main(int argc, char **argv)
+{
+   static const char *invalid[] = { "10.0.0.0/33", "10.0.0.0/", "x/8", "::/129", "10.0.0.0/-1" };
+   struct test_prefix prefixes[TEST_PREFIXES];
+   unsigned long checks = 0;
+   struct ip_trie *trie;
+   int round, q, i;
+
+   srand(argc > 1 ? atoi(argv[1]) : 1);
+   for (round = 0; round < TEST_ROUNDS; round++) {
+      int n = rand() % TEST_PREFIXES;
+
+      trie = createIPTrie();
+      for (i = 0; i < n; i++) {
+         char str[64];
+
+         random_prefix(&prefixes[i], str, sizeof(str));
+         if (addIPPrefix(trie, str) != 0) {
+            fprintf(stderr, "Error: Prefix %s was not added.\n", str);
+            return 1;
+         }
+      }
+      if (buildIPTrie(trie) != 0) {
+         fprintf(stderr, "Error: Trie could not be built.\n");
+         return 1;
+      }
+      for (q = 0; q < TEST_LOOKUPS; q++) {
+         ip_addr_t ip;
+         int expected = 0;
+
+         random_address(prefixes, n, &ip);
+         for (i = 0; i < n && !expected; i++) {
+            expected = covers(&prefixes[i], &ip);
+         }
+         if (lookupIPTrie(trie, &ip) != expected) {
+            char addr[INET6_ADDRSTRLEN];
+            ip_to_str(&ip, addr);
+            fprintf(stderr, "Error: Lookup of %s in set %d: %d, expected %d\n", addr, round, !expected, expected);
+            return 1;
+         }
+         checks++;
+      }
+      freeIPTrie(trie);
+   }
+
+   trie = createIPTrie();
+   for (i = 0; i < (int) (sizeof(invalid) / sizeof(invalid[0])); i++) {
+      if (addIPPrefix(trie, invalid[i]) == 0) {
+         fprintf(stderr, "Error: Invalid prefix %s was added.\n", invalid[i]);
+         return 1;
+      }
+   }
+   freeIPTrie(trie);
+   if (check_file() != 0) {
+      return 1;
+   }
+   printf("%lu addresses checked\n", checks);
+   return 0;
+}
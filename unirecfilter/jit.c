@@ -0,0 +1,329 @@
+/**
+ * \file jit.c
+ * \brief Compilation of filter sets to native code.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "jit.h"
+#include "valueset.h"
+
+#define JIT_SYMBOL "filters"
+
+extern char **environ;
+
+#define JIT_TYPE(NAME, TYPE, MEMBER, OP) { #TYPE, #MEMBER, #OP },
+
+// C type of field, member of constant and operator of numeric instructions
+static const struct { const char *type; const char *member; const char *op; } jit_numeric[] = {
+   BC_NUMERIC_OPS(JIT_TYPE)
+};
+
+static const char *jit_ops[] = { "==", "!=", "<", "<=", ">", ">=" };
+
+// Helpers of generated code, same as cases of evalProgram()
+static const char *jit_prologue =
+   "#include <stdint.h>\n"
+   "#include <string.h>\n"
+   "#include <regex.h>\n"
+   "\n"
+   "static inline const char *str_ptr(const char *rec, unsigned off)\n"
+   "{\n"
+   "   return rec + STATIC_SIZE + *(const uint16_t *) (rec + off);\n"
+   "}\n"
+   "\n"
+   "static inline uint16_t str_len(const char *rec, unsigned off)\n"
+   "{\n"
+   "   return *(const uint16_t *) (rec + off + 2);\n"
+   "}\n"
+   "\n"
+   "static inline int str_eq(const char *rec, unsigned off, const void *s, unsigned len)\n"
+   "{\n"
+   "   return str_len(rec, off) == len && memcmp(str_ptr(rec, off), s, len) == 0;\n"
+   "}\n"
+   "\n"
+   "static inline int str_re(const char *rec, unsigned off, const void *re, char *buf)\n"
+   "{\n"
+   "   uint16_t len = str_len(rec, off);\n"
+   "   memcpy(buf, str_ptr(rec, off), len);\n"
+   "   buf[len] = '\\0';\n"
+   "   return regexec((const regex_t *) re, buf, 0, NULL, 0) != REG_NOMATCH;\n"
+   "}\n"
+   "\n"
+   "/* Set of prefixes starts with pointer to its lookup function */\n"
+   "static inline int ip_in(const char *ip, const void *set)\n"
+   "{\n"
+   "   return (*(int (*const *)(const void *, const void *)) set)(set, ip);\n"
+   "}\n"
+   "\n"
+   "static inline int int_in(uint64_t value, const void *set)\n"
+   "{\n"
+   "   return (*(int (*const *)(const void *, uint64_t)) set)(set, value);\n"
+   "}\n"
+   "\n"
+   "static inline int in_bitmap(uint64_t value, uint64_t min, uint64_t range, const uint64_t *bitmap)\n"
+   "{\n"
+   "   return value - min <= range && (bitmap[(value - min) / 64] >> ((value - min) % 64)) & 1;\n"
+   "}\n"
+   "\n"
+   "static inline int str_in(const char *rec, unsigned off, const void *set)\n"
+   "{\n"
+   "   return (*(int (*const *)(const void *, const char *, uint16_t)) set)(set, str_ptr(rec, off), str_len(rec, off));\n"
+   "}\n"
+   "\n"
+   "/* Automaton starts with pointer to its scan function, it stores results of all its expressions to m */\n"
+   "static inline int re_scan(const void *a, const char *rec, uint8_t *m)\n"
+   "{\n"
+   "   (*(void (*const *)(const void *, const char *, uint8_t *)) a)(a, rec, m);\n"
+   "   return 1;\n"
+   "}\n"
+   "\n"
+   "static inline double abs_diff(double a, double b)\n"
+   "{\n"
+   "   return a > b ? a - b : b - a;\n"
+   "}\n"
+   "\n"
+   "/* Result of comparison evaluated at most once, p is 0 when unknown, 1 false, 2 true */\n"
+   "#define PRED(p, cond) ((p) ? (p) - 1 : ((p) = (cond) + 1) - 1)\n"
+   "\n";
+
+// Write condition of instruction as C expression
+static void gen_condition(FILE *f, const struct bc_insn *insn, int i)
+{
+   int op = insn->op;
+
+   if (op <= BC_I64_GE) {
+      if (jit_numeric[op].member[0] == 'u') {
+         fprintf(f, "*(const %s *) (rec + %u) %s UINT64_C(%" PRIu64 ")",
+                 jit_numeric[op].type, insn->offset, jit_numeric[op].op, insn->val.u);
+      } else {
+         fprintf(f, "*(const %s *) (rec + %u) %s (int64_t) UINT64_C(%" PRIu64 ")",
+                 jit_numeric[op].type, insn->offset, jit_numeric[op].op, insn->val.u);
+      }
+   } else if (op <= BC_DBL_GE) {
+      const char *type = op <= BC_FLT_GE ? "float" : "double";
+      int cmp = op - (op <= BC_FLT_GE ? BC_FLT_EQ : BC_DBL_EQ);
+
+      // Hexadecimal notation keeps the constant exact
+      if (cmp == 0) {
+         fprintf(f, "abs_diff(*(const %s *) (rec + %u), %a) < %a", type, insn->offset, insn->val.d, BC_EPS);
+      } else {
+         fprintf(f, "*(const %s *) (rec + %u) %s %a", type, insn->offset, jit_ops[cmp], insn->val.d);
+      }
+   } else if (op <= BC_IP_GE) {
+      fprintf(f, "memcmp(rec + %u, c[%d], 16) %s 0", insn->offset, i, jit_ops[op - BC_IP_EQ]);
+   } else if (op == BC_IP_IN) {
+      fprintf(f, "ip_in(rec + %u, c[%d])", insn->offset, i);
+   } else if (op == BC_INT_IN) {
+      const struct int_set *set = (const struct int_set *) insn->val.ptr;
+      char value[64];
+
+      snprintf(value, sizeof(value), "(uint64_t) %s*(const %s *) (rec + %u)",
+               jit_numeric[insn->len].member[0] == 'i' ? "(int64_t) " : "", jit_numeric[insn->len].type, insn->offset);
+      // Bitmap is tested inline, c[i] points to it
+      if (set->bitmap != NULL) {
+         fprintf(f, "in_bitmap(%s, UINT64_C(%" PRIu64 "), UINT64_C(%" PRIu64 "), c[%d])", value, set->min, set->range, i);
+      } else {
+         fprintf(f, "int_in(%s, c[%d])", value, i);
+      }
+   } else if (op <= BC_CHAR_NE) {
+      fprintf(f, "rec[%u] %s (char) %" PRId64, insn->offset, op == BC_CHAR_EQ ? "==" : "!=", insn->val.i);
+   } else if (op == BC_STR_EQ || op == BC_STR_NE) {
+      fprintf(f, "%sstr_eq(rec, %u, c[%d], %u)", op == BC_STR_NE ? "!" : "", insn->offset, i, insn->len);
+   } else if (op == BC_STR_RE) {
+      fprintf(f, "str_re(rec, %u, c[%d], buf)", insn->offset, i);
+   } else if (op == BC_STR_IN) {
+      fprintf(f, "str_in(rec, %u, c[%d])", insn->offset, i);
+   } else {
+      fprintf(f, "%d", op == BC_TRUE);
+   }
+}
+
+// Write C source of function evaluating filter set
+static void gen_source(FILE *f, const struct filter_set *set)
+{
+   int i, j;
+
+   fprintf(f, "#define STATIC_SIZE %u\n", set->static_size);
+   fputs(jit_prologue, f);
+   fprintf(f, "uint32_t " JIT_SYMBOL "(const void *in_rec, const void *const *c, char *buf)\n{\n");
+   fprintf(f, "   const char *rec = (const char *) in_rec;\n");
+   fprintf(f, "   uint32_t mask = UINT32_C(%u);\n", set->always);
+   for (i = 0; i < set->n_preds; i++) {
+      fprintf(f, "   int p%d = 0;\n", i);
+   }
+   if (set->n_automata > 0) {
+      fprintf(f, "   uint8_t m[%d];\n", set->n_preds);
+   }
+   for (i = 0; i < set->n_automata; i++) {
+      fprintf(f, "   int a%d = 0;\n", i);
+   }
+   for (i = 0; i < set->n_programs; i++) {
+      const struct filter_program *prog = set->programs[i];
+
+      for (j = 0; prog != NULL && j < prog->count; j++) {
+         const struct bc_insn *insn = &prog->insns[j];
+
+         fprintf(f, "L%d_%d:\n", i, j);
+         if (insn->op == BC_ACCEPT) {
+            fprintf(f, "   mask |= UINT32_C(1) << %d;\n   goto E%d;\n", i, i);
+         } else if (insn->op == BC_REJECT) {
+            fprintf(f, "   goto E%d;\n", i);
+         } else if (insn->op >= BC_TRUE) {
+            fprintf(f, "   goto L%d_%u;\n", i, insn->op == BC_TRUE ? insn->jt : insn->jf);
+         } else {
+            int a = set->pred_automaton[insn->pred];
+
+            fprintf(f, "   if (PRED(p%u, ", insn->pred);
+            if (a >= 0) {
+               // The first expression of the field scans it for all of them
+               fprintf(f, "(a%d || (a%d = re_scan(c[%u], rec, m))) && m[%u] == 2", a, a, insn->pred, insn->pred);
+            } else {
+               gen_condition(f, &set->preds[insn->pred], insn->pred);
+            }
+            fprintf(f, "))\n      goto L%d_%u;\n   goto L%d_%u;\n", i, insn->jt, i, insn->jf);
+         }
+      }
+      fprintf(f, "E%d: ;\n", i);
+   }
+   fprintf(f, "   return mask;\n}\n");
+}
+
+/**
+ * \brief Compile filter set to native code.
+ * C source of the filters is generated and compiled by C compiler from
+ * environment variable CC into shared object, which is loaded and removed
+ * from disk. Each distinct comparison is a local variable evaluated at most
+ * once. The set keeps being evaluated by evalFilterSet() when compilation fails.
+ * \param[in,out] set Filter set, native function is stored in it.
+ * \return 0 on success, 1 otherwise.
+ */
+// Run command by shell and wait for it, return 0 when it succeeded. Unlike system(), signals of
+// the module are not blocked or ignored while compiler runs, it is called from reload thread.
+static int run_command(const char *cmd)
+{
+   char *argv[] = { "sh", "-c", (char *) cmd, NULL };
+   pid_t pid;
+   int status;
+
+   if (posix_spawn(&pid, "/bin/sh", NULL, NULL, argv, environ) != 0) {
+      return -1;
+   }
+   while (waitpid(pid, &status, 0) < 0) {
+      if (errno != EINTR) {
+         return -1;
+      }
+   }
+   return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+int jitFilterSet(struct filter_set *set)
+{
+   const char *tmpdir = getenv("TMPDIR");
+   const char *cc = getenv("CC");
+   char dir[256], src[300], obj[300];
+   char *cmd = NULL;
+   FILE *f;
+   void *handle = NULL;
+   int ret = 1;
+   int i;
+
+   if (tmpdir == NULL || tmpdir[0] == '\0') {
+      tmpdir = "/tmp";
+   }
+   if (cc == NULL || cc[0] == '\0') {
+      cc = JIT_DEFAULT_CC;
+   }
+   snprintf(dir, sizeof(dir), "%s/unirecfilter-XXXXXX", tmpdir);
+   if (mkdtemp(dir) == NULL) {
+      fprintf(stderr, "Warning: Directory for native code could not be created.\n");
+      return 1;
+   }
+   snprintf(src, sizeof(src), "%s/filter.c", dir);
+   snprintf(obj, sizeof(obj), "%s/filter.so", dir);
+
+   if ((f = fopen(src, "w")) == NULL) {
+      fprintf(stderr, "Warning: File %s could not be created.\n", src);
+      rmdir(dir);
+      return 1;
+   }
+   gen_source(f, set);
+   fclose(f);
+
+   cmd = (char *) malloc(strlen(cc) + strlen(src) + strlen(obj) + 64);
+   if (cmd != NULL) {
+      sprintf(cmd, "%s -O2 -w -fPIC -shared -o '%s' '%s'", cc, obj, src);
+      if (run_command(cmd) != 0) {
+         fprintf(stderr, "Warning: Filters could not be compiled to native code by '%s'.\n", cc);
+      } else if ((handle = dlopen(obj, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+         fprintf(stderr, "Warning: Native code of filters could not be loaded: %s\n", dlerror());
+      } else if ((*(void **) (&set->native) = dlsym(handle, JIT_SYMBOL)) == NULL
+                 || (set->consts = (const void **) calloc(set->n_preds + 1, sizeof(void *))) == NULL) {
+         fprintf(stderr, "Warning: Native code of filters could not be loaded.\n");
+         set->native = NULL;
+         dlclose(handle);
+      } else {
+         for (i = 0; i < set->n_preds; i++) {
+            int op = set->preds[i].op;
+            if (set->pred_automaton[i] >= 0) {
+               set->consts[i] = set->automata[set->pred_automaton[i]];
+            } else if (op == BC_INT_IN && ((const struct int_set *) set->preds[i].val.ptr)->bitmap != NULL) {
+               set->consts[i] = ((const struct int_set *) set->preds[i].val.ptr)->bitmap;
+            } else if ((op >= BC_IP_EQ && op <= BC_INT_IN) || (op >= BC_STR_EQ && op <= BC_STR_IN)) {
+               set->consts[i] = set->preds[i].val.ptr;
+            }
+         }
+         set->handle = handle;
+         ret = 0;
+      }
+      free(cmd);
+   }
+   unlink(src);
+   unlink(obj);
+   rmdir(dir);
+   return ret;
+}
@@ -0,0 +1,849 @@
+/**
+ * \file multimatch.c
+ * \brief Matching of string field against many regular expressions in one pass.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "multimatch.h"
+
+#define RE_MAX_STATES 65536  // Limit of nondeterministic automaton of all expressions
+#define RE_MAX_REPEAT 255    // Limit of bounds of {m,n}
+
+/*
+ * Supported subset of POSIX extended regular expressions (in C locale):
+ * characters, escaped special characters, ., bracket expressions with
+ * ranges and character classes, groups, |, *, +, ?, {m,n}, ^ and $.
+ * Other expressions (back references, GNU escapes like \w, equivalence
+ * classes, empty groups or alternatives) are evaluated by regexec().
+ */
+
+/* Node of syntax tree of expression */
+enum { RE_SET, RE_CAT, RE_ALT, RE_STAR, RE_PLUS, RE_QUEST, RE_REPEAT, RE_BOL, RE_EOL };
+
+struct re_node {
+   int type;
+   int l, r;
+   int min, max;        // Bounds of RE_REPEAT, max -1 for unbounded
+   uint64_t set[4];     // Bytes matched by RE_SET
+};
+
+struct re_parser {
+   const char *pattern;
+   const char *p;
+   int depth;           // Nesting of groups
+   struct re_node *nodes;
+   int n_nodes;
+   int size;
+   int error;
+};
+
+/* State of nondeterministic automaton */
+enum { NFA_SET, NFA_SPLIT, NFA_BOL, NFA_EOL, NFA_MATCH };
+
+struct nfa_state {
+   int type;
+   int out, out1;
+   int pred;            // Comparison matched by NFA_MATCH
+   uint64_t set[4];     // Bytes leading from NFA_SET to out
+};
+
+/* Construction of automata */
+struct builder {
+   const struct re_node *nodes;
+   struct nfa_state *states;
+   int n_states;
+   int size;
+   int error;
+   int *mark;           // Closure computation
+   int stamp;
+   int *stack;
+};
+
+static inline int set_has(const uint64_t *set, int c)
+{
+   return (set[c / 64] >> (c % 64)) & 1;
+}
+
+static inline void set_add(uint64_t *set, int c)
+{
+   set[c / 64] |= UINT64_C(1) << (c % 64);
+}
+
+static int new_node(struct re_parser *ps, int type, int l, int r)
+{
+   struct re_node *node;
+
+   if (ps->error) {
+      return -1;
+   }
+   if (ps->n_nodes == ps->size) {
+      int size = ps->size ? 2 * ps->size : 64;
+      node = (struct re_node *) realloc(ps->nodes, size * sizeof(struct re_node));
+      if (node == NULL) {
+         ps->error = 1;
+         return -1;
+      }
+      ps->nodes = node;
+      ps->size = size;
+   }
+   node = &ps->nodes[ps->n_nodes];
+   memset(node, 0, sizeof(*node));
+   node->type = type;
+   node->l = l;
+   node->r = r;
+   return ps->n_nodes++;
+}
+
+// Add bytes of character class [:name:] in C locale
+static int add_class(uint64_t *set, const char *name, size_t len)
+{
+   static const char *names[] = { "alpha", "digit", "alnum", "upper", "lower", "space",
+                                  "blank", "punct", "print", "graph", "cntrl", "xdigit" };
+   int i, c;
+
+   for (i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++) {
+      if (strlen(names[i]) == len && strncmp(names[i], name, len) == 0) {
+         break;
+      }
+   }
+   for (c = 1; c < 128; c++) {
+      int upper = c >= 'A' && c <= 'Z';
+      int lower = c >= 'a' && c <= 'z';
+      int digit = c >= '0' && c <= '9';
+      int graph = c > ' ' && c < 127;
+      int in;
+
+      switch (i) {
+      case 0: in = upper || lower; break;
+      case 1: in = digit; break;
+      case 2: in = upper || lower || digit; break;
+      case 3: in = upper; break;
+      case 4: in = lower; break;
+      case 5: in = c == ' ' || (c >= '\t' && c <= '\r'); break;
+      case 6: in = c == ' ' || c == '\t'; break;
+      case 7: in = graph && !upper && !lower && !digit; break;
+      case 8: in = graph || c == ' '; break;
+      case 9: in = graph; break;
+      case 10: in = c < ' ' || c == 127; break;
+      case 11: in = digit || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); break;
+      default: return 1;
+      }
+      if (in) {
+         set_add(set, c);
+      }
+   }
+   return 0;
+}
+
+// Parse bracket expression after [
+static int parse_bracket(struct re_parser *ps)
+{
+   uint64_t set[4] = { 0, 0, 0, 0 };
+   int negate = 0, first = 1;
+   int node, i;
+
+   if (*ps->p == '^') {
+      negate = 1;
+      ps->p++;
+   }
+   for (;;) {
+      unsigned char lo = *ps->p, hi;
+
+      if (lo == '\0') {
+         ps->error = 1;
+         return -1;
+      } else if (lo == ']' && !first) {
+         ps->p++;
+         break;
+      } else if (lo == '[' && ps->p[1] == ':') {
+         const char *end = strstr(ps->p + 2, ":]");
+         if (end == NULL || add_class(set, ps->p + 2, end - ps->p - 2) != 0) {
+            ps->error = 1;
+            return -1;
+         }
+         ps->p = end + 2;
+      } else if (lo == '[' && (ps->p[1] == '=' || ps->p[1] == '.')) {
+         // Equivalence classes and collating symbols
+         ps->error = 1;
+         return -1;
+      } else if (ps->p[1] == '-' && ps->p[2] != ']' && ps->p[2] != '\0') {
+         hi = ps->p[2];
+         if (hi == '[' || hi < lo) {
+            ps->error = 1;
+            return -1;
+         }
+         for (i = lo; i <= hi; i++) {
+            set_add(set, i);
+         }
+         ps->p += 3;
+      } else {
+         set_add(set, lo);
+         ps->p++;
+      }
+      first = 0;
+   }
+   if ((node = new_node(ps, RE_SET, -1, -1)) < 0) {
+      return -1;
+   }
+   for (i = 0; i < 4; i++) {
+      ps->nodes[node].set[i] = negate ? ~set[i] : set[i];
+   }
+   // Strings end by NUL
+   ps->nodes[node].set[0] &= ~UINT64_C(1);
+   return node;
+}
+
+static int parse_alt(struct re_parser *ps);
+
+static int parse_atom(struct re_parser *ps)
+{
+   unsigned char c = *ps->p;
+   int escaped = 0;
+   int node;
+
+   switch (c) {
+   case '(':
+      ps->p++;
+      ps->depth++;
+      node = parse_alt(ps);
+      if (*ps->p != ')') {
+         ps->error = 1;
+         return -1;
+      }
+      ps->p++;
+      ps->depth--;
+      return node;
+   case '[':
+      ps->p++;
+      return parse_bracket(ps);
+   case '^':
+      // Anchors are supported only at ends of top level alternatives,
+      // regexec() of glibc lets $ elsewhere match also before newline
+      if (ps->depth > 0 || (ps->p != ps->pattern && ps->p[-1] != '|')) {
+         ps->error = 1;
+         return -1;
+      }
+      ps->p++;
+      return new_node(ps, RE_BOL, -1, -1);
+   case '$':
+      if (ps->depth > 0 || (ps->p[1] != '\0' && ps->p[1] != '|')) {
+         ps->error = 1;
+         return -1;
+      }
+      ps->p++;
+      return new_node(ps, RE_EOL, -1, -1);
+   case '*':
+   case '+':
+   case '?':
+   case '{':
+      ps->error = 1;
+      return -1;
+   case '\\':
+      c = *++ps->p;
+      // Back references and GNU extensions like \w
+      if (c == '\0' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+         ps->error = 1;
+         return -1;
+      }
+      escaped = 1;
+      break;
+   default:
+      break;
+   }
+   ps->p++;
+   if ((node = new_node(ps, RE_SET, -1, -1)) < 0) {
+      return -1;
+   }
+   if (c == '.' && !escaped) {
+      memset(ps->nodes[node].set, 0xff, sizeof(ps->nodes[node].set));
+      ps->nodes[node].set[0] &= ~UINT64_C(1);
+   } else {
+      set_add(ps->nodes[node].set, c);
+   }
+   return node;
+}
+
+// Parse number of bound of {m,n}
+static int parse_bound(struct re_parser *ps)
+{
+   int n = 0;
+
+   if (*ps->p < '0' || *ps->p > '9') {
+      ps->error = 1;
+      return -1;
+   }
+   while (*ps->p >= '0' && *ps->p <= '9') {
+      n = 10 * n + (*ps->p++ - '0');
+      if (n > RE_MAX_REPEAT) {
+         ps->error = 1;
+         return -1;
+      }
+   }
+   return n;
+}
+
+static int parse_repeat(struct re_parser *ps)
+{
+   int atom = parse_atom(ps);
+   int node, min, max;
+
+   if (ps->error) {
+      return -1;
+   }
+   switch (*ps->p) {
+   case '*':
+      node = new_node(ps, RE_STAR, atom, -1);
+      break;
+   case '+':
+      node = new_node(ps, RE_PLUS, atom, -1);
+      break;
+   case '?':
+      node = new_node(ps, RE_QUEST, atom, -1);
+      break;
+   case '{':
+      ps->p++;
+      min = max = parse_bound(ps);
+      if (*ps->p == ',') {
+         ps->p++;
+         max = *ps->p == '}' ? -1 : parse_bound(ps);
+      }
+      if (ps->error || *ps->p != '}' || (max >= 0 && max < min)) {
+         ps->error = 1;
+         return -1;
+      }
+      node = new_node(ps, RE_REPEAT, atom, -1);
+      if (node >= 0) {
+         ps->nodes[node].min = min;
+         ps->nodes[node].max = max;
+      }
+      break;
+   default:
+      return atom;
+   }
+   ps->p++;
+   // Repeated anchors and repeated repetitions are left to regexec()
+   if (ps->nodes[atom].type == RE_BOL || ps->nodes[atom].type == RE_EOL
+       || (*ps->p != '\0' && strchr("*+?{", *ps->p) != NULL)) {
+      ps->error = 1;
+      return -1;
+   }
+   return node;
+}
+
+static int parse_concat(struct re_parser *ps)
+{
+   int node = -1;
+
+   while (!ps->error && *ps->p != '\0' && *ps->p != '|' && *ps->p != ')') {
+      int next = parse_repeat(ps);
+      node = node < 0 ? next : new_node(ps, RE_CAT, node, next);
+   }
+   if (node < 0) {
+      // Empty alternative or group
+      ps->error = 1;
+   }
+   return node;
+}
+
+static int parse_alt(struct re_parser *ps)
+{
+   int node = parse_concat(ps);
+
+   while (!ps->error && *ps->p == '|') {
+      ps->p++;
+      node = new_node(ps, RE_ALT, node, parse_concat(ps));
+   }
+   return node;
+}
+
+// Parse expression, return its root or -1 when it is not supported
+static int parse(struct re_parser *ps, const char *pattern)
+{
+   int root;
+
+   ps->pattern = pattern;
+   ps->p = pattern;
+   ps->depth = 0;
+   root = parse_alt(ps);
+   if (ps->error || *ps->p != '\0') {
+      return -1;
+   }
+   return root;
+}
+
+/**
+ * \brief Check whether regular expression can be matched by automaton.
+ * \param[in] pattern Extended regular expression.
+ * \return 1 when it is supported, 0 when it has to be matched by regexec().
+ */
+int isAutomatonRegex(const char *pattern)
+{
+   struct re_parser ps;
+   int ret;
+
+   memset(&ps, 0, sizeof(ps));
+   ret = pattern[0] == '\0' || parse(&ps, pattern) >= 0;
+   free(ps.nodes);
+   return ret;
+}
+
+static int new_state(struct builder *b, int type, int out, int out1)
+{
+   struct nfa_state *state;
+
+   if (b->error) {
+      return 0;
+   }
+   if (b->n_states == b->size) {
+      int size = b->size ? 2 * b->size : 256;
+      if (size > RE_MAX_STATES || (state = (struct nfa_state *) realloc(b->states, size * sizeof(struct nfa_state))) == NULL) {
+         b->error = 1;
+         return 0;
+      }
+      b->states = state;
+      b->size = size;
+   }
+   state = &b->states[b->n_states];
+   memset(state, 0, sizeof(*state));
+   state->type = type;
+   state->out = out;
+   state->out1 = out1;
+   return b->n_states++;
+}
+
+// Build states of subtree continuing to state next, return its first state
+static int build(struct builder *b, int node, int next)
+{
+   const struct re_node *n = &b->nodes[node];
+   int s, i;
+
+   if (b->error) {
+      return 0;
+   }
+   switch (n->type) {
+   case RE_SET:
+      s = new_state(b, NFA_SET, next, -1);
+      if (!b->error) {
+         memcpy(b->states[s].set, n->set, sizeof(n->set));
+      }
+      return s;
+   case RE_CAT:
+      return build(b, n->l, build(b, n->r, next));
+   case RE_ALT:
+      return new_state(b, NFA_SPLIT, build(b, n->l, next), build(b, n->r, next));
+   case RE_QUEST:
+      return new_state(b, NFA_SPLIT, build(b, n->l, next), next);
+   case RE_STAR:
+      s = new_state(b, NFA_SPLIT, -1, next);
+      i = build(b, n->l, s);
+      if (!b->error) {
+         b->states[s].out = i;
+      }
+      return s;
+   case RE_PLUS:
+      s = new_state(b, NFA_SPLIT, -1, next);
+      i = build(b, n->l, s);
+      if (!b->error) {
+         b->states[s].out = i;
+      }
+      return i;
+   case RE_REPEAT:
+      // x{2,4} is xx(x(x)?)?, x{2,} is xxx*
+      s = next;
+      if (n->max < 0) {
+         s = new_state(b, NFA_SPLIT, -1, next);
+         i = build(b, n->l, s);
+         if (!b->error) {
+            b->states[s].out = i;
+         }
+      } else {
+         for (i = n->min; i < n->max; i++) {
+            s = new_state(b, NFA_SPLIT, build(b, n->l, s), next);
+         }
+      }
+      for (i = 0; i < n->min; i++) {
+         s = build(b, n->l, s);
+      }
+      return s;
+   case RE_BOL:
+      return new_state(b, NFA_BOL, next, -1);
+   case RE_EOL:
+      return new_state(b, NFA_EOL, next, -1);
+   }
+   b->error = 1;
+   return 0;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+   return *(const int *) a - *(const int *) b;
+}
+
+/*
+ * Follow empty transitions from n seeds, ^ only at the start of string and $
+ * only at its end. Sorted states which consume bytes, match or wait for the
+ * end of string are written to out, return their count.
+ */
+static int closure(struct builder *b, const int *seeds, int n, int at_start, int at_end, int *out)
+{
+   int n_stack = 0, n_out = 0;
+   int i;
+
+   b->stamp++;
+   for (i = 0; i < n; i++) {
+      b->stack[n_stack++] = seeds[i];
+   }
+   while (n_stack > 0) {
+      int s = b->stack[--n_stack];
+      const struct nfa_state *state = &b->states[s];
+
+      if (b->mark[s] == b->stamp) {
+         continue;
+      }
+      b->mark[s] = b->stamp;
+      switch (state->type) {
+      case NFA_SPLIT:
+         b->stack[n_stack++] = state->out;
+         b->stack[n_stack++] = state->out1;
+         break;
+      case NFA_BOL:
+         if (at_start) {
+            b->stack[n_stack++] = state->out;
+         }
+         break;
+      case NFA_EOL:
+         if (at_end) {
+            b->stack[n_stack++] = state->out;
+         }
+         out[n_out++] = s;
+         break;
+      default:
+         out[n_out++] = s;
+         break;
+      }
+   }
+   qsort(out, n_out, sizeof(int), compare_ints);
+   return n_out;
+}
+
+// Sets of states of deterministic automaton
+struct dfa_sets {
+   int *pool;           // States of i-th set are pool[start[i]] .. pool[start[i + 1] - 1]
+   int pool_len;
+   int pool_size;
+   int *start;
+   int *table;          // Hash table of sets, -1 for empty slot
+   int table_mask;
+};
+
+static uint32_t hash_set(const int *states, int n)
+{
+   uint32_t h = 2166136261u;
+   int i;
+
+   for (i = 0; i < n; i++) {
+      h = (h ^ (uint32_t) states[i]) * 16777619u;
+   }
+   return h;
+}
+
+// Find set of states, add it as n-th set when it is not present and add is set
+static int find_set(struct dfa_sets *d, int n, const int *states, int len, int add)
+{
+   uint32_t h;
+   int i;
+
+   for (h = hash_set(states, len) & d->table_mask; d->table[h] >= 0; h = (h + 1) & d->table_mask) {
+      i = d->table[h];
+      if (d->start[i + 1] - d->start[i] == len && memcmp(d->pool + d->start[i], states, len * sizeof(int)) == 0) {
+         return i;
+      }
+   }
+   if (!add) {
+      return -1;
+   }
+   if (d->pool_len + len > d->pool_size) {
+      int size = 2 * (d->pool_len + len);
+      int *pool = (int *) realloc(d->pool, size * sizeof(int));
+      if (pool == NULL) {
+         return -2;
+      }
+      d->pool = pool;
+      d->pool_size = size;
+   }
+   memcpy(d->pool + d->pool_len, states, len * sizeof(int));
+   d->pool_len += len;
+   d->start[n + 1] = d->pool_len;
+   if (n > 0) {
+      // The initial state is not shared, ^ holds only in it
+      d->table[h] = n;
+   }
+   return n;
+}
+
+// Compute classes of bytes which lead to the same states from every state
+static void byte_classes(struct builder *b, struct re_automaton *a, int *reps)
+{
+   int map[256][2];
+   int c, i, n;
+
+   memset(a->classes, 0, sizeof(a->classes));
+   a->n_classes = 1;
+   for (i = 0; i < b->n_states; i++) {
+      if (b->states[i].type != NFA_SET) {
+         continue;
+      }
+      memset(map, -1, a->n_classes * sizeof(map[0]));
+      n = 0;
+      for (c = 0; c < 256; c++) {
+         int *cls = &map[a->classes[c]][set_has(b->states[i].set, c)];
+         if (*cls < 0) {
+            *cls = n++;
+         }
+         a->classes[c] = *cls;
+      }
+      a->n_classes = n;
+   }
+   for (c = 255; c >= 0; c--) {
+      reps[a->classes[c]] = c;
+   }
+}
+
+/**
+ * \brief Compile regular expressions of one string field into automaton.
+ * \param[in] patterns Expressions supported by isAutomatonRegex().
+ * \param[in] preds Index of comparison of each expression in filter set.
+ * \param[in] n Number of expressions.
+ * \param[in] offset Offset of offset and length of the field in record.
+ * \param[in] static_size Size of static part of record.
+ * \return Automaton or NULL when it would have more than AUTOMATON_MAX_STATES
+ *         states or memory allocation fails.
+ */
+struct re_automaton *compileAutomaton(const char *const *patterns, const int *preds, int n, uint16_t offset, uint16_t static_size)
+{
+   struct re_automaton *a = (struct re_automaton *) calloc(1, sizeof(struct re_automaton));
+   struct re_parser ps;
+   struct builder b;
+   struct dfa_sets d;
+   int *starts = (int *) malloc((n + 1) * sizeof(int));
+   int *targets = NULL, *set = NULL;
+   int reps[256];
+   int i, j, k, s, len, n_accept = 0, n_end = 0, end_size = 0;
+   int ok = 0;
+
+   memset(&ps, 0, sizeof(ps));
+   memset(&b, 0, sizeof(b));
+   memset(&d, 0, sizeof(d));
+   if (a == NULL || starts == NULL) {
+      goto out;
+   }
+   a->scan = scanAutomaton;
+   a->offset = offset;
+   a->static_size = static_size;
+
+   // Nondeterministic automaton of all expressions
+   for (i = 0; i < n; i++) {
+      int match = new_state(&b, NFA_MATCH, -1, -1);
+      int root = patterns[i][0] == '\0' ? -1 : parse(&ps, patterns[i]);
+
+      if (b.error || (root < 0 && patterns[i][0] != '\0')) {
+         goto out;
+      }
+      b.states[match].pred = preds[i];
+      b.nodes = ps.nodes;
+      starts[i] = root < 0 ? match : build(&b, root, match);
+   }
+   if (b.error) {
+      goto out;
+   }
+   b.mark = (int *) calloc(b.n_states, sizeof(int));
+   b.stack = (int *) malloc((3 * b.n_states + n) * sizeof(int));
+   targets = (int *) malloc((b.n_states + n) * sizeof(int));
+   set = (int *) malloc(b.n_states * sizeof(int));
+   a->preds = (int *) malloc(n * sizeof(int));
+   d.start = (int *) malloc((AUTOMATON_MAX_STATES + 1) * sizeof(int));
+   d.table = (int *) malloc(2 * AUTOMATON_MAX_STATES * sizeof(int));
+   if (b.mark == NULL || b.stack == NULL || targets == NULL || set == NULL || a->preds == NULL
+       || d.start == NULL || d.table == NULL) {
+      goto out;
+   }
+   memcpy(a->preds, preds, n * sizeof(int));
+   a->n_preds = n;
+   byte_classes(&b, a, reps);
+   d.table_mask = 2 * AUTOMATON_MAX_STATES - 1;
+   memset(d.table, -1, 2 * AUTOMATON_MAX_STATES * sizeof(int));
+   d.start[0] = 0;
+   a->next = (uint16_t *) malloc(AUTOMATON_MAX_STATES * a->n_classes * sizeof(uint16_t));
+   if (a->next == NULL) {
+      goto out;
+   }
+
+   // Subset construction, expressions are searched from every position of string
+   len = closure(&b, starts, n, 1, 0, set);
+   find_set(&d, 0, set, len, 1);
+   a->n_states = 1;
+   for (s = 0; s < a->n_states; s++) {
+      for (k = 0; k < a->n_classes; k++) {
+         int n_targets = 0;
+
+         for (i = d.start[s]; i < d.start[s + 1]; i++) {
+            const struct nfa_state *state = &b.states[d.pool[i]];
+            if (state->type == NFA_SET && set_has(state->set, reps[k])) {
+               targets[n_targets++] = state->out;
+            }
+         }
+         memcpy(targets + n_targets, starts, n * sizeof(int));
+         len = closure(&b, targets, n_targets + n, 0, 0, set);
+         j = find_set(&d, a->n_states, set, len, a->n_states < AUTOMATON_MAX_STATES);
+         if (j < 0) {
+            goto out;
+         } else if (j == a->n_states) {
+            a->n_states++;
+         }
+         a->next[s * a->n_classes + k] = j;
+      }
+   }
+
+   // Expressions matched in states and at the end of string
+   a->accept_start = (int *) malloc((a->n_states + 1) * sizeof(int));
+   a->end_start = (int *) malloc((a->n_states + 1) * sizeof(int));
+   a->accept = (int *) malloc(d.pool_len * sizeof(int) + sizeof(int));
+   a->stuck = (uint8_t *) malloc(a->n_states);
+   if (a->accept_start == NULL || a->end_start == NULL || a->accept == NULL || a->stuck == NULL) {
+      goto out;
+   }
+   for (s = 0; s < a->n_states; s++) {
+      a->accept_start[s] = n_accept;
+      for (i = d.start[s]; i < d.start[s + 1]; i++) {
+         if (b.states[d.pool[i]].type == NFA_MATCH) {
+            a->accept[n_accept++] = b.states[d.pool[i]].pred;
+         }
+      }
+      a->end_start[s] = n_end;
+      len = closure(&b, d.pool + d.start[s], d.start[s + 1] - d.start[s], s == 0, 1, set);
+      for (i = 0; i < len; i++) {
+         if (b.states[set[i]].type == NFA_MATCH) {
+            if (n_end == end_size) {
+               int *end = (int *) realloc(a->end, (end_size = 2 * end_size + 16) * sizeof(int));
+               if (end == NULL) {
+                  goto out;
+               }
+               a->end = end;
+            }
+            a->end[n_end++] = b.states[set[i]].pred;
+         }
+      }
+      a->stuck[s] = 1;
+      for (k = 0; k < a->n_classes; k++) {
+         if (a->next[s * a->n_classes + k] != s) {
+            a->stuck[s] = 0;
+         }
+      }
+   }
+   a->accept_start[a->n_states] = n_accept;
+   a->end_start[a->n_states] = n_end;
+   ok = 1;
+
+out:
+   free(ps.nodes);
+   free(b.states);
+   free(b.mark);
+   free(b.stack);
+   free(starts);
+   free(targets);
+   free(set);
+   free(d.pool);
+   free(d.start);
+   free(d.table);
+   if (!ok) {
+      freeAutomaton(a);
+      return NULL;
+   }
+   return a;
+}
+
+/**
+ * \brief Search string field of record for expressions of automaton.
+ * String ends at its first NUL byte, as for regexec().
+ * \param[in] a Automaton.
+ * \param[in] rec Record.
+ * \param[out] memo Results of comparisons of filter set, 2 is written for
+ *             each expression which matches, 1 for the others.
+ */
+void scanAutomaton(const struct re_automaton *a, const char *rec, uint8_t *memo)
+{
+   uint16_t len = *(const uint16_t *) (rec + a->offset + 2);
+   const uint8_t *data = (const uint8_t *) rec + a->static_size + *(const uint16_t *) (rec + a->offset);
+   int s = 0;
+   int i, k;
+
+   for (i = 0; i < a->n_preds; i++) {
+      memo[a->preds[i]] = 1;
+   }
+   for (i = 0; ; i++) {
+      for (k = a->accept_start[s]; k < a->accept_start[s + 1]; k++) {
+         memo[a->accept[k]] = 2;
+      }
+      if (i == len || data[i] == '\0' || a->stuck[s]) {
+         break;
+      }
+      s = a->next[s * a->n_classes + a->classes[data[i]]];
+   }
+   for (k = a->end_start[s]; k < a->end_start[s + 1]; k++) {
+      memo[a->end[k]] = 2;
+   }
+}
+
+void freeAutomaton(struct re_automaton *a)
+{
+   if (a == NULL) {
+      return;
+   }
+   free(a->next);
+   free(a->accept_start);
+   free(a->accept);
+   free(a->end_start);
+   free(a->end);
+   free(a->stuck);
+   free(a->preds);
+   free(a);
+}
@@ -0,0 +1,79 @@
+/**
+ * \file multimatch.h
+ * \brief Matching of string field against many regular expressions in one pass.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifndef MULTIMATCH_H
+#define MULTIMATCH_H
+
+#include <stdint.h>
+
+#define AUTOMATON_MAX_STATES 4096 // Larger automata are split, see compileFilterSet()
+
+/*
+ * Deterministic automaton searching a string field for several extended
+ * regular expressions at once (for literals it is Aho-Corasick automaton).
+ * Bytes are mapped to classes of bytes no expression distinguishes, state 0
+ * is the initial one. Expressions matched in state s are
+ * accept[accept_start[s]] .. accept[accept_start[s + 1] - 1], expressions
+ * matched when string ends in state s are in end and end_start in the same way.
+ */
+struct re_automaton {
+   void (*scan)(const struct re_automaton *a, const char *rec, uint8_t *memo); // First member, called by native code
+   uint16_t offset;        // Offset of offset and length of field in record
+   uint16_t static_size;
+   uint8_t classes[256];
+   int n_classes;
+   uint16_t *next;         // Next state for each state and class of byte
+   int n_states;
+   int *accept_start;
+   int *accept;
+   int *end_start;
+   int *end;
+   uint8_t *stuck;         // States which are never left and match nothing more until end
+   int *preds;             // Index of comparison in filter set of each expression
+   int n_preds;
+};
+
+int isAutomatonRegex(const char *pattern);
+struct re_automaton *compileAutomaton(const char *const *patterns, const int *preds, int n, uint16_t offset, uint16_t static_size);
+void scanAutomaton(const struct re_automaton *a, const char *rec, uint8_t *memo);
+void freeAutomaton(struct re_automaton *a);
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * \file multimatch_test.c
+ * \brief Automata matching many regular expressions at once must give the same results as regexec().
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <regex.h>
+
+#include "multimatch.h"
+
+#define TEST_ROUNDS 3000     // Sets of expressions compiled to one automaton
+#define TEST_PATTERNS 8      // Maximal number of expressions in set
+#define TEST_STRINGS 200     // Strings matched by each automaton
+#define TEST_MAX_LEN 12      // Maximal length of string
+
+#define COUNT(array) ((int) (sizeof(array) / sizeof(array[0])))
+
+static const char *atoms[] = { "a", "b", "c", ".", "[ab]", "[^a]", "[[:alpha:]]", "\\.", "\xe9", "[\x80-\xff]",
+                               "^", "$", "x", "[a-c]", "\\*", "[]a]", "]", "}", "[^\xe9]" };
+static const char *repeats[] = { "*", "+", "?", "{2}", "{1,3}", "{0,}", "{2,}", "{0,1}" };
+// Bytes of strings, with high bytes and NUL
+static const char alphabet[] = "abcx.\n*]}\xe9\xff\x80";
+
+// Append random regular expression to pattern
+static void random_pattern(char *pattern, int depth)
+{
+   switch (rand() % (depth > 0 ? 10 : 6)) {
+   case 0:
+   case 1:
+   case 2:
+   case 3:
+   case 4:
+      strcat(pattern, atoms[rand() % COUNT(atoms)]);
+      break;
+   case 5:
+      // Quantified atoms are not anchors
+      strcat(pattern, atoms[rand() % 10]);
+      strcat(pattern, repeats[rand() % COUNT(repeats)]);
+      break;
+   case 6:
+   case 7:
+      random_pattern(pattern, depth - 1);
+      random_pattern(pattern, depth - 1);
+      break;
+   case 8:
+      strcat(pattern, "(");
+      random_pattern(pattern, depth - 1);
+      strcat(pattern, "|");
+      random_pattern(pattern, depth - 1);
+      strcat(pattern, ")");
+      if (rand() % 2) {
+         strcat(pattern, repeats[rand() % COUNT(repeats)]);
+      }
+      break;
+   default:
+      strcat(pattern, "(");
+      random_pattern(pattern, depth - 1);
+      strcat(pattern, ")");
+      break;
+   }
+}
+
+int main(int argc, char **argv)
+{
+   static char rec[4 + TEST_MAX_LEN];
+   unsigned long checks = 0, supported = 0, total = 0;
+   int round, q, i;
+
+   srand(argc > 1 ? atoi(argv[1]) : 1);
+   for (round = 0; round < TEST_ROUNDS; round++) {
+      char patterns[TEST_PATTERNS][256];
+      const char *ptrs[TEST_PATTERNS];
+      int preds[TEST_PATTERNS];
+      regex_t re[TEST_PATTERNS];
+      struct re_automaton *a;
+      int n = 1 + rand() % TEST_PATTERNS, m = 0;
+
+      // Keep expressions supported by automata, the other are matched by regexec() in filters
+      for (i = 0; i < n; i++) {
+         patterns[m][0] = '\0';
+         random_pattern(patterns[m], 3);
+         total++;
+         if (!isAutomatonRegex(patterns[m])) {
+            continue;
+         }
+         if (regcomp(&re[m], patterns[m], REG_EXTENDED) != 0) {
+            fprintf(stderr, "Error: Expression '%s' is supported by automaton, but not by regcomp().\n", patterns[m]);
+            return 1;
+         }
+         ptrs[m] = patterns[m];
+         preds[m] = m * 2 + 1;
+         m++;
+      }
+      if (m == 0) {
+         continue;
+      }
+      supported += m;
+      // Field is the only dynamic one of record without static fields
+      if ((a = compileAutomaton(ptrs, preds, m, 0, 4)) == NULL) {
+         fprintf(stderr, "Error: Automaton could not be compiled.\n");
+         return 1;
+      }
+      for (q = 0; q < TEST_STRINGS; q++) {
+         uint8_t memo[2 * TEST_PATTERNS];
+         char str[TEST_MAX_LEN + 1];
+         uint16_t len = rand() % (TEST_MAX_LEN + 1);
+
+         for (i = 0; i < len; i++) {
+            str[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+         }
+         if (len > 0 && rand() % 20 == 0) {
+            str[rand() % len] = '\0';
+         }
+         str[len] = '\0';
+         *(uint16_t *) rec = 0;
+         *(uint16_t *) (rec + 2) = len;
+         memcpy(rec + 4, str, len);
+         memset(memo, 0, sizeof(memo));
+         scanAutomaton(a, rec, memo);
+
+         // Filters pass field to regexec() as C string, so it ends at first NUL
+         for (i = 0; i < m; i++) {
+            int expected = regexec(&re[i], str, 0, NULL, 0) == 0;
+
+            if (memo[preds[i]] != expected + 1) {
+               fprintf(stderr, "Error: Expression '%s' on string '%.*s' (length %u): %d, expected %d\n",
+                       ptrs[i], len, str, len, memo[preds[i]] - 1, expected);
+               return 1;
+            }
+            checks++;
+         }
+      }
+      freeAutomaton(a);
+      for (i = 0; i < m; i++) {
+         regfree(&re[i]);
+      }
+   }
+   printf("%lu strings checked, %lu of %lu expressions supported by automata\n", checks, supported, total);
+   return 0;
+}
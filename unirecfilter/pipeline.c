@@ -0,0 +1,197 @@
+/**
+ * \file pipeline.c
+ * \brief Lock-free queues and batches of records passed between threads.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include "pipeline.h"
+
+/**
+ * \brief Create empty queue.
+ * \param[in] size Minimal number of items, rounded up to power of 2.
+ * \return Queue or NULL when memory allocation fails.
+ */
+struct ring *createRing(uint32_t size)
+{
+   struct ring *r;
+   uint32_t n = 1;
+
+   while (n < size) {
+      n <<= 1;
+   }
+   if (posix_memalign((void **) &r, 64, sizeof(struct ring)) != 0) {
+      return NULL;
+   }
+   memset(r, 0, sizeof(struct ring));
+   r->items = (void **) calloc(n, sizeof(void *));
+   if (r->items == NULL) {
+      free(r);
+      return NULL;
+   }
+   r->mask = n - 1;
+   return r;
+}
+
+/**
+ * \brief Append item to queue, called only by producer thread.
+ * \param[in] r Queue.
+ * \param[in] item Item.
+ * \return 0 on success, 1 when queue is full.
+ */
+int pushRing(struct ring *r, void *item)
+{
+   uint32_t tail = r->tail;
+
+   if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) > r->mask) {
+      return 1;
+   }
+   r->items[tail & r->mask] = item;
+   // Item is written before consumer sees new tail
+   __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+   return 0;
+}
+
+/**
+ * \brief Remove the oldest item from queue, called only by consumer thread.
+ * \param[in] r Queue.
+ * \return Item or NULL when queue is empty.
+ */
+void *popRing(struct ring *r)
+{
+   uint32_t head = r->head;
+   void *item;
+
+   if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) {
+      return NULL;
+   }
+   item = r->items[head & r->mask];
+   __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+   return item;
+}
+
+/**
+ * \brief Wait before next attempt to access queue.
+ * Thread yields for the first RING_SPINS attempts and then sleeps, so idle
+ * threads do not occupy processors.
+ * \param[in,out] spins Number of unsuccessful attempts, reset it to 0 after success.
+ */
+void waitRing(int *spins)
+{
+   struct timespec ts = { 0, RING_SLEEP_NS };
+
+   if (++*spins < RING_SPINS) {
+      sched_yield();
+   } else {
+      nanosleep(&ts, NULL);
+   }
+}
+
+void freeRing(struct ring *r)
+{
+   if (r == NULL) {
+      return;
+   }
+   free(r->items);
+   free(r);
+}
+
+/**
+ * \brief Create empty batch.
+ * \return Batch or NULL when memory allocation fails.
+ */
+struct batch *createBatch(void)
+{
+   struct batch *b = (struct batch *) calloc(1, sizeof(struct batch));
+
+   if (b == NULL) {
+      return NULL;
+   }
+   b->capacity = BATCH_RECORDS * 128;
+   b->data = (char *) malloc(b->capacity);
+   if (b->data == NULL) {
+      free(b);
+      return NULL;
+   }
+   return b;
+}
+
+/**
+ * \brief Copy record to batch.
+ * \param[in,out] b Batch with less than BATCH_RECORDS records.
+ * \param[in] rec Record.
+ * \param[in] size Size of record.
+ * \return 0 on success, 1 when memory allocation fails.
+ */
+int addToBatch(struct batch *b, const void *rec, uint16_t size)
+{
+   // Records start at multiples of 8 bytes, so their fields are aligned as in record created by UniRec
+   uint32_t offset = (b->size + 7) & ~(uint32_t) 7;
+
+   if (offset + size > b->capacity) {
+      uint32_t capacity = b->capacity * 2;
+      char *data;
+
+      while (offset + size > capacity) {
+         capacity *= 2;
+      }
+      if ((data = (char *) realloc(b->data, capacity)) == NULL) {
+         return 1;
+      }
+      b->data = data;
+      b->capacity = capacity;
+   }
+   memcpy(b->data + offset, rec, size);
+   b->offsets[b->count] = offset;
+   b->size = offset + size;
+   b->offsets[++b->count] = b->size;
+   return 0;
+}
+
+void freeBatch(struct batch *b)
+{
+   if (b == NULL) {
+      return;
+   }
+   free(b->data);
+   free(b);
+}
@@ -0,0 +1,87 @@
+/**
+ * \file pipeline.h
+ * \brief Lock-free queues and batches of records passed between threads.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+
+#define BATCH_RECORDS 256    // Maximal number of records in batch
+#define RING_SPINS 64        // Attempts to access queue before waiting thread sleeps
+#define RING_SLEEP_NS 50000  // Sleep of waiting thread
+#define BATCH_TIMEOUT 10000  // Microseconds without record after which incomplete batch is dispatched
+
+/*
+ * Queue of pointers between one producer and one consumer thread. Producer
+ * writes only tail, consumer only head, so no locks are needed. Both are on
+ * their own cache line.
+ */
+struct ring {
+   void **items;
+   uint32_t mask;                                 // Size of queue (power of 2) - 1
+   uint32_t head __attribute__((aligned(64)));    // Next item to pop
+   uint32_t tail __attribute__((aligned(64)));    // Next free slot
+};
+
+/* Records received together, evaluated by one thread */
+struct batch {
+   uint64_t seq;           // Order of batch on input
+   unsigned int first;     // Number of the first record
+   int count;
+   uint32_t size;          // Bytes of records in data
+   uint32_t capacity;
+   char *data;
+   uint32_t offsets[BATCH_RECORDS + 1]; // Record i starts at data[offsets[i]]
+   uint32_t matches[BATCH_RECORDS];     // Outputs whose filter matches each record
+   const void *config;     // Filters the batch is evaluated with
+};
+
+struct ring *createRing(uint32_t size);
+int pushRing(struct ring *r, void *item);
+void *popRing(struct ring *r);
+void waitRing(int *spins);
+void freeRing(struct ring *r);
+
+struct batch *createBatch(void);
+int addToBatch(struct batch *b, const void *rec, uint16_t size);
+void freeBatch(struct batch *b);
+
+#endif
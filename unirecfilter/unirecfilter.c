@@ -55,12 +55,17 @@
 #include <getopt.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include <libtrap/trap.h>
 #include <unirec/unirec.h>
 
 #include "parser.tab.h"
 #include "unirecfilter.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "copyplan.h"
+#include "pipeline.h"
 #include "fields.h"
 
 UR_FIELDS ()
@@ -82,9 +87,17 @@ trap_module_info_t *module_info = NULL;
   PARAM('n', "no_eof", "Don't send 'EOF message' at the end.", no_argument, "none") \
   PARAM('f', "file", "Read template and filter from file.", required_argument, "string") \
   PARAM('c', "cut", "Quit after N records are received.", required_argument, "int32") \
+  PARAM('t', "flush_timeout", "Send buffered records of outputs at least every N milliseconds, 0 sends every record immediately (DEFAULT: 500).", required_argument, "int32") \
+  PARAM('j', "jit", "Compile filters to native code by C compiler from CC environment variable (DEFAULT: cc).", no_argument, "none") \
+  PARAM('w', "workers", "Evaluate filters by N threads, records are sent by one more thread (DEFAULT: 0, all is done by one thread).", required_argument, "int32") \
+  PARAM('u', "unordered", "With -w, records may be sent in different order than they were received.", no_argument, "none") \
 
 static int stop = 0;               // Flag to interrupt process
 static int send_eof = 1;           // Flag to enable EOF
+static int use_jit = 0;            // Flag to compile filters to native code
+static int flush_timeout = DEFAULT_FLUSH_TIMEOUT; // Timeout of output buffers in milliseconds
+static int n_workers = 0;          // Number of threads evaluating filters
+static int ordered = 1;            // Flag to send records of all threads in the input order
 int reload_filter = 0;             // Flag to reload filter from file
 int verbose;                       // Verbosity level
 
@@ -92,10 +105,10 @@ unsigned int num_records = 0;      // Number of records received (total of all i
 unsigned int max_num_records = 0;  // Exit after this number of records is received
 unsigned int max_num_ifaces = 32;  // Maximum number of output interfaces
 
-char *str_buffer = NULL;           // Auxiliary buffer for evalAST()
+__thread char *str_buffer = NULL;  // Auxiliary buffer for evalAST() of each thread
 
 // Function to handle SIGTERM and SIGINT signals (used to stop the module)
-TRAP_DEFAULT_SIGNAL_HANDLER(stop = 1);
+TRAP_DEFAULT_SIGNAL_HANDLER(__atomic_store_n(&stop, 1, __ATOMIC_RELAXED));
 
 // Handler for SIGUSR1 to set flag for force filter reloading
 void reload_filter_signal_handler(int signum) {
@@ -107,11 +120,72 @@ struct unirec_output_t {
    char *output_specifier_str;
    char *unirec_output_specifier;
    char *filter;
-   struct ast *tree;
    ur_template_t *out_tmplt;
    void *out_rec;
+   struct copy_plan *copy_plan;
 };
 
+// Filters of all outputs, replaced as a whole when they are reloaded
+struct filter_config {
+   struct ast *trees[32];           // Syntax tree of each output, NULL for outputs without filter
+   int n_trees;
+   struct filter_set *filters;      // Filters compiled for input template, NULL when trees are evaluated
+   struct unirec_output_t **output_specifiers; // Output specifiers read by reload
+   int templates_changed;           // Output specifiers of reload differ from the ones in use
+   int in_flight;                   // Batches dispatched with it and not sent yet
+   struct filter_config *next;      // Next replaced configuration
+};
+
+struct filter_config *config = NULL; // Filters in use
+static struct filter_config *retired_configs = NULL; // Replaced filters which may still be used by workers
+
+// Reload of filters by background thread, SIGUSR1 only starts it
+struct reload {
+   pthread_t thread;
+   int running;                     // Thread was started and not joined yet
+   int done;                        // Set by thread when it finishes
+   struct filter_config *result;    // Reloaded filters, NULL when reload failed
+   char *filename;
+   int n_outputs;
+   char **port_numbers;
+   struct unirec_output_t **output_specifiers; // Output specifiers in use
+   const char *in_format;           // Default output template
+   ur_template_t **in_tmplt;
+};
+
+static struct reload reload;
+static pthread_mutex_t reload_mutex = PTHREAD_MUTEX_INITIALIZER; // Held while reloaded filters are compiled and while input template changes
+
+// Thread evaluating filters on batches of records
+struct worker {
+   pthread_t thread;
+   struct ring *in;     // Batches from main thread
+   struct ring *out;    // Evaluated batches for writer
+};
+
+// Pool of threads, main thread receives records into batches and hands them
+// to workers in turn, writer takes them from workers in the same turn and
+// sends records, so the order of records is kept
+struct pool {
+   struct worker *workers;
+   int n_workers;
+   int n_started;                   // Number of running workers
+   pthread_t writer;
+   int writer_started;
+   struct ring *free_batches;       // Batches sent by writer
+   struct batch **batches;          // All batches
+   int n_batches;
+   struct batch *batch;             // Batch being filled by main thread
+   uint64_t dispatched;             // Number of batches handed to workers
+   uint64_t written;                // Number of batches sent by writer
+   int done;                        // No more batches will be dispatched
+   int n_outputs;
+   struct unirec_output_t **output_specifiers;
+   const ur_template_t *in_tmplt;
+};
+
+static struct pool pool;
+
 // Search for delimiter (skip literals within string)
 char *skip_str_chr(char *ptr, char delim)
 {
@@ -175,6 +249,7 @@ int parse_output_specifier_from_str(struct unirec_output_t *output_specifier) {
    char *ptr1, *ptr2;
 
    // Output specifier string to be created
+   free(output_specifier->unirec_output_specifier);
    output_specifier->unirec_output_specifier = (char*) malloc(strlen(output_specifier->output_specifier_str)+1);
    out_spec_ptr = output_specifier->unirec_output_specifier;
    ptr1 = output_specifier->output_specifier_str;
@@ -325,7 +400,7 @@ int get_filter_from_file(char * filename, struct unirec_output_t **output_specif
 }
 
 // Create templates based on data from filter
-int create_templates(int n_outputs, char **port_numbers, struct unirec_output_t **output_specifiers) {
+int create_templates(int n_outputs, struct unirec_output_t **output_specifiers) {
    int i;
    int memory_needed = 0;
 
@@ -355,9 +430,6 @@ float, double, ipaddr, string, bytes\n");
          fprintf(stderr, "ERROR: output data format is not set.\n");
       }
 
-      // Get Abstract syntax tree from filter
-      output_specifiers[i]->tree = getTree(output_specifiers[i]->filter, port_numbers[i]);
-
       // Calculate maximum needed memory for dynamic fields
       ur_field_id_t field_id = UR_ITER_BEGIN;
       while ((field_id = ur_iter_fields(output_specifiers[i]->out_tmplt, field_id)) != UR_ITER_END) {
@@ -371,6 +443,587 @@ float, double, ipaddr, string, bytes\n");
    return 0;
 }
 
+// Free output specifier and its template and record
+void free_output(struct unirec_output_t *output_specifier)
+{
+   if (output_specifier == NULL) {
+      return;
+   }
+   freeCopyPlan(output_specifier->copy_plan);
+   free(output_specifier->output_specifier_str);
+   free(output_specifier->unirec_output_specifier);
+   free(output_specifier->filter);
+   if (output_specifier->out_rec != NULL) {
+      ur_free_record(output_specifier->out_rec);
+   }
+   if (output_specifier->out_tmplt != NULL) {
+      ur_free_template(output_specifier->out_tmplt);
+   }
+   free(output_specifier);
+}
+
+// Compile filters of configuration for input template
+void compile_config(struct filter_config *cfg, const ur_template_t *in_tmplt)
+{
+   int i;
+
+   freeFilterSet(cfg->filters);
+   cfg->filters = compileFilterSet(cfg->trees, cfg->n_trees, in_tmplt);
+   if (cfg->filters == NULL) {
+      fprintf(stderr, "Warning: Filters are evaluated from syntax trees.\n");
+      return;
+   }
+   if (use_jit && jitFilterSet(cfg->filters) != 0) {
+      fprintf(stderr, "Warning: Filters are interpreted.\n");
+   }
+   if (verbose >= 1) {
+      printf("ADVANCED VERBOSE: %d distinct comparisons in filters\n", cfg->filters->n_preds);
+      for (i = 0; i < cfg->n_trees; i++) {
+         if (cfg->filters->programs[i] != NULL) {
+            printf("ADVANCED VERBOSE: Program of filter for interface %d:\n", i);
+            printProgram(cfg->filters->programs[i]);
+         }
+      }
+   }
+}
+
+// Parse filters of all outputs and compile them, errors of parsing are counted in errors
+struct filter_config *create_config(int n_outputs, char **port_numbers, struct unirec_output_t **output_specifiers, const ur_template_t *in_tmplt, int *errors)
+{
+   struct filter_config *cfg = (struct filter_config *) calloc(1, sizeof(struct filter_config));
+   int i;
+
+   *errors = 0;
+   if (cfg == NULL) {
+      fprintf(stderr, "Memory allocation error\n");
+      return NULL;
+   }
+   cfg->n_trees = n_outputs;
+   for (i = 0; i < n_outputs; i++) {
+      // Get Abstract syntax tree from filter
+      cfg->trees[i] = getTree(output_specifiers[i]->filter, port_numbers[i]);
+      *errors += parse_errors;
+   }
+   compile_config(cfg, in_tmplt);
+   return cfg;
+}
+
+void free_config(struct filter_config *cfg)
+{
+   int i;
+
+   if (cfg == NULL) {
+      return;
+   }
+   for (i = 0; i < cfg->n_trees; i++) {
+      if (cfg->trees[i] != NULL) {
+         freeAST(cfg->trees[i]);
+      }
+      if (cfg->output_specifiers != NULL) {
+         free_output(cfg->output_specifiers[i]);
+      }
+   }
+   free(cfg->output_specifiers);
+   freeFilterSet(cfg->filters);
+   free(cfg);
+}
+
+// Create copy plans of all outputs for current input template
+void prepare_outputs(int n_outputs, struct unirec_output_t **output_specifiers, const ur_template_t *in_tmplt)
+{
+   int i;
+
+   for (i = 0; i < n_outputs; i++) {
+      freeCopyPlan(output_specifiers[i]->copy_plan);
+      output_specifiers[i]->copy_plan = createCopyPlan(in_tmplt, output_specifiers[i]->out_tmplt, output_specifiers[i]->out_rec);
+   }
+}
+
+// Copy fields of input record present in output template to output record, return its size
+uint16_t copy_record(const struct unirec_output_t *output_specifier, const ur_template_t *in_tmplt, const void *in_rec)
+{
+   void *ptr1 = NULL, *ptr2 = NULL;
+   ur_field_id_t id = 0;
+   int rec_ind = 0;
+
+   if (output_specifier->copy_plan) {
+      return applyCopyPlan(output_specifier->copy_plan, in_rec, output_specifier->out_rec);
+   }
+   // Plan could not be created, iterate over all output fields
+   while ((id = ur_iter_fields_record_order(output_specifier->out_tmplt, rec_ind++)) != UR_ITER_END) {
+      if (ur_is_present(in_tmplt, id)) {
+         if (!ur_is_dynamic(id)) { //static field
+            ptr1 = ur_get_ptr_by_id(in_tmplt, in_rec, id);
+            ptr2 = ur_get_ptr_by_id(output_specifier->out_tmplt, output_specifier->out_rec, id);
+            //copy the data
+            if ((ptr1 != NULL) && (ptr2 != NULL)) {
+               memcpy(ptr2, ptr1, ur_get_size(id));
+            }
+         } else { //dynamic field
+            char *in_ptr = ur_get_ptr_by_id(in_tmplt, in_rec, id);
+            int size = ur_get_var_len(in_tmplt, in_rec, id);
+            // Check size of dynamic field and if longer than maximum size then cut it
+            if (size > DYN_FIELD_MAX_SIZE)
+               size = DYN_FIELD_MAX_SIZE;
+            //copy the data
+            ur_set_var(output_specifier->out_tmplt, output_specifier->out_rec, id, in_ptr, size);
+         }
+      }
+   }
+   return ur_rec_size(output_specifier->out_tmplt, output_specifier->out_rec);
+}
+
+// Get bit mask of output interfaces whose filter matches record, memo is
+// buffer of the thread for results of comparisons, NULL for the one of filter set
+static inline uint32_t match_filters(const struct filter_config *cfg, const ur_template_t *in_tmplt, const void *in_rec, uint8_t *memo)
+{
+   const struct filter_set *filters = cfg->filters;
+   uint32_t mask = 0;
+   int i;
+
+   if (filters != NULL) {
+      if (filters->native) {
+         mask = filters->native(in_rec, filters->consts, str_buffer);
+      } else {
+         mask = evalFilterSet(filters, in_rec, memo != NULL ? memo : filters->memo);
+      }
+      if (!filters->fallback) {
+         return mask;
+      }
+   }
+   // Filters which could not be compiled
+   for (i = 0; i < cfg->n_trees; i++) {
+      if ((filters == NULL || (filters->fallback >> i) & 1)
+          && (!cfg->trees[i] || evalAST(cfg->trees[i], in_tmplt, in_rec))) {
+         mask |= (uint32_t) 1 << i;
+      }
+   }
+   return mask;
+}
+
+// Send record to output interfaces whose filter matches it, return 1 on error
+static int send_record(int n_outputs, struct unirec_output_t **output_specifiers, const ur_template_t *in_tmplt, const void *in_rec, uint32_t matches, unsigned int rec_num)
+{
+   int ret;
+   int i;
+
+   for (i = 0; i < n_outputs; i++) {
+      if ((matches >> i) & 1) {
+         if (verbose >= 1) {
+            printf("ADVANCED VERBOSE: Record %d accepted on interface %d\n", rec_num, i);
+         }
+         // Copy fields present in output template
+         uint16_t out_rec_size = copy_record(output_specifiers[i], in_tmplt, in_rec);
+         // Send record to corresponding interface
+         ret = trap_send(i, output_specifiers[i]->out_rec, out_rec_size);
+         if (flush_timeout == 0) {
+            trap_send_flush(i);
+         }
+         // Handle possible errors
+         TRAP_DEFAULT_SEND_DATA_ERROR_HANDLING(ret, continue, return 1);
+      } else {
+         if (verbose >= 1) {
+               printf("ADVANCED VERBOSE: Record %d declined on interface %d\n", rec_num, i);
+         }
+      }
+   }
+   return 0;
+}
+
+// Evaluate filters on records of batches
+static void *worker_thread(void *arg)
+{
+   struct worker *w = (struct worker *) arg;
+   const struct filter_config *cfg;
+   struct batch *b;
+   uint8_t *memo = NULL;
+   int memo_size = 0;
+   int failed = 0;
+   int spins = 0;
+   int k;
+
+   // Batches are still taken when memory is missing, so writer and main thread are not blocked
+   if ((str_buffer = (char *) malloc(65536)) == NULL) {
+      failed = 1;
+   }
+   for (;;) {
+      // Flag is read first, so batches dispatched before it was set are seen
+      int done = __atomic_load_n(&pool.done, __ATOMIC_ACQUIRE);
+
+      if ((b = (struct batch *) popRing(w->in)) == NULL) {
+         if (done) {
+            break;
+         }
+         waitRing(&spins);
+         continue;
+      }
+      spins = 0;
+      cfg = (const struct filter_config *) b->config;
+      if (!failed && cfg->filters != NULL && cfg->filters->n_preds > memo_size) {
+         free(memo);
+         memo_size = cfg->filters->n_preds;
+         if ((memo = (uint8_t *) malloc(memo_size)) == NULL) {
+            failed = 1;
+         }
+      }
+      if (failed == 1) {
+         // Memo of filters is shared by main thread, so records are declined instead
+         fprintf(stderr, "Error: Not enough memory for evaluation of filters.\n");
+         __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+         failed = 2;
+      }
+      for (k = 0; k < b->count; k++) {
+         b->matches[k] = failed ? 0 : match_filters(cfg, pool.in_tmplt, b->data + b->offsets[k], memo);
+      }
+      // Queue has room for all batches
+      pushRing(w->out, b);
+   }
+   free(memo);
+   free(str_buffer);
+   return NULL;
+}
+
+// Send records of evaluated batches
+static void *writer_thread(void *arg)
+{
+   uint64_t written = 0;
+   int failed = 0;
+   int spins = 0;
+   int w = 0;
+   int i, k;
+
+   for (;;) {
+      struct batch *b = NULL;
+
+      if (ordered) {
+         b = (struct batch *) popRing(pool.workers[written % pool.n_workers].out);
+      } else {
+         for (i = 0; i < pool.n_workers && b == NULL; i++) {
+            b = (struct batch *) popRing(pool.workers[w].out);
+            w = (w + 1) % pool.n_workers;
+         }
+      }
+      if (b == NULL) {
+         if (__atomic_load_n(&pool.done, __ATOMIC_ACQUIRE)
+             && written == __atomic_load_n(&pool.dispatched, __ATOMIC_ACQUIRE)) {
+            break;
+         }
+         waitRing(&spins);
+         continue;
+      }
+      spins = 0;
+      for (k = 0; k < b->count && !failed; k++) {
+         if (send_record(pool.n_outputs, pool.output_specifiers, pool.in_tmplt, b->data + b->offsets[k],
+                         b->matches[k], b->first + k) != 0) {
+            // Batches are still taken, so main thread is not blocked
+            failed = 1;
+            __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+         }
+      }
+      // Worker is done with filters of batch, configuration may be freed when it was replaced
+      __atomic_sub_fetch(&((struct filter_config *) b->config)->in_flight, 1, __ATOMIC_RELEASE);
+      b->config = NULL;
+      b->count = 0;
+      b->size = 0;
+      pushRing(pool.free_batches, b);
+      __atomic_store_n(&pool.written, ++written, __ATOMIC_RELEASE);
+   }
+   return NULL;
+}
+
+// Create batches and start workers and writer, return 0 on success
+static int start_pool(int n_outputs, struct unirec_output_t **output_specifiers, const ur_template_t *in_tmplt)
+{
+   int i;
+
+   memset(&pool, 0, sizeof(pool));
+   pool.n_workers = n_workers;
+   pool.n_outputs = n_outputs;
+   pool.output_specifiers = output_specifiers;
+   pool.in_tmplt = in_tmplt;
+   // A few batches for each worker, every queue can hold all of them
+   pool.n_batches = 4 * n_workers;
+   pool.batches = (struct batch **) calloc(pool.n_batches, sizeof(struct batch *));
+   pool.workers = (struct worker *) calloc(n_workers, sizeof(struct worker));
+   pool.free_batches = createRing(pool.n_batches);
+   if (pool.batches == NULL || pool.workers == NULL || pool.free_batches == NULL) {
+      return 1;
+   }
+   for (i = 0; i < pool.n_batches; i++) {
+      if ((pool.batches[i] = createBatch()) == NULL) {
+         return 1;
+      }
+      pushRing(pool.free_batches, pool.batches[i]);
+   }
+   for (i = 0; i < n_workers; i++) {
+      if ((pool.workers[i].in = createRing(pool.n_batches)) == NULL
+          || (pool.workers[i].out = createRing(pool.n_batches)) == NULL) {
+         return 1;
+      }
+   }
+   for (i = 0; i < n_workers; i++) {
+      if (pthread_create(&pool.workers[i].thread, NULL, worker_thread, &pool.workers[i]) != 0) {
+         return 1;
+      }
+      pool.n_started++;
+   }
+   if (pthread_create(&pool.writer, NULL, writer_thread, NULL) != 0) {
+      return 1;
+   }
+   pool.writer_started = 1;
+   return 0;
+}
+
+// Hand batch being filled to the next worker, to the least loaded one when order is not kept
+static void dispatch_batch(void)
+{
+   struct batch *b = pool.batch;
+   int w, i;
+
+   if (b == NULL) {
+      return;
+   }
+   b->seq = pool.dispatched;
+   b->config = config;
+   __atomic_add_fetch(&config->in_flight, 1, __ATOMIC_RELAXED);
+   w = b->seq % pool.n_workers;
+   if (!ordered) {
+      uint32_t queued, min_queued = UINT32_MAX;
+
+      for (i = 0; i < pool.n_workers; i++) {
+         struct ring *r = pool.workers[i].in;
+
+         queued = r->tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+         if (queued < min_queued) {
+            min_queued = queued;
+            w = i;
+         }
+      }
+   }
+   pushRing(pool.workers[w].in, b);
+   __atomic_store_n(&pool.dispatched, b->seq + 1, __ATOMIC_RELEASE);
+   pool.batch = NULL;
+}
+
+// Copy record to batch, the batch is dispatched when it is full, return 0 on success
+static int queue_record(const void *in_rec, uint16_t in_rec_size)
+{
+   int spins = 0;
+
+   while (pool.batch == NULL) {
+      // All batches are in use, wait for writer
+      if ((pool.batch = (struct batch *) popRing(pool.free_batches)) == NULL) {
+         waitRing(&spins);
+      }
+   }
+   if (pool.batch->count == 0) {
+      pool.batch->first = num_records;
+   }
+   if (addToBatch(pool.batch, in_rec, in_rec_size) != 0) {
+      fprintf(stderr, "Error: Not enough memory for batch of records.\n");
+      return 1;
+   }
+   if (pool.batch->count == BATCH_RECORDS) {
+      dispatch_batch();
+   }
+   return 0;
+}
+
+// Wait until all received records are sent, so template and filters can be changed
+static void drain_pool(void)
+{
+   int spins = 0;
+
+   dispatch_batch();
+   while (__atomic_load_n(&pool.written, __ATOMIC_ACQUIRE) != pool.dispatched) {
+      waitRing(&spins);
+   }
+}
+
+// Send remaining records, stop threads and free pool
+static void stop_pool(void)
+{
+   int i;
+
+   if (pool.writer_started) {
+      dispatch_batch();
+   }
+   __atomic_store_n(&pool.done, 1, __ATOMIC_RELEASE);
+   for (i = 0; i < pool.n_started; i++) {
+      pthread_join(pool.workers[i].thread, NULL);
+   }
+   if (pool.writer_started) {
+      pthread_join(pool.writer, NULL);
+   }
+   for (i = 0; i < pool.n_workers && pool.workers != NULL; i++) {
+      freeRing(pool.workers[i].in);
+      freeRing(pool.workers[i].out);
+   }
+   for (i = 0; i < pool.n_batches && pool.batches != NULL; i++) {
+      freeBatch(pool.batches[i]);
+   }
+   free(pool.batches);
+   free(pool.workers);
+   freeRing(pool.free_batches);
+   memset(&pool, 0, sizeof(pool));
+}
+
+// Parse and compile filters from file, main thread is not blocked meanwhile
+static void *reload_thread(void *arg)
+{
+   struct unirec_output_t **output_specifiers;
+   struct filter_config *cfg = NULL;
+   int errors = 0;
+   int i;
+
+   // Input template is not changed while filters are compiled for it
+   pthread_mutex_lock(&reload_mutex);
+   output_specifiers = (struct unirec_output_t **) calloc(reload.n_outputs, sizeof(struct unirec_output_t *));
+   for (i = 0; output_specifiers != NULL && i < reload.n_outputs; i++) {
+      if ((output_specifiers[i] = (struct unirec_output_t *) calloc(1, sizeof(struct unirec_output_t))) == NULL) {
+         break;
+      }
+   }
+   if (output_specifiers != NULL && i == reload.n_outputs
+       && get_filter_from_file(reload.filename, output_specifiers, reload.n_outputs) == 0) {
+      for (i = 0; i < reload.n_outputs; i++) {
+         if (output_specifiers[i]->output_specifier_str == NULL) {
+            output_specifiers[i]->output_specifier_str = ur_cpy_string(reload.in_format);
+         }
+      }
+      cfg = create_config(reload.n_outputs, reload.port_numbers, output_specifiers, *reload.in_tmplt, &errors);
+      if (errors > 0) {
+         fprintf(stderr, "Error: Reloaded filters contain %d errors.\n", errors);
+         free_config(cfg);
+         cfg = NULL;
+      }
+   }
+   if (cfg != NULL) {
+      cfg->output_specifiers = output_specifiers;
+      for (i = 0; i < reload.n_outputs; i++) {
+         if (strcmp(output_specifiers[i]->output_specifier_str, reload.output_specifiers[i]->output_specifier_str) != 0) {
+            cfg->templates_changed = 1;
+         }
+      }
+   } else if (output_specifiers != NULL) {
+      for (i = 0; i < reload.n_outputs; i++) {
+         free_output(output_specifiers[i]);
+      }
+      free(output_specifiers);
+   }
+   reload.result = cfg;
+   __atomic_store_n(&reload.done, 1, __ATOMIC_RELEASE);
+   pthread_mutex_unlock(&reload_mutex);
+   return NULL;
+}
+
+// Start reload of filters from file unless one is running, return 0 on success
+static int start_reload(char *filename, int n_outputs, char **port_numbers, struct unirec_output_t **output_specifiers,
+                        const char *in_format, ur_template_t **in_tmplt)
+{
+   if (reload.running) {
+      return 1;
+   }
+   if (filename == NULL) {
+      fprintf(stderr, "Warning: Filter given by -F cannot be reloaded.\n");
+      return 0;
+   }
+   printf("\nReloading filter...\n\n");
+   printf("New filter:\n");
+   reload.done = 0;
+   reload.result = NULL;
+   reload.filename = filename;
+   reload.n_outputs = n_outputs;
+   reload.port_numbers = port_numbers;
+   reload.output_specifiers = output_specifiers;
+   reload.in_format = in_format;
+   reload.in_tmplt = in_tmplt;
+   if (pthread_create(&reload.thread, NULL, reload_thread, NULL) != 0) {
+      fprintf(stderr, "Warning: Thread reloading filters could not be started.\n");
+      return 0;
+   }
+   reload.running = 1;
+   return 0;
+}
+
+// Free replaced configurations whose batches were sent, all of them when force is set
+static void free_retired_configs(int force)
+{
+   struct filter_config **cfg = &retired_configs;
+
+   while (*cfg != NULL) {
+      // Batches may be sent out of order, so each configuration counts its own
+      if (force || __atomic_load_n(&(*cfg)->in_flight, __ATOMIC_ACQUIRE) == 0) {
+         struct filter_config *next = (*cfg)->next;
+         free_config(*cfg);
+         *cfg = next;
+      } else {
+         cfg = &(*cfg)->next;
+      }
+   }
+}
+
+// Replace filters in use by reloaded ones when reload is done, called by main thread between batches
+static void finish_reload(int n_outputs, struct unirec_output_t **output_specifiers, const ur_template_t *in_tmplt)
+{
+   struct filter_config *cfg;
+   int i;
+
+   if (!reload.running || !__atomic_load_n(&reload.done, __ATOMIC_ACQUIRE)) {
+      return;
+   }
+   pthread_join(reload.thread, NULL);
+   reload.running = 0;
+   cfg = reload.result;
+   reload.result = NULL;
+   if (cfg == NULL) {
+      fprintf(stderr, "Warning: Filters were not reloaded, previous filters are used.\n");
+      return;
+   }
+
+   if (cfg->templates_changed) {
+      // Records of old templates are sent first, new templates are checked before old ones are freed
+      if (n_workers > 0) {
+         drain_pool();
+      }
+      for (i = 0; i < n_outputs; i++) {
+         parse_output_specifier_from_str(cfg->output_specifiers[i]);
+         if (ur_define_set_of_fields(cfg->output_specifiers[i]->unirec_output_specifier) != UR_OK) {
+            fprintf(stderr, "Error: output template format of interface %d is not accurate, previous filters are used.\n", i);
+            free_config(cfg);
+            return;
+         }
+      }
+      for (i = 0; i < n_outputs; i++) {
+         struct unirec_output_t *tmp = output_specifiers[i];
+         output_specifiers[i] = cfg->output_specifiers[i];
+         cfg->output_specifiers[i] = tmp;
+      }
+      if (create_templates(n_outputs, output_specifiers) != 0) {
+         __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+      }
+      prepare_outputs(n_outputs, output_specifiers, in_tmplt);
+   } else {
+      // Only filters changed, records already in pool are evaluated by previous ones
+      for (i = 0; i < n_outputs; i++) {
+         char *tmp = output_specifiers[i]->filter;
+         output_specifiers[i]->filter = cfg->output_specifiers[i]->filter;
+         cfg->output_specifiers[i]->filter = tmp;
+      }
+   }
+   for (i = 0; i < n_outputs; i++) {
+      free_output(cfg->output_specifiers[i]);
+   }
+   free(cfg->output_specifiers);
+   cfg->output_specifiers = NULL;
+
+   // Previous configuration is freed when its batches are sent
+   config->next = retired_configs;
+   retired_configs = config;
+   config = cfg;
+   free_retired_configs(n_workers == 0);
+}
+
 int main(int argc, char **argv)
 {
    struct unirec_output_t **output_specifiers = NULL; // filters and output specifiers
@@ -424,6 +1077,30 @@ int main(int argc, char **argv)
          filename = optarg;
          from = 1;
          break;
+      case 't': // Timeout of output buffers
+         flush_timeout = atoi(optarg);
+         if (flush_timeout < 0) {
+            fprintf(stderr, "Error: Parameter of -t option must be >= 0.\n");
+            TRAP_DEFAULT_FINALIZATION();
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+            return 3;
+         }
+         break;
+      case 'j': // Native code of filters
+         use_jit = 1;
+         break;
+      case 'w': // Threads evaluating filters
+         n_workers = atoi(optarg);
+         if (n_workers < 0) {
+            fprintf(stderr, "Error: Parameter of -w option must be >= 0.\n");
+            TRAP_DEFAULT_FINALIZATION();
+            FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
+            return 3;
+         }
+         break;
+      case 'u': // Order of records is not kept
+         ordered = 0;
+         break;
       case 'c': {
          int nb = atoi(optarg);
          if (nb <= 0) {
@@ -505,6 +1182,16 @@ int main(int argc, char **argv)
       return 1;
    }
 
+   // Records are collected in buffers of output interfaces, a buffer is sent when
+   // it is full or when the timeout expires, so low-rate outputs are not delayed
+   if (flush_timeout > 0) {
+      for (i = 0; i < n_outputs; i++) {
+         if (trap_ifcctl(TRAPIFC_OUTPUT, i, TRAPCTL_AUTOFLUSH_TIMEOUT, (uint64_t) flush_timeout * 1000) != TRAP_E_OK) {
+            fprintf(stderr, "Warning: Timeout of output interface %d could not be set.\n", i);
+         }
+      }
+   }
+
    // Create input template
    trap_set_required_fmt(0, TRAP_FMT_UNIREC, "");
    ret = trap_recv(0, &in_rec, &in_rec_size);
@@ -576,7 +1263,7 @@ int main(int argc, char **argv)
       }
    }
    // Create templates from output specifiers
-   if ((ret = create_templates(n_outputs, port_numbers, output_specifiers)) != 0) {
+   if ((ret = create_templates(n_outputs, output_specifiers)) != 0) {
       for (i = 0; i < n_outputs; i++) {
          free(port_numbers[i]);
       }
@@ -586,12 +1273,29 @@ int main(int argc, char **argv)
       FREE_MODULE_INFO_STRUCT(MODULE_BASIC_INFO, MODULE_PARAMS)
       return ret;
    }
+   prepare_outputs(n_outputs, output_specifiers, in_tmplt);
+   // Errors of filters given at start are only reported
+   if ((config = create_config(n_outputs, port_numbers, output_specifiers, in_tmplt, &ret)) == NULL) {
+      __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+   }
 
    // Allocate auxiliary buffer for evalAST()
    str_buffer = (char *) malloc(65536 * sizeof(char)); // No string in unirec can be longer than 64kB
    if (str_buffer == NULL) {
       fprintf(stderr, "Error: Not enough memory for string buffer.\n");
-      stop = 1;
+      __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+   }
+
+   // Records are received by this thread and evaluated by pool of workers
+   if (n_workers > 0 && !__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+      if (start_pool(n_outputs, output_specifiers, in_tmplt) != 0) {
+         fprintf(stderr, "Warning: Threads could not be started, records are processed by one thread.\n");
+         stop_pool();
+         n_workers = 0;
+      } else if (trap_ifcctl(TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, BATCH_TIMEOUT) != TRAP_E_OK) {
+         // Incomplete batch is dispatched when no record comes within the timeout
+         fprintf(stderr, "Warning: Timeout of input interface could not be set.\n");
+      }
    }
 
    // Free ifc_spec structure
@@ -602,9 +1306,52 @@ int main(int argc, char **argv)
    }
    // Main loop
    // Copy data from input to output
-   while (!stop) {
+   while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+      // SIGUSR1 has been sent, reload filter in background, another signal
+      // during reload starts a new one after it
+      if (reload_filter == 1
+          && start_reload(filename, n_outputs, port_numbers, output_specifiers, req_format, &in_tmplt) == 0) {
+         reload_filter = 0;
+      }
+      // Use reloaded filters, free replaced ones no longer used by workers, also when input is idle
+      finish_reload(n_outputs, output_specifiers, in_tmplt);
+      if (retired_configs != NULL) {
+         free_retired_configs(0);
+      }
       // Receive data from any input interface, wait until data are available
-      ret = TRAP_RECEIVE(0, in_rec, in_rec_size, in_tmplt);
+      ret = trap_recv(0, &in_rec, &in_rec_size);
+      if (ret == TRAP_E_TIMEOUT && n_workers > 0) {
+         // Do not delay records of incomplete batch
+         dispatch_batch();
+         continue;
+      }
+      if (ret == TRAP_E_FORMAT_CHANGED) {
+         // Update input template and compile filters for it
+         const char *spec = NULL;
+         uint8_t data_fmt;
+         if (n_workers > 0) {
+            drain_pool();
+         }
+         // Wait for reload compiling filters for the previous template and use its filters
+         pthread_mutex_lock(&reload_mutex);
+         finish_reload(n_outputs, output_specifiers, in_tmplt);
+         if (trap_get_data_fmt(TRAPIFC_INPUT, 0, &data_fmt, &spec) != TRAP_E_OK) {
+            fprintf(stderr, "Data format was not loaded.\n");
+            pthread_mutex_unlock(&reload_mutex);
+            break;
+         }
+         in_tmplt = ur_define_fields_and_update_template(spec, in_tmplt);
+         if (in_tmplt == NULL) {
+            fprintf(stderr, "Template could not be edited.\n");
+            pthread_mutex_unlock(&reload_mutex);
+            break;
+         }
+         prepare_outputs(n_outputs, output_specifiers, in_tmplt);
+         compile_config(config, in_tmplt);
+         pool.in_tmplt = in_tmplt;
+         pthread_mutex_unlock(&reload_mutex);
+         ret = TRAP_E_OK;
+      }
       TRAP_DEFAULT_RECV_ERROR_HANDLING(ret, continue, break);
       // Check size of received data
       if (in_rec_size < ur_rec_fixlen_size(in_tmplt)) {
@@ -620,62 +1367,20 @@ int main(int argc, char **argv)
       }
 
       // PROCESS THE DATA
-      for (i = 0; i < n_outputs; i++) {
-         if (!(output_specifiers[i]->tree) || (output_specifiers[i]->tree && evalAST(output_specifiers[i]->tree, in_tmplt, in_rec))) {
-            if (verbose >= 1) {
-               printf("ADVANCED VERBOSE: Record %d accepted on interface %d\n", num_records, i);
-            }
-            //Iterate over all output fields; if the field is present in input template, copy it to output record
-            // If missing, set null
-            void *ptr1 = NULL, *ptr2 = NULL;
-            ur_field_id_t id = 0;
-            int rec_ind = 0;
-            while ((id = ur_iter_fields_record_order(output_specifiers[i]->out_tmplt, rec_ind++)) != UR_ITER_END) {
-               if (ur_is_present(in_tmplt, id)) {
-                  if (!ur_is_dynamic(id)) { //static field
-                     ptr1 = ur_get_ptr_by_id(in_tmplt, in_rec, id);
-                     ptr2 = ur_get_ptr_by_id(output_specifiers[i]->out_tmplt, output_specifiers[i]->out_rec, id);
-                     //copy the data
-                     if ((ptr1 != NULL) && (ptr2 != NULL)) {
-                        memcpy(ptr2, ptr1, ur_get_size(id));
-                     }
-                  } else { //dynamic field
-                     char *in_ptr = ur_get_ptr_by_id(in_tmplt, in_rec, id);
-                     int size = ur_get_var_len(in_tmplt, in_rec, id);
-                     // Check size of dynamic field and if longer than maximum size then cut it
-                     if (size > DYN_FIELD_MAX_SIZE)
-                        size = DYN_FIELD_MAX_SIZE;
-                     //copy the data
-                     ur_set_var(output_specifiers[i]->out_tmplt, output_specifiers[i]->out_rec, id, in_ptr, size);
-                  }
-               }
-            }
-            // Send record to corresponding interface
-            ret = trap_send(i, output_specifiers[i]->out_rec, ur_rec_size(output_specifiers[i]->out_tmplt, output_specifiers[i]->out_rec));
-            trap_send_flush(i);
-            // Handle possible errors
-            TRAP_DEFAULT_SEND_DATA_ERROR_HANDLING(ret, continue, {stop=1; break;});
-         } else {
-            if (verbose >= 1) {
-                  printf("ADVANCED VERBOSE: Record %d declined on interface %d\n", num_records, i);
-            }
+      if (n_workers > 0) {
+         if (queue_record(in_rec, in_rec_size) != 0) {
+            break;
          }
-      }
-      // SIGUSR1 has been sent, reload filter
-      if (reload_filter == 1) {
-         printf("\nReloading filter...\n\n");
-         printf("New filter:\n");
-
-         if (get_filter_from_file(filename, output_specifiers, n_outputs) != 0
-            || create_templates(n_outputs, port_numbers, output_specifiers) != 0) {
-               stop = 1;
+      } else {
+         uint32_t matches = match_filters(config, in_tmplt, in_rec, NULL);
+         if (send_record(n_outputs, output_specifiers, in_tmplt, in_rec, matches, num_records) != 0) {
+            __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
          }
-         reload_filter = 0;
       }
       // Quit if maximum number of records has been reached
       num_records++;
       if (max_num_records && max_num_records == num_records) {
-         stop = 1;
+         __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
       }
    }
 
@@ -683,6 +1388,16 @@ int main(int argc, char **argv)
    if (verbose >= 0) {
       printf("VERBOSE: Cleanup...\n");
    }
+   // Send records remaining in batches
+   if (n_workers > 0) {
+      stop_pool();
+   }
+   if (reload.running) {
+      pthread_join(reload.thread, NULL);
+      free_config(reload.result);
+   }
+   free_retired_configs(1);
+   free_config(config);
    free(str_buffer);
 
    if (send_eof == 1) {
@@ -690,31 +1405,16 @@ int main(int argc, char **argv)
          ret = trap_send(i, output_specifiers[i]->out_rec, 1);
       }
    }
+   for (i = 0; i < n_outputs; i++) {
+      trap_send_flush(i);
+   }
 
    TRAP_DEFAULT_FINALIZATION();
    ur_free_template(in_tmplt);
    free(req_format);
 
    for (i = 0; i < n_outputs; i++) {
-      if (output_specifiers[i]->tree != NULL) {
-         freeAST(output_specifiers[i]->tree);
-         output_specifiers[i]->tree = NULL;
-      }
-      if (output_specifiers[i]->output_specifier_str != NULL) {
-         free(output_specifiers[i]->output_specifier_str);
-         output_specifiers[i]->output_specifier_str = NULL;
-      }
-      if (output_specifiers[i]->unirec_output_specifier != NULL) {
-         free(output_specifiers[i]->unirec_output_specifier);
-         output_specifiers[i]->unirec_output_specifier = NULL;
-      }
-      if (output_specifiers[i]->filter != NULL) {
-         free(output_specifiers[i]->filter);
-         output_specifiers[i]->filter = NULL;
-      }
-      ur_free_record(output_specifiers[i]->out_rec);
-      ur_free_template(output_specifiers[i]->out_tmplt);
-      free(output_specifiers[i]);
+      free_output(output_specifiers[i]);
       free(port_numbers[i]);
    }
    free(port_numbers);
@@ -52,6 +52,7 @@
 
 #define SPEC_COND_DELIM   ':'
 #define DYN_FIELD_MAX_SIZE 1024 // Maximal size of dynamic field, longer fields will be cutted to this size
+#define DEFAULT_FLUSH_TIMEOUT 500 // Default timeout of output buffers in milliseconds
 
 #define SET_NULL(field_id, tmpl, data) \
 memset(ur_get_ptr_by_id(tmpl, data, field_id), 0, ur_get_size(field_id));
@@ -59,7 +60,7 @@ memset(ur_get_ptr_by_id(tmpl, data, field_id), 0, ur_get_size(field_id));
 /* Used for types of expression nodes in abstract syntax tree */
 typedef enum { NODE_T_AST, NODE_T_EXPRESSION, NODE_T_EXPRESSION_FP,
                NODE_T_PROTOCOL, NODE_T_IP, NODE_T_STRING,
-               NODE_T_BRACKET, NODE_T_NEGATION } node_type;
+               NODE_T_BRACKET, NODE_T_NEGATION, NODE_T_IPSET, NODE_T_SET } node_type;
 
 /* Used for describing comparison operators */
 typedef enum { OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE, OP_RE /* regex match */, OP_INVALID } cmp_op;
@@ -116,6 +117,37 @@ struct str {
    ur_field_id_t id;
 };
 
+struct ip_trie;
+struct int_set;
+struct str_set;
+
+/* Item of set written in filter */
+struct set_item {
+   int64_t number;
+   char *s;             // String or IP prefix, NULL for numbers
+   int is_ip;
+   struct set_item *next;
+};
+
+struct ipset {
+   node_type type;
+   char *column;
+   char *source;        // Prefix or file with prefixes as written in filter
+   int is_file;
+   struct ip_trie *trie;
+   ur_field_id_t id;
+};
+
+struct valueset {
+   node_type type;
+   char *column;
+   char *source;        // List of values or file with values as written in filter
+   int is_file;
+   struct int_set *ints; // Set of integer field, NULL otherwise
+   struct str_set *strs; // Set of string field, NULL otherwise
+   ur_field_id_t id;
+};
+
 struct brack {
    node_type type;
    struct ast *b;
@@ -129,7 +161,8 @@ void freeAST(struct ast *tree);
 struct ast *getTree(const char *str, const char *port_number);
 void changeProtocol(struct ast **ast);
 
-extern char * str_buffer;
+extern __thread char *str_buffer;
+extern int parse_errors;
 
 #endif
 
@@ -0,0 +1,443 @@
+/**
+ * \file valueset.c
+ * \brief Sets of integers and strings with constant time lookup.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "valueset.h"
+
+#define SET_MIN_SIZE 16
+
+static inline uint32_t hash_int(uint64_t value)
+{
+   return (uint32_t) ((value * UINT64_C(0x9e3779b97f4a7c15)) >> 32);
+}
+
+// FNV-1a
+static inline uint32_t hash_str(const char *data, uint16_t len)
+{
+   uint32_t hash = 2166136261u;
+   uint16_t i;
+
+   for (i = 0; i < len; i++) {
+      hash = (hash ^ (uint8_t) data[i]) * 16777619u;
+   }
+   return hash;
+}
+
+// Get next line of file without comment and surrounding white space, NULL at the end of file
+static char *next_item(FILE *f, char **line, size_t *size, int *line_num)
+{
+   while (getline(line, size, f) != -1) {
+      char *start = *line;
+      char *end = strchr(start, '#');
+
+      (*line_num)++;
+      if (end == NULL) {
+         end = start + strlen(start);
+      }
+      while (start < end && isspace((unsigned char) *start)) {
+         start++;
+      }
+      while (end > start && isspace((unsigned char) end[-1])) {
+         end--;
+      }
+      if (start < end) {
+         *end = '\0';
+         return start;
+      }
+   }
+   return NULL;
+}
+
+/**
+ * \brief Create empty set of integers.
+ * \return Set or NULL when memory allocation fails.
+ */
+struct int_set *createIntSet(void)
+{
+   struct int_set *set = (struct int_set *) calloc(1, sizeof(struct int_set));
+
+   if (set != NULL) {
+      set->lookup = lookupIntSet;
+   }
+   return set;
+}
+
+/**
+ * \brief Add integer to set, it has to be called before buildIntSet().
+ * \return 0 on success, 1 when memory allocation fails.
+ */
+int addToIntSet(struct int_set *set, uint64_t value)
+{
+   if (set->n_items == set->size_items) {
+      int size = set->size_items ? 2 * set->size_items : SET_MIN_SIZE;
+      uint64_t *items = (uint64_t *) realloc(set->items, size * sizeof(uint64_t));
+
+      if (items == NULL) {
+         return 1;
+      }
+      set->items = items;
+      set->size_items = size;
+   }
+   set->items[set->n_items++] = value;
+   return 0;
+}
+
+/**
+ * \brief Add integers listed in file to set, it has to be called before buildIntSet().
+ * File contains one number per line, empty lines and comments starting
+ * with # are skipped. Invalid numbers are reported and skipped.
+ * \return Number of added integers, -1 when file cannot be read.
+ */
+int loadIntSet(struct int_set *set, const char *filename)
+{
+   FILE *f = fopen(filename, "r");
+   char *line = NULL, *item, *end;
+   size_t size = 0;
+   int line_num = 0;
+   int count = 0;
+
+   if (f == NULL) {
+      fprintf(stderr, "Error: File %s with values could not be opened.\n", filename);
+      return -1;
+   }
+   while ((item = next_item(f, &line, &size, &line_num)) != NULL) {
+      uint64_t value;
+
+      errno = 0;
+      if (item[0] == '-') {
+         value = (uint64_t) strtoll(item, &end, 10);
+      } else {
+         value = strtoull(item, &end, 10);
+      }
+      if (errno != 0 || *end != '\0' || !isdigit((unsigned char) item[item[0] == '-'])) {
+         fprintf(stderr, "Warning: %s on line %d of %s is not a valid number.\n", item, line_num, filename);
+      } else if (addToIntSet(set, value) == 0) {
+         count++;
+      }
+   }
+   free(line);
+   fclose(f);
+   return count;
+}
+
+/**
+ * \brief Build bitmap or hash table of set for lookups, no values can be added after it.
+ * \return 0 on success, 1 when memory allocation fails.
+ */
+int buildIntSet(struct int_set *set)
+{
+   uint64_t max = 0;
+   uint32_t size = SET_MIN_SIZE;
+   int i;
+
+   set->min = set->n_items > 0 ? set->items[0] : 0;
+   for (i = 0; i < set->n_items; i++) {
+      if (set->items[i] < set->min) {
+         set->min = set->items[i];
+      }
+      if (set->items[i] > max) {
+         max = set->items[i];
+      }
+   }
+   set->range = set->n_items > 0 ? max - set->min : 0;
+
+   if (set->range < INT_SET_BITMAP_RANGE) {
+      set->bitmap = (uint64_t *) calloc(set->range / 64 + 1, sizeof(uint64_t));
+      if (set->bitmap == NULL) {
+         return 1;
+      }
+      for (i = 0; i < set->n_items; i++) {
+         uint64_t bit = set->items[i] - set->min;
+         set->bitmap[bit / 64] |= UINT64_C(1) << (bit % 64);
+      }
+   } else {
+      // Keep at least half of the table empty
+      while (size < 2 * (uint32_t) set->n_items) {
+         size *= 2;
+      }
+      set->keys = (uint64_t *) calloc(size, sizeof(uint64_t));
+      if (set->keys == NULL) {
+         return 1;
+      }
+      set->mask = size - 1;
+      for (i = 0; i < set->n_items; i++) {
+         uint64_t value = set->items[i];
+         uint32_t h;
+
+         if (value == 0) {
+            set->has_zero = 1;
+            continue;
+         }
+         for (h = hash_int(value) & set->mask; set->keys[h] != 0 && set->keys[h] != value; h = (h + 1) & set->mask) {
+         }
+         set->keys[h] = value;
+      }
+   }
+   free(set->items);
+   set->items = NULL;
+   set->n_items = 0;
+   set->size_items = 0;
+   return 0;
+}
+
+/**
+ * \brief Check whether integer is in set built by buildIntSet().
+ */
+int lookupIntSet(const struct int_set *set, uint64_t value)
+{
+   uint32_t h;
+
+   if (set->bitmap != NULL) {
+      uint64_t bit = value - set->min;
+      return bit <= set->range && (set->bitmap[bit / 64] >> (bit % 64)) & 1;
+   } else if (value == 0) {
+      return set->has_zero;
+   } else if (set->keys == NULL) {
+      return 0;
+   }
+   for (h = hash_int(value) & set->mask; set->keys[h] != 0; h = (h + 1) & set->mask) {
+      if (set->keys[h] == value) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/**
+ * \brief Check whether two built sets have the same bitmaps or tables, so they contain the same integers.
+ */
+int equalIntSets(const struct int_set *a, const struct int_set *b)
+{
+   if (a->bitmap != NULL && b->bitmap != NULL) {
+      return a->min == b->min && a->range == b->range
+             && memcmp(a->bitmap, b->bitmap, (a->range / 64 + 1) * sizeof(uint64_t)) == 0;
+   } else if (a->keys != NULL && b->keys != NULL) {
+      return a->mask == b->mask && a->has_zero == b->has_zero
+             && memcmp(a->keys, b->keys, (a->mask + 1) * sizeof(uint64_t)) == 0;
+   }
+   return 0;
+}
+
+void freeIntSet(struct int_set *set)
+{
+   if (set == NULL) {
+      return;
+   }
+   free(set->bitmap);
+   free(set->keys);
+   free(set->items);
+   free(set);
+}
+
+/**
+ * \brief Create empty set of strings.
+ * \return Set or NULL when memory allocation fails.
+ */
+struct str_set *createStrSet(void)
+{
+   struct str_set *set = (struct str_set *) calloc(1, sizeof(struct str_set));
+
+   if (set == NULL) {
+      return NULL;
+   }
+   set->entries = (struct str_set_entry *) calloc(SET_MIN_SIZE, sizeof(struct str_set_entry));
+   if (set->entries == NULL) {
+      free(set);
+      return NULL;
+   }
+   set->lookup = lookupStrSet;
+   set->mask = SET_MIN_SIZE - 1;
+   set->min_len = UINT16_MAX;
+   return set;
+}
+
+// Put entry to the first empty slot of its chain
+static void insert_entry(struct str_set_entry *entries, uint32_t mask, const struct str_set_entry *entry)
+{
+   uint32_t h;
+
+   for (h = entry->hash & mask; entries[h].data != NULL; h = (h + 1) & mask) {
+   }
+   entries[h] = *entry;
+}
+
+/**
+ * \brief Add string to set.
+ * \param[in,out] set Set of strings.
+ * \param[in] data String, it is copied.
+ * \param[in] len Length of string.
+ * \return 0 on success, 1 when memory allocation fails.
+ */
+int addToStrSet(struct str_set *set, const char *data, uint16_t len)
+{
+   struct str_set_entry entry;
+   uint32_t i;
+
+   if (lookupStrSet(set, data, len)) {
+      return 0;
+   }
+   // Keep at least half of the table empty
+   if (2 * (uint32_t) (set->count + 1) > set->mask + 1) {
+      uint32_t mask = 2 * set->mask + 1;
+      struct str_set_entry *entries = (struct str_set_entry *) calloc(mask + 1, sizeof(struct str_set_entry));
+
+      if (entries == NULL) {
+         return 1;
+      }
+      for (i = 0; i <= set->mask; i++) {
+         if (set->entries[i].data != NULL) {
+            insert_entry(entries, mask, &set->entries[i]);
+         }
+      }
+      free(set->entries);
+      set->entries = entries;
+      set->mask = mask;
+   }
+   entry.hash = hash_str(data, len);
+   entry.len = len;
+   entry.data = (char *) malloc(len + 1);
+   if (entry.data == NULL) {
+      return 1;
+   }
+   memcpy(entry.data, data, len);
+   entry.data[len] = '\0';
+   insert_entry(set->entries, set->mask, &entry);
+   set->count++;
+   if (len < set->min_len) {
+      set->min_len = len;
+   }
+   if (len > set->max_len) {
+      set->max_len = len;
+   }
+   return 0;
+}
+
+/**
+ * \brief Add strings listed in file to set.
+ * File contains one string per line, white space around strings, empty
+ * lines and comments starting with # are skipped.
+ * \return Number of added strings, -1 when file cannot be read.
+ */
+int loadStrSet(struct str_set *set, const char *filename)
+{
+   FILE *f = fopen(filename, "r");
+   char *line = NULL, *item;
+   size_t size = 0;
+   int line_num = 0;
+   int count = 0;
+
+   if (f == NULL) {
+      fprintf(stderr, "Error: File %s with values could not be opened.\n", filename);
+      return -1;
+   }
+   while ((item = next_item(f, &line, &size, &line_num)) != NULL) {
+      size_t len = strlen(item);
+
+      if (len > UINT16_MAX) {
+         fprintf(stderr, "Warning: String on line %d of %s is too long.\n", line_num, filename);
+      } else if (addToStrSet(set, item, len) == 0) {
+         count++;
+      }
+   }
+   free(line);
+   fclose(f);
+   return count;
+}
+
+/**
+ * \brief Check whether string is in set.
+ */
+int lookupStrSet(const struct str_set *set, const char *data, uint16_t len)
+{
+   uint32_t hash, h;
+
+   if (len < set->min_len || len > set->max_len) {
+      return 0;
+   }
+   hash = hash_str(data, len);
+   for (h = hash & set->mask; set->entries[h].data != NULL; h = (h + 1) & set->mask) {
+      const struct str_set_entry *entry = &set->entries[h];
+
+      if (entry->hash == hash && entry->len == len && memcmp(entry->data, data, len) == 0) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/**
+ * \brief Check whether two sets contain the same strings.
+ */
+int equalStrSets(const struct str_set *a, const struct str_set *b)
+{
+   uint32_t i;
+
+   if (a->count != b->count) {
+      return 0;
+   }
+   for (i = 0; i <= a->mask; i++) {
+      const struct str_set_entry *entry = &a->entries[i];
+
+      if (entry->data != NULL && !lookupStrSet(b, entry->data, entry->len)) {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+void freeStrSet(struct str_set *set)
+{
+   uint32_t i;
+
+   if (set == NULL) {
+      return;
+   }
+   for (i = 0; i <= set->mask; i++) {
+      free(set->entries[i].data);
+   }
+   free(set->entries);
+   free(set);
+}
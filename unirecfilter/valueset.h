@@ -0,0 +1,99 @@
+/**
+ * \file valueset.h
+ * \brief Sets of integers and strings with constant time lookup.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifndef VALUESET_H
+#define VALUESET_H
+
+#include <stdint.h>
+
+#define INT_SET_BITMAP_RANGE 65536 // Sets of integers spanning at most this many values are bitmaps
+
+/*
+ * Set of integers, values of signed fields are sign extended to 64 bits.
+ * Values close to each other are kept in a bitmap, other sets in hash table
+ * with open addressing where 0 marks an empty slot.
+ */
+struct int_set {
+   int (*lookup)(const struct int_set *set, uint64_t value); // First member, called by native code
+   uint64_t *bitmap;    // Bit i is set when min + i is in set, NULL for hash table
+   uint64_t min;
+   uint64_t range;      // Largest value minus min
+   uint64_t *keys;      // Hash table
+   uint32_t mask;       // Size of hash table minus one
+   int has_zero;
+   uint64_t *items;     // Values added before buildIntSet()
+   int n_items;
+   int size_items;
+};
+
+/* String of set with its hash */
+struct str_set_entry {
+   uint32_t hash;
+   uint16_t len;
+   char *data;          // NULL for empty slot
+};
+
+/* Set of strings in hash table with open addressing, sizes are compared before contents */
+struct str_set {
+   int (*lookup)(const struct str_set *set, const char *data, uint16_t len); // First member, called by native code
+   struct str_set_entry *entries;
+   uint32_t mask;       // Size of table minus one
+   int count;
+   uint16_t min_len;
+   uint16_t max_len;
+};
+
+struct int_set *createIntSet(void);
+int addToIntSet(struct int_set *set, uint64_t value);
+int loadIntSet(struct int_set *set, const char *filename);
+int buildIntSet(struct int_set *set);
+int lookupIntSet(const struct int_set *set, uint64_t value);
+int equalIntSets(const struct int_set *a, const struct int_set *b);
+void freeIntSet(struct int_set *set);
+
+struct str_set *createStrSet(void);
+int addToStrSet(struct str_set *set, const char *data, uint16_t len);
+int loadStrSet(struct str_set *set, const char *filename);
+int lookupStrSet(const struct str_set *set, const char *data, uint16_t len);
+int equalStrSets(const struct str_set *a, const struct str_set *b);
+void freeStrSet(struct str_set *set);
+
+#endif
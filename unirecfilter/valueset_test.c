@@ -0,0 +1,193 @@
+/**
+ * \file valueset_test.c
+ * \brief Lookup in bitmaps and hash tables of sets must give the same results as linear search of values.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "valueset.h"
+
+#define TEST_ROUNDS 2000      // Sets of integers and of strings
+#define TEST_VALUES 100       // Maximal number of values in set
+#define TEST_LOOKUPS 2000     // Values looked up in each set
+#define TEST_MAX_LEN 6        // Maximal length of string
+
+/* Kinds of sets of integers, the last two are kept in hash table */
+enum { SET_SMALL, SET_NEGATIVE_SMALL, SET_WIDE, SET_WIDE_WITH_ZERO };
+
+// Random integer of set of given kind
+static uint64_t random_int(int kind)
+{
+   switch (kind) {
+   case SET_SMALL:
+      return rand() % 1000;
+   case SET_NEGATIVE_SMALL:
+      // Range of set has to be below INT_SET_BITMAP_RANGE, negative values are sign extended
+      return (uint64_t) -1000 + rand() % 1000;
+   default:
+      return rand() % 2 ? (uint64_t) (rand() % 1000) : ((uint64_t) rand() << 33) ^ rand();
+   }
+}
+
+// Random integer near values of set, zero or anything
+static uint64_t random_query(const uint64_t *values, int n)
+{
+   switch (rand() % 4) {
+   case 0:
+      return 0;
+   case 1:
+      return ((uint64_t) rand() << 33) ^ rand();
+   default:
+      return n > 0 ? values[rand() % n] + rand() % 5 - 2 : (uint64_t) rand();
+   }
+}
+
+static int check_int_sets(int round)
+{
+   uint64_t values[TEST_VALUES];
+   struct int_set *set = createIntSet();
+   int kind = rand() % 4, n = rand() % TEST_VALUES, q, i;
+
+   for (i = 0; i < n; i++) {
+      values[i] = random_int(kind);
+      if (kind == SET_WIDE_WITH_ZERO && i == 0) {
+         values[i] = 0;
+      }
+      addToIntSet(set, values[i]);
+   }
+   if (buildIntSet(set) != 0) {
+      fprintf(stderr, "Error: Set of integers could not be built.\n");
+      return 1;
+   }
+   // Make sure both lookup paths are tested
+   if (n > 0 && kind < SET_WIDE && set->bitmap == NULL) {
+      fprintf(stderr, "Error: Set %d of small range is not bitmap.\n", round);
+      return 1;
+   }
+   if (kind == SET_WIDE_WITH_ZERO && n > 0 && set->bitmap == NULL && !set->has_zero) {
+      fprintf(stderr, "Error: Zero is missing in hash table of set %d.\n", round);
+      return 1;
+   }
+   for (q = 0; q < TEST_LOOKUPS; q++) {
+      uint64_t value = random_query(values, n);
+      int expected = 0;
+
+      for (i = 0; i < n && !expected; i++) {
+         expected = values[i] == value;
+      }
+      if (lookupIntSet(set, value) != expected) {
+         fprintf(stderr, "Error: Lookup of %llu in %s of set %d: %d, expected %d\n", (unsigned long long) value,
+                 set->bitmap != NULL ? "bitmap" : "hash table", round, !expected, expected);
+         return 1;
+      }
+   }
+   freeIntSet(set);
+   return 0;
+}
+
+// Random string of few bytes, with high bytes and NUL
+static uint16_t random_string(char *str)
+{
+   static const char alphabet[] = { 'a', 'b', '.', '\0', '\xe9', '\xff' };
+   uint16_t len = rand() % (TEST_MAX_LEN + 1), i;
+
+   for (i = 0; i < len; i++) {
+      str[i] = alphabet[rand() % sizeof(alphabet)];
+   }
+   return len;
+}
+
+static int check_str_sets(int round)
+{
+   char values[TEST_VALUES][TEST_MAX_LEN];
+   uint16_t lens[TEST_VALUES];
+   struct str_set *set = createStrSet();
+   int n = rand() % TEST_VALUES, q, i;
+
+   for (i = 0; i < n; i++) {
+      lens[i] = random_string(values[i]);
+      if (addToStrSet(set, values[i], lens[i]) != 0) {
+         fprintf(stderr, "Error: String could not be added to set.\n");
+         return 1;
+      }
+   }
+   for (q = 0; q < TEST_LOOKUPS; q++) {
+      char str[TEST_MAX_LEN];
+      uint16_t len;
+      int expected = 0;
+
+      if (n > 0 && rand() % 2) {
+         i = rand() % n;
+         len = lens[i];
+         memcpy(str, values[i], len);
+      } else {
+         len = random_string(str);
+      }
+      for (i = 0; i < n && !expected; i++) {
+         expected = lens[i] == len && memcmp(values[i], str, len) == 0;
+      }
+      if (lookupStrSet(set, str, len) != expected) {
+         fprintf(stderr, "Error: Lookup of string of length %u in set %d: %d, expected %d\n", len, round, !expected, expected);
+         return 1;
+      }
+   }
+   freeStrSet(set);
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   int round;
+
+   srand(argc > 1 ? atoi(argv[1]) : 1);
+   for (round = 0; round < TEST_ROUNDS; round++) {
+      if (check_int_sets(round) != 0 || check_str_sets(round) != 0) {
+         return 1;
+      }
+   }
+   printf("%d sets of integers and %d sets of strings checked\n", TEST_ROUNDS, TEST_ROUNDS);
+   return 0;
+}